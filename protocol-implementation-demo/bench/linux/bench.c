@@ -0,0 +1,641 @@
+/*
+ * Copyright (c) 2014-2019 Alibaba Group. All rights reserved.
+ * License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * 端到端性能测试, 配合mock_server使用.
+ *
+ * 依次测试同步上线, 异步属性上报和mock_server发起的getProperty, setProperty, callService,
+ * 输出每秒消息数, 时延分位和每条消息消耗的CPU时间. 服务端发起的请求时延由mock_server统计,
+ * 通过benchResult服务调用带回; CPU时间为本进程(含SDK线程)在该阶段消耗的用户态和内核态时间.
+ * 任一场景有错误或测试中连接断开(mock_server收到无法解码的帧时会断开)时返回非0.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "leda.h"
+#include "le_error.h"
+
+#define BENCH_PK                "bench_product"
+#define BENCH_WAIT_SECONDS      30
+
+typedef struct bench_result
+{
+    char            name[32];
+    unsigned int    count;
+    unsigned int    errors;
+    double          elapsed_us;
+    uint32_t        p50_us;
+    uint32_t        p99_us;
+    uint32_t        p999_us;
+    uint32_t        max_us;
+    double          cpu_us;
+} bench_result_t;
+
+typedef struct bench_device
+{
+    char            dn[32];
+    int             handle;
+} bench_device_t;
+
+static sem_t            g_conn_sem;
+static sem_t            g_result_sem;
+static volatile int     g_is_connected  = 0;
+static volatile int     g_disconnects   = 0;
+
+static pthread_mutex_t  g_report_lock   = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   g_report_cond   = PTHREAD_COND_INITIALIZER;
+static uint64_t         *g_send_us      = NULL;     /* 按msg_id & g_slot_mask索引 */
+static uint64_t         *g_reply_us     = NULL;
+static unsigned int     g_slot_mask     = 0;
+static unsigned int     g_inflight      = 0;
+static unsigned int     g_replied       = 0;
+static unsigned int     g_reply_errors  = 0;
+
+static bench_result_t   g_server_result = {{0}};
+static bench_device_t   *g_devices      = NULL;
+static int              g_devices_count = 10;
+
+static uint64_t now_us(void)
+{
+    struct timespec ts = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static double cpu_us(void)
+{
+    struct rusage usage = {{0}};
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e6 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* 对latency排序并填写分位值 */
+static void fill_percentiles(bench_result_t *result, uint32_t *latency, unsigned int count)
+{
+    if (0 == count)
+    {
+        return;
+    }
+
+    qsort(latency, count, sizeof(uint32_t), cmp_u32);
+    result->p50_us  = latency[(unsigned int)(0.5 * (count - 1) + 0.5)];
+    result->p99_us  = latency[(unsigned int)(0.99 * (count - 1) + 0.5)];
+    result->p999_us = latency[(unsigned int)(0.999 * (count - 1) + 0.5)];
+    result->max_us  = latency[count - 1];
+}
+
+static void print_result(const bench_result_t *result)
+{
+    double rate = (result->elapsed_us > 0) ? (result->count - result->errors) * 1e6 / result->elapsed_us : 0;
+    double cpu  = (result->count > 0) ? result->cpu_us / result->count : 0;
+
+    printf("%-20s %8u %7u %12.0f %9u %9u %9u %9u %11.1f\n", result->name, result->count, result->errors,
+           rate, result->p50_us, result->p99_us, result->p999_us, result->max_us, cpu);
+}
+
+static int wait_sem(sem_t *sem, int seconds)
+{
+    struct timespec ts = {0};
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += seconds;
+
+    while (0 != sem_timedwait(sem, &ts))
+    {
+        if (EINTR != errno)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int cb_get_property(const char *pk, const char *dn, leda_device_data_t properties[], int properties_count, void *usr_data)
+{
+    int i = 0;
+
+    for (i = 0; i < properties_count; i++)
+    {
+        properties[i].type = LEDA_TYPE_INT;
+        snprintf(properties[i].value, MAX_PARAM_VALUE_LENGTH, "%d", 25 + i);
+    }
+
+    return LE_SUCCESS;
+}
+
+static int cb_set_property(const char *pk, const char *dn, const leda_device_data_t properties[], int properties_count, void *usr_data)
+{
+    return LE_SUCCESS;
+}
+
+static int cb_call_service(const char *pk, const char *dn, const char *method_name, const leda_device_data_t data[], int data_count,
+                           leda_device_data_t output_data[], void *usr_data)
+{
+    bench_result_t  *result = &g_server_result;
+    int             i       = 0;
+
+    if (0 == strcmp(method_name, "bench"))
+    {
+        return LE_SUCCESS;
+    }
+
+    if (0 != strcmp(method_name, "benchResult"))
+    {
+        return LEDA_ERROR_SERVICE_NOT_EXIST;
+    }
+
+    for (i = 0; i < data_count; i++)
+    {
+        if (0 == strcmp(data[i].key, "method"))
+        {
+            snprintf(result->name, sizeof(result->name), "%s(server)", data[i].value);
+        }
+        else if (0 == strcmp(data[i].key, "count"))
+        {
+            result->count = strtoul(data[i].value, NULL, 10);
+        }
+        else if (0 == strcmp(data[i].key, "errors"))
+        {
+            result->errors = strtoul(data[i].value, NULL, 10);
+        }
+        else if (0 == strcmp(data[i].key, "elapsed_us"))
+        {
+            result->elapsed_us = strtod(data[i].value, NULL);
+        }
+        else if (0 == strcmp(data[i].key, "p50_us"))
+        {
+            result->p50_us = strtoul(data[i].value, NULL, 10);
+        }
+        else if (0 == strcmp(data[i].key, "p99_us"))
+        {
+            result->p99_us = strtoul(data[i].value, NULL, 10);
+        }
+        else if (0 == strcmp(data[i].key, "p999_us"))
+        {
+            result->p999_us = strtoul(data[i].value, NULL, 10);
+        }
+        else if (0 == strcmp(data[i].key, "max_us"))
+        {
+            result->max_us = strtoul(data[i].value, NULL, 10);
+        }
+    }
+    sem_post(&g_result_sem);
+
+    return LE_SUCCESS;
+}
+
+static int cb_report_reply(unsigned int msg_id, int code, void *usr_data)
+{
+    pthread_mutex_lock(&g_report_lock);
+    if (NULL != g_reply_us)
+    {
+        g_reply_us[msg_id & g_slot_mask] = now_us();
+        g_replied++;
+        g_inflight--;
+        if (LE_SUCCESS != code)
+        {
+            g_reply_errors++;
+        }
+        pthread_cond_signal(&g_report_cond);
+    }
+    pthread_mutex_unlock(&g_report_lock);
+
+    return 0;
+}
+
+static void cb_state_changed(leda_conn_state_e state, void *usr_data)
+{
+    if (LEDA_WS_CONNECTED == state)
+    {
+        g_is_connected = 1;
+        sem_post(&g_conn_sem);
+    }
+    else if (g_is_connected)
+    {
+        g_is_connected = 0;
+        g_disconnects++;
+        printf("connection to mock server lost, see its log for undecodable frames\n");
+    }
+}
+
+static void bench_online(bench_result_t *result)
+{
+    uint32_t    *latency    = NULL;
+    uint64_t    begin       = 0;
+    uint64_t    start       = 0;
+    double      cpu         = 0;
+    int         i           = 0;
+
+    latency = calloc(g_devices_count, sizeof(uint32_t));
+    if (NULL == latency)
+    {
+        return;
+    }
+
+    snprintf(result->name, sizeof(result->name), "online(sync)");
+    cpu = cpu_us();
+    begin = now_us();
+    for (i = 0; i < g_devices_count; i++)
+    {
+        start = now_us();
+        if (LE_SUCCESS != leda_online_by_handle(g_devices[i].handle))
+        {
+            result->errors++;
+        }
+        latency[result->count++] = (uint32_t)(now_us() - start);
+    }
+    result->elapsed_us = now_us() - begin;
+    result->cpu_us = cpu_us() - cpu;
+
+    fill_percentiles(result, latency, result->count);
+    free(latency);
+}
+
+static void bench_report(bench_result_t *result, unsigned int count, unsigned int window)
+{
+    leda_device_data_t  property[2] = {{0}};
+    struct timespec     ts          = {0};
+    uint32_t            *latency    = NULL;
+    unsigned int        *ids        = NULL;
+    unsigned int        slots       = 1;
+    unsigned int        sent        = 0;
+    unsigned int        replied     = 0;
+    unsigned int        msg_id      = 0;
+    unsigned int        i           = 0;
+    uint64_t            begin       = 0;
+    uint64_t            start       = 0;
+    uint64_t            stop        = 0;
+    uint64_t            last        = 0;
+    double              cpu         = 0;
+
+    while (slots < count * 2)
+    {
+        slots <<= 1;
+    }
+
+    latency = calloc(count, sizeof(uint32_t));
+    ids = calloc(count, sizeof(unsigned int));
+    pthread_mutex_lock(&g_report_lock);
+    g_send_us = calloc(slots, sizeof(uint64_t));
+    g_reply_us = calloc(slots, sizeof(uint64_t));
+    g_slot_mask = slots - 1;
+    g_inflight = 0;
+    g_replied = 0;
+    g_reply_errors = 0;
+    pthread_mutex_unlock(&g_report_lock);
+    if ((NULL == latency) || (NULL == ids) || (NULL == g_send_us) || (NULL == g_reply_us))
+    {
+        printf("no memory can allocate\n");
+        goto end;
+    }
+
+    snprintf(result->name, sizeof(result->name), "report(async)");
+    snprintf(property[0].key, MAX_PARAM_NAME_LENGTH, "temperature");
+    property[0].type = LEDA_TYPE_INT;
+    snprintf(property[1].key, MAX_PARAM_NAME_LENGTH, "humidity");
+    property[1].type = LEDA_TYPE_FLOAT;
+
+    cpu = cpu_us();
+    begin = now_us();
+    for (i = 0; i < count; i++)
+    {
+        pthread_mutex_lock(&g_report_lock);
+        while (g_inflight >= window)
+        {
+            pthread_cond_wait(&g_report_cond, &g_report_lock);
+        }
+        g_inflight++;
+        pthread_mutex_unlock(&g_report_lock);
+
+        snprintf(property[0].value, MAX_PARAM_VALUE_LENGTH, "%u", i % 100);
+        snprintf(property[1].value, MAX_PARAM_VALUE_LENGTH, "%u.%u", i % 100, i % 10);
+
+        start = now_us();
+        if (LE_SUCCESS != leda_report_properties_by_handle(g_devices[i % g_devices_count].handle, property, 2, &msg_id))
+        {
+            pthread_mutex_lock(&g_report_lock);
+            g_inflight--;
+            pthread_mutex_unlock(&g_report_lock);
+            result->errors++;
+            continue;
+        }
+
+        /* 应答可能先于这里到达, 时延在结束后统一计算 */
+        g_send_us[msg_id & g_slot_mask] = start;
+        ids[sent++] = msg_id;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += BENCH_WAIT_SECONDS;
+    pthread_mutex_lock(&g_report_lock);
+    while (g_replied < sent)
+    {
+        if (ETIMEDOUT == pthread_cond_timedwait(&g_report_cond, &g_report_lock, &ts))
+        {
+            break;
+        }
+    }
+    result->errors += g_reply_errors + (sent - g_replied);
+    pthread_mutex_unlock(&g_report_lock);
+
+    result->cpu_us = cpu_us() - cpu;
+    result->count = count;
+
+    last = begin;
+    for (i = 0; i < sent; i++)
+    {
+        start = g_send_us[ids[i] & g_slot_mask];
+        stop = g_reply_us[ids[i] & g_slot_mask];
+        if (stop > start)
+        {
+            latency[replied++] = (uint32_t)(stop - start);
+            last = (stop > last) ? stop : last;
+        }
+    }
+    result->elapsed_us = last - begin;
+    fill_percentiles(result, latency, replied);
+
+end:
+    pthread_mutex_lock(&g_report_lock);
+    free(g_send_us);
+    free(g_reply_us);
+    g_send_us = NULL;
+    g_reply_us = NULL;
+    pthread_mutex_unlock(&g_report_lock);
+    free(latency);
+    free(ids);
+}
+
+static void bench_server(bench_result_t *result, const char *method, unsigned int count, unsigned int rate)
+{
+    leda_device_data_t  params[4]   = {{0}};
+    double              cpu         = 0;
+
+    snprintf(params[0].key, MAX_PARAM_NAME_LENGTH, "method");
+    params[0].type = LEDA_TYPE_TEXT;
+    snprintf(params[0].value, MAX_PARAM_VALUE_LENGTH, "%s", method);
+    snprintf(params[1].key, MAX_PARAM_NAME_LENGTH, "count");
+    params[1].type = LEDA_TYPE_INT;
+    snprintf(params[1].value, MAX_PARAM_VALUE_LENGTH, "%u", count);
+    snprintf(params[2].key, MAX_PARAM_NAME_LENGTH, "rate");
+    params[2].type = LEDA_TYPE_INT;
+    snprintf(params[2].value, MAX_PARAM_VALUE_LENGTH, "%u", rate);
+    snprintf(params[3].key, MAX_PARAM_NAME_LENGTH, "window");
+    params[3].type = LEDA_TYPE_INT;
+    snprintf(params[3].value, MAX_PARAM_VALUE_LENGTH, "%d", 64);
+
+    memset(&g_server_result, 0, sizeof(bench_result_t));
+    cpu = cpu_us();
+    if (LE_SUCCESS != leda_report_event_by_handle(g_devices[0].handle, "benchDrive", params, 4, NULL))
+    {
+        snprintf(result->name, sizeof(result->name), "%s(server)", method);
+        result->count = result->errors = count;
+        return;
+    }
+
+    if (0 != wait_sem(&g_result_sem, BENCH_WAIT_SECONDS + ((0 != rate) ? count / rate : 0)))
+    {
+        printf("no result of %s from mock server\n", method);
+        snprintf(result->name, sizeof(result->name), "%s(server)", method);
+        result->count = result->errors = count;
+        return;
+    }
+
+    memcpy(result, &g_server_result, sizeof(bench_result_t));
+    result->cpu_us = cpu_us() - cpu;
+}
+
+static void usage(void)
+{
+    printf("usage: ./bench [-h $server_ip] [-p $server_port] [-t -a $ca_path] [-n $devices] [-m $reports] [-w $window]\n"
+           "               [-s $server_calls] [-r $call_rate] [-e json|cbor|zdict] [-b]\n"
+           "    -h -p address of mock_server, 127.0.0.1:8000 for default\n"
+           "    -t uses wss, -a is the ca certificate of the server\n"
+           "    -n number of devices to online, 10 for default\n"
+           "    -m number of property reports, 100000 for default, -w reports waiting for reply, 256 for default\n"
+           "    -s number of each server initiated call, 10000 for default, -r calls per second, 0 for unlimited\n"
+           "    -e payload encoding, json for default\n"
+           "    -b batches reports\n");
+}
+
+int main(int argc, char **argv)
+{
+    leda_conn_info_t    conn        = {0};
+    leda_batch_config_t batch       = {0};
+    leda_stats_t        stats       = {0};
+    bench_result_t      result      = {{0}};
+    const char          *ip         = "127.0.0.1";
+    const char          *encoding   = "json";
+    char                dn[32]      = {0};
+    unsigned int        reports     = 100000;
+    unsigned int        window      = 256;
+    unsigned int        calls       = 10000;
+    unsigned int        rate        = 0;
+    unsigned int        errors      = 0;
+    int                 port        = 8000;
+    int                 opt         = 0;
+    int                 i           = 0;
+
+    while (-1 != (opt = getopt(argc, argv, "h:p:ta:n:m:w:s:r:e:b")))
+    {
+        switch (opt)
+        {
+            case 'h':
+                ip = optarg;
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 't':
+                conn.use_tls = 1;
+                break;
+            case 'a':
+                conn.ca_path = optarg;
+                break;
+            case 'n':
+                g_devices_count = atoi(optarg);
+                break;
+            case 'm':
+                reports = strtoul(optarg, NULL, 10);
+                break;
+            case 'w':
+                window = strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                calls = strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                rate = strtoul(optarg, NULL, 10);
+                break;
+            case 'e':
+                encoding = optarg;
+                break;
+            case 'b':
+                batch.enable = 1;
+                break;
+            default:
+                usage();
+                return -1;
+        }
+    }
+
+    if ((g_devices_count <= 0) || (0 == reports) || (0 == window) || (conn.use_tls && (NULL == conn.ca_path)))
+    {
+        usage();
+        return -1;
+    }
+
+    if (0 == strcmp(encoding, "cbor"))
+    {
+        leda_set_payload_encoding(LEDA_ENCODING_CBOR);
+    }
+    else if (0 == strcmp(encoding, "zdict"))
+    {
+        leda_set_payload_encoding(LEDA_ENCODING_JSON_ZDICT);
+    }
+    else if (0 != strcmp(encoding, "json"))
+    {
+        usage();
+        return -1;
+    }
+    leda_set_batching(&batch);
+
+    g_devices = calloc(g_devices_count, sizeof(bench_device_t));
+    if (NULL == g_devices)
+    {
+        printf("no memory can allocate\n");
+        return -1;
+    }
+
+    sem_init(&g_conn_sem, 0, 0);
+    sem_init(&g_result_sem, 0, 0);
+
+    conn.server_ip                              = ip;
+    conn.server_port                            = port;
+    conn.timeout                                = 20 * 60;
+    conn.ws_conn_cb.conn_state_change_cb        = cb_state_changed;
+    conn.conn_devices_cb.get_properties_cb      = cb_get_property;
+    conn.conn_devices_cb.set_properties_cb      = cb_set_property;
+    conn.conn_devices_cb.call_service_cb        = cb_call_service;
+    conn.conn_devices_cb.service_output_max_count = 0;
+    conn.conn_devices_cb.report_reply_cb        = cb_report_reply;
+
+    if (LE_SUCCESS != leda_init(&conn))
+    {
+        printf("leda init failed\n");
+        return -1;
+    }
+
+    if (0 != wait_sem(&g_conn_sem, BENCH_WAIT_SECONDS))
+    {
+        printf("connect to %s:%d failed\n", ip, port);
+        leda_exit();
+        return -1;
+    }
+
+    for (i = 0; i < g_devices_count; i++)
+    {
+        snprintf(dn, sizeof(dn), "bench_device_%d", i);
+        snprintf(g_devices[i].dn, sizeof(g_devices[i].dn), "%s", dn);
+        if (LE_SUCCESS != leda_register_device(BENCH_PK, g_devices[i].dn, &g_devices[i], &g_devices[i].handle))
+        {
+            printf("register device(%s:%s) failed\n", BENCH_PK, g_devices[i].dn);
+            leda_exit();
+            return -1;
+        }
+    }
+
+    printf("%s://%s:%d, encoding %s%s, %d devices\n", conn.use_tls ? "wss" : "ws", ip, port, encoding,
+           batch.enable ? ", batched" : "", g_devices_count);
+    printf("%-20s %8s %7s %12s %9s %9s %9s %9s %11s\n", "scenario", "count", "errors", "msgs/s",
+           "p50(us)", "p99(us)", "p999(us)", "max(us)", "cpu/msg(us)");
+
+    bench_online(&result);
+    print_result(&result);
+    errors += result.errors;
+
+    memset(&result, 0, sizeof(result));
+    bench_report(&result, reports, window);
+    print_result(&result);
+    errors += result.errors;
+
+    if (0 != calls)
+    {
+        memset(&result, 0, sizeof(result));
+        bench_server(&result, "getProperty", calls, rate);
+        print_result(&result);
+        errors += result.errors;
+
+        memset(&result, 0, sizeof(result));
+        bench_server(&result, "setProperty", calls, rate);
+        print_result(&result);
+        errors += result.errors;
+
+        memset(&result, 0, sizeof(result));
+        bench_server(&result, "callService", calls, rate);
+        print_result(&result);
+        errors += result.errors;
+    }
+
+    leda_get_stats(&stats);
+    printf("sent %llu msgs %llu bytes, received %llu msgs %llu bytes, send queue full %llu, tls handshake p50 %u us\n",
+           stats.msgs_sent, stats.bytes_sent, stats.msgs_recv, stats.bytes_recv, stats.send_queue_full,
+           stats.tls_handshake.p50_us);
+
+    for (i = 0; i < g_devices_count; i++)
+    {
+        leda_offline_by_handle(g_devices[i].handle);
+    }
+
+    leda_exit();
+    sem_destroy(&g_conn_sem);
+    sem_destroy(&g_result_sem);
+    free(g_devices);
+
+    if ((0 != errors) || (0 != g_disconnects))
+    {
+        printf("bench failed, encoding %s: %u errors, %d disconnects\n", encoding, errors, g_disconnects);
+        return 1;
+    }
+
+    return 0;
+}
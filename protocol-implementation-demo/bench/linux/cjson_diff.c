@@ -0,0 +1,632 @@
+/*
+ * Copyright (c) 2014-2019 Alibaba Group. All rights reserved.
+ * License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * cJSON的差分测试, 不需要连接.
+ *
+ * 同时加载三份cJSON:
+ *   cjson_ref.so       引入SIMD扫描之前的cJSON(cJSON_ref.c)
+ *   cjson_simd.so      当前的cJSON, x86_64上为SSE2, aarch64上为NEON
+ *   cjson_scalar.so    当前的cJSON, 以CJSON_NO_SIMD编译
+ * 用固定种子随机生成JSON文本(长空白, 长字符串, 转义, 非ASCII字节, 随机截断和改写)和原始字符串,
+ * 比较三者解析出的树, 解析结束或出错位置, 以及原始字符串经cJSON_CreateString后的输出.
+ * 参考实现之后数字改为按最短往返格式输出, 所以解析出的树按结构和数值的二进制比较,
+ * 格式化和非格式化输出只检查能否解析回同一棵树.
+ * cJSON_Minify不经过SIMD扫描, SDK也不使用, 而且在字符串未结束时会越过结束符读取, 不参与比较.
+ *
+ * 每个输入都放在一页的末尾, 后面紧跟不可访问的页, 越过结束符的读取会直接崩溃.
+ *
+ * 发现不一致时打印种子, 序号和输入并返回1, 可作为cJSON修改和ARM构建的回归门禁.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <sys/mman.h>
+
+#include "cJSON.h"
+
+#define DIFF_VARIANTS           3
+#define DIFF_MAX_INPUT          (64 * 1024)
+#define DIFF_MAX_DEPTH          6
+#define DIFF_DEF_CASES          200000
+
+typedef struct diff_variant
+{
+    const char      *name;
+    const char      *path;
+    void            *handle;
+    cJSON           *(*parse_with_opts)(const char *value, const char **return_parse_end, cJSON_bool require_null_terminated);
+    char            *(*print)(const cJSON *item);
+    char            *(*print_unformatted)(const cJSON *item);
+    void            (*delete_item)(cJSON *item);
+    const char      *(*get_error_ptr)(void);
+    cJSON           *(*create_string)(const char *string);
+    void            (*free_ptr)(void *object);
+} diff_variant_t;
+
+typedef struct diff_text
+{
+    char            *data;
+    size_t          len;
+    size_t          size;
+} diff_text_t;
+
+/* 对一份cJSON运行一次, 返回结果的文本描述 */
+typedef char *(*diff_run_t)(const diff_variant_t *v, const diff_text_t *text);
+
+static diff_variant_t g_variants[DIFF_VARIANTS] =
+{
+    {"ref",     "./cjson_ref.so"},
+    {"simd",    "./cjson_simd.so"},
+    {"scalar",  "./cjson_scalar.so"},
+};
+
+static uint64_t     g_rand      = 0;
+
+/* 输入所在的映射区, 最后一页不可访问 */
+static char         *g_area     = NULL;
+static size_t       g_area_size = 0;
+
+static uint64_t next_rand(void)
+{
+    g_rand ^= g_rand << 13;
+    g_rand ^= g_rand >> 7;
+    g_rand ^= g_rand << 17;
+
+    return g_rand;
+}
+
+static unsigned int rand_below(unsigned int n)
+{
+    return (unsigned int)(next_rand() % n);
+}
+
+static void text_putc(diff_text_t *text, char c)
+{
+    if (text->len + 1 < text->size)
+    {
+        text->data[text->len++] = c;
+    }
+}
+
+static void text_puts(diff_text_t *text, const char *s)
+{
+    while ('\0' != *s)
+    {
+        text_putc(text, *s++);
+    }
+}
+
+/* 0到40个空白, 跨过16字节的扫描边界 */
+static void gen_whitespace(diff_text_t *text)
+{
+    static const char   spaces[] = {' ', '\t', '\n', '\r'};
+    unsigned int        cnt = 0;
+    unsigned int        i   = 0;
+
+    cnt = (0 == rand_below(3)) ? rand_below(41) : rand_below(2);
+    for (i = 0; i < cnt; i++)
+    {
+        text_putc(text, spaces[rand_below(sizeof(spaces))]);
+    }
+}
+
+static void gen_string(diff_text_t *text)
+{
+    static const char   *escapes[] = {"\\\"", "\\\\", "\\/", "\\b", "\\f", "\\n", "\\r", "\\t",
+                                      "\\u0001", "\\u001f", "\\u00e9", "\\u4e2d", "\\ud83d\\ude00", "\\uffff"};
+    unsigned int        len = 0;
+    unsigned int        i   = 0;
+    unsigned int        r   = 0;
+    char                c   = 0;
+
+    len = (0 == rand_below(4)) ? rand_below(200) : rand_below(24);
+
+    text_putc(text, '\"');
+    for (i = 0; i < len; i++)
+    {
+        r = rand_below(100);
+        if (r < 80)
+        {
+            c = (char)(' ' + rand_below(95));
+            text_putc(text, (('\"' == c) || ('\\' == c)) ? 'x' : c);
+        }
+        else if (r < 92)
+        {
+            text_puts(text, escapes[rand_below(sizeof(escapes) / sizeof(escapes[0]))]);
+        }
+        else
+        {
+            text_putc(text, (char)(0x80 + rand_below(128)));
+        }
+    }
+    text_putc(text, '\"');
+}
+
+static void gen_number(diff_text_t *text)
+{
+    static const char   *numbers[] = {"0", "-0", "1", "-1", "42", "0.5", "-12.25", "3.14159265358979",
+                                      "1e10", "1E-7", "-2.5e+3", "123456789012", "9007199254740993",
+                                      "1.7976931348623157e308", "2.2250738585072014e-308", "100000000000000000000"};
+    char                buf[32] = {0};
+
+    if (rand_below(2))
+    {
+        text_puts(text, numbers[rand_below(sizeof(numbers) / sizeof(numbers[0]))]);
+    }
+    else
+    {
+        snprintf(buf, sizeof(buf), "%d", (int)(next_rand() >> 33) - (1 << 30));
+        text_puts(text, buf);
+    }
+}
+
+static void gen_value(diff_text_t *text, int depth)
+{
+    static const char   *literals[] = {"true", "false", "null"};
+    unsigned int        kind    = 0;
+    unsigned int        cnt     = 0;
+    unsigned int        i       = 0;
+
+    kind = (depth >= DIFF_MAX_DEPTH) ? rand_below(3) : rand_below(5);
+    switch (kind)
+    {
+        case 0:
+            gen_string(text);
+            break;
+        case 1:
+            gen_number(text);
+            break;
+        case 2:
+            text_puts(text, literals[rand_below(3)]);
+            break;
+        case 3:
+            cnt = rand_below(6);
+            text_putc(text, '[');
+            for (i = 0; i < cnt; i++)
+            {
+                gen_whitespace(text);
+                gen_value(text, depth + 1);
+                gen_whitespace(text);
+                if (i + 1 < cnt)
+                {
+                    text_putc(text, ',');
+                }
+            }
+            text_putc(text, ']');
+            break;
+        default:
+            cnt = rand_below(6);
+            text_putc(text, '{');
+            for (i = 0; i < cnt; i++)
+            {
+                gen_whitespace(text);
+                gen_string(text);
+                gen_whitespace(text);
+                text_putc(text, ':');
+                gen_whitespace(text);
+                gen_value(text, depth + 1);
+                gen_whitespace(text);
+                if (i + 1 < cnt)
+                {
+                    text_putc(text, ',');
+                }
+            }
+            text_putc(text, '}');
+            break;
+    }
+}
+
+/* 四分之一的输入被截断或改写若干字节, 覆盖出错路径 */
+static void mutate(diff_text_t *text)
+{
+    static const char   specials[] = {'\"', '\\', ' ', '\0', '\n', 0x1f, 0x7f, (char)0xff, '{', ']', ','};
+    unsigned int        cnt = 0;
+    unsigned int        i   = 0;
+
+    if ((0 == text->len) || (0 != rand_below(4)))
+    {
+        return;
+    }
+
+    if (rand_below(2))
+    {
+        text->len = rand_below((unsigned int)text->len);
+        return;
+    }
+
+    cnt = 1 + rand_below(3);
+    for (i = 0; i < cnt; i++)
+    {
+        text->data[rand_below((unsigned int)text->len)] = specials[rand_below(sizeof(specials))];
+    }
+}
+
+/* 原始字节串, 用于cJSON_CreateString后的输出 */
+static void gen_raw(diff_text_t *text)
+{
+    unsigned int len    = 0;
+    unsigned int i      = 0;
+    unsigned int r      = 0;
+
+    len = (0 == rand_below(4)) ? rand_below(300) : rand_below(40);
+    for (i = 0; i < len; i++)
+    {
+        r = rand_below(100);
+        if (r < 70)
+        {
+            text_putc(text, (char)(' ' + rand_below(95)));
+        }
+        else if (r < 85)
+        {
+            text_putc(text, (char)(1 + rand_below(31)));
+        }
+        else if (r < 92)
+        {
+            text_putc(text, rand_below(2) ? '\"' : '\\');
+        }
+        else
+        {
+            text_putc(text, (char)(0x80 + rand_below(128)));
+        }
+    }
+}
+
+/* 把输入复制到映射区末尾, 结束符是不可访问页前的最后一个字节 */
+static char *place(const diff_text_t *text)
+{
+    char *dst = g_area + g_area_size - (size_t)getpagesize() - text->len - 1;
+
+    memcpy(dst, text->data, text->len);
+    dst[text->len] = '\0';
+
+    return dst;
+}
+
+static void out_add(diff_text_t *out, const char *data, size_t len)
+{
+    char    *tmp    = NULL;
+    size_t  size    = 0;
+
+    if (out->len + len + 1 > out->size)
+    {
+        size = (out->len + len + 1) * 2;
+        tmp = realloc(out->data, size);
+        if (NULL == tmp)
+        {
+            printf("no memory can allocate\n");
+            exit(1);
+        }
+        out->data = tmp;
+        out->size = size;
+    }
+
+    memcpy(out->data + out->len, data, len);
+    out->len += len;
+    out->data[out->len] = '\0';
+}
+
+static void out_puts(diff_text_t *out, const char *s)
+{
+    out_add(out, s, strlen(s));
+}
+
+/* 带长度的字节串, 内容中的任何字节都不会与结构混淆 */
+static void out_bytes(diff_text_t *out, char tag, const char *s)
+{
+    char buf[32] = {0};
+
+    snprintf(buf, sizeof(buf), "%c%zu:", tag, strlen(s));
+    out_puts(out, buf);
+    out_puts(out, s);
+    out_puts(out, "\n");
+}
+
+/* 解析结果的结构描述, 数值按二进制比较, 与输出格式无关 */
+static void describe(diff_text_t *out, const cJSON *item)
+{
+    char buf[64] = {0};
+
+    for (; NULL != item; item = item->next)
+    {
+        if (NULL != item->string)
+        {
+            out_bytes(out, 'k', item->string);
+        }
+
+        switch (item->type & 0xFF)
+        {
+            case cJSON_False:
+                out_puts(out, "false\n");
+                break;
+            case cJSON_True:
+                out_puts(out, "true\n");
+                break;
+            case cJSON_NULL:
+                out_puts(out, "null\n");
+                break;
+            case cJSON_Number:
+                snprintf(buf, sizeof(buf), "n%a %d\n", item->valuedouble, item->valueint);
+                out_puts(out, buf);
+                break;
+            case cJSON_String:
+                out_bytes(out, 's', item->valuestring);
+                break;
+            case cJSON_Array:
+                out_puts(out, "[\n");
+                describe(out, item->child);
+                out_puts(out, "]\n");
+                break;
+            case cJSON_Object:
+                out_puts(out, "{\n");
+                describe(out, item->child);
+                out_puts(out, "}\n");
+                break;
+            default:
+                snprintf(buf, sizeof(buf), "type %d\n", item->type);
+                out_puts(out, buf);
+                break;
+        }
+    }
+}
+
+/* 输出的文本应能解析回同一棵树 */
+static void check_printed(const diff_variant_t *v, diff_text_t *out, const char *tree, const char *name, char *printed)
+{
+    diff_text_t again   = {0};
+    cJSON       *root   = NULL;
+
+    root = (NULL != printed) ? v->parse_with_opts(printed, NULL, 1) : NULL;
+    describe(&again, root);
+    if ((NULL == root) || (NULL == again.data) || (0 != strcmp(tree, again.data)))
+    {
+        out_puts(out, name);
+        out_puts(out, " does not parse back: ");
+        out_puts(out, (NULL != printed) ? printed : "(null)");
+        out_puts(out, "\n");
+    }
+
+    v->delete_item(root);
+    v->free_ptr(printed);
+    free(again.data);
+}
+
+static char *parse(const diff_variant_t *v, const diff_text_t *text, cJSON_bool require_null_terminated)
+{
+    const char  *input  = place(text);
+    const char  *end    = NULL;
+    cJSON       *root   = NULL;
+    diff_text_t out     = {0};
+    diff_text_t tree    = {0};
+    char        buf[64] = {0};
+
+    root = v->parse_with_opts(input, &end, require_null_terminated);
+    if (NULL == root)
+    {
+        snprintf(buf, sizeof(buf), "error at %ld\n", (long)(v->get_error_ptr() - input));
+        out_puts(&out, buf);
+        return out.data;
+    }
+
+    snprintf(buf, sizeof(buf), "end at %ld\n", (long)(end - input));
+    out_puts(&out, buf);
+    describe(&tree, root);
+    out_puts(&out, tree.data);
+    check_printed(v, &out, tree.data, "unformatted", v->print_unformatted(root));
+    check_printed(v, &out, tree.data, "formatted", v->print(root));
+
+    v->delete_item(root);
+    free(tree.data);
+
+    return out.data;
+}
+
+static char *run_parse(const diff_variant_t *v, const diff_text_t *text)
+{
+    return parse(v, text, 0);
+}
+
+static char *run_parse_strict(const diff_variant_t *v, const diff_text_t *text)
+{
+    return parse(v, text, 1);
+}
+
+static char *run_string(const diff_variant_t *v, const diff_text_t *text)
+{
+    cJSON       *item       = v->create_string(place(text));
+    char        *printed    = v->print_unformatted(item);
+    diff_text_t out         = {0};
+
+    out_puts(&out, (NULL != printed) ? printed : "(null)");
+
+    v->free_ptr(printed);
+    v->delete_item(item);
+
+    return out.data;
+}
+
+static void dump(const char *title, const char *data, size_t len)
+{
+    size_t i = 0;
+
+    printf("%s(%zu bytes): ", title, len);
+    for (i = 0; i < len; i++)
+    {
+        if (((unsigned char)data[i] < ' ') || ((unsigned char)data[i] >= 0x7f) || ('\\' == data[i]))
+        {
+            printf("\\x%02x", (unsigned char)data[i]);
+        }
+        else
+        {
+            putchar(data[i]);
+        }
+    }
+    putchar('\n');
+}
+
+/* 三份cJSON依次运行, 返回0表示结果一致 */
+static int check(const char *op, diff_run_t run, uint64_t seed, long index, const diff_text_t *text)
+{
+    char    *outs[DIFF_VARIANTS]    = {0};
+    int     failed                  = 0;
+    int     i                       = 0;
+
+    for (i = 0; i < DIFF_VARIANTS; i++)
+    {
+        outs[i] = run(&g_variants[i], text);
+        if ((NULL == outs[i]) || ((i > 0) && (0 != strcmp(outs[0], outs[i]))))
+        {
+            failed = 1;
+        }
+    }
+
+    if (failed)
+    {
+        printf("mismatch in %s, seed %llu case %ld\n", op, (unsigned long long)seed, index);
+        dump("input", text->data, text->len);
+        for (i = 0; i < DIFF_VARIANTS; i++)
+        {
+            dump(g_variants[i].name, (NULL == outs[i]) ? "(no memory)" : outs[i], (NULL == outs[i]) ? 11 : strlen(outs[i]));
+        }
+    }
+
+    for (i = 0; i < DIFF_VARIANTS; i++)
+    {
+        free(outs[i]);
+    }
+
+    return failed;
+}
+
+static int load(diff_variant_t *v)
+{
+    v->handle = dlopen(v->path, RTLD_NOW | RTLD_LOCAL);
+    if (NULL == v->handle)
+    {
+        printf("load %s failed: %s\n", v->path, dlerror());
+        return -1;
+    }
+
+    *(void **)&v->parse_with_opts    = dlsym(v->handle, "cJSON_ParseWithOpts");
+    *(void **)&v->print              = dlsym(v->handle, "cJSON_Print");
+    *(void **)&v->print_unformatted  = dlsym(v->handle, "cJSON_PrintUnformatted");
+    *(void **)&v->delete_item        = dlsym(v->handle, "cJSON_Delete");
+    *(void **)&v->get_error_ptr      = dlsym(v->handle, "cJSON_GetErrorPtr");
+    *(void **)&v->create_string      = dlsym(v->handle, "cJSON_CreateString");
+    *(void **)&v->free_ptr           = dlsym(v->handle, "cJSON_free");
+
+    if ((NULL == v->parse_with_opts) || (NULL == v->print) || (NULL == v->print_unformatted)
+        || (NULL == v->delete_item) || (NULL == v->get_error_ptr) || (NULL == v->create_string)
+        || (NULL == v->free_ptr))
+    {
+        printf("%s misses cJSON symbols\n", v->path);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void usage(const char *name)
+{
+    printf("usage: %s [-n cases] [-s seed]\n", name);
+    printf("  -n    number of generated inputs, default %d\n", DIFF_DEF_CASES);
+    printf("  -s    random seed, default 1, a mismatch prints the seed and case to reproduce it\n");
+}
+
+int main(int argc, char **argv)
+{
+    diff_text_t text    = {0};
+    uint64_t    seed    = 1;
+    long        cases   = DIFF_DEF_CASES;
+    long        index   = 0;
+    int         failed  = 0;
+    int         opt     = 0;
+    int         i       = 0;
+
+    while (-1 != (opt = getopt(argc, argv, "n:s:h")))
+    {
+        switch (opt)
+        {
+            case 'n':
+                cases = atol(optarg);
+                break;
+            case 's':
+                seed = strtoull(optarg, NULL, 0);
+                break;
+            default:
+                usage(argv[0]);
+                return ('h' == opt) ? 0 : 1;
+        }
+    }
+
+    for (i = 0; i < DIFF_VARIANTS; i++)
+    {
+        if (0 != load(&g_variants[i]))
+        {
+            return 1;
+        }
+    }
+
+    g_area_size = DIFF_MAX_INPUT + 2 * (size_t)getpagesize();
+    g_area = mmap(NULL, g_area_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ((MAP_FAILED == g_area) || (0 != mprotect(g_area + g_area_size - getpagesize(), getpagesize(), PROT_NONE)))
+    {
+        printf("map input area failed\n");
+        return 1;
+    }
+
+    text.size = DIFF_MAX_INPUT;
+    text.data = malloc(text.size);
+    if (NULL == text.data)
+    {
+        printf("no memory can allocate\n");
+        return 1;
+    }
+
+    /* xorshift的状态不能为0 */
+    g_rand = seed * 2654435761u + 1;
+    for (index = 0; (index < cases) && !failed; index++)
+    {
+        text.len = 0;
+        gen_whitespace(&text);
+        gen_value(&text, 0);
+        gen_whitespace(&text);
+        mutate(&text);
+        failed = check("parse", run_parse, seed, index, &text)
+                 || check("parse null terminated", run_parse_strict, seed, index, &text);
+
+        text.len = 0;
+        gen_raw(&text);
+        failed = failed || check("print string", run_string, seed, index, &text);
+    }
+
+    printf("%ld cases, seed %llu, %s\n", index, (unsigned long long)seed, failed ? "mismatch" : "all variants agree");
+
+    free(text.data);
+    munmap(g_area, g_area_size);
+    for (i = 0; i < DIFF_VARIANTS; i++)
+    {
+        dlclose(g_variants[i].handle);
+    }
+
+    return failed;
+}
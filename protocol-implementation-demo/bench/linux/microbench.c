@@ -0,0 +1,816 @@
+/*
+ * Copyright (c) 2014-2019 Alibaba Group. All rights reserved.
+ * License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * JSON编解码热点的微基准测试, 不需要连接.
+ *
+ * 对几组典型数据(少量属性上报, 100个属性的getProperty, 结构体和数组值, 长文本, 约64KB的大消息)分别测试:
+ *   encode     按模板生成上报消息的JSON文本, 与leda_asyn_send_method相同(在arena中)
+ *   decode     解析收到的请求, leda_parse_receive_msg, 复制payload, json_data_to_struct_data, 与接收通道相同
+ *              (解析在arena中, payload副本在堆上)
+ *   parse      cJSON_Parse
+ *   print      cJSON_PrintUnformatted
+ * 输出每次操作的耗时(ns/op), 内存分配次数(allocs/op)和分配字节数(bytes/op).
+ *
+ * 开始前检查每组数据的上报消息经发送队列(内存和文件两种)后, 能按各编码被mock_server原样解出.
+ *
+ * 用-o保存结果作为基线, 之后用-c对比, 耗时超过基线的-r百分比或分配次数/字节数增加时返回非0,
+ * 可作为leda.c和cJSON优化的回归门禁.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "leda.h"
+#include "le_error.h"
+#include "cJSON.h"
+#include "mem.h"
+#include "cbor.h"
+#include "zdict.h"
+#include "wsc_buffer_mgmt.h"
+#include "leda_internal.h"
+
+#define MICRO_MAX_CASES         64
+#define MICRO_ROUNDS            10
+#define MICRO_QUEUE_FILE        "/tmp/leda_microbench.queue"
+#define MICRO_QUEUE_MSG_LEN     (128 * 1024)
+#define MICRO_MAX_INFLATE       (4 * 1024 * 1024)
+
+typedef enum micro_wire
+{
+    MICRO_WIRE_JSON = 0,
+    MICRO_WIRE_CBOR,
+    MICRO_WIRE_ZDICT,
+    MICRO_WIRE_COUNT
+} micro_wire_e;
+
+static const char *g_wire_names[MICRO_WIRE_COUNT] = {"json", "cbor", "zdict"};
+
+typedef struct micro_corpus
+{
+    const char          *name;
+    const char          *method;        /* decode使用的下行请求 */
+    leda_device_data_t  *data;
+    int                 data_cnt;
+    char                *request;       /* 下行请求的JSON文本 */
+    cJSON               *tree;          /* print使用的已解析的上报消息 */
+} micro_corpus_t;
+
+typedef struct micro_result
+{
+    char                name[48];
+    double              ns_per_op;
+    double              allocs_per_op;
+    double              bytes_per_op;
+} micro_result_t;
+
+typedef struct micro_frame
+{
+    char                *data;
+    size_t              len;
+    int                 type;           /* 0为文本帧, 1为二进制帧 */
+} micro_frame_t;
+
+typedef int (*micro_op_t)(const micro_corpus_t *corpus);
+
+/* glibc允许程序替换malloc, SDK和cJSON内部的分配都经过这里计数 */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static int              g_counting      = 0;
+static uint64_t         g_allocs        = 0;
+static uint64_t         g_alloc_bytes   = 0;
+
+static micro_result_t   g_results[MICRO_MAX_CASES];
+static int              g_results_cnt   = 0;
+
+void *malloc(size_t size)
+{
+    if (g_counting)
+    {
+        g_allocs++;
+        g_alloc_bytes += size;
+    }
+
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    if (g_counting)
+    {
+        g_allocs++;
+        g_alloc_bytes += nmemb * size;
+    }
+
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (g_counting)
+    {
+        g_allocs++;
+        g_alloc_bytes += size;
+    }
+
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void set_data(leda_device_data_t *data, leda_data_type_e type, const char *key, const char *value)
+{
+    data->type = type;
+    snprintf(data->key, sizeof(data->key), "%s", key);
+    snprintf(data->value, sizeof(data->value), "%s", value);
+}
+
+/* 与leda_asyn_send_method相同的上报消息 */
+static cJSON *build_report(const micro_corpus_t *corpus)
+{
+    cJSON *root     = NULL;
+    cJSON *payload  = NULL;
+    cJSON *params   = NULL;
+
+    params = struct_data_to_json_data(corpus->data, corpus->data_cnt);
+    if (NULL == params)
+    {
+        return NULL;
+    }
+
+    root    = cJSON_CreateObject();
+    payload = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "version", "1.0");
+    cJSON_AddNumberToObject(root, "messageId", 123456);
+    cJSON_AddStringToObject(root, "method", "reportProperty");
+    cJSON_AddItemToObject(root, "payload", payload);
+    cJSON_AddStringToObject(payload, "productKey", "a1ZJTVsqj2y");
+    cJSON_AddStringToObject(payload, "deviceName", "demo_led_00001");
+    cJSON_AddItemToObject(payload, "properties", params);
+
+    return root;
+}
+
+/* 生成平台下发的请求: getProperty只带属性名, 其他请求带完整的属性 */
+static char *build_request(const micro_corpus_t *corpus)
+{
+    cJSON   *root       = NULL;
+    cJSON   *payload    = NULL;
+    cJSON   *params     = NULL;
+    char    *msg        = NULL;
+    int     i           = 0;
+
+    if (0 == strcmp(corpus->method, "getProperty"))
+    {
+        params = cJSON_CreateArray();
+        for (i = 0; i < corpus->data_cnt; i++)
+        {
+            cJSON_AddItemToArray(params, cJSON_CreateString(corpus->data[i].key));
+        }
+    }
+    else
+    {
+        params = struct_data_to_json_data(corpus->data, corpus->data_cnt);
+    }
+
+    root    = cJSON_CreateObject();
+    payload = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "version", "1.0");
+    cJSON_AddNumberToObject(root, "messageId", 654321);
+    cJSON_AddStringToObject(root, "method", corpus->method);
+    cJSON_AddItemToObject(root, "payload", payload);
+    cJSON_AddStringToObject(payload, "productKey", "a1ZJTVsqj2y");
+    cJSON_AddStringToObject(payload, "deviceName", "demo_led_00001");
+    if (0 == strcmp(corpus->method, "callService"))
+    {
+        cJSON_AddStringToObject(payload, "identifier", "configure");
+        cJSON_AddItemToObject(payload, "inputData", params);
+    }
+    else
+    {
+        cJSON_AddItemToObject(payload, "properties", params);
+    }
+
+    msg = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+
+    return msg;
+}
+
+static int op_encode(const micro_corpus_t *corpus)
+{
+    char            *msg    = NULL;
+    int             ret     = -1;
+    mem_arena_mark  mark    = {0};
+
+    mem_arena_begin(&mark);
+    if (LE_SUCCESS == leda_envelope_build(123456, "reportProperty", "a1ZJTVsqj2y", "demo_led_00001",
+                                          NULL, corpus->data, corpus->data_cnt, &msg))
+    {
+        ret = 0;
+        cJSON_free(msg);
+    }
+    mem_arena_end(&mark);
+
+    return ret;
+}
+
+/* 模板生成的文本应与组装消息树后打印的结果逐字节相同 */
+static int check_envelope(const micro_corpus_t *corpus)
+{
+    char    *msg    = NULL;
+    char    *expect = NULL;
+    int     ret     = -1;
+
+    expect = cJSON_PrintUnformatted(corpus->tree);
+    if ((NULL != expect) &&
+        (LE_SUCCESS == leda_envelope_build(123456, "reportProperty", "a1ZJTVsqj2y", "demo_led_00001",
+                                           NULL, corpus->data, corpus->data_cnt, &msg)))
+    {
+        ret = (0 == strcmp(msg, expect)) ? 0 : -1;
+        cJSON_free(msg);
+    }
+    cJSON_free(expect);
+
+    return ret;
+}
+
+/* 代替lws_write, 取出发送队列交给网络的帧 */
+static int take_frame(char *buf, size_t buf_len, int type, void *usr)
+{
+    micro_frame_t *frame = usr;
+
+    frame->data = malloc(buf_len + 1);
+    if (NULL == frame->data)
+    {
+        return -1;
+    }
+
+    memcpy(frame->data, buf, buf_len);
+    frame->data[buf_len] = '\0';
+    frame->len  = buf_len;
+    frame->type = type;
+
+    return (int)buf_len;
+}
+
+/* 与_leda_send_report和leda_send_json相同的编码 */
+static char *encode_frame(const cJSON *tree, micro_wire_e wire, size_t *len, int *type)
+{
+    char    *text   = NULL;
+    char    *data   = NULL;
+    size_t  size    = 0;
+
+    if (MICRO_WIRE_CBOR == wire)
+    {
+        *type = 1;
+        return cbor_encode(tree, len);
+    }
+
+    text = cJSON_PrintUnformatted(tree);
+    *type = 0;
+    *len = (NULL != text) ? strlen(text) : 0;
+    if ((MICRO_WIRE_ZDICT != wire) || (NULL == text))
+    {
+        return text;
+    }
+
+    size = zdict_bound(*len);
+    data = cJSON_malloc(size);
+    if ((NULL != data) && (0 != zdict_compress(text, *len, data, &size)))
+    {
+        cJSON_free(data);
+        data = NULL;
+    }
+    cJSON_free(text);
+    *type = 1;
+    *len = size;
+
+    return data;
+}
+
+/* 与mock_server的handle_frame相同的解码, 多余的字节视为错误 */
+static cJSON *decode_frame(const micro_frame_t *frame, micro_wire_e wire)
+{
+    cJSON   *root       = NULL;
+    char    *text       = NULL;
+    size_t  text_len    = 0;
+
+    if (0 == frame->type)
+    {
+        return cJSON_Parse(frame->data);
+    }
+
+    if (MICRO_WIRE_CBOR == wire)
+    {
+        return cbor_decode(frame->data, frame->len);
+    }
+
+    text = zdict_decompress(frame->data, frame->len, MICRO_MAX_INFLATE, &text_len);
+    root = (NULL != text) ? cJSON_Parse(text) : NULL;
+    mem_free(text);
+
+    return root;
+}
+
+static int wire_queue_init(int file)
+{
+    if (!file)
+    {
+        return client_buf_mgmt_init(1024 * 2, 2);
+    }
+
+    unlink(MICRO_QUEUE_FILE);
+    return client_buf_mgmt_init_file(MICRO_QUEUE_FILE, MICRO_QUEUE_MSG_LEN, 2);
+}
+
+/* 上报消息经发送队列后应能被mock_server解出原来的消息树 */
+static int check_wire(const micro_corpus_t *corpus)
+{
+    micro_frame_t   frame   = {0};
+    cJSON           *root   = NULL;
+    char            *data   = NULL;
+    size_t          len     = 0;
+    int             type    = 0;
+    int             file    = 0;
+    int             wire    = 0;
+    int             ret     = 0;
+
+    for (file = 0; file < 2; file++)
+    {
+        for (wire = 0; wire < MICRO_WIRE_COUNT; wire++)
+        {
+            if (0 != wire_queue_init(file))
+            {
+                printf("init %s send queue failed\n", file ? "file" : "memory");
+                return -1;
+            }
+
+            memset(&frame, 0, sizeof(frame));
+            data = encode_frame(corpus->tree, (micro_wire_e)wire, &len, &type);
+            if ((NULL != data) && (LE_SUCCESS == client_buf_mgmt_push(data, len, type)))
+            {
+                client_buf_mgmt_pop(take_frame, &frame);
+            }
+
+            root = (NULL != frame.data) ? decode_frame(&frame, (micro_wire_e)wire) : NULL;
+            if ((NULL == root) || !cJSON_Compare(root, corpus->tree, 1))
+            {
+                printf("%s report of corpus %s does not survive the %s send queue\n",
+                       g_wire_names[wire], corpus->name, file ? "file" : "memory");
+                ret = -1;
+            }
+
+            cJSON_Delete(root);
+            cJSON_free(data);
+            free(frame.data);
+            client_buf_mgmt_destroy();
+        }
+    }
+    unlink(MICRO_QUEUE_FILE);
+
+    return ret;
+}
+
+/* 与_ws_dispatch_msg和threadpool_recv_proc的处理相同, 不含回调和应答 */
+static int op_decode(const micro_corpus_t *corpus)
+{
+    cJSON               *root       = NULL;
+    cJSON               *payload    = NULL;
+    cJSON               *dup        = NULL;
+    cJSON               *item       = NULL;
+    char                *method     = NULL;
+    leda_device_data_t  *data       = NULL;
+    int                 data_cnt    = 0;
+    int                 msg_id      = 0;
+    int                 code        = 0;
+    int                 ret         = -1;
+    mem_arena_mark      mark        = {0};
+
+    mem_arena_begin(&mark);
+    root = cJSON_Parse(corpus->request);
+    if (NULL == root)
+    {
+        mem_arena_end(&mark);
+        return -1;
+    }
+
+    if (MSG_METHOD != leda_parse_receive_msg(root, &msg_id, &code, &method, &payload))
+    {
+        goto end;
+    }
+
+    mem_arena_pause();
+    dup = cJSON_Duplicate(payload, 1);
+    mem_arena_resume();
+    if (NULL == dup)
+    {
+        goto end;
+    }
+
+    item = cJSON_GetObjectItem(dup, "properties");
+    if (NULL == item)
+    {
+        item = cJSON_GetObjectItem(dup, "inputData");
+    }
+
+    if ((NULL != item) && (LE_SUCCESS == json_data_to_struct_data(item, &data, &data_cnt)))
+    {
+        ret = (data_cnt == corpus->data_cnt) ? 0 : -1;
+        mem_free(data);
+    }
+
+end:
+    cJSON_Delete(dup);
+    cJSON_Delete(root);
+    mem_arena_end(&mark);
+
+    return ret;
+}
+
+static int op_parse(const micro_corpus_t *corpus)
+{
+    cJSON *root = NULL;
+
+    root = cJSON_Parse(corpus->request);
+    if (NULL == root)
+    {
+        return -1;
+    }
+    cJSON_Delete(root);
+
+    return 0;
+}
+
+static int op_print(const micro_corpus_t *corpus)
+{
+    char *msg = NULL;
+
+    msg = cJSON_PrintUnformatted(corpus->tree);
+    if (NULL == msg)
+    {
+        return -1;
+    }
+    cJSON_free(msg);
+
+    return 0;
+}
+
+/* 每组数据的每种操作跑MICRO_ROUNDS轮, 取最快一轮的耗时, 分配统计取平均 */
+static int run_case(const char *op_name, micro_op_t op, const micro_corpus_t *corpus, unsigned int min_ms, const char *filter)
+{
+    micro_result_t  *result     = NULL;
+    uint64_t        begin       = 0;
+    uint64_t        elapsed     = 0;
+    uint64_t        iters       = 0;
+    uint64_t        total       = 0;
+    uint64_t        batch       = 1;
+    double          best        = 0;
+    int             round       = 0;
+
+    if (g_results_cnt >= MICRO_MAX_CASES)
+    {
+        return 0;
+    }
+
+    result = &g_results[g_results_cnt];
+    snprintf(result->name, sizeof(result->name), "%s/%s", op_name, corpus->name);
+    if ((NULL != filter) && (NULL == strstr(result->name, filter)))
+    {
+        return 0;
+    }
+
+    if (0 != op(corpus))
+    {
+        printf("%-28s failed\n", result->name);
+        return -1;
+    }
+
+    /* 估算每轮的次数 */
+    begin = now_ns();
+    while ((elapsed = now_ns() - begin) < 10000000)
+    {
+        op(corpus);
+        iters++;
+    }
+    batch = iters * min_ms / MICRO_ROUNDS / 10;
+    if (0 == batch)
+    {
+        batch = 1;
+    }
+
+    g_allocs        = 0;
+    g_alloc_bytes   = 0;
+    for (round = 0; round < MICRO_ROUNDS; round++)
+    {
+        g_counting = 1;
+        begin = now_ns();
+        for (iters = 0; iters < batch; iters++)
+        {
+            op(corpus);
+        }
+        elapsed = now_ns() - begin;
+        g_counting = 0;
+
+        total += batch;
+        if ((0 == round) || ((double)elapsed / batch < best))
+        {
+            best = (double)elapsed / batch;
+        }
+    }
+
+    result->ns_per_op       = best;
+    result->allocs_per_op   = (double)g_allocs / total;
+    result->bytes_per_op    = (double)g_alloc_bytes / total;
+    g_results_cnt++;
+
+    printf("%-28s %12llu %12.1f %12.1f %12.1f\n", result->name, (unsigned long long)total,
+           result->ns_per_op, result->allocs_per_op, result->bytes_per_op);
+
+    return 0;
+}
+
+static int save_results(const char *path)
+{
+    FILE    *fp = NULL;
+    int     i   = 0;
+
+    fp = fopen(path, "w");
+    if (NULL == fp)
+    {
+        printf("open %s failed\n", path);
+        return -1;
+    }
+
+    for (i = 0; i < g_results_cnt; i++)
+    {
+        fprintf(fp, "%s %.1f %.2f %.1f\n", g_results[i].name, g_results[i].ns_per_op,
+                g_results[i].allocs_per_op, g_results[i].bytes_per_op);
+    }
+    fclose(fp);
+
+    return 0;
+}
+
+/* 与基线对比, 返回退化的用例数 */
+static int compare_results(const char *path, unsigned int tolerance)
+{
+    FILE            *fp         = NULL;
+    micro_result_t  base        = {{0}};
+    int             regressions = 0;
+    int             i           = 0;
+
+    fp = fopen(path, "r");
+    if (NULL == fp)
+    {
+        printf("open %s failed\n", path);
+        return -1;
+    }
+
+    printf("\n%-28s %12s %12s %8s %10s %10s\n", "vs baseline", "base ns", "ns/op", "delta", "allocs", "bytes");
+    while (4 == fscanf(fp, "%47s %lf %lf %lf", base.name, &base.ns_per_op, &base.allocs_per_op, &base.bytes_per_op))
+    {
+        for (i = 0; i < g_results_cnt; i++)
+        {
+            if (0 != strcmp(g_results[i].name, base.name))
+            {
+                continue;
+            }
+
+            printf("%-28s %12.1f %12.1f %+7.1f%% %+10.2f %+10.1f", base.name, base.ns_per_op, g_results[i].ns_per_op,
+                   (g_results[i].ns_per_op - base.ns_per_op) * 100 / base.ns_per_op,
+                   g_results[i].allocs_per_op - base.allocs_per_op, g_results[i].bytes_per_op - base.bytes_per_op);
+
+            /* 分配次数和字节数是确定的, 只要增加就算退化 */
+            if ((g_results[i].ns_per_op > base.ns_per_op * (100 + tolerance) / 100)
+                || (g_results[i].allocs_per_op > base.allocs_per_op + 0.01)
+                || (g_results[i].bytes_per_op > base.bytes_per_op + 0.5))
+            {
+                printf("  REGRESSION");
+                regressions++;
+            }
+            printf("\n");
+            break;
+        }
+    }
+    fclose(fp);
+
+    return regressions;
+}
+
+static void usage(void)
+{
+    printf("usage: ./microbench [-t $min_ms] [-f $filter] [-o $baseline] [-c $baseline [-r $tolerance]]\n"
+           "    -t running time of each case in ms, 500 for default\n"
+           "    -f only runs cases whose name contains the filter, e.g. decode or get100\n"
+           "    -o saves results to the baseline file\n"
+           "    -c compares with the baseline file, exits with 1 on regression\n"
+           "    -r tolerated slowdown in percent, 10 for default\n");
+}
+
+int main(int argc, char **argv)
+{
+    static leda_device_data_t small[3];
+    static leda_device_data_t get100[100];
+    static leda_device_data_t nested[4];
+    static leda_device_data_t text[1];
+    static leda_device_data_t bulk[32];
+
+    micro_corpus_t corpora[] =
+    {
+        {"small",   "setProperty",  small,  3},
+        {"get100",  "getProperty",  get100, 100},
+        {"nested",  "callService",  nested, 4},
+        {"text",    "setProperty",  text,   1},
+        {"bulk",    "setProperty",  bulk,   32},
+    };
+
+    leda_log_config_t log_cfg   = {0};
+    const char      *filter     = NULL;
+    const char      *save_path  = NULL;
+    const char      *base_path  = NULL;
+    unsigned int    min_ms      = 500;
+    unsigned int    tolerance   = 10;
+    char            key[MAX_PARAM_NAME_LENGTH]  = {0};
+    char            value[MAX_PARAM_VALUE_LENGTH] = {0};
+    int             failures    = 0;
+    int             opt         = 0;
+    int             i           = 0;
+    int             j           = 0;
+
+    while (-1 != (opt = getopt(argc, argv, "t:f:o:c:r:")))
+    {
+        switch (opt)
+        {
+            case 't':
+                min_ms = strtoul(optarg, NULL, 10);
+                break;
+            case 'f':
+                filter = optarg;
+                break;
+            case 'o':
+                save_path = optarg;
+                break;
+            case 'c':
+                base_path = optarg;
+                break;
+            case 'r':
+                tolerance = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                usage();
+                return -1;
+        }
+    }
+
+    if (0 == min_ms)
+    {
+        usage();
+        return -1;
+    }
+
+    /* 只打印错误日志 */
+    log_cfg.level = 3;
+    leda_set_log_config(&log_cfg);
+
+    set_data(&small[0], LEDA_TYPE_FLOAT, "temperature", "25.5");
+    set_data(&small[1], LEDA_TYPE_INT, "power", "1");
+    set_data(&small[2], LEDA_TYPE_TEXT, "mode", "auto");
+
+    for (i = 0; i < 100; i++)
+    {
+        snprintf(key, sizeof(key), "property_%02d", i);
+        switch (i % 4)
+        {
+            case 0:
+                snprintf(value, sizeof(value), "%d", i * 37);
+                set_data(&get100[i], LEDA_TYPE_INT, key, value);
+                break;
+            case 1:
+                snprintf(value, sizeof(value), "%.3f", i * 1.375);
+                set_data(&get100[i], LEDA_TYPE_DOUBLE, key, value);
+                break;
+            case 2:
+                set_data(&get100[i], LEDA_TYPE_BOOL, key, (i & 8) ? "1" : "0");
+                break;
+            default:
+                snprintf(value, sizeof(value), "status of %d", i);
+                set_data(&get100[i], LEDA_TYPE_TEXT, key, value);
+                break;
+        }
+    }
+
+    set_data(&nested[0], LEDA_TYPE_STRUCT, "config",
+             "{\"mode\":\"auto\",\"threshold\":{\"low\":-12.5,\"high\":85.25},\"enabled\":true,\"name\":\"line \\\"A\\\"\"}");
+    set_data(&nested[1], LEDA_TYPE_ARRAY, "samples",
+             "[1,2,3,5,8,13,21,34,55,89,144,233,377,610,987,1597,2584,4181,6765,10946]");
+    set_data(&nested[2], LEDA_TYPE_ARRAY, "points",
+             "[{\"x\":1.5,\"y\":-2.25},{\"x\":3.125,\"y\":4.0},{\"x\":-5.5,\"y\":6.75},{\"x\":7.0,\"y\":-8.875}]");
+    set_data(&nested[3], LEDA_TYPE_INT, "version", "3");
+
+    /* 接近MAX_PARAM_VALUE_LENGTH的文本, 含需要转义的字符 */
+    for (j = 0; j < MAX_PARAM_VALUE_LENGTH - 64; j++)
+    {
+        value[j] = (0 == j % 64) ? '"' : (0 == j % 97) ? '\n' : 'a' + j % 26;
+    }
+    value[j] = '\0';
+    set_data(&text[0], LEDA_TYPE_TEXT, "log", value);
+
+    /* 大消息: 32个接近最大长度的文本属性, 转义字符较少 */
+    for (i = 0; i < 32; i++)
+    {
+        for (j = 0; j < MAX_PARAM_VALUE_LENGTH - 64; j++)
+        {
+            value[j] = (0 == (i + j) % 509) ? '\\' : 'a' + (i + j) % 26;
+        }
+        value[j] = '\0';
+        snprintf(key, sizeof(key), "block_%02d", i);
+        set_data(&bulk[i], LEDA_TYPE_TEXT, key, value);
+    }
+
+    for (i = 0; i < (int)(sizeof(corpora) / sizeof(corpora[0])); i++)
+    {
+        corpora[i].request  = build_request(&corpora[i]);
+        corpora[i].tree     = build_report(&corpora[i]);
+        if ((NULL == corpora[i].request) || (NULL == corpora[i].tree))
+        {
+            printf("build corpus %s failed\n", corpora[i].name);
+            return -1;
+        }
+        if (0 != check_envelope(&corpora[i]))
+        {
+            printf("envelope of corpus %s differs from the message tree\n", corpora[i].name);
+            return -1;
+        }
+        if (0 != check_wire(&corpora[i]))
+        {
+            return -1;
+        }
+    }
+
+    printf("%-28s %12s %12s %12s %12s\n", "case", "iterations", "ns/op", "allocs/op", "bytes/op");
+    for (i = 0; i < (int)(sizeof(corpora) / sizeof(corpora[0])); i++)
+    {
+        failures += run_case("encode", op_encode, &corpora[i], min_ms, filter);
+        failures += run_case("decode", op_decode, &corpora[i], min_ms, filter);
+        failures += run_case("parse", op_parse, &corpora[i], min_ms, filter);
+        failures += run_case("print", op_print, &corpora[i], min_ms, filter);
+    }
+
+    for (i = 0; i < (int)(sizeof(corpora) / sizeof(corpora[0])); i++)
+    {
+        cJSON_free(corpora[i].request);
+        cJSON_Delete(corpora[i].tree);
+    }
+
+    if (0 != failures)
+    {
+        return 1;
+    }
+
+    if ((NULL != save_path) && (0 != save_results(save_path)))
+    {
+        return -1;
+    }
+
+    if ((NULL != base_path) && (0 != compare_results(base_path, tolerance)))
+    {
+        return 1;
+    }
+
+    return 0;
+}
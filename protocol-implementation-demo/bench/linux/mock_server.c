@@ -0,0 +1,881 @@
+/*
+ * Copyright (c) 2014-2019 Alibaba Group. All rights reserved.
+ * License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * 本地模拟的Link IoT Edge WebSocket驱动, 仅用于性能测试.
+ *
+ * 按protocol-design-description.md应答设备的上下线和上报, 支持JSON, CBOR和预置字典压缩三种子协议
+ * 以及批量消息. 设备上报名为benchDrive的事件时, 按事件参数向该设备发起getProperty, setProperty
+ * 或callService请求并统计应答时延, 结束后以名为benchResult的callService将结果发给设备.
+ * 收到无法按协商的子协议解码的帧时打印该帧并断开连接, 退出时返回非0, 以免编码错误只体现为计数.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libwebsockets.h"
+#include "cJSON.h"
+#include "cbor.h"
+#include "zdict.h"
+#include "mem.h"
+
+#define MOCK_PROTOCOL           "alibaba-iot-linkedge-protocol"
+#define MOCK_PROTOCOL_CBOR      "alibaba-iot-linkedge-protocol-cbor"
+#define MOCK_PROTOCOL_ZDICT     "alibaba-iot-linkedge-protocol-zdict1"
+
+#define MOCK_ENCODING_JSON      0
+#define MOCK_ENCODING_CBOR      1
+#define MOCK_ENCODING_ZDICT     2
+
+#define MOCK_MAX_INFLATE        (4 * 1024 * 1024)
+#define MOCK_DRIVE_MAX          1000000
+#define MOCK_DRIVE_WINDOW       64
+#define MOCK_DRIVE_TIMEOUT_US   (10 * 1000000)
+
+typedef struct mock_frame
+{
+    struct mock_frame   *next;
+    size_t              len;
+    int                 binary;
+    unsigned char       data[];         /* 前LWS_PRE字节留给libwebsockets */
+} mock_frame_t;
+
+typedef struct mock_drive
+{
+    int             active;
+    char            method[16];
+    char            pk[64];
+    char            dn[64];
+
+    unsigned int    total;
+    unsigned int    window;
+    unsigned int    sent;
+    unsigned int    done;
+    unsigned int    errors;
+    unsigned int    base_id;            /* 第一条请求的messageId */
+
+    uint64_t        interval_us;        /* 0表示只受窗口限制 */
+    uint64_t        next_us;
+    uint64_t        begin_us;
+    uint64_t        progress_us;
+
+    uint64_t        *sent_us;           /* 按messageId - base_id索引 */
+    uint32_t        *latency;
+} mock_drive_t;
+
+typedef struct mock_session
+{
+    struct lws          *wsi;
+    int                 encoding;
+
+    char                *rx;
+    size_t              rx_len;
+
+    mock_frame_t        *tx_head;
+    mock_frame_t        *tx_tail;
+
+    unsigned int        next_id;
+    mock_drive_t        drive;
+
+    struct mock_session *next;
+} mock_session_t;
+
+typedef struct mock_stats
+{
+    unsigned long long  frames_in;
+    unsigned long long  frames_out;
+    unsigned long long  requests;
+    unsigned long long  batches;
+    unsigned long long  online;
+    unsigned long long  offline;
+    unsigned long long  reports;
+    unsigned long long  events;
+    unsigned long long  invalid;
+    unsigned long long  undecodable;    /* 无法按子协议解码的帧 */
+} mock_stats_t;
+
+static volatile int     g_is_running    = 1;
+static mock_session_t   *g_sessions     = NULL;
+static mock_stats_t     g_stats         = {0};
+
+static uint64_t now_us(void)
+{
+    struct timespec ts = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static uint32_t percentile(const uint32_t *sorted, unsigned int count, double p)
+{
+    unsigned int idx = 0;
+
+    if (0 == count)
+    {
+        return 0;
+    }
+
+    idx = (unsigned int)(p * (count - 1) + 0.5);
+    return sorted[idx];
+}
+
+static void session_queue(mock_session_t *session, const char *data, size_t len, int binary)
+{
+    mock_frame_t *frame = NULL;
+
+    frame = malloc(sizeof(mock_frame_t) + LWS_PRE + len);
+    if (NULL == frame)
+    {
+        printf("no memory can allocate\n");
+        return;
+    }
+
+    frame->next     = NULL;
+    frame->len      = len;
+    frame->binary   = binary;
+    memcpy(frame->data + LWS_PRE, data, len);
+
+    if (NULL == session->tx_tail)
+    {
+        session->tx_head = frame;
+    }
+    else
+    {
+        session->tx_tail->next = frame;
+    }
+    session->tx_tail = frame;
+
+    lws_callback_on_writable(session->wsi);
+}
+
+/* 按会话协商的编码发送, root由调用方释放 */
+static void session_send(mock_session_t *session, const cJSON *root)
+{
+    char    *text   = NULL;
+    char    *data   = NULL;
+    size_t  len     = 0;
+    size_t  size    = 0;
+
+    if (MOCK_ENCODING_CBOR == session->encoding)
+    {
+        data = cbor_encode(root, &len);
+        if (NULL != data)
+        {
+            session_queue(session, data, len, 1);
+            cJSON_free(data);
+        }
+        return;
+    }
+
+    text = cJSON_PrintUnformatted(root);
+    if (NULL == text)
+    {
+        return;
+    }
+    len = strlen(text);
+
+    if (MOCK_ENCODING_ZDICT == session->encoding)
+    {
+        size = zdict_bound(len);
+        data = malloc(size);
+        if ((NULL != data) && (0 == zdict_compress(text, len, data, &size)))
+        {
+            session_queue(session, data, size, 1);
+        }
+        free(data);
+    }
+    else
+    {
+        session_queue(session, text, len, 0);
+    }
+
+    cJSON_free(text);
+}
+
+static cJSON *make_reply(int msg_id, int code)
+{
+    cJSON *reply = cJSON_CreateObject();
+
+    if (NULL != reply)
+    {
+        cJSON_AddNumberToObject(reply, "code", code);
+        cJSON_AddStringToObject(reply, "message", (0 == code) ? "Success" : "Failure");
+        cJSON_AddNumberToObject(reply, "messageId", msg_id);
+        cJSON_AddItemToObject(reply, "payload", cJSON_CreateObject());
+    }
+
+    return reply;
+}
+
+static cJSON *make_param(const char *identifier, const char *type, double value)
+{
+    cJSON *param = cJSON_CreateObject();
+
+    if (NULL != param)
+    {
+        cJSON_AddStringToObject(param, "identifier", identifier);
+        cJSON_AddStringToObject(param, "type", type);
+        cJSON_AddNumberToObject(param, "value", value);
+    }
+
+    return param;
+}
+
+static cJSON *make_request(mock_session_t *session, const char *method, const char *pk, const char *dn, unsigned int *msg_id)
+{
+    cJSON *root     = cJSON_CreateObject();
+    cJSON *payload  = cJSON_CreateObject();
+
+    if ((NULL == root) || (NULL == payload))
+    {
+        cJSON_Delete(root);
+        cJSON_Delete(payload);
+        return NULL;
+    }
+
+    *msg_id = ++session->next_id;
+
+    cJSON_AddStringToObject(root, "version", "1.0");
+    cJSON_AddStringToObject(root, "method", method);
+    cJSON_AddNumberToObject(root, "messageId", *msg_id);
+    cJSON_AddStringToObject(payload, "productKey", pk);
+    cJSON_AddStringToObject(payload, "deviceName", dn);
+    cJSON_AddItemToObject(root, "payload", payload);
+
+    return root;
+}
+
+static void drive_send_one(mock_session_t *session)
+{
+    mock_drive_t    *drive      = &session->drive;
+    cJSON           *root       = NULL;
+    cJSON           *payload    = NULL;
+    cJSON           *list       = NULL;
+    unsigned int    msg_id      = 0;
+
+    root = make_request(session, drive->method, drive->pk, drive->dn, &msg_id);
+    if (NULL == root)
+    {
+        return;
+    }
+    payload = cJSON_GetObjectItem(root, "payload");
+
+    list = cJSON_CreateArray();
+    if (0 == strcmp(drive->method, "getProperty"))
+    {
+        cJSON_AddItemToArray(list, cJSON_CreateString("temperature"));
+        cJSON_AddItemToArray(list, cJSON_CreateString("humidity"));
+        cJSON_AddItemToObject(payload, "properties", list);
+    }
+    else if (0 == strcmp(drive->method, "setProperty"))
+    {
+        cJSON_AddItemToArray(list, make_param("temperature", "int", drive->sent % 100));
+        cJSON_AddItemToObject(payload, "properties", list);
+    }
+    else
+    {
+        cJSON_AddStringToObject(payload, "identifier", "bench");
+        cJSON_AddItemToArray(list, make_param("seq", "int", drive->sent));
+        cJSON_AddItemToObject(payload, "inputData", list);
+    }
+
+    if (0 == drive->sent)
+    {
+        drive->base_id = msg_id;
+    }
+    drive->sent_us[msg_id - drive->base_id] = now_us();
+    drive->sent++;
+
+    session_send(session, root);
+    cJSON_Delete(root);
+}
+
+static void drive_free(mock_drive_t *drive)
+{
+    free(drive->sent_us);
+    free(drive->latency);
+    memset(drive, 0, sizeof(mock_drive_t));
+}
+
+static void drive_finish(mock_session_t *session)
+{
+    mock_drive_t    *drive      = &session->drive;
+    cJSON           *root       = NULL;
+    cJSON           *payload    = NULL;
+    cJSON           *input      = NULL;
+    cJSON           *method     = NULL;
+    unsigned int    msg_id      = 0;
+    uint64_t        elapsed     = drive->progress_us - drive->begin_us;
+
+    qsort(drive->latency, drive->done, sizeof(uint32_t), cmp_u32);
+    drive->errors += drive->total - drive->done;
+
+    printf("%s %s:%s count %u errors %u elapsed %llu us p50 %u us p99 %u us p999 %u us\n",
+           drive->method, drive->pk, drive->dn, drive->total, drive->errors, (unsigned long long)elapsed,
+           percentile(drive->latency, drive->done, 0.5), percentile(drive->latency, drive->done, 0.99),
+           percentile(drive->latency, drive->done, 0.999));
+
+    root = make_request(session, "callService", drive->pk, drive->dn, &msg_id);
+    if (NULL != root)
+    {
+        payload = cJSON_GetObjectItem(root, "payload");
+        cJSON_AddStringToObject(payload, "identifier", "benchResult");
+
+        input = cJSON_CreateArray();
+        method = cJSON_CreateObject();
+        cJSON_AddStringToObject(method, "identifier", "method");
+        cJSON_AddStringToObject(method, "type", "text");
+        cJSON_AddStringToObject(method, "value", drive->method);
+        cJSON_AddItemToArray(input, method);
+        cJSON_AddItemToArray(input, make_param("count", "int", drive->total));
+        cJSON_AddItemToArray(input, make_param("errors", "int", drive->errors));
+        cJSON_AddItemToArray(input, make_param("elapsed_us", "double", (double)elapsed));
+        cJSON_AddItemToArray(input, make_param("p50_us", "int", percentile(drive->latency, drive->done, 0.5)));
+        cJSON_AddItemToArray(input, make_param("p99_us", "int", percentile(drive->latency, drive->done, 0.99)));
+        cJSON_AddItemToArray(input, make_param("p999_us", "int", percentile(drive->latency, drive->done, 0.999)));
+        cJSON_AddItemToArray(input, make_param("max_us", "int", (0 != drive->done) ? drive->latency[drive->done - 1] : 0));
+        cJSON_AddItemToObject(payload, "inputData", input);
+
+        session_send(session, root);
+        cJSON_Delete(root);
+    }
+
+    drive_free(drive);
+}
+
+/* benchDrive事件的参数: method(text), count(int), rate(int, 每秒请求数, 0不限), window(int, 在途请求上限) */
+static void drive_start(mock_session_t *session, const char *pk, const char *dn, const cJSON *params)
+{
+    mock_drive_t    *drive  = &session->drive;
+    const cJSON     *item   = NULL;
+    const cJSON     *id     = NULL;
+    const cJSON     *value  = NULL;
+    const char      *method = "getProperty";
+    int             count   = 1000;
+    int             rate    = 0;
+    int             window  = MOCK_DRIVE_WINDOW;
+
+    if (drive->active)
+    {
+        printf("drive of %s:%s is already running\n", drive->pk, drive->dn);
+        return;
+    }
+
+    for (item = (NULL != params) ? params->child : NULL; NULL != item; item = item->next)
+    {
+        id = cJSON_GetObjectItem(item, "identifier");
+        value = cJSON_GetObjectItem(item, "value");
+        if ((NULL == id) || (cJSON_String != id->type) || (NULL == value))
+        {
+            continue;
+        }
+
+        if ((0 == strcmp(id->valuestring, "method")) && (cJSON_String == value->type))
+        {
+            method = value->valuestring;
+        }
+        else if (0 == strcmp(id->valuestring, "count"))
+        {
+            count = (cJSON_String == value->type) ? atoi(value->valuestring) : value->valueint;
+        }
+        else if (0 == strcmp(id->valuestring, "rate"))
+        {
+            rate = (cJSON_String == value->type) ? atoi(value->valuestring) : value->valueint;
+        }
+        else if (0 == strcmp(id->valuestring, "window"))
+        {
+            window = (cJSON_String == value->type) ? atoi(value->valuestring) : value->valueint;
+        }
+    }
+
+    if ((0 != strcmp(method, "getProperty")) && (0 != strcmp(method, "setProperty")) && (0 != strcmp(method, "callService")))
+    {
+        printf("drive method: %s is not supported\n", method);
+        return;
+    }
+    if ((count <= 0) || (count > MOCK_DRIVE_MAX) || (rate < 0) || (window <= 0))
+    {
+        printf("drive count: %d should be in [1, %d], rate: %d and window: %d positive\n", count, MOCK_DRIVE_MAX, rate, window);
+        return;
+    }
+
+    memset(drive, 0, sizeof(mock_drive_t));
+    drive->sent_us = calloc(count, sizeof(uint64_t));
+    drive->latency = calloc(count, sizeof(uint32_t));
+    if ((NULL == drive->sent_us) || (NULL == drive->latency))
+    {
+        printf("no memory can allocate\n");
+        drive_free(drive);
+        return;
+    }
+
+    snprintf(drive->method, sizeof(drive->method), "%s", method);
+    snprintf(drive->pk, sizeof(drive->pk), "%s", pk);
+    snprintf(drive->dn, sizeof(drive->dn), "%s", dn);
+    drive->total        = count;
+    drive->window       = window;
+    drive->interval_us  = (0 != rate) ? 1000000 / rate : 0;
+    drive->begin_us     = now_us();
+    drive->next_us      = drive->begin_us;
+    drive->progress_us  = drive->begin_us;
+    drive->active       = 1;
+}
+
+static void drive_reply(mock_session_t *session, unsigned int msg_id, int code)
+{
+    mock_drive_t    *drive  = &session->drive;
+    unsigned int    idx     = msg_id - drive->base_id;
+    uint64_t        now     = 0;
+
+    if (!drive->active || (0 == drive->sent) || (idx >= drive->sent) || (0 == drive->sent_us[idx]))
+    {
+        return;
+    }
+
+    now = now_us();
+    drive->latency[drive->done++] = (uint32_t)(now - drive->sent_us[idx]);
+    drive->sent_us[idx] = 0;
+    drive->progress_us = now;
+    if (0 != code)
+    {
+        drive->errors++;
+    }
+}
+
+static void drive_tick(mock_session_t *session)
+{
+    mock_drive_t    *drive  = &session->drive;
+    uint64_t        now     = 0;
+
+    if (!drive->active)
+    {
+        return;
+    }
+
+    now = now_us();
+    while ((drive->sent < drive->total) && (drive->sent - drive->done < drive->window)
+           && ((0 == drive->interval_us) || (now >= drive->next_us)))
+    {
+        drive_send_one(session);
+        drive->next_us += drive->interval_us;
+    }
+
+    if ((drive->done == drive->total) || (now - drive->progress_us > MOCK_DRIVE_TIMEOUT_US))
+    {
+        drive_finish(session);
+    }
+}
+
+/* 处理一条消息, 需要应答时返回应答 */
+static cJSON *handle_msg(mock_session_t *session, const cJSON *msg)
+{
+    const cJSON *id         = cJSON_GetObjectItem(msg, "messageId");
+    const cJSON *method     = cJSON_GetObjectItem(msg, "method");
+    const cJSON *code       = cJSON_GetObjectItem(msg, "code");
+    const cJSON *payload    = cJSON_GetObjectItem(msg, "payload");
+    const cJSON *pk         = cJSON_GetObjectItem(payload, "productKey");
+    const cJSON *dn         = cJSON_GetObjectItem(payload, "deviceName");
+    const cJSON *event      = NULL;
+
+    if ((NULL == id) || (cJSON_Number != id->type))
+    {
+        g_stats.invalid++;
+        return NULL;
+    }
+
+    if (NULL != code)
+    {
+        drive_reply(session, (unsigned int)id->valueint, (cJSON_Number == code->type) ? code->valueint : -1);
+        return NULL;
+    }
+
+    if ((NULL == method) || (cJSON_String != method->type))
+    {
+        g_stats.invalid++;
+        return make_reply(id->valueint, 109007);
+    }
+
+    g_stats.requests++;
+    if (0 == strcmp(method->valuestring, "onlineDevice"))
+    {
+        g_stats.online++;
+    }
+    else if (0 == strcmp(method->valuestring, "offlineDevice"))
+    {
+        g_stats.offline++;
+    }
+    else if (0 == strcmp(method->valuestring, "reportProperty"))
+    {
+        g_stats.reports++;
+    }
+    else if (0 == strcmp(method->valuestring, "reportEvent"))
+    {
+        g_stats.events++;
+        event = cJSON_GetObjectItem(payload, "identifier");
+        if ((NULL != event) && (cJSON_String == event->type) && (0 == strcmp(event->valuestring, "benchDrive"))
+            && (NULL != pk) && (cJSON_String == pk->type) && (NULL != dn) && (cJSON_String == dn->type))
+        {
+            drive_start(session, pk->valuestring, dn->valuestring, cJSON_GetObjectItem(payload, "outputData"));
+        }
+    }
+    else
+    {
+        return make_reply(id->valueint, 100000);
+    }
+
+    return make_reply(id->valueint, 0);
+}
+
+static const char *encoding_name(int encoding)
+{
+    return (MOCK_ENCODING_CBOR == encoding) ? "cbor" : ((MOCK_ENCODING_ZDICT == encoding) ? "zdict" : "json");
+}
+
+/* 打印无法解码的帧, 末尾字节通常能说明问题(如多余的'\0') */
+static void dump_frame(const mock_session_t *session, const char *data, size_t len, int binary)
+{
+    size_t i = 0;
+
+    printf("undecodable %s frame of %zu bytes on %s session:", binary ? "binary" : "text", len,
+           encoding_name(session->encoding));
+    for (i = 0; (i < len) && (i < 16); i++)
+    {
+        printf(" %02x", (unsigned char)data[i]);
+    }
+    if (len > 32)
+    {
+        printf(" ...");
+    }
+    for (i = (len > 32) ? len - 16 : 16; i < len; i++)
+    {
+        printf(" %02x", (unsigned char)data[i]);
+    }
+    printf("\n");
+}
+
+/* 帧无法解码时返回-1 */
+static int handle_frame(mock_session_t *session, const char *data, size_t len, int binary)
+{
+    cJSON   *root       = NULL;
+    cJSON   *item       = NULL;
+    cJSON   *reply      = NULL;
+    cJSON   *replies    = NULL;
+    char    *text       = NULL;
+    size_t  text_len    = 0;
+
+    g_stats.frames_in++;
+
+    if (!binary)
+    {
+        root = cJSON_Parse(data);
+    }
+    else if (MOCK_ENCODING_ZDICT == session->encoding)
+    {
+        text = zdict_decompress(data, len, MOCK_MAX_INFLATE, &text_len);
+        root = (NULL != text) ? cJSON_Parse(text) : NULL;
+        mem_free(text);
+    }
+    else
+    {
+        root = cbor_decode(data, len);
+    }
+
+    if (NULL == root)
+    {
+        g_stats.undecodable++;
+        dump_frame(session, data, len, binary);
+        return -1;
+    }
+
+    if (cJSON_Array != root->type)
+    {
+        reply = handle_msg(session, root);
+        if (NULL != reply)
+        {
+            session_send(session, reply);
+            cJSON_Delete(reply);
+        }
+        cJSON_Delete(root);
+        return 0;
+    }
+
+    /* 批量消息的应答也合并为一条 */
+    g_stats.batches++;
+    replies = cJSON_CreateArray();
+    for (item = root->child; NULL != item; item = item->next)
+    {
+        reply = handle_msg(session, item);
+        if ((NULL != reply) && (NULL != replies))
+        {
+            cJSON_AddItemToArray(replies, reply);
+        }
+        else
+        {
+            cJSON_Delete(reply);
+        }
+    }
+
+    if ((NULL != replies) && (NULL != replies->child))
+    {
+        session_send(session, (NULL == replies->child->next) ? replies->child : replies);
+    }
+    cJSON_Delete(replies);
+    cJSON_Delete(root);
+
+    return 0;
+}
+
+static void session_close(mock_session_t *session)
+{
+    mock_session_t  **pp    = &g_sessions;
+    mock_frame_t    *frame  = NULL;
+
+    while (NULL != *pp)
+    {
+        if (*pp == session)
+        {
+            *pp = session->next;
+            break;
+        }
+        pp = &(*pp)->next;
+    }
+
+    while (NULL != session->tx_head)
+    {
+        frame = session->tx_head;
+        session->tx_head = frame->next;
+        free(frame);
+    }
+    session->tx_tail = NULL;
+
+    free(session->rx);
+    session->rx = NULL;
+    session->rx_len = 0;
+
+    drive_free(&session->drive);
+}
+
+static int callback_mock(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len)
+{
+    mock_session_t  *session    = (mock_session_t *)user;
+    mock_frame_t    *frame      = NULL;
+    char            *tmp        = NULL;
+
+    switch (reason)
+    {
+        case LWS_CALLBACK_ESTABLISHED:
+            memset(session, 0, sizeof(mock_session_t));
+            session->wsi        = wsi;
+            session->encoding   = (int)lws_get_protocol(wsi)->id;
+            session->next       = g_sessions;
+            g_sessions          = session;
+            printf("device connected, protocol: %s\n", lws_get_protocol(wsi)->name);
+            break;
+
+        case LWS_CALLBACK_RECEIVE:
+            tmp = realloc(session->rx, session->rx_len + len + 1);
+            if (NULL == tmp)
+            {
+                return -1;
+            }
+            memcpy(tmp + session->rx_len, in, len);
+            session->rx = tmp;
+            session->rx_len += len;
+            session->rx[session->rx_len] = '\0';
+
+            if (lws_is_final_fragment(wsi) && (0 == lws_remaining_packet_payload(wsi)))
+            {
+                if (0 != handle_frame(session, session->rx, session->rx_len, lws_frame_is_binary(wsi)))
+                {
+                    lws_close_reason(wsi, LWS_CLOSE_STATUS_INVALID_PAYLOAD, (unsigned char *)"undecodable frame", 17);
+                    return -1;
+                }
+                session->rx_len = 0;
+            }
+            break;
+
+        case LWS_CALLBACK_SERVER_WRITEABLE:
+            frame = session->tx_head;
+            if (NULL == frame)
+            {
+                break;
+            }
+
+            session->tx_head = frame->next;
+            if (NULL == session->tx_head)
+            {
+                session->tx_tail = NULL;
+            }
+
+            if (lws_write(wsi, frame->data + LWS_PRE, frame->len, frame->binary ? LWS_WRITE_BINARY : LWS_WRITE_TEXT) < (int)frame->len)
+            {
+                free(frame);
+                return -1;
+            }
+            free(frame);
+            g_stats.frames_out++;
+
+            if (NULL != session->tx_head)
+            {
+                lws_callback_on_writable(wsi);
+            }
+            break;
+
+        case LWS_CALLBACK_CLOSED:
+            printf("device disconnected\n");
+            session_close(session);
+            break;
+
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+static struct lws_protocols g_protocols[] =
+{
+    { MOCK_PROTOCOL, callback_mock, sizeof(mock_session_t), 65536, MOCK_ENCODING_JSON, NULL, 0 },
+    { MOCK_PROTOCOL_CBOR, callback_mock, sizeof(mock_session_t), 65536, MOCK_ENCODING_CBOR, NULL, 0 },
+    { MOCK_PROTOCOL_ZDICT, callback_mock, sizeof(mock_session_t), 65536, MOCK_ENCODING_ZDICT, NULL, 0 },
+    { NULL, NULL, 0, 0, 0, NULL, 0 }
+};
+
+static const struct lws_extension g_exts[] =
+{
+    { "permessage-deflate", lws_extension_callback_pm_deflate, "permessage-deflate" },
+    { NULL, NULL, NULL }
+};
+
+static void sigint_handler(int sig)
+{
+    g_is_running = 0;
+}
+
+static void usage(void)
+{
+    printf("usage: ./mock_server [-p $port] [-c $cert_path -k $key_path] [-D]\n"
+           "    -p listen port, 8000 for default\n"
+           "    -c -k server certificate and private key, enables wss\n"
+           "    -D refuses permessage-deflate\n");
+}
+
+int main(int argc, char **argv)
+{
+    struct lws_context_creation_info    info        = {0};
+    struct lws_context                  *context    = NULL;
+    struct sigaction                    sig_int     = {0};
+    mock_session_t                      *session    = NULL;
+    const char                          *cert_path  = NULL;
+    const char                          *key_path   = NULL;
+    int                                 port        = 8000;
+    int                                 deflate     = 1;
+    int                                 busy        = 0;
+    int                                 opt         = 0;
+
+    while (-1 != (opt = getopt(argc, argv, "p:c:k:D")))
+    {
+        switch (opt)
+        {
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'c':
+                cert_path = optarg;
+                break;
+            case 'k':
+                key_path = optarg;
+                break;
+            case 'D':
+                deflate = 0;
+                break;
+            default:
+                usage();
+                return -1;
+        }
+    }
+
+    if ((NULL == cert_path) != (NULL == key_path))
+    {
+        usage();
+        return -1;
+    }
+
+    sigemptyset(&sig_int.sa_mask);
+    sig_int.sa_handler = sigint_handler;
+    sigaction(SIGINT, &sig_int, NULL);
+    sigaction(SIGTERM, &sig_int, NULL);
+
+    lws_set_log_level(LLL_ERR | LLL_WARN, NULL);
+
+    info.port       = port;
+    info.protocols  = g_protocols;
+    info.extensions = deflate ? g_exts : NULL;
+    info.gid        = -1;
+    info.uid        = -1;
+    if (NULL != cert_path)
+    {
+        info.options                    |= LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
+        info.ssl_cert_filepath          = cert_path;
+        info.ssl_private_key_filepath   = key_path;
+    }
+
+    context = lws_create_context(&info);
+    if (NULL == context)
+    {
+        printf("create server context failed\n");
+        return -1;
+    }
+    printf("mock server listening on %s://0.0.0.0:%d\n", (NULL != cert_path) ? "wss" : "ws", port);
+
+    while (g_is_running)
+    {
+        /* 有请求待发时缩短poll等待, 以免限制发送速率 */
+        lws_service(context, busy ? 1 : 50);
+
+        busy = 0;
+        for (session = g_sessions; NULL != session; session = session->next)
+        {
+            drive_tick(session);
+            busy |= session->drive.active;
+        }
+    }
+
+    lws_context_destroy(context);
+
+    printf("frames in %llu out %llu, requests %llu in %llu batches, online %llu offline %llu reports %llu events %llu invalid %llu"
+           " undecodable %llu\n",
+           g_stats.frames_in, g_stats.frames_out, g_stats.requests, g_stats.batches, g_stats.online, g_stats.offline,
+           g_stats.reports, g_stats.events, g_stats.invalid, g_stats.undecodable);
+
+    return (0 != g_stats.undecodable) ? 1 : 0;
+}
@@ -0,0 +1,40 @@
+#! /bin/bash
+
+if [ "$1" == "-h" ] || [ "$1" == "--help" ]; then
+	echo -e "usage: ./start_bench.sh [bench options]\n"\
+			"    runs mock_server and bench on ws:// and wss:// loopback, options are passed to bench,\n"\
+			"    e.g. ./start_bench.sh -n 100 -m 200000 -e cbor -b"
+    exit
+fi
+
+export LD_LIBRARY_PATH=../../build/lib/:../../sdk/export/lib/:$LD_LIBRARY_PATH
+
+CERT_DIR=./bench_cert
+WS_PORT=18000
+WSS_PORT=18443
+
+if [ ! -f $CERT_DIR/server.cer ]; then
+    mkdir -p $CERT_DIR
+    openssl req -x509 -newkey rsa:2048 -nodes -days 365 -subj "/CN=127.0.0.1" \
+        -keyout $CERT_DIR/server.key -out $CERT_DIR/server.cer > /dev/null 2>&1 || exit 1
+fi
+
+./mock_server -p $WS_PORT > mock_server_ws.log &
+WS_PID=$!
+./mock_server -p $WSS_PORT -c $CERT_DIR/server.cer -k $CERT_DIR/server.key > mock_server_wss.log &
+WSS_PID=$!
+sleep 1
+
+./bench -p $WS_PORT "$@"
+WS_RET=$?
+echo
+./bench -p $WSS_PORT -t -a $CERT_DIR/server.cer "$@"
+WSS_RET=$?
+
+kill -INT $WS_PID $WSS_PID
+wait $WS_PID || WS_RET=1
+wait $WSS_PID || WSS_RET=1
+
+# mock_server reports undecodable frames in its log and exit code
+grep -h undecodable mock_server_ws.log mock_server_wss.log
+[ $WS_RET -eq 0 ] && [ $WSS_RET -eq 0 ]
@@ -35,6 +35,7 @@ typedef struct device
     char    pk[16];
     char    dn[32];
 
+    int     handle;
     int     online;
 
     int     power;
@@ -53,57 +54,68 @@ int             g_devices_count     = 0;
 int             g_is_connected      = 0;
 int             g_is_running        = 1;
 
-int get_device_index(const char *pk, const char *dn)
+static device_t *get_device(const char *pk, const char *dn)
 {
-    int i = 0;
+    device_t *dev = NULL;
 
-    for (i = 0; i < g_devices_count; i++)
+    if (LE_SUCCESS != leda_get_device_handle(pk, dn, NULL, (void **)&dev))
     {
-        if (strcmp(g_devices[i].dn, dn) == 0)
-        {
-            return i;
-        }
+        return NULL;
     }
+
+    return dev;
 }
 
 int set_led_power(const char *pk, const char *dn, int state)
 {
-    int index = 0;
+    device_t *dev = NULL;
 
     if (0 != state && 1 != state)
     {
         return LE_ERROR_PARAM_RANGE_OVERFLOW;
     }
 
-    index = get_device_index(pk, dn);
-    g_devices[index].power = state;
+    dev = get_device(pk, dn);
+    if (NULL == dev)
+    {
+        return LEDA_ERROR_DEVICE_UNREGISTER;
+    }
+    dev->power = state;
     return LE_SUCCESS;
 }
 
 int get_led_power(const char *pk, const char *dn)
 {
-    int index;
-    index = get_device_index(pk, dn);
-    return g_devices[index].power;
+    device_t *dev = NULL;
+
+    dev = get_device(pk, dn);
+    return (NULL != dev) ? dev->power : 0;
 }
 
 int set_led_brightness(const char *pk, const char *dn, int level)
 {
-    int index = 0;
+    device_t *dev = NULL;
+
     if (level < 0 || level > 5)
     {
         return LE_ERROR_PARAM_RANGE_OVERFLOW;
     }
-    index = get_device_index(pk, dn);
-    g_devices[index].brightness = level;
+
+    dev = get_device(pk, dn);
+    if (NULL == dev)
+    {
+        return LEDA_ERROR_DEVICE_UNREGISTER;
+    }
+    dev->brightness = level;
     return LE_SUCCESS;
 }
 
 int get_led_brightness(const char *pk, const char *dn)
 {
-    int index = 0;
-    index = get_device_index(pk, dn);
-    return g_devices[index].brightness;
+    device_t *dev = NULL;
+
+    dev = get_device(pk, dn);
+    return (NULL != dev) ? dev->brightness : 0;
 }
 
 static int cb_get_property(const char *pk, const char *dn,
@@ -199,47 +211,43 @@ static void cb_state_changed(leda_conn_state_e state, void *usr)
     return;
 }
 
-static int g_online_dev_num = 0;
+static void cb_device_restored(const char *pk, const char *dn, int code, void *usr)
+{
+    printf("restore device(%s:%s) %s\n", pk, dn, (LE_SUCCESS == code) ? "success" : "failed");
+}
 
 void *thread_online(void *arg)
 {
-    int count = 0, i =0, ret = LE_SUCCESS;
-    char *pk = NULL, *dn = NULL;
+    int i = 0, online = 0, online_num = 0, ret = LE_SUCCESS;
+    leda_restore_stats_t stats = {0};
 
     pthread_detach(pthread_self());
 
-    count = g_devices_count;
+    /* 首次上线及恢复失败的设备在这里上线, 重连后的批量恢复由SDK完成 */
     while (g_is_running)
     {
-        pthread_mutex_lock(&g_conn_state_locker);
-        for (i = 0; i < count; i++)
+        leda_get_restore_stats(&stats);
+
+        online_num = 0;
+        for (i = 0; i < g_devices_count; i++)
         {
-            if (g_is_connected)
-            {
-                if (!g_devices[i].online)
-                {
-                    ret = leda_online(g_devices[i].pk, g_devices[i].dn);
-                    if (LE_SUCCESS == ret)
-                    {
-                        g_devices[i].online = 1;
-                        g_online_dev_num += 1;
-                        printf("online device(%s:%s) success\n", g_devices[i].pk, g_devices[i].dn);
-                    }
-                }
-            }
-            else
+            online = 0;
+            leda_get_device_online(g_devices[i].handle, &online);
+            if (!online && g_is_connected && !stats.in_progress)
             {
-                if (g_devices[i].online)
+                ret = leda_online_by_handle(g_devices[i].handle);
+                if (LE_SUCCESS == ret)
                 {
-                    g_devices[i].online = 0;
-                    g_online_dev_num -= 1;
-                    printf("online device(%s:%s) failed, will try online again\n", g_devices[i].pk, g_devices[i].dn);
+                    online = 1;
+                    printf("online device(%s:%s) success\n", g_devices[i].pk, g_devices[i].dn);
                 }
             }
+
+            g_devices[i].online = online;
+            online_num += online;
         }
 
-        printf("current online device number is %d\n", g_online_dev_num);
-        pthread_mutex_unlock(&g_conn_state_locker);
+        printf("current online device number is %d, last restore cost %u ms\n", online_num, stats.last_restore_ms);
         sleep(5);
     }
 }
@@ -275,8 +283,8 @@ void *thread_report(void *arg)
             {
                 snprintf(property[0].value, MAX_PARAM_VALUE_LENGTH, "%d", get_led_brightness(pk, dn));
                 snprintf(property[1].value, MAX_PARAM_VALUE_LENGTH, "%d", get_led_power(pk, dn));
-                ret = leda_report_properties(pk, dn, property, 2, NULL);
-                ret |= leda_report_event(pk, dn, "ledBroken", NULL, 0, NULL);
+                ret = leda_report_properties_by_handle(g_devices[i].handle, property, 2, NULL);
+                ret |= leda_report_event_by_handle(g_devices[i].handle, "ledBroken", NULL, 0, NULL);
             }
             usleep(10 * 1000000 / count);
         }
@@ -358,6 +366,7 @@ int main(int argc, char **argv)
 {
     struct sigaction sig_int = {0};
     leda_conn_info_t conn    = {0};
+    leda_restore_policy_t restore = {0};
     char   *triad_path       = "./triad.csv";
 
     char ca_path[PATH_MAX]   = {0};
@@ -412,6 +421,14 @@ int main(int argc, char **argv)
     conn.conn_devices_cb.call_service_cb = cb_call_service;
     conn.conn_devices_cb.usr_data_call_service = NULL;
     conn.conn_devices_cb.service_output_max_count = 0;
+
+    restore.enable = 1;
+    restore.window = 8;
+    restore.rate = 100;
+    restore.restore_cb = cb_device_restored;
+    restore.usr_data = NULL;
+    leda_set_restore_policy(&restore);
+
     while (leda_init(&conn) != LE_SUCCESS)
     {
         leda_exit();
@@ -419,6 +436,15 @@ int main(int argc, char **argv)
         continue;
     }
 
+    for (i = 0; i < g_devices_count; i++)
+    {
+        if (LE_SUCCESS != leda_register_device(g_devices[i].pk, g_devices[i].dn, &g_devices[i], &g_devices[i].handle))
+        {
+            printf("register device(%s:%s) failed\n", g_devices[i].pk, g_devices[i].dn);
+            goto end;
+        }
+    }
+
     if (0 != pthread_create(&g_thread_online, NULL, thread_online, NULL))
     {
         goto end;
@@ -439,7 +465,7 @@ end:
     {
         if (g_is_connected && g_devices[i].online)
         {
-            if (leda_offline(g_devices[i].pk, g_devices[i].dn) == LE_SUCCESS)
+            if (leda_offline_by_handle(g_devices[i].handle) == LE_SUCCESS)
             {
                 g_devices[i].online = 0;
             }
@@ -65,6 +65,7 @@ extern "C"
 #define    LEDA_ERROR_TRANSLATION                   109015         /* 转换错误*/
 #define    LEDA_ERROR_DECODE                        109016         /* 解码错误*/
 #define    LEDA_ERROR_ENCODE                        109017         /* 编码错误*/
+#define    LEDA_ERROR_BUSY                          109018         /* 在途消息数达到上限*/
 
 
 #ifdef __cplusplus  /* If this is a C++ compiler, use C linkage */
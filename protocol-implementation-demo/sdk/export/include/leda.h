@@ -19,6 +19,8 @@
 #ifndef __LINKEDGE_DEVICE_ACCESS__
 #define __LINKEDGE_DEVICE_ACCESS__
 
+#include <stddef.h>
+
 #ifdef __cplusplus /* If this is a C++ compiler, use C linkage */
 extern "C"
 {
@@ -27,6 +29,10 @@ extern "C"
 
 #define MAX_PARAM_NAME_LENGTH                   64                  /* 属性或事件名的最大长度*/
 #define MAX_PARAM_VALUE_LENGTH                  2048                /* 属性值或事件参数的最大长度*/
+#define MAX_METHOD_NAME_LENGTH                  64                  /* 自定义方法名的最大长度*/
+#define MAX_METHOD_HANDLER_COUNT                16                  /* 可注册的自定义方法个数*/
+#define PRODUCT_KEY_MAXLEN                      (32 + 1)            /* ProductKey的最大长度, 包含结束符*/
+#define DEVICE_NAME_MAXLEN                      (64 + 1)            /* DeviceName的最大长度, 包含结束符*/
 
 
 typedef enum leda_conn_state
@@ -135,6 +141,8 @@ typedef int (*call_service_callback)(const char *product_key,
 /*
  * 上报属性及事件的应答回调函数
  * 上报消息发送成功立马返回, 如果需要上报消息响应值, 需要注册该接口, msg_id对应上报接口的msg_id
+ * 该回调在SDK的网络线程中执行, 不要在回调中调用leda_online等需要等待应答的接口, 也不要长时间阻塞.
+ * SDK的所有回调都不在SDK内部的临时内存区(arena)中执行, 回调中创建的cJSON对象可以在回调返回后继续使用.
  * 
  * @msg_id      消息id
  * @code        上报结果返回码
@@ -144,6 +152,7 @@ typedef int (*report_reply_callback)(unsigned int msg_id, int code, void *usr_da
 
 /*
  * 设备回调函数group
+ * 同一设备(ProductKey + DeviceName)的下行请求按到达顺序串行回调, 不同设备的请求可能在不同线程并发回调.
 */
 typedef struct leda_device_callback
 {
@@ -249,6 +258,618 @@ int leda_report_event(const char *product_key, const char *device_name, const ch
  */
 int leda_report_properties(const char *product_key, const char *device_name, const leda_device_data_t properties[], int properties_count, unsigned int *msg_id);
 
+/*
+ * 注册设备, 注册后SDK只保存一份ProductKey和DeviceName, 并分配一个设备句柄.
+ * 注册表记录设备的在线状态, 下行消息可通过@leda_get_device_handle以哈希查找的方式映射为设备句柄和用户数据.
+ *
+ * @product_key:          设备ProductKey, 长度小于PRODUCT_KEY_MAXLEN.
+ * @device_name:          设备DeviceName, 长度小于DEVICE_NAME_MAXLEN.
+ * @usr_data:             设备的用户私有数据, 可通过@leda_get_device_handle获取.
+ * @dev_handle:           返回的设备句柄. 设备已注册时返回LEDA_ERROR_NAME_EXISTED, 同时返回已有句柄.
+ *
+ * 非阻塞接口, 成功返回LE_SUCCESS, 失败返回错误码.
+ */
+int leda_register_device(const char *product_key, const char *device_name, void *usr_data, int *dev_handle);
+
+/*
+ * 注销设备, 注销后设备句柄失效, 之后使用该句柄的接口返回LEDA_ERROR_DEVICE_UNREGISTER, 重新注册会分配新的句柄.
+ *
+ * @dev_handle:           设备句柄.
+ *
+ * 非阻塞接口, 成功返回LE_SUCCESS, 失败返回错误码.
+ */
+int leda_unregister_device(int dev_handle);
+
+/*
+ * 根据ProductKey和DeviceName查找已注册设备的句柄和用户私有数据, 可在设备回调函数中使用以替代字符串比较.
+ *
+ * @product_key:          设备ProductKey.
+ * @device_name:          设备DeviceName.
+ * @dev_handle:           返回的设备句柄, 不关心可置NULL.
+ * @usr_data:             返回注册时传入的用户私有数据, 不关心可置NULL.
+ *
+ * 非阻塞接口, 成功返回LE_SUCCESS, 设备未注册返回LEDA_ERROR_DEVICE_UNREGISTER.
+ */
+int leda_get_device_handle(const char *product_key, const char *device_name, int *dev_handle, void **usr_data);
+
+/*
+ * 获取已注册设备在当前连接下的在线状态.
+ *
+ * @dev_handle:           设备句柄.
+ * @online:               返回1表示在线, 0表示离线.
+ *
+ * 非阻塞接口, 成功返回LE_SUCCESS, 失败返回错误码.
+ */
+int leda_get_device_online(int dev_handle, int *online);
+
+/*
+ * 以设备句柄上线设备, 同@leda_online.
+ */
+int leda_online_by_handle(int dev_handle);
+
+/*
+ * 以设备句柄下线设备, 同@leda_offline.
+ */
+int leda_offline_by_handle(int dev_handle);
+
+/*
+ * 以设备句柄上报属性, 同@leda_report_properties.
+ */
+int leda_report_properties_by_handle(int dev_handle, const leda_device_data_t properties[], int properties_count, unsigned int *msg_id);
+
+/*
+ * 以设备句柄上报事件, 同@leda_report_event.
+ */
+int leda_report_event_by_handle(int dev_handle, const char *event_name, const leda_device_data_t data[], int data_count, unsigned int *msg_id);
+
+/*
+ * 设备上线恢复结果回调函数, 连接重新建立后SDK自动上线之前已上线的注册设备, 每个设备完成后回调一次.
+ *
+ * @product_key:          设备ProductKey.
+ * @device_name:          设备DeviceName.
+ * @code:                 上线结果, LE_SUCCESS表示恢复成功, 其他为错误码.
+ * @usr_data:             @leda_restore_policy_t中设置的用户私有数据.
+ */
+typedef void (*device_restore_callback)(const char *product_key, const char *device_name, int code, void *usr_data);
+
+typedef struct leda_restore_policy
+{
+    int                         enable;         /* 是否在重连后自动恢复上线, 0关闭, 1开启, 默认开启 */
+    int                         window;         /* 同时等待应答的上线请求数上限, 取值[1, 64], 默认8 */
+    int                         rate;           /* 每秒最多发送的上线请求数, 0不限制, 默认100 */
+    device_restore_callback     restore_cb;     /* 单个设备恢复完成的回调, 可为NULL */
+    void                        *usr_data;      /* 恢复回调函数的用户私有数据 */
+} leda_restore_policy_t;
+
+typedef struct leda_restore_stats
+{
+    unsigned int    restore_count;              /* 完成的恢复轮次 */
+    unsigned int    devices_restored;           /* 累计恢复成功的设备数 */
+    unsigned int    devices_failed;             /* 累计恢复失败的设备数 */
+    unsigned int    last_device_count;          /* 最近一轮需要恢复的设备数 */
+    unsigned int    last_restore_ms;            /* 最近一轮从连接建立到所有设备恢复完成的耗时, 单位毫秒 */
+    unsigned int    max_restore_ms;             /* 历史最大恢复耗时, 单位毫秒 */
+    int             in_progress;                /* 当前是否正在恢复 */
+} leda_restore_stats_t;
+
+/*
+ * 设置重连后设备上线恢复策略.
+ *
+ * 只有通过@leda_register_device注册且上线成功的设备会被恢复, 主动下线的设备不再恢复.
+ * 恢复时上线请求流水线发送, 同时等待应答的请求数不超过window, 发送速率不超过rate.
+ *
+ * @policy:               恢复策略.
+ *
+ * 非阻塞接口, 成功返回LE_SUCCESS, 失败返回错误码.
+ */
+int leda_set_restore_policy(const leda_restore_policy_t *policy);
+
+/*
+ * 获取设备上线恢复统计.
+ *
+ * @stats:                返回的统计数据.
+ *
+ * 非阻塞接口, 成功返回LE_SUCCESS, 失败返回错误码.
+ */
+int leda_get_restore_stats(leda_restore_stats_t *stats);
+
+typedef struct leda_spool_config
+{
+    int                 enable;             /* 断线期间是否缓存上报的属性和事件, 0关闭, 1开启, 默认关闭 */
+    const char          *file_path;         /* 缓存文件路径, NULL则缓存在内存中. 使用文件时进程重启后未重放的消息仍会重放 */
+    unsigned int        capacity;           /* 缓存容量, 单位字节, 不小于4096. 缓存满时丢弃最早的消息 */
+    int                 max_age;            /* 消息最长缓存时间, 单位秒, 超时的消息不再重放, 0表示不过期 */
+    int                 replay_rate;        /* 重连后每秒最多重放的消息数, 0不限制 */
+} leda_spool_config_t;
+
+typedef struct leda_spool_stats
+{
+    unsigned long long  depth;              /* 当前缓存的消息数 */
+    unsigned long long  bytes;              /* 当前缓存占用的字节数 */
+    unsigned long long  capacity;           /* 缓存容量 */
+    unsigned long long  spooled;            /* 累计进入缓存的消息数 */
+    unsigned long long  replayed;           /* 累计重放的消息数 */
+    unsigned long long  dropped_full;       /* 缓存满被丢弃的消息数 */
+    unsigned long long  dropped_aged;       /* 超时被丢弃的消息数 */
+    unsigned int        last_replay_count;  /* 最近一次重放的消息数 */
+    unsigned int        last_replay_ms;     /* 最近一次重放的耗时, 单位毫秒 */
+    unsigned int        last_replay_rate;   /* 最近一次重放的吞吐, 单位条/秒 */
+    int                 holding;            /* 当前上报是否进入缓存(断线中或重放未完成) */
+} leda_spool_stats_t;
+
+/*
+ * 设置离线缓存.
+ *
+ * 开启后, 断线期间上报的属性和事件不再返回LEDA_ERROR_CONNECTION, 而是进入缓存并返回消息id,
+ * 重连且设备上线恢复完成后按上报顺序重放, 重放完成前新的上报也进入缓存以保证顺序.
+ *
+ * @config:               缓存配置.
+ *
+ * 需在leda_init之前调用, 成功返回LE_SUCCESS, 失败返回错误码.
+ */
+int leda_set_offline_spool(const leda_spool_config_t *config);
+
+/*
+ * 获取离线缓存统计.
+ *
+ * @stats:                返回的统计数据.
+ *
+ * 非阻塞接口, 成功返回LE_SUCCESS, 失败返回错误码.
+ */
+int leda_get_spool_stats(leda_spool_stats_t *stats);
+
+/*
+ * 设置发送队列文件.
+ *
+ * 发送队列默认在内存中, 设置后改为映射到文件, 进程退出或异常重启时尚未发出的消息保留在文件中,
+ * 下次leda_init后连接建立即优先发出. 断线时队列中的消息也不再丢弃, 待重连后发出.
+ * 开启可靠上报(leda_set_reliable_delivery)时, 已发出但尚未收到应答的上报消息也保留在文件中,
+ * 收到应答或重发超时后才释放, 异常重启后与之后的消息一起重新发出; 重启前的消息重新发出后即释放,
+ * 不再等待应答. 队列满时最早的未应答消息被放弃.
+ *
+ * @file_path:            队列文件路径, NULL表示恢复为内存队列.
+ * @max_msg_len:          单条消息最大长度, 单位字节, 0表示默认4096, 超出的消息发送失败.
+ *
+ * 需在leda_init之前调用, 成功返回LE_SUCCESS, 失败返回错误码.
+ */
+int leda_set_send_queue_file(const char *file_path, unsigned int max_msg_len);
+
+typedef struct leda_reliable_config
+{
+    int                 enable;             /* 是否开启可靠上报, 0关闭, 1开启, 默认关闭 */
+    int                 window;             /* 同时等待应答的上报数上限, 取值[1, 4096], 达到上限时上报返回LEDA_ERROR_BUSY */
+    int                 timeout_ms;         /* 等待应答超时重传的时间, 单位毫秒, 不小于100 */
+    int                 max_retries;        /* 最大重传次数, 超过后以LE_ERROR_TIMEOUT回调report_reply_cb, 0表示一直重传 */
+} leda_reliable_config_t;
+
+typedef struct leda_reliable_stats
+{
+    unsigned long long  tracked;            /* 累计登记的上报数 */
+    unsigned long long  acked;              /* 累计收到应答的上报数 */
+    unsigned long long  retransmitted;      /* 累计重传次数 */
+    unsigned long long  duplicates;         /* 累计丢弃的重复应答数 */
+    unsigned long long  expired;            /* 累计超过重传次数放弃的上报数 */
+    unsigned long long  window_full;        /* 累计因在途数达到上限被拒绝的上报数 */
+    unsigned int        inflight;           /* 当前等待应答的上报数 */
+    unsigned int        ack_p50_us;         /* 最近1024次应答时延的分位值, 从首次上报开始计算, 单位微秒 */
+    unsigned int        ack_p90_us;
+    unsigned int        ack_p99_us;
+    unsigned int        ack_max_us;
+} leda_reliable_stats_t;
+
+/*
+ * 设置可靠上报.
+ *
+ * 开启后, leda_report_properties和leda_report_event的上报在收到应答前保留在在途表中,
+ * 超时未收到应答或重连后按上报顺序重传, 同一msg_id的应答只回调report_reply_cb一次.
+ * 断线期间的上报也保留在在途表中, 重连后发送, 不再返回LEDA_ERROR_CONNECTION.
+ *
+ * @config:               可靠上报配置.
+ *
+ * 需在leda_init之前调用, 成功返回LE_SUCCESS, 失败返回错误码.
+ */
+int leda_set_reliable_delivery(const leda_reliable_config_t *config);
+
+/*
+ * 获取可靠上报统计.
+ *
+ * @stats:                返回的统计数据.
+ *
+ * 非阻塞接口, 成功返回LE_SUCCESS, 失败返回错误码.
+ */
+int leda_get_reliable_stats(leda_reliable_stats_t *stats);
+
+typedef struct leda_latency_stats
+{
+    unsigned long long  count;              /* 样本数 */
+    unsigned long long  sum_us;             /* 样本总和, 单位微秒 */
+    unsigned int        p50_us;             /* 分位值, 单位微秒, 误差不超过12.5% */
+    unsigned int        p90_us;
+    unsigned int        p99_us;
+    unsigned int        max_us;
+} leda_latency_stats_t;
+
+typedef struct leda_stats
+{
+    unsigned long long      msgs_sent;          /* 累计发送的消息数 */
+    unsigned long long      bytes_sent;         /* 累计发送的字节数 */
+    unsigned long long      msgs_recv;          /* 累计接收的消息数 */
+    unsigned long long      bytes_recv;         /* 累计接收的字节数 */
+    unsigned long long      send_queue_full;    /* 发送队列满被拒绝的消息数 */
+    unsigned long long      recv_dropped;       /* 接收通道满被丢弃的消息数 */
+    unsigned long long      parse_failures;     /* 接收到的非法JSON消息数 */
+    unsigned long long      connects;           /* 连接建立次数 */
+    unsigned long long      disconnects;        /* 连接断开或失败次数 */
+    unsigned long long      reply_timeouts;     /* 等待应答超时的请求数 */
+    unsigned int            send_queue_depth;   /* 发送队列中待发送的消息数 */
+    unsigned int            pending_replies;    /* 等待应答的请求数 */
+    unsigned int            recv_backlog;       /* 接收通道中待处理的消息数 */
+    unsigned int            task_backlog;       /* 后台任务队列中待执行的任务数 */
+    leda_latency_stats_t    enqueue_to_write;   /* 消息从进入发送队列到写入连接的时延 */
+    leda_latency_stats_t    request_rtt;        /* 请求从发送到收到应答的时延 */
+    leda_latency_stats_t    callback;           /* 用户处理属性获取, 设置及服务调用回调的耗时 */
+    unsigned long long      log_written;        /* 异步日志写出的记录数 */
+    unsigned long long      log_dropped;        /* 异步日志因缓冲区满或超过限速丢弃的记录数 */
+    unsigned long long      log_truncated;      /* 异步日志因超长被截断的记录数 */
+    unsigned long long      batches_sent;       /* 批量发送时包含多条上报的消息数 */
+    unsigned long long      batched_msgs;       /* 以批量方式发出的上报数 */
+    unsigned long long      batch_dropped;      /* 批量缓冲区中因断线或退出时发送队列满而丢弃的上报数 */
+    unsigned long long      tls_handshakes;     /* 完成的TLS握手次数 */
+    unsigned long long      tls_resumed;        /* 复用会话完成的TLS握手次数 */
+    leda_latency_stats_t    tls_handshake;      /* TLS握手耗时 */
+    leda_latency_stats_t    connect;            /* 从发起连接到WebSocket连接建立的耗时, 包含TCP和TLS握手 */
+    unsigned long long      cache_hits;         /* getProperty中从属性缓存应答的属性数 */
+    unsigned long long      cache_misses;       /* 开启属性缓存时, getProperty中交给回调获取的属性数 */
+    unsigned long long      report_suppressed;  /* 开启上报过滤时, 因没有变化未上报的属性数 */
+} leda_stats_t;
+
+/*
+ * 获取SDK运行统计.
+ *
+ * @stats:                返回的统计数据, 计数从进程启动开始累计.
+ *
+ * 非阻塞接口, 成功返回LE_SUCCESS, 失败返回错误码.
+ */
+int leda_get_stats(leda_stats_t *stats);
+
+/*
+ * 以Prometheus文本格式输出SDK运行统计.
+ *
+ * @buf:                  输出缓冲区, 输出以'\0'结尾.
+ * @size:                 缓冲区大小, 建议不小于8192.
+ *
+ * 非阻塞接口, 成功返回LE_SUCCESS, 缓冲区不足返回LE_ERROR_PARAM_RANGE_OVERFLOW.
+ */
+int leda_dump_stats(char *buf, unsigned int size);
+
+/*
+ * 开始消息跟踪.
+ *
+ * 开启后记录每条消息在各阶段的起止时间, 以msg_id关联, 阶段包括:
+ * recv(接收分片重组), parse(JSON解析), queue(接收通道排队), callback(用户回调),
+ * send_rsp(构造并发送应答), send_wait(发送队列等待), write(写入连接).
+ * 每个线程的记录保存在独立的环形缓冲区中, 写满后覆盖最早的记录.
+ *
+ * @events_per_thread:    每个线程保留的记录数, 向上取2的幂, 仅首次调用生效.
+ *
+ * 非阻塞接口, 成功返回LE_SUCCESS, 失败返回错误码.
+ */
+int leda_trace_start(unsigned int events_per_thread);
+
+/*
+ * 停止消息跟踪, 已记录的数据保留, 可继续导出.
+ */
+void leda_trace_stop(void);
+
+/*
+ * 导出最近一次leda_trace_start之后的跟踪记录.
+ *
+ * @file_path:            输出文件路径, 内容为Chrome trace格式的JSON, 可在chrome://tracing或Perfetto中查看.
+ *
+ * 成功返回LE_SUCCESS, 失败返回错误码.
+ */
+int leda_trace_export(const char *file_path);
+
+typedef struct leda_log_config
+{
+    int             level;          /* 日志级别, 0:debug, 1:info, 2:warn, 3:error */
+    int             async;          /* 1表示异步输出: 调用线程只格式化到本线程的缓冲区, 由后台线程写出, 从不阻塞 */
+    const char      *file_path;     /* 异步输出的日志文件, 以追加方式打开, NULL表示输出到标准输出 */
+    int             use_syslog;     /* 1表示异步输出到syslog, 忽略file_path */
+    unsigned int    ring_size;      /* 每个线程缓冲的记录数, 向上取2的幂, 0表示默认256, 缓冲区满时丢弃新记录 */
+    unsigned int    max_len;        /* 单条记录最大长度, 超出部分截断, 0表示默认256 */
+    unsigned int    rate_limit;     /* 每个线程每秒最多输出的记录数, 0表示不限制 */
+    unsigned int    payload_len;    /* 收发消息内容在日志中最多输出的字节数, 0表示不限制 */
+    unsigned int    payload_sample; /* 每N条收发消息输出一次内容, 0和1表示每条都输出 */
+} leda_log_config_t;
+
+/*
+ * 设置日志.
+ *
+ * 默认日志同步输出到标准输出. 开启异步输出后, 记录先格式化到调用线程独立的环形缓冲区,
+ * 由后台线程约每20毫秒批量写出, 进程退出时写出剩余记录. 超过限速的记录被丢弃,
+ * 丢弃数在该线程下一条记录中给出.
+ *
+ * @config:               日志配置.
+ *
+ * 成功返回LE_SUCCESS, 失败返回错误码.
+ */
+int leda_set_log_config(const leda_log_config_t *config);
+
+typedef enum leda_encoding
+{
+    LEDA_ENCODING_JSON = 0,         /* JSON文本帧 */
+    LEDA_ENCODING_CBOR,             /* CBOR(RFC 7049)二进制帧, 消息模型与JSON相同 */
+    LEDA_ENCODING_JSON_ZDICT,       /* 以协议字段预置字典压缩的JSON, zlib格式二进制帧 */
+} leda_encoding_e;
+
+/*
+ * 设置消息编码.
+ *
+ * 设置为LEDA_ENCODING_CBOR后, 握手时优先提供子协议alibaba-iot-linkedge-protocol-cbor,
+ * 同时提供alibaba-iot-linkedge-protocol, 由服务端选择. 服务端不支持CBOR时按JSON收发.
+ * LEDA_ENCODING_JSON_ZDICT对应的子协议为alibaba-iot-linkedge-protocol-zdict1, 每条消息独立压缩,
+ * 不依赖permessage-deflate, 适合按流量计费的链路.
+ * 编码按每次连接的协商结果决定, 离线缓存和可靠上报重发的消息在发送时转换.
+ *
+ * @encoding:             消息编码, 取值见leda_encoding_e, 默认LEDA_ENCODING_JSON.
+ *
+ * 需在leda_init之前调用, 成功返回LE_SUCCESS, 失败返回错误码.
+ */
+int leda_set_payload_encoding(int encoding);
+
+typedef struct leda_compression_config
+{
+    int             enable;             /* 0表示不协商压缩 */
+    int             context_takeover;   /* 1表示消息之间保留压缩上下文, 结构相似的小消息压缩率更高 */
+    int             window_bits;        /* 压缩窗口, 取值0或[9, 15], 0表示15 */
+    int             level;              /* 压缩级别, 取值0或[1, 9], 0表示不设置, 使用libwebsockets的默认级别 */
+    unsigned int    min_size;           /* 小于该长度的消息不压缩, 单位字节 */
+} leda_compression_config_t;
+
+typedef struct leda_compression_stats
+{
+    int                 active;             /* 当前连接已协商permessage-deflate */
+    unsigned long long  raw_out;            /* 压缩前的发送字节数 */
+    unsigned long long  compressed_out;     /* 压缩后的发送字节数 */
+    unsigned long long  skipped_out;        /* 因小于min_size未压缩的消息数 */
+    unsigned long long  compressed_in;      /* 解压前的接收字节数 */
+    unsigned long long  raw_in;             /* 解压后的接收字节数 */
+    unsigned long long  deflate_us;         /* 压缩耗时, 单位微秒 */
+    unsigned long long  inflate_us;         /* 解压耗时, 单位微秒 */
+} leda_compression_stats_t;
+
+/*
+ * 设置消息压缩.
+ *
+ * 未设置时握手提供permessage-deflate(client_no_context_takeover)和deflate-frame.
+ * 设置后只提供permessage-deflate, 参数按配置生成; enable为0时不提供任何压缩扩展.
+ *
+ * @config:               压缩配置.
+ *
+ * 需在leda_init之前调用, 成功返回LE_SUCCESS, 失败返回错误码.
+ */
+int leda_set_compression(const leda_compression_config_t *config);
+
+/*
+ * 获取当前连接的压缩统计, 每次连接协商压缩成功后清零.
+ *
+ * @stats:                返回的统计数据.
+ *
+ * 非阻塞接口, 成功返回LE_SUCCESS, 失败返回错误码.
+ */
+int leda_get_compression_stats(leda_compression_stats_t *stats);
+
+typedef struct leda_batch_config
+{
+    int             enable;             /* 是否开启批量发送, 0关闭, 1开启, 默认关闭 */
+    unsigned int    max_count;          /* 一次最多打包的上报数, 取值[1, 1024], 0表示32 */
+    unsigned int    max_bytes;          /* 打包后的最大长度, 单位字节, 取值[256, 1048576], 0表示16384 */
+    unsigned int    linger_ms;          /* 第一条上报最多等待的时间, 单位毫秒, 取值[1, 1000], 0表示5 */
+} leda_batch_config_t;
+
+/*
+ * 设置批量发送.
+ *
+ * 开启后, 连接正常时leda_report_properties和leda_report_event的上报先进入批量缓冲区,
+ * 条数达到max_count, 长度将超过max_bytes或第一条等待超过linger_ms时, 将缓冲区中的上报
+ * 打包为一条消息发送: JSON编码为消息数组, CBOR编码为CBOR数组, 只有一条时按原消息发送.
+ * 网关需支持批量消息, 对批量消息的应答可以是单条应答或应答数组, SDK按msg_id分别处理.
+ * 发送队列满时缓冲区中的上报保留, 在下一个linger_ms周期重试, 期间放不下的新上报返回错误.
+ * 离线缓存重放, 可靠上报重传及其他消息不进入批量缓冲区; 断线时缓冲区中的上报交给离线缓存,
+ * 开启可靠上报时留在在途表中等待重传, 都未开启时以LEDA_ERROR_CONNECTION回调report_reply_cb.
+ * 设置了发送队列文件时max_bytes不超过队列单条消息长度.
+ *
+ * @config:               批量发送配置.
+ *
+ * 需在leda_init之前调用, 成功返回LE_SUCCESS, 失败返回错误码.
+ */
+int leda_set_batching(const leda_batch_config_t *config);
+
+typedef struct leda_tls_config
+{
+    const char      *cipher_list;       /* TLS1.2及以下的密码套件, OpenSSL格式, 如"ECDHE-ECDSA-CHACHA20-POLY1305:ECDHE-ECDSA-AES128-GCM-SHA256", NULL表示库默认值 */
+    const char      *ciphersuites;      /* TLS1.3的密码套件, 如"TLS_CHACHA20_POLY1305_SHA256:TLS_AES_128_GCM_SHA256", NULL表示库默认值 */
+    const char      *curves;            /* 密钥交换曲线, 按优先级排列, 如"X25519:P-256", NULL表示库默认值 */
+    int             session_resumption; /* 重连时是否复用上次的TLS会话, 0关闭, 1开启 */
+    const char      *session_file;      /* 会话保存文件, 进程重启后仍可复用会话, NULL表示只保存在内存中 */
+} leda_tls_config_t;
+
+/*
+ * 设置TLS连接参数.
+ *
+ * 未调用时使用库默认的密码套件和曲线, 并在进程内复用会话. 复用会话时重连只需简化握手,
+ * 省去证书校验和密钥交换的计算; 是否复用由服务端决定, 复用次数见leda_stats_t的tls_resumed.
+ * 低端设备上可优先选择CHACHA20-POLY1305和X25519以减少握手和加解密开销.
+ * session_file中保存会话密钥, 文件权限为0600, 请放在只有本进程可访问的目录中.
+ * 需要OpenSSL 1.1.0及以上版本, 其他TLS库下只有密码套件设置生效.
+ *
+ * @config:               TLS配置, 字符串在接口内复制.
+ *
+ * 需在leda_init之前调用, 成功返回LE_SUCCESS, 失败返回错误码.
+ */
+int leda_set_tls_config(const leda_tls_config_t *config);
+
+typedef struct leda_allocator
+{
+    void            *(*malloc_fn)(size_t size);             /* 分配函数, 与free_fn同时为NULL时使用C库, 只限制内存上限 */
+    void            *(*realloc_fn)(void *ptr, size_t size); /* 可以为NULL, 此时以分配, 复制和释放代替 */
+    void            (*free_fn)(void *ptr);                  /* 释放函数 */
+    size_t          max_bytes;                              /* SDK可占用的内存上限, 单位字节, 超过时分配失败, 0表示不限制 */
+} leda_allocator_t;
+
+/*
+ * 设置SDK的内存分配器.
+ *
+ * SDK各模块, cJSON, zlib压缩流的分配都经由该分配器; 同时libwebsockets的分配也交给该分配器,
+ * 此时应用不能再自行使用libwebsockets. OpenSSL的分配不受影响.
+ * 每块内存前有16字节的头部, 记录长度和所属模块, 用于分模块统计, 见leda_get_mem_stats.
+ * 分配器需线程安全, 返回的内存按16字节对齐.
+ *
+ * @allocator:            分配器.
+ *
+ * 需在调用其他SDK接口之前调用, SDK已分配过内存后调用返回LE_ERROR_INVAILD_PARAM.
+ * 成功返回LE_SUCCESS, 失败返回错误码.
+ */
+int leda_set_allocator(const leda_allocator_t *allocator);
+
+typedef enum leda_mem_module
+{
+    LEDA_MEM_CORE = 0,              /* 设备管理, 请求应答, 离线缓存, 可靠上报, 批量发送等 */
+    LEDA_MEM_JSON,                  /* cJSON对象和序列化的文本, 收发消息的临时对象按16KB整块分配并在线程内复用 */
+    LEDA_MEM_WS,                    /* WebSocket客户端, 发送队列和libwebsockets */
+    LEDA_MEM_THREADPOOL,            /* 接收通道和后台任务的线程池 */
+    LEDA_MEM_LOG,                   /* 异步日志缓冲区 */
+    LEDA_MEM_SPOOL,                 /* 离线缓存文件 */
+    LEDA_MEM_TRACE,                 /* 消息跟踪缓冲区 */
+    LEDA_MEM_COMPRESS,              /* 预置字典压缩 */
+    LEDA_MEM_MODULE_BUTT
+} leda_mem_module_e;
+
+typedef struct leda_mem_stats
+{
+    unsigned long long  allocs;             /* 累计分配次数 */
+    unsigned long long  frees;              /* 累计释放次数 */
+    unsigned long long  failures;           /* 超过内存上限或分配器返回NULL的次数 */
+    unsigned long long  in_use;             /* 当前占用的字节数, 不含头部 */
+    unsigned long long  peak;               /* 占用字节数的峰值 */
+} leda_mem_stats_t;
+
+/*
+ * 获取分模块的内存统计.
+ *
+ * @stats:                返回的统计数据, 按leda_mem_module_e索引.
+ *
+ * 非阻塞接口, 成功返回LE_SUCCESS, 失败返回错误码.
+ */
+int leda_get_mem_stats(leda_mem_stats_t stats[LEDA_MEM_MODULE_BUTT]);
+
+/*
+ * 自定义方法的回调函数, LinkEdge 下发的方法不是getProperty, setProperty, callService时, SDK 按方法名调用注册的回调函数.
+ * 与服务调用相同, 同一设备的请求按到达顺序串行回调.
+ *
+ * @product_key:  LinkEdge 请求的具体某个设备所属的ProductKey.
+ * @device_name:  LinkEdge 请求的具体某个设备的DeviceName.
+ * @method:       方法名.
+ * @data:         payload中properties或inputData的参数, 都不存在时为空.
+ * @data_count:   参数个数.
+ * @output_data:  开发者需要将返回值填写到output_data中, 以outputData应答, 最多service_output_max_count个.
+ * @usr_data:     注册时传入的私有数据.
+ *
+ * 返回值作为应答的code, 成功返回LE_SUCCESS.
+ */
+typedef int (*method_handler_callback)(const char *product_key,
+                                       const char *device_name,
+                                       const char *method,
+                                       const leda_device_data_t data[],
+                                       int data_count,
+                                       leda_device_data_t output_data[],
+                                       void *usr_data);
+
+/*
+ * 注册自定义方法的回调函数, 用于扩展协议的下行方法, 未注册的方法不作应答.
+ *
+ * @method:               方法名, 长度小于MAX_METHOD_NAME_LENGTH, 不能是getProperty, setProperty, callService.
+ * @handler:              回调函数, 同一方法重复注册时替换之前的回调, NULL表示注销.
+ * @usr_data:             回调时传入的私有数据.
+ *
+ * 最多注册MAX_METHOD_HANDLER_COUNT个方法.
+ * 需在leda_init之前调用, 成功返回LE_SUCCESS, 失败返回错误码.
+ */
+int leda_register_method_handler(const char *method, method_handler_callback handler, void *usr_data);
+
+typedef struct leda_property_cache_config
+{
+    int             enable;             /* 是否开启属性缓存, 0关闭, 1开启, 默认关闭 */
+    unsigned int    default_ttl_ms;     /* 未单独设置有效期的属性的有效期, 单位毫秒, 0表示这些属性不缓存 */
+    unsigned int    max_entries;        /* 缓存的属性值个数上限, 取值[1, 1048576], 0表示4096, 超出时淘汰最久未更新的 */
+} leda_property_cache_config_t;
+
+/*
+ * 设置属性缓存.
+ *
+ * 开启后, SDK按设备和属性名保存leda_report_properties上报的值, setProperty设置成功的值
+ * 和get_properties_cb获取到的值. getProperty请求中仍在有效期内的属性直接由缓存应答,
+ * 只有过期或未缓存的属性交给get_properties_cb获取, 全部有效时不调用回调.
+ * 命中和未命中的属性数见leda_stats_t的cache_hits和cache_misses.
+ * 值会被设备以外的途径改变的属性, 请将有效期设为0.
+ *
+ * @config:               属性缓存配置.
+ *
+ * 需在leda_init之前调用, 成功返回LE_SUCCESS, 失败返回错误码.
+ */
+int leda_set_property_cache(const leda_property_cache_config_t *config);
+
+/*
+ * 设置某个产品的某个属性的缓存有效期, 覆盖default_ttl_ms.
+ *
+ * @product_key:          产品的ProductKey, 有效期对该产品下的所有设备生效.
+ * @identifier:           物模型中的属性名.
+ * @ttl_ms:               有效期, 单位毫秒, 0表示该属性不缓存, 总是交给get_properties_cb获取.
+ *
+ * 可在leda_init前后调用, 成功返回LE_SUCCESS, 失败返回错误码.
+ */
+int leda_set_property_ttl(const char *product_key, const char *identifier, unsigned int ttl_ms);
+
+typedef struct leda_report_filter_config
+{
+    int             enable;             /* 是否开启上报过滤, 0关闭, 1开启, 默认关闭 */
+    unsigned int    heartbeat_ms;       /* 没有变化的属性最长多久重新上报一次, 单位毫秒, 0表示60000 */
+    unsigned int    max_entries;        /* 记录的属性值个数上限, 取值[1, 1048576], 0表示4096, 超出时淘汰最久未上报的 */
+} leda_report_filter_config_t;
+
+typedef enum leda_deadband_type
+{
+    LEDA_DEADBAND_ABSOLUTE = 0,         /* 与上次上报值之差的绝对值超过死区才上报 */
+    LEDA_DEADBAND_PERCENT               /* 变化量超过上次上报值绝对值的百分比才上报 */
+} leda_deadband_type_e;
+
+/*
+ * 设置属性上报过滤.
+ *
+ * 开启后, leda_report_properties按设备和属性名将每个属性与上次发出的值比较, 没有变化的属性
+ * 不再上报; 数值型(int, float, double)属性的变化不超过leda_set_property_deadband设置的死区
+ * 时也视为没有变化, 未设置死区时任何变化都上报. 距上次发出超过heartbeat_ms的属性总是上报.
+ * 所有属性都被过滤时不发送消息, 接口返回LE_SUCCESS, msg_id为0.
+ * 设备调用leda_online上线或注销后, 其第一次上报不被过滤. 事件上报不过滤.
+ *
+ * @config:               上报过滤配置.
+ *
+ * 需在leda_init之前调用, 成功返回LE_SUCCESS, 失败返回错误码.
+ */
+int leda_set_report_filter(const leda_report_filter_config_t *config);
+
+/*
+ * 设置某个产品的某个数值型属性的上报死区.
+ *
+ * @product_key:          产品的ProductKey, 死区对该产品下的所有设备生效.
+ * @identifier:           物模型中的属性名.
+ * @type:                 死区类型, 绝对值或百分比.
+ * @deadband:             死区大小, 不小于0, 百分比类型时10表示10%.
+ *
+ * 可在leda_init前后调用, 成功返回LE_SUCCESS, 失败返回错误码.
+ */
+int leda_set_property_deadband(const char *product_key, const char *identifier, leda_deadband_type_e type, double deadband);
 
 #ifdef __cplusplus  /* If this is a C++ compiler, use C linkage */
 }
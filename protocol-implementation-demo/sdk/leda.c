@@ -22,6 +22,7 @@
 #include <pthread.h>
 #include <time.h>
 #include <errno.h>
+#include <limits.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <semaphore.h>
@@ -31,11 +32,18 @@
 
 #include "base-utils.h"
 #include "cJSON.h"
+#include "cbor.h"
+#include "zdict.h"
 #include "threadpool.h"
+#include "metrics.h"
+#include "mem.h"
+#include "trace.h"
 
 #include "log.h"
 #include "le_error.h"
 #include "leda.h"
+#include "leda_device.h"
+#include "leda_internal.h"
 
 #ifdef __cplusplus /* If this is a C++ compiler, use C linkage */
 extern "C"
@@ -44,9 +52,6 @@ extern "C"
 
 #define LOG_TAG                 "LINKEDGE_DEVICE_ACCESS"
 
-#define METHOD_ONLINE           "onlineDevice"
-#define METHOD_OFFLINE          "offlineDevice"
-
 #define EMTHOD_REPORT_PROPERTY  "reportProperty"
 #define METHOD_REPORT_EVENT     "reportEvent"
 
@@ -55,17 +60,43 @@ extern "C"
 #define METHOD_SET_PROPERTY     "setProperty"
 
 #define CONN_PROTOCOL           "alibaba-iot-linkedge-protocol"
-#define PROTOCOL_VERSION        "1.0"
+#define CONN_PROTOCOL_CBOR      "alibaba-iot-linkedge-protocol-cbor"
+#define CONN_PROTOCOL_ZDICT     "alibaba-iot-linkedge-protocol-zdict1"    /* 后缀与ZDICT_VERSION一致 */
+#define ZDICT_MAX_INFLATE       (4 * 1024 * 1024)
 
 //#define SUPPORT_DUAL_CERTIFICATION
 
+/* 下行消息按设备分片到单线程的处理通道, 同一设备的消息始终在同一通道内按序处理 */
+#define RECV_LANE_COUNT         5
+#define RECV_LANE_QUEUE_SIZE    1024
+
+/* 发送队列文件中单条消息的默认最大长度 */
+#define SEND_QUEUE_MSG_LEN      4096
+
+typedef enum recv_method
+{
+    RECV_METHOD_UNKNOWN = -1,
+    RECV_METHOD_GET_PROPERTY = 0,
+    RECV_METHOD_SET_PROPERTY,
+    RECV_METHOD_CALL_SERVICE,
+    RECV_METHOD_CUSTOM
+} recv_method_e;
+
+typedef struct method_handler
+{
+    char                    method[MAX_METHOD_NAME_LENGTH];
+    size_t                  len;
+    method_handler_callback handler;
+    void                    *usr_data;
+} method_handler_t;
+
 typedef struct parsed_msg
 {
     int     msg_type;
     int     msg_id;
-    int     code;
-    char    method[16];
+    int     method;         /* recv_method_e, 自定义方法为RECV_METHOD_CUSTOM + 注册序号 */
     cJSON   *payload;
+    uint64_t queued_us;
 } parsed_msg_t;
 
 typedef struct ws_msg_reply
@@ -75,21 +106,28 @@ typedef struct ws_msg_reply
     int                 code;
     char                *payload;
     sem_t               sem;
+    uint64_t            sent_us;
 } ws_msg_reply_t;
 
-typedef enum ws_msg_type
-{
-    MSG_INVALID = -1,
-    MSG_RSP = 0,
-    MSG_METHOD
-} ws_msg_type_e;
-
 LIST_HEAD(g_ws_msg_reply_list);
 pthread_mutex_t g_ws_msg_reply_lock;
+static int      g_ws_msg_reply_cnt = 0;
 
 static ws_conn_cb_t             g_conn_cb = {0};
 static leda_device_callback_t   g_devs_cb = {0};
 
+/* 按recv_method_e索引, 首字符各不相同 */
+static const char               *g_method_names[RECV_METHOD_CUSTOM] =
+{
+    METHOD_GET_PROPERTY,
+    METHOD_SET_PROPERTY,
+    METHOD_CALL_SERVICE
+};
+
+/* 只在leda_init之前注册, 接收通道中只读, 不需要加锁 */
+static method_handler_t         g_method_handlers[MAX_METHOD_HANDLER_COUNT];
+static int                      g_method_handler_cnt = 0;
+
 static int              g_has_init       = 0;
 static int              g_conn_state     = -1;
 
@@ -106,23 +144,44 @@ typedef struct wsc_conn
 static wsc_conn_t       g_wsc_conn       = {0};
 static wsc_param_conn   g_param_conn     = {0};
 
+static char             *g_queue_path    = NULL;
+static int              g_queue_msg_len  = SEND_QUEUE_MSG_LEN;
+
+static int              g_encoding       = LEDA_ENCODING_JSON;
+
+static int              g_has_deflate    = 0;
+static wsc_deflate_config g_deflate_cfg  = {0};
+static int              g_has_tls        = 0;
+static wsc_tls_config   g_tls_cfg        = {0};
+static char             *g_tls_str[4]    = {NULL};  /* cipher_list, ciphersuites, curves, session_file的副本 */
+static volatile int     g_conn_encoding  = LEDA_ENCODING_JSON;  /* 当前连接协商的编码 */
+
+static int              g_payload_len    = 0;
+static unsigned int     g_payload_sample = 1;
+static unsigned int     g_payload_seq    = 0;
+
+/* 收发消息内容按采样输出, 超出长度截断 */
+#define LOG_PAYLOAD(what, msg) \
+    do \
+    { \
+        if (log_enabled(LOG_LEVEL_INFO) && \
+            ((g_payload_sample <= 1) || (0 == (__sync_fetch_and_add(&g_payload_seq, 1) % g_payload_sample)))) \
+        { \
+            log_i(LOG_TAG, what " msg: %.*s", (g_payload_len > 0) ? g_payload_len : INT_MAX, msg); \
+        } \
+    } while (0)
+
 static unsigned int     g_msg_id         = 0;
 static pthread_mutex_t  g_msg_locker     = PTHREAD_MUTEX_INITIALIZER;
 
-static threadpool_t     *g_threadpool    = NULL;
+static threadpool_t     *g_threadpool[RECV_LANE_COUNT] = {NULL};
+static threadpool_t     *g_task_pool     = NULL;
+
+#define TYPE_NAME(name)         name,
 
 static char *g_type_map[LEDA_TYPE_BUTT + 1] = 
 {
-    "int",    //LEDA_TYPE_INT
-    "bool",   //LEDA_TYPE_BOOL
-    "float",  //LEDA_TYPE_FLOAT
-    "text",   //LEDA_TYPE_TEXT
-    "date",   //LEDA_TYPE_DATE
-    "enum",   //LEDA_TYPE_ENUM
-    "struct", //LEDA_TYPE_STRUCT
-    "array",  //LEDA_TYPE_ARRAY
-    "double", //LEDA_TYPE_DOUBLE
-    "invalid"
+    LEDA_TYPE_NAMES(TYPE_NAME)
 };
 
 const char *type_number_to_string(int type)
@@ -138,46 +197,71 @@ const char *type_number_to_string(int type)
 
 int type_string_to_number(char *type)
 {
-    if (0 == strcmp("int", type))
-    {
-        return LEDA_TYPE_INT;
-    }
-    else if (0 == strcmp("bool", type))
-    {
-        return LEDA_TYPE_BOOL;
-    }
-    else if (0 == strcmp("float", type))
-    {
-        return LEDA_TYPE_FLOAT;
-    }
-    else if (0 == strcmp("text", type))
-    {
-        return LEDA_TYPE_TEXT;
-    }
-    else if (0 == strcmp("date", type))
-    {
-        return LEDA_TYPE_DATE;
-    }
-    else if (0 == strcmp("enum", type))
-    {
-        return LEDA_TYPE_ENUM;
+    int     candidate   = LEDA_TYPE_BUTT;
+
+    /* 首字符区分出唯一的候选类型(date与double再看第二个字符), 只需一次完整比较 */
+    switch (type[0])
+    {
+    case 'i':
+        candidate = LEDA_TYPE_INT;
+        break;
+    case 'b':
+        candidate = LEDA_TYPE_BOOL;
+        break;
+    case 'f':
+        candidate = LEDA_TYPE_FLOAT;
+        break;
+    case 't':
+        candidate = LEDA_TYPE_TEXT;
+        break;
+    case 'd':
+        candidate = ('a' == type[1]) ? LEDA_TYPE_DATE : LEDA_TYPE_DOUBLE;
+        break;
+    case 'e':
+        candidate = LEDA_TYPE_ENUM;
+        break;
+    case 's':
+        candidate = LEDA_TYPE_STRUCT;
+        break;
+    case 'a':
+        candidate = LEDA_TYPE_ARRAY;
+        break;
+    default:
+        break;
+    }
+
+    if ((LEDA_TYPE_BUTT != candidate) && (0 == strcmp(g_type_map[candidate], type)))
+    {
+        return candidate;
     }
-    else if (0 == strcmp("struct", type))
+
+    log_w(LOG_TAG, "unknown data type: %s\n", type);
+
+    return LEDA_TYPE_BUTT;
+}
+
+/* 整数转十进制文本, 与snprintf("%d")结果相同, buff至少12字节 */
+static void _leda_format_int(char *buff, int value)
+{
+    char            digits[10];
+    unsigned int    abs_value   = (value < 0) ? (0U - (unsigned int)value) : (unsigned int)value;
+    int             len         = 0;
+
+    do
     {
-        return LEDA_TYPE_STRUCT;
-    }
-    else if (0 == strcmp("array", type))
+        digits[len++] = (char)('0' + abs_value % 10);
+        abs_value /= 10;
+    } while (0 != abs_value);
+
+    if (value < 0)
     {
-        return LEDA_TYPE_ARRAY;
+        *buff++ = '-';
     }
-    else if (0 == strcmp("double", type))
+    while (len > 0)
     {
-        return LEDA_TYPE_DOUBLE;
+        *buff++ = digits[--len];
     }
-
-    log_w(LOG_TAG, "unknown data type: %s\n", type);
-
-    return LEDA_TYPE_BUTT;
+    *buff = '\0';
 }
 
 cJSON *struct_data_to_json_data(const leda_device_data_t *struct_data, int data_cnt)
@@ -204,23 +288,24 @@ cJSON *struct_data_to_json_data(const leda_device_data_t *struct_data, int data_
             return NULL;
         }
 
-        cJSON_AddStringToObject(item, "identifier", struct_data[i].key);
-        cJSON_AddStringToObject(item, "type", type_number_to_string(struct_data[i].type));
+        /* 键名和类型名为常量, 不再逐个复制 */
+        cJSON_AddItemToObjectCS(item, "identifier", cJSON_CreateString(struct_data[i].key));
+        cJSON_AddItemToObjectCS(item, "type", cJSON_CreateStringReference(type_number_to_string(struct_data[i].type)));
 
         switch (struct_data[i].type)
         {
         case LEDA_TYPE_INT:
         case LEDA_TYPE_BOOL:
         case LEDA_TYPE_ENUM:
-            cJSON_AddNumberToObject(item, "value", atoi(struct_data[i].value));
+            cJSON_AddItemToObjectCS(item, "value", cJSON_CreateNumber(atoi(struct_data[i].value)));
             break;
         case LEDA_TYPE_DOUBLE:
         case LEDA_TYPE_FLOAT:
-            cJSON_AddNumberToObject(item, "value", atof(struct_data[i].value));
+            cJSON_AddItemToObjectCS(item, "value", cJSON_CreateNumber(atof(struct_data[i].value)));
             break;
         case LEDA_TYPE_DATE:
         case LEDA_TYPE_TEXT:
-            cJSON_AddStringToObject(item, "value", struct_data[i].value);
+            cJSON_AddItemToObjectCS(item, "value", cJSON_CreateString(struct_data[i].value));
             break;
         case LEDA_TYPE_ARRAY:
         case LEDA_TYPE_STRUCT:
@@ -231,11 +316,11 @@ cJSON *struct_data_to_json_data(const leda_device_data_t *struct_data, int data_
                 cJSON_Delete(root);
                 return NULL;
             }
-            cJSON_AddItemToObject(item, "value", sub_item);
+            cJSON_AddItemToObjectCS(item, "value", sub_item);
             break;
         default:
-            log_w(LOG_TAG, "identifier: %s type: %s is invalid type\n", struct_data[i].key, struct_data[i].type);
-            cJSON_AddStringToObject(item, "value", "invalid");
+            log_w(LOG_TAG, "identifier: %s type: %d is invalid type\n", struct_data[i].key, struct_data[i].type);
+            cJSON_AddItemToObjectCS(item, "value", cJSON_CreateStringReference("invalid"));
             break;
         }
 
@@ -263,7 +348,7 @@ int json_data_to_struct_data(cJSON *json_data, leda_device_data_t **struct_data,
     }
 
     *data_cnt = size;
-    data = malloc(sizeof(leda_device_data_t) * size);
+    data = mem_malloc(MEM_CORE, sizeof(leda_device_data_t) * size);
     if (NULL == data)
     {
         log_w(LOG_TAG, "no memory can allocate\n");
@@ -281,7 +366,7 @@ int json_data_to_struct_data(cJSON *json_data, leda_device_data_t **struct_data,
         sub_item = cJSON_GetObjectItem(item, "identifier");
         if (NULL == sub_item)
         {
-            free(data);
+            mem_free(data);
             return LE_ERROR_INVAILD_PARAM;
         }
         snprintf(data[i].key, MAX_PARAM_NAME_LENGTH, "%s", sub_item->valuestring);
@@ -289,7 +374,7 @@ int json_data_to_struct_data(cJSON *json_data, leda_device_data_t **struct_data,
         sub_item = cJSON_GetObjectItem(item, "type");
         if (NULL == sub_item || sub_item->type != cJSON_String)
         {
-            free(data);
+            mem_free(data);
             return LE_ERROR_INVAILD_PARAM;
         }
         data[i].type = type_string_to_number(sub_item->valuestring);
@@ -297,7 +382,7 @@ int json_data_to_struct_data(cJSON *json_data, leda_device_data_t **struct_data,
         sub_item = cJSON_GetObjectItem(item, "value");
         if (NULL == sub_item)
         {
-            free(data);
+            mem_free(data);
             return LE_ERROR_INVAILD_PARAM;
         }
 
@@ -306,7 +391,7 @@ int json_data_to_struct_data(cJSON *json_data, leda_device_data_t **struct_data,
         case LEDA_TYPE_INT:
         case LEDA_TYPE_BOOL:
         case LEDA_TYPE_ENUM:
-            snprintf(data[i].value, MAX_PARAM_VALUE_LENGTH, "%d", sub_item->valueint);
+            _leda_format_int(data[i].value, sub_item->valueint);
             break;
         case LEDA_TYPE_FLOAT:
         case LEDA_TYPE_DOUBLE:
@@ -322,7 +407,7 @@ int json_data_to_struct_data(cJSON *json_data, leda_device_data_t **struct_data,
             if (!buff)
             {
                 log_w(LOG_TAG, "no memory can allocate\n");
-                free(data);
+                mem_free(data);
                 return LE_ERROR_ALLOCATING_MEM;
             }
             snprintf(data[i].value, MAX_PARAM_VALUE_LENGTH, "%s", buff);
@@ -374,7 +459,7 @@ static int _ws_insert_reply(int msg_id)
     ws_msg_reply_t *reply = NULL;
 
     pthread_mutex_lock(&g_ws_msg_reply_lock);
-    reply = (ws_msg_reply_t *)malloc(sizeof(ws_msg_reply_t));
+    reply = (ws_msg_reply_t *)mem_malloc(MEM_CORE, sizeof(ws_msg_reply_t));
     if (NULL == reply)
     {
         log_w(LOG_TAG, "no memory can allocate\n");
@@ -385,7 +470,7 @@ static int _ws_insert_reply(int msg_id)
     memset(reply, 0, sizeof(ws_msg_reply_t));
     if (0 != sem_init(&reply->sem, 0, 0))
     {
-        free(reply);
+        mem_free(reply);
         log_w(LOG_TAG, "semphore init failed\n");
         pthread_mutex_unlock(&g_ws_msg_reply_lock);
         return LE_ERROR_UNKNOWN;
@@ -393,8 +478,10 @@ static int _ws_insert_reply(int msg_id)
 
     reply->msg_id = msg_id;
     reply->code = LE_ERROR_UNKNOWN;
+    reply->sent_us = metrics_now_us();
 
     list_add(&reply->list_node, &g_ws_msg_reply_list);
+    ++g_ws_msg_reply_cnt;
     pthread_mutex_unlock(&g_ws_msg_reply_lock);
 
     return LE_SUCCESS;
@@ -414,21 +501,23 @@ static void _ws_remove_reply(int msg_id)
     pthread_mutex_lock(&g_ws_msg_reply_lock);
     if (NULL != reply->payload)
     {
-        free(reply->payload);
+        mem_free(reply->payload);
         reply->payload = NULL;
     }
     sem_destroy(&reply->sem);
     list_del(&reply->list_node);
-    free(reply);
+    mem_free(reply);
+    --g_ws_msg_reply_cnt;
 
     pthread_mutex_unlock(&g_ws_msg_reply_lock);
 
     return;
 }
 
-static int _ws_set_reply_result(int msg_id, int code, char *payload)
+static int _ws_set_reply_result(int msg_id, int code, const cJSON *payload)
 {
-    ws_msg_reply_t *reply = NULL;
+    ws_msg_reply_t  *reply          = NULL;
+    char            *payload_str    = NULL;
 
     reply = _ws_get_reply_by_msg_id(msg_id);
     if (NULL == reply)
@@ -436,13 +525,22 @@ static int _ws_set_reply_result(int msg_id, int code, char *payload)
         return LE_ERROR_UNKNOWN;
     }
 
+    metrics_observe(METRIC_HIST_REQUEST_RTT, metrics_now_us() - reply->sent_us);
+
+    /* 只有等待应答的请求需要payload文本 */
+    if (NULL != payload)
+    {
+        payload_str = cJSON_PrintUnformatted(payload);
+    }
+
     pthread_mutex_lock(&g_ws_msg_reply_lock);
     reply->code = code;
-    if (NULL != payload)
+    if (NULL != payload_str)
     {
-        reply->payload = strdup(payload);
+        reply->payload = mem_strdup(MEM_CORE, payload_str);
     }
     pthread_mutex_unlock(&g_ws_msg_reply_lock);
+    cJSON_free(payload_str);
 
     sem_post(&reply->sem);
 
@@ -469,8 +567,9 @@ static int _ws_get_reply_result(int msg_id, int timeout_ms, int *code, char **pa
         return LE_ERROR_UNKNOWN;
     }
 
-    ts.tv_nsec = ts.tv_nsec + (timeout_ms % 1000) * 1000000000;
-    ts.tv_sec  = ts.tv_sec + timeout_ms / 1000;
+    ts.tv_nsec = ts.tv_nsec + (timeout_ms % 1000) * 1000000;
+    ts.tv_sec  = ts.tv_sec + timeout_ms / 1000 + ts.tv_nsec / 1000000000;
+    ts.tv_nsec = ts.tv_nsec % 1000000000;
     while ((ret = sem_timedwait(&reply->sem, &ts)) == -1 && errno == EINTR)
     {
         continue;
@@ -479,6 +578,7 @@ static int _ws_get_reply_result(int msg_id, int timeout_ms, int *code, char **pa
     if (-1 == ret)
     {
         _ws_remove_reply(msg_id);
+        metrics_inc(METRIC_REPLY_TIMEOUTS);
         log_w(LOG_TAG, "It's time out that get reply from request msg id %d", msg_id);
         return LE_ERROR_TIMEOUT;
     }
@@ -490,7 +590,7 @@ static int _ws_get_reply_result(int msg_id, int timeout_ms, int *code, char **pa
 
     if (NULL != payload)
     {
-        *payload = strdup(reply->payload);
+        *payload = mem_strdup(MEM_CORE, reply->payload);
     }
 
     _ws_remove_reply(msg_id);
@@ -498,11 +598,172 @@ static int _ws_get_reply_result(int msg_id, int timeout_ms, int *code, char **pa
     return LE_SUCCESS;
 }
 
-int leda_send_rsp(int code, int msg_id, cJSON *payload)
+/* 以预置字典压缩JSON文本, 结果用cJSON_free释放 */
+static char *_leda_zdict_compress(const char *msg, size_t *len)
+{
+    char    *data   = NULL;
+    size_t  size    = zdict_bound(*len);
+
+    data = cJSON_malloc(size);
+    if (NULL == data)
+    {
+        return NULL;
+    }
+
+    if (0 != zdict_compress(msg, *len, data, &size))
+    {
+        cJSON_free(data);
+        return NULL;
+    }
+    *len = size;
+
+    return data;
+}
+
+/* 按当前连接协商的编码序列化消息, 结果用cJSON_free释放 */
+static char *_leda_print_msg(const cJSON *root, size_t *len, int *type)
+{
+    char *msg   = NULL;
+    char *data  = NULL;
+
+    if (LEDA_ENCODING_CBOR == g_conn_encoding)
+    {
+        *type = 1;
+        return cbor_encode(root, len);
+    }
+
+    *type = 0;
+    msg = cJSON_PrintUnformatted(root);
+    if (NULL == msg)
+    {
+        return NULL;
+    }
+    *len = strlen(msg);
+
+    if (LEDA_ENCODING_JSON_ZDICT == g_conn_encoding)
+    {
+        *type = 1;
+        data = _leda_zdict_compress(msg, len);
+        cJSON_free(msg);
+        return data;
+    }
+
+    return msg;
+}
+
+int leda_send_json(const char *msg, size_t len)
+{
+    return leda_send_json_tracked(msg, len, NULL, 0);
+}
+
+int leda_send_json_tracked(const char *msg, size_t len, const unsigned int *msg_ids, int id_cnt)
+{
+    cJSON           *root   = NULL;
+    char            *text   = NULL;
+    char            *data   = NULL;
+    size_t          size    = 0;
+    int             ret     = LE_SUCCESS;
+    mem_arena_mark  mark    = {0};
+
+    if (LEDA_ENCODING_JSON_ZDICT == g_conn_encoding)
+    {
+        size = len;
+        data = _leda_zdict_compress(msg, &size);
+        if (NULL == data)
+        {
+            return LE_ERROR_ALLOCATING_MEM;
+        }
+        ret = wsc_add_tracked_msg(data, size, 1, msg_ids, id_cnt);
+        cJSON_free(data);
+        return ret;
+    }
+
+    if (LEDA_ENCODING_CBOR != g_conn_encoding)
+    {
+        return wsc_add_tracked_msg(msg, len, 0, msg_ids, id_cnt);
+    }
+
+    /* 缓存和在途表中保存的是JSON文本, 不一定以'\0'结尾 */
+    text = mem_malloc(MEM_CORE, len + 1);
+    if (NULL == text)
+    {
+        return LE_ERROR_ALLOCATING_MEM;
+    }
+    memcpy(text, msg, len);
+    text[len] = '\0';
+
+    /* 转换用的临时树只在本函数中使用 */
+    mem_arena_begin(&mark);
+    root = cJSON_Parse(text);
+    mem_free(text);
+    if (NULL == root)
+    {
+        mem_arena_end(&mark);
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    data = cbor_encode(root, &size);
+    cJSON_Delete(root);
+    if (NULL == data)
+    {
+        mem_arena_end(&mark);
+        return LE_ERROR_ALLOCATING_MEM;
+    }
+
+    ret = wsc_add_tracked_msg(data, size, 1, msg_ids, id_cnt);
+    cJSON_free(data);
+    mem_arena_end(&mark);
+
+    return ret;
+}
+
+/* 发送异步上报, 开启批量发送时先进入批量缓冲区 */
+static int _leda_send_report(unsigned int msg_id, const cJSON *root, const char *msg)
+{
+    char    *frame  = NULL;
+    size_t  len     = 0;
+    int     ret     = LEDA_BATCH_BYPASS;
+    int     tracked = leda_reliable_enabled();  /* 可靠模式下发送队列文件保留消息直到收到应答 */
+
+    /* 没有消息树时(生成文本后连接才协商为CBOR)由leda_send_json转换 */
+    if ((LEDA_ENCODING_CBOR != g_conn_encoding) || (NULL == root))
+    {
+        len = strlen(msg);
+        if ((LEDA_ENCODING_CBOR != g_conn_encoding) && leda_batch_enabled())
+        {
+            ret = leda_batch_add(msg_id, msg, len, 0);
+        }
+
+        return (LEDA_BATCH_BYPASS == ret) ? leda_send_json_tracked(msg, len, &msg_id, tracked) : ret;
+    }
+
+    frame = cbor_encode(root, &len);
+    if (NULL == frame)
+    {
+        return LE_ERROR_ALLOCATING_MEM;
+    }
+
+    if (leda_batch_enabled())
+    {
+        ret = leda_batch_add(msg_id, frame, len, 1);
+    }
+    if (LEDA_BATCH_BYPASS == ret)
+    {
+        ret = wsc_add_tracked_msg(frame, len, 1, &msg_id, tracked);
+    }
+    cJSON_free(frame);
+
+    return ret;
+}
+
+static int _leda_send_rsp(int code, int msg_id, cJSON *payload)
 {
     cJSON   *root   = NULL;
     char    *msg    = NULL;
+    size_t  len     = 0;
+    int     type    = 0;
     int     ret     = LE_SUCCESS;
+    uint64_t begin  = trace_enabled() ? trace_now_us() : 0;
 
     root = cJSON_CreateObject();
     if (NULL == root)
@@ -511,8 +772,8 @@ int leda_send_rsp(int code, int msg_id, cJSON *payload)
         return LE_ERROR_ALLOCATING_MEM;
     }
 
-    cJSON_AddNumberToObject(root, "code", code);
-    cJSON_AddNumberToObject(root, "messageId", msg_id);
+    cJSON_AddItemToObjectCS(root, "code", cJSON_CreateNumber(code));
+    cJSON_AddItemToObjectCS(root, "messageId", cJSON_CreateNumber(msg_id));
     if (NULL == payload)
     {
         payload = cJSON_CreateObject();
@@ -523,9 +784,9 @@ int leda_send_rsp(int code, int msg_id, cJSON *payload)
             return LE_ERROR_ALLOCATING_MEM;
         }
     }
-    cJSON_AddItemToObject(root, "payload", payload);
+    cJSON_AddItemToObjectCS(root, "payload", payload);
 
-    msg = cJSON_PrintUnformatted(root);
+    msg = _leda_print_msg(root, &len, &type);
     cJSON_Delete(root);
     if (NULL == msg)
     {
@@ -533,10 +794,117 @@ int leda_send_rsp(int code, int msg_id, cJSON *payload)
         return LE_ERROR_ALLOCATING_MEM;
     }
 
-    log_i(LOG_TAG, "send response msg: %s", msg);
-    ret = wsc_add_msg(msg, strlen(msg) + 1, 0);
+    if (0 == type)
+    {
+        /* 文本应答带上结尾的'\0' */
+        LOG_PAYLOAD("send response", msg);
+        len += 1;
+    }
+    trace_set_current(msg_id);
+    ret = wsc_add_msg(msg, len, type);
+    trace_set_current(0);
     cJSON_free(msg);
 
+    if (trace_enabled())
+    {
+        trace_span("send_rsp", msg_id, begin, trace_now_us());
+    }
+
+    return ret;
+}
+
+int leda_send_rsp(int code, int msg_id, cJSON *payload)
+{
+    mem_arena_mark  mark    = {0};
+    int             ret     = LE_SUCCESS;
+
+    /* payload可能来自堆, 随应答树一起释放时按各自的来源处理 */
+    mem_arena_begin(&mark);
+    ret = _leda_send_rsp(code, msg_id, payload);
+    mem_arena_end(&mark);
+
+    return ret;
+}
+
+static int _leda_get_properties_cb(char *pk, char *dn, int msg_id, leda_device_data_t *data, int data_cnt)
+{
+    int         ret     = LE_ERROR_UNKNOWN;
+    uint64_t    begin   = 0;
+    uint64_t    end     = 0;
+
+    if (g_devs_cb.get_properties_cb)
+    {
+        begin = metrics_now_us();
+        ret = g_devs_cb.get_properties_cb(pk, dn, data, data_cnt, g_devs_cb.usr_data_get_property);
+        end = metrics_now_us();
+        metrics_observe(METRIC_HIST_CALLBACK, end - begin);
+        if (trace_enabled())
+        {
+            trace_span("callback", msg_id, begin, end);
+        }
+    }
+    else
+    {
+        log_w(LOG_TAG, "get_properties_cb no hook init!\n");
+    }
+
+    return ret;
+}
+
+/* 有效期内的属性从缓存填写, 其余的交给回调获取, 获取到的值写回缓存 */
+static int _leda_get_cached_properties(char *pk, char *dn, int msg_id, leda_device_data_t *data, int data_cnt)
+{
+    int                 ret     = LE_SUCCESS;
+    int                 *stale  = NULL;
+    int                 cnt     = 0;
+    int                 i       = 0;
+    leda_device_data_t  *sub    = NULL;
+
+    stale = mem_malloc(MEM_CORE, sizeof(int) * data_cnt);
+    if (NULL == stale)
+    {
+        log_w(LOG_TAG, "no memory can allocate\n");
+        return LE_ERROR_ALLOCATING_MEM;
+    }
+
+    cnt = leda_cache_lookup(pk, dn, data, data_cnt, stale);
+    if (cnt == data_cnt)
+    {
+        ret = _leda_get_properties_cb(pk, dn, msg_id, data, data_cnt);
+        if (LE_SUCCESS == ret)
+        {
+            leda_cache_update(pk, dn, data, data_cnt);
+        }
+    }
+    else if (0 != cnt)
+    {
+        sub = mem_malloc(MEM_CORE, sizeof(leda_device_data_t) * cnt);
+        if (NULL == sub)
+        {
+            mem_free(stale);
+            log_w(LOG_TAG, "no memory can allocate\n");
+            return LE_ERROR_ALLOCATING_MEM;
+        }
+
+        for (i = 0; i < cnt; i++)
+        {
+            sub[i] = data[stale[i]];
+        }
+
+        ret = _leda_get_properties_cb(pk, dn, msg_id, sub, cnt);
+        if (LE_SUCCESS == ret)
+        {
+            for (i = 0; i < cnt; i++)
+            {
+                data[stale[i]] = sub[i];
+            }
+            leda_cache_update(pk, dn, sub, cnt);
+        }
+        mem_free(sub);
+    }
+
+    mem_free(stale);
+
     return ret;
 }
 
@@ -557,19 +925,19 @@ int leda_rsp_get_properties(char *pk, char *dn, int msg_id, leda_device_data_t *
         return LE_ERROR_ALLOCATING_MEM;
     }
 
-    if (g_devs_cb.get_properties_cb)
+    if (leda_cache_enabled() && (data_cnt > 0))
     {
-        ret = g_devs_cb.get_properties_cb(pk, dn, data, data_cnt, g_devs_cb.usr_data_get_property);
+        ret = _leda_get_cached_properties(pk, dn, msg_id, data, data_cnt);
     }
     else
     {
-        log_w(LOG_TAG, "get_properties_cb no hook init!\n");
+        ret = _leda_get_properties_cb(pk, dn, msg_id, data, data_cnt);
     }
 
     if (ret == LE_SUCCESS)
     {
         properties = struct_data_to_json_data(data, data_cnt);
-        cJSON_AddItemToObject(payload, "properties", properties);
+        cJSON_AddItemToObjectCS(payload, "properties", properties);
     }
 
     return leda_send_rsp(ret, msg_id, payload);
@@ -577,32 +945,75 @@ int leda_rsp_get_properties(char *pk, char *dn, int msg_id, leda_device_data_t *
 
 int leda_rsp_set_properties(char *pk, char *dn, int msg_id, leda_device_data_t *data, int data_cnt)
 {
-    int ret = LE_ERROR_UNKNOWN;
+    int         ret     = LE_ERROR_UNKNOWN;
+    uint64_t    begin   = 0;
+    uint64_t    end     = 0;
 
     if (g_devs_cb.set_properties_cb)
     {
+        begin = metrics_now_us();
         ret = g_devs_cb.set_properties_cb(pk, dn, data, data_cnt, g_devs_cb.set_properties_cb);
+        end = metrics_now_us();
+        metrics_observe(METRIC_HIST_CALLBACK, end - begin);
+        if (trace_enabled())
+        {
+            trace_span("callback", msg_id, begin, end);
+        }
     }
     else
     {
         log_w(LOG_TAG, "set_properties_cb no hook init!\n");
     }
 
+    if (LE_SUCCESS == ret)
+    {
+        leda_cache_update(pk, dn, data, data_cnt);
+    }
+
     return leda_send_rsp(ret, msg_id, NULL);
 }
 
+/* 以key为空的项结束的输出参数组装为应答的outputData */
+static cJSON *_leda_output_payload(const leda_device_data_t *output_params)
+{
+    int     params_cnt  = 0;
+    cJSON   *payload    = NULL;
+    cJSON   *params     = NULL;
+
+    while ((params_cnt < g_devs_cb.service_output_max_count) && (0 != output_params[params_cnt].key[0]))
+    {
+        ++params_cnt;
+    }
+
+    payload = cJSON_CreateObject();
+    if (NULL == payload)
+    {
+        log_w(LOG_TAG, "no memory can allocate\n");
+        return NULL;
+    }
+
+    params = struct_data_to_json_data(output_params, params_cnt);
+    if (NULL != params)
+    {
+        cJSON_AddItemToObjectCS(payload, "outputData", params);
+    }
+
+    return payload;
+}
+
 int leda_rsp_call_service(char *pk, char *dn, int msg_id, const char *service_name, leda_device_data_t *input_params,
                           int params_cnt)
 {
     int     ret         = LE_ERROR_UNKNOWN;
-    int     i           = 0;
 
     cJSON   *payload    = NULL;
-    cJSON   *params     = NULL;
 
     leda_device_data_t *output_params = NULL;
 
-    output_params = malloc(sizeof(leda_device_data_t) * g_devs_cb.service_output_max_count);
+    uint64_t begin       = 0;
+    uint64_t end         = 0;
+
+    output_params = mem_malloc(MEM_CORE, sizeof(leda_device_data_t) * g_devs_cb.service_output_max_count);
     if (!output_params)
     {
         log_w(LOG_TAG, "no memory can allocate\n");
@@ -612,7 +1023,14 @@ int leda_rsp_call_service(char *pk, char *dn, int msg_id, const char *service_na
     memset(output_params, 0, sizeof(leda_device_data_t) * g_devs_cb.service_output_max_count);
     if (g_devs_cb.call_service_cb)
     {
+        begin = metrics_now_us();
         ret = g_devs_cb.call_service_cb(pk, dn, service_name, input_params, params_cnt, output_params, g_devs_cb.usr_data_call_service);
+        end = metrics_now_us();
+        metrics_observe(METRIC_HIST_CALLBACK, end - begin);
+        if (trace_enabled())
+        {
+            trace_span("callback", msg_id, begin, end);
+        }
         if (ret != LE_SUCCESS)
         {
             goto end;
@@ -623,43 +1041,99 @@ int leda_rsp_call_service(char *pk, char *dn, int msg_id, const char *service_na
         log_w(LOG_TAG, "call_service_cb no hook init!\n");
     }
 
-    params_cnt = 0;
-    for (i = 0; i < g_devs_cb.service_output_max_count; i++)
+    payload = _leda_output_payload(output_params);
+
+end:
+
+    if (NULL != output_params)
     {
-        if (strlen(output_params[i].key) == 0)
-        {
-            break;
-        }
-        ++params_cnt;
+        mem_free(output_params);
     }
 
-    payload = cJSON_CreateObject();
-    if (NULL == payload)
+    return leda_send_rsp(ret, msg_id, payload);
+}
+
+static int leda_rsp_custom_method(const method_handler_t *handler, char *pk, char *dn, int msg_id,
+                                  leda_device_data_t *input_params, int params_cnt)
+{
+    int     ret         = LE_ERROR_UNKNOWN;
+
+    cJSON   *payload    = NULL;
+
+    leda_device_data_t *output_params = NULL;
+
+    uint64_t begin       = 0;
+    uint64_t end         = 0;
+
+    output_params = mem_calloc(MEM_CORE, (g_devs_cb.service_output_max_count > 0) ? g_devs_cb.service_output_max_count : 1,
+                               sizeof(leda_device_data_t));
+    if (!output_params)
     {
         log_w(LOG_TAG, "no memory can allocate\n");
-        goto end;
+        return LE_ERROR_ALLOCATING_MEM;
     }
 
-    params = struct_data_to_json_data(output_params, params_cnt);
-    if (NULL != params)
+    begin = metrics_now_us();
+    ret = handler->handler(pk, dn, handler->method, input_params, params_cnt, output_params, handler->usr_data);
+    end = metrics_now_us();
+    metrics_observe(METRIC_HIST_CALLBACK, end - begin);
+    if (trace_enabled())
     {
-        cJSON_AddItemToObject(payload, "outputData", params);
+        trace_span("callback", msg_id, begin, end);
     }
 
-end:
-
-    if (NULL != output_params)
+    if (ret == LE_SUCCESS)
     {
-        free(output_params);
+        payload = _leda_output_payload(output_params);
     }
 
+    mem_free(output_params);
+
     return leda_send_rsp(ret, msg_id, payload);
 }
 
-static void threadpool_recv_proc(void *arg)
+/* 内置方法按首字符定位后比较一次, 其余在注册的自定义方法中查找 */
+static int _leda_method_lookup(const char *method)
 {
-    parsed_msg_t        *parsed_msg     = NULL;
-    char                *payload_str    = NULL;
+    int     candidate   = RECV_METHOD_UNKNOWN;
+    size_t  len         = 0;
+    int     i           = 0;
+
+    switch (method[0])
+    {
+    case 'g':
+        candidate = RECV_METHOD_GET_PROPERTY;
+        break;
+    case 's':
+        candidate = RECV_METHOD_SET_PROPERTY;
+        break;
+    case 'c':
+        candidate = RECV_METHOD_CALL_SERVICE;
+        break;
+    default:
+        break;
+    }
+
+    if ((RECV_METHOD_UNKNOWN != candidate) && (0 == strcmp(g_method_names[candidate], method)))
+    {
+        return candidate;
+    }
+
+    len = strlen(method);
+    for (i = 0; i < g_method_handler_cnt; i++)
+    {
+        if ((len == g_method_handlers[i].len) && (0 == memcmp(g_method_handlers[i].method, method, len)))
+        {
+            return RECV_METHOD_CUSTOM + i;
+        }
+    }
+
+    return RECV_METHOD_UNKNOWN;
+}
+
+static void threadpool_recv_proc(void *arg)
+{
+    parsed_msg_t        *parsed_msg     = NULL;
     char                *pk             = NULL;
     char                *dn             = NULL;;
     cJSON               *item           = NULL;
@@ -668,23 +1142,12 @@ static void threadpool_recv_proc(void *arg)
     int                 data_cnt        = 0;
 
     parsed_msg = (parsed_msg_t *)arg;
-    if (parsed_msg->msg_type == MSG_RSP)
+    if (trace_enabled())
     {
-        payload_str = cJSON_PrintUnformatted(parsed_msg->payload);
-        if (NULL != payload_str)
-        {
-            if (LE_SUCCESS != _ws_set_reply_result(parsed_msg->msg_id, parsed_msg->code, payload_str))
-            {
-                if (g_devs_cb.report_reply_cb)
-                {
-                    log_i(LOG_TAG, "recive response msg id: %u\n", parsed_msg->msg_id);
-                    g_devs_cb.report_reply_cb(parsed_msg->msg_id, parsed_msg->code, g_devs_cb.usr_data_report_reply);
-                }
-            }
-            cJSON_free(payload_str);
-        }
+        trace_span("queue", parsed_msg->msg_id, parsed_msg->queued_us, trace_now_us());
     }
-    else if (parsed_msg->msg_type == MSG_METHOD)
+
+    if (parsed_msg->msg_type == MSG_METHOD)
     {
         item = cJSON_GetObjectItem(parsed_msg->payload, "productKey");
         if (NULL == item)
@@ -700,37 +1163,45 @@ static void threadpool_recv_proc(void *arg)
         }
         dn = item->valuestring;
 
+        /* 自定义方法的payload可以没有参数 */
         item = cJSON_GetObjectItem(parsed_msg->payload, "properties");
         if (NULL == item)
         {
             item = cJSON_GetObjectItem(parsed_msg->payload, "inputData");
-            if (NULL == item)
+            if ((NULL == item) && (parsed_msg->method < RECV_METHOD_CUSTOM))
             {
                 goto end;
             }
         }
 
-        if (LE_SUCCESS != json_data_to_struct_data(item, &data, &data_cnt))
+        if ((NULL != item) && (LE_SUCCESS != json_data_to_struct_data(item, &data, &data_cnt)))
         {
             goto end;
         }
 
-        if (0 == strcmp(parsed_msg->method, METHOD_GET_PROPERTY))
+        switch (parsed_msg->method)
         {
+        case RECV_METHOD_GET_PROPERTY:
             leda_rsp_get_properties(pk, dn, parsed_msg->msg_id, data, data_cnt);
-        }
-        else if (0 == strcmp(parsed_msg->method, METHOD_SET_PROPERTY))
-        {
+            break;
+        case RECV_METHOD_SET_PROPERTY:
             leda_rsp_set_properties(pk, dn, parsed_msg->msg_id, data, data_cnt);
-        }
-        else if (0 == strcmp(parsed_msg->method, METHOD_CALL_SERVICE))
-        {
+            break;
+        case RECV_METHOD_CALL_SERVICE:
             service_name = cJSON_GetObjectItem(parsed_msg->payload, "identifier");
             if (NULL == service_name)
             {
                 goto end;
             }
             leda_rsp_call_service(pk, dn, parsed_msg->msg_id, service_name->valuestring, data, data_cnt);
+            break;
+        default:
+            if ((parsed_msg->method >= RECV_METHOD_CUSTOM) && (parsed_msg->method < RECV_METHOD_CUSTOM + g_method_handler_cnt))
+            {
+                leda_rsp_custom_method(&g_method_handlers[parsed_msg->method - RECV_METHOD_CUSTOM], pk, dn,
+                                       parsed_msg->msg_id, data, data_cnt);
+            }
+            break;
         }
     }
 
@@ -742,18 +1213,18 @@ end:
             cJSON_Delete(parsed_msg->payload);
         }
 
-        free(parsed_msg);
+        mem_free(parsed_msg);
     }
 
     if (NULL != data)
     {
-        free(data);
+        mem_free(data);
     }
 
     return;
 }
 
-static int leda_parse_receive_msg(cJSON *root, int *msg_id, int *code, char **method, cJSON **payload)
+int leda_parse_receive_msg(cJSON *root, int *msg_id, int *code, char **method, cJSON **payload)
 {
     cJSON *item = NULL;
 
@@ -789,16 +1260,126 @@ static int leda_parse_receive_msg(cJSON *root, int *msg_id, int *code, char **me
     return MSG_METHOD;
 }
 
-static void cb_ws_recv(const char *msg, size_t len, void *user)
+/* 唤醒等待应答的请求, 或将异步上报的应答交给用户回调 */
+static void _ws_dispatch_rsp(int msg_id, int code, const cJSON *payload)
 {
-    cJSON           *root       = NULL;
-    cJSON           *payload    = NULL;
+    /* 发送队列文件中等待该应答的消息可以释放, 包括上次运行留下的消息 */
+    wsc_ack_msg(msg_id);
 
-    int             msg_type    = MSG_INVALID; 
-    int             msg_id      = 0;
+    if (LE_SUCCESS == _ws_set_reply_result(msg_id, code, payload))
+    {
+        return;
+    }
+
+    /* 可靠模式下重传可能带来重复应答, 只回调一次 */
+    if (!leda_reliable_enabled() || (LE_SUCCESS == leda_reliable_ack(msg_id)))
+    {
+        log_i(LOG_TAG, "recive response msg id: %u\n", msg_id);
+        leda_report_reply(msg_id, code);
+    }
+}
 
+static void _ws_dispatch_msg(const cJSON *root, uint64_t enter)
+{
+    cJSON           *payload    = NULL;
     char            *method     = NULL;
     parsed_msg_t    *parsed_msg = NULL;
+    int             msg_type    = MSG_INVALID;
+    int             msg_id      = 0;
+    int             code        = 0;
+    int             method_id   = RECV_METHOD_UNKNOWN;
+
+    cJSON           *pk         = NULL;
+    cJSON           *dn         = NULL;
+    unsigned int    lane        = 0;
+
+    metrics_inc(METRIC_MSGS_RECV);
+
+    msg_type = leda_parse_receive_msg((cJSON *)root, &msg_id, &code, &method, &payload);
+    if (MSG_RSP == msg_type)
+    {
+        /* 应答在接收线程中直接处理, 不排在设备回调之后 */
+        if (trace_enabled())
+        {
+            trace_span("recv", msg_id, wsc_recv_begin_us(), enter);
+            trace_span("parse", msg_id, enter, trace_now_us());
+        }
+        _ws_dispatch_rsp(msg_id, code, payload);
+        return;
+    }
+    else if (MSG_METHOD != msg_type)
+    {
+        return;
+    }
+
+    /* 方法名在接收线程中直接从解析结果查表, 不支持的方法不再进入接收通道 */
+    method_id = _leda_method_lookup(method);
+    if (RECV_METHOD_UNKNOWN == method_id)
+    {
+        log_w(LOG_TAG, "unsupported method: %s, msg id: %d\n", method, msg_id);
+        return;
+    }
+
+    parsed_msg = mem_malloc(MEM_CORE, sizeof(parsed_msg_t));
+    if (NULL == parsed_msg)
+    {
+        log_w(LOG_TAG, "no memory can allocate\n");
+        return;
+    }
+    memset(parsed_msg, 0, sizeof(parsed_msg_t));
+    parsed_msg->msg_type    = msg_type;
+    parsed_msg->msg_id      = msg_id;
+    parsed_msg->method      = method_id;
+
+    if (NULL != payload)
+    {
+        mem_arena_pause();
+        parsed_msg->payload = cJSON_Duplicate(payload, 1);
+        mem_arena_resume();
+        if (NULL == parsed_msg->payload)
+        {
+            log_w(LOG_TAG, "no memory can allocate\n");
+            mem_free(parsed_msg);
+            return;
+        }
+    }
+
+    if (trace_enabled())
+    {
+        parsed_msg->queued_us = trace_now_us();
+        trace_span("recv", parsed_msg->msg_id, wsc_recv_begin_us(), enter);
+        trace_span("parse", parsed_msg->msg_id, enter, parsed_msg->queued_us);
+    }
+
+    lane = (unsigned int)parsed_msg->msg_id % RECV_LANE_COUNT;
+    pk = cJSON_GetObjectItem(parsed_msg->payload, "productKey");
+    dn = cJSON_GetObjectItem(parsed_msg->payload, "deviceName");
+    if ((NULL != pk) && (cJSON_String == pk->type) && (NULL != dn) && (cJSON_String == dn->type))
+    {
+        lane = leda_device_hash(pk->valuestring, dn->valuestring) % RECV_LANE_COUNT;
+    }
+
+    if (0 != threadpool_add(g_threadpool[lane], threadpool_recv_proc, (void *)parsed_msg, 0))
+    {
+        metrics_inc(METRIC_RECV_DROPPED);
+        log_w(LOG_TAG, "recv lane %u is busy, drop msg id: %d\n", lane, parsed_msg->msg_id);
+        if (NULL != parsed_msg->payload)
+        {
+            cJSON_Delete(parsed_msg->payload);
+        }
+        mem_free(parsed_msg);
+    }
+}
+
+static void cb_ws_recv(const char *msg, size_t len, void *user)
+{
+    cJSON           *root       = NULL;
+    cJSON           *item       = NULL;
+    uint64_t        enter       = 0;
+    int             binary      = 0;
+    char            *text       = NULL;
+    size_t          text_len    = 0;
+    mem_arena_mark  mark        = {0};
 
     if (NULL == msg)
     {
@@ -806,296 +1387,936 @@ static void cb_ws_recv(const char *msg, size_t len, void *user)
         return;
     }
 
-    log_i(LOG_TAG, "receive reply msg: %s", msg);
+    binary = wsc_recv_is_binary();
+    if (!binary)
+    {
+        LOG_PAYLOAD("receive reply", msg);
+    }
+    metrics_add(METRIC_BYTES_RECV, len);
+    enter = trace_enabled() ? trace_now_us() : 0;
 
-    root = cJSON_Parse(msg);
+    /* 解析出的消息只在本函数中使用, 从arena分配, 交给接收通道的payload另行复制 */
+    mem_arena_begin(&mark);
+    if (!binary)
+    {
+        root = cJSON_Parse(msg);
+    }
+    else if (LEDA_ENCODING_JSON_ZDICT == g_conn_encoding)
+    {
+        text = zdict_decompress(msg, len, ZDICT_MAX_INFLATE, &text_len);
+        root = (NULL != text) ? cJSON_Parse(text) : NULL;
+        mem_free(text);
+    }
+    else
+    {
+        root = cbor_decode(msg, len);
+    }
     if (NULL == root)
     {
-        log_w(LOG_TAG, "receive reply msg is invalid json format\n");
+        metrics_inc(METRIC_PARSE_FAILURES);
+        log_w(LOG_TAG, "receive reply msg is invalid %s format\n",
+              !binary ? "json" : ((LEDA_ENCODING_JSON_ZDICT == g_conn_encoding) ? "zdict" : "cbor"));
+        mem_arena_end(&mark);
         return;
     }
 
-    parsed_msg = malloc(sizeof(parsed_msg_t));
-    if (NULL == parsed_msg)
+    /* 批量消息为消息数组, 按元素分别处理 */
+    if (cJSON_Array == root->type)
     {
+        for (item = root->child; NULL != item; item = item->next)
+        {
+            _ws_dispatch_msg(item, enter);
+        }
+    }
+    else
+    {
+        _ws_dispatch_msg(root, enter);
+    }
+    cJSON_Delete(root);
+    mem_arena_end(&mark);
+
+    return;
+}
+
+int leda_add_task(void (*routine)(void *), void *arg)
+{
+    if (NULL == g_task_pool)
+    {
+        return LE_ERROR_UNKNOWN;
+    }
+
+    if (0 != threadpool_add(g_task_pool, routine, arg, 0))
+    {
+        log_w(LOG_TAG, "task pool is busy\n");
+        return LE_ERROR_UNKNOWN;
+    }
+
+    return LE_SUCCESS;
+}
+
+void leda_report_reply(unsigned int msg_id, int code)
+{
+    if (g_devs_cb.report_reply_cb)
+    {
+        /* 接收和上报路径可能处于arena中, 用户在回调中创建的cJSON树须来自堆 */
+        mem_arena_pause();
+        g_devs_cb.report_reply_cb(msg_id, code, g_devs_cb.usr_data_report_reply);
+        mem_arena_resume();
+    }
+}
+
+static void cb_ws_close(void *user)
+{
+    g_conn_state = LEDA_WS_DISCONNECTED;
+    g_conn_encoding = LEDA_ENCODING_JSON;
+    metrics_inc(METRIC_DISCONNECTS);
+    leda_batch_drop();
+    leda_restore_stop();
+    leda_reliable_resend_stop();
+    leda_spool_replay_stop();
+    leda_device_reset_online();
+    log_i(LOG_TAG, "connection failed.\n");
+
+    if (g_conn_cb.conn_state_change_cb)
+    {
+        g_conn_cb.conn_state_change_cb(LEDA_WS_DISCONNECTED, g_conn_cb.usr_data);
+    }
+
+    return;
+}
+
+static void cb_ws_estab(void *user)
+{
+    const char *protocol = wsc_get_protocol();
+
+    if ((NULL != protocol) && (0 == strcmp(protocol, CONN_PROTOCOL_CBOR)))
+    {
+        g_conn_encoding = LEDA_ENCODING_CBOR;
+    }
+    else if ((NULL != protocol) && (0 == strcmp(protocol, CONN_PROTOCOL_ZDICT)))
+    {
+        g_conn_encoding = LEDA_ENCODING_JSON_ZDICT;
+    }
+    else
+    {
+        g_conn_encoding = LEDA_ENCODING_JSON;
+    }
+    g_conn_state = LEDA_WS_CONNECTED;
+    metrics_inc(METRIC_CONNECTS);
+    log_i(LOG_TAG, "connection success, protocol: %s.\n", protocol ? protocol : CONN_PROTOCOL);
+
+    if (g_conn_cb.conn_state_change_cb)
+    {
+        g_conn_cb.conn_state_change_cb(LEDA_WS_CONNECTED, g_conn_cb.usr_data);
+    }
+
+    /* 连接建立后自动恢复之前已上线的注册设备 */
+    leda_restore_start();
+    leda_reliable_resend_start();
+    leda_spool_replay_start();
+
+    return;
+}
+
+int leda_send_request(const char *pk, const char *dn, const char *method, unsigned int *msg_id)
+{
+    cJSON           *root       = NULL;
+    cJSON           *payload    = NULL;
+
+    unsigned int    tmp_msg_id  = 0;
+    char            *msg        = NULL;
+    size_t          len         = 0;
+    int             type        = 0;
+
+    int             ret         = 0;
+
+    if (LEDA_WS_CONNECTED != g_conn_state)
+    {
+        log_w(LOG_TAG, "the connection is disconnected\n");
+        return LEDA_ERROR_CONNECTION;
+    }
+
+    if (NULL == pk || NULL == dn || NULL == method)
+    {
+        log_w(LOG_TAG, "pk: %s dn: %s method: %s has invlid value\n", pk, dn, method);
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    root = cJSON_CreateObject();
+    if (NULL == root)
+    {
+        log_w(LOG_TAG, "no memory can allocate\n");
+        return LE_ERROR_ALLOCATING_MEM;
+    }
+
+    payload = cJSON_CreateObject();
+    if (NULL == payload)
+    {
+        log_w(LOG_TAG, "no memory can allocate\n");
         cJSON_Delete(root);
+        return LE_ERROR_ALLOCATING_MEM;
+    }
+
+    tmp_msg_id = _ws_get_msg_id();
+
+    cJSON_AddItemToObjectCS(root, "version", cJSON_CreateStringReference(PROTOCOL_VERSION));
+    cJSON_AddItemToObjectCS(root, "messageId", cJSON_CreateNumber(tmp_msg_id));
+    cJSON_AddItemToObjectCS(root, "method", cJSON_CreateString(method));
+
+    cJSON_AddItemToObjectCS(root, "payload", payload);
+    cJSON_AddItemToObjectCS(payload, "productKey", cJSON_CreateString(pk));
+    cJSON_AddItemToObjectCS(payload, "deviceName", cJSON_CreateString(dn));
+
+    msg = _leda_print_msg(root, &len, &type);
+    cJSON_Delete(root);
+    if (NULL == msg)
+    {
         log_w(LOG_TAG, "no memory can allocate\n");
-        return;
+        return LE_ERROR_ALLOCATING_MEM;
     }
-    memset(parsed_msg, 0, sizeof(parsed_msg_t));
 
-    parsed_msg->msg_type = leda_parse_receive_msg(root, &parsed_msg->msg_id, &parsed_msg->code, &method, &payload);
-    if (NULL != method)
+    ret = _ws_insert_reply(tmp_msg_id);
+    if (ret != LE_SUCCESS)
     {
-        snprintf(parsed_msg->method, sizeof(parsed_msg->method), "%s", method);
+        log_w(LOG_TAG, "no memory can allocate\n");
+        cJSON_free(msg);
+        return ret;
     }
 
-    if (NULL != payload)
+    if (0 == type)
     {
-        parsed_msg->payload = cJSON_Duplicate(payload, 1);
-        if (NULL == parsed_msg->payload)
+        LOG_PAYLOAD("send request", msg);
+    }
+    trace_set_current(tmp_msg_id);
+    ret = wsc_add_msg(msg, len, type);
+    trace_set_current(0);
+    cJSON_free(msg);
+    if (ret != LE_SUCCESS)
+    {
+        log_w(LOG_TAG, "no memory can allocate\n");
+        _ws_remove_reply(tmp_msg_id);
+        return ret;
+    }
+
+    *msg_id = tmp_msg_id;
+
+    return LE_SUCCESS;
+}
+
+int leda_wait_reply(unsigned int msg_id, int timeout_ms, int *code)
+{
+    return _ws_get_reply_result(msg_id, timeout_ms, code, NULL);
+}
+
+int leda_is_connected(void)
+{
+    return (LEDA_WS_CONNECTED == g_conn_state);
+}
+
+void leda_get_backlog(unsigned int *pending_replies, unsigned int *recv_backlog, unsigned int *task_backlog)
+{
+    int i       = 0;
+    int count   = 0;
+
+    pthread_mutex_lock(&g_ws_msg_reply_lock);
+    *pending_replies = g_ws_msg_reply_cnt;
+    pthread_mutex_unlock(&g_ws_msg_reply_lock);
+
+    *recv_backlog = 0;
+    for (i = 0; i < RECV_LANE_COUNT; i++)
+    {
+        count = (NULL != g_threadpool[i]) ? threadpool_pending(g_threadpool[i]) : 0;
+        *recv_backlog += (count > 0) ? count : 0;
+    }
+
+    count = (NULL != g_task_pool) ? threadpool_pending(g_task_pool) : 0;
+    *task_backlog = (count > 0) ? count : 0;
+}
+
+int leda_send_method(const char *pk, 
+                     const char *dn, 
+                     const char *method, 
+                     const char *event_name,
+                     const leda_device_data_t *data, 
+                     int data_cnt)
+{
+    unsigned int    msg_id      = 0;
+
+    int             ret         = 0;
+    int             code        = 0;
+
+    ret = leda_send_request(pk, dn, method, &msg_id);
+    if (ret != LE_SUCCESS)
+    {
+        return ret;
+    }
+
+    ret = leda_wait_reply(msg_id, LEDA_REPLY_TIMEOUT_MS, &code);
+    log_i(LOG_TAG, "receive reply code: %d\n", code);
+    if (ret != LE_SUCCESS)
+    {
+        return ret;
+    }
+
+    return code;
+}
+
+/* 组装上报消息树, CBOR编码发送时使用 */
+static cJSON *_leda_build_report(unsigned int msg_id,
+                                 const char *pk,
+                                 const char *dn,
+                                 const char *method,
+                                 const char *event_name,
+                                 const leda_device_data_t *data,
+                                 int data_cnt,
+                                 int *ret)
+{
+    cJSON           *root       = NULL;
+    cJSON           *payload    = NULL;
+    cJSON           *params     = NULL;
+
+    root = cJSON_CreateObject();
+    if (NULL == root)
+    {
+        log_w(LOG_TAG, "no memory can allocate\n");
+        *ret = LE_ERROR_ALLOCATING_MEM;
+        return NULL;
+    }
+
+    payload = cJSON_CreateObject();
+    if (NULL == payload)
+    {
+        log_w(LOG_TAG, "no memory can allocate\n");
+        cJSON_Delete(root);
+        *ret = LE_ERROR_ALLOCATING_MEM;
+        return NULL;
+    }
+
+    cJSON_AddItemToObjectCS(root, "version", cJSON_CreateStringReference(PROTOCOL_VERSION));
+    cJSON_AddItemToObjectCS(root, "messageId", cJSON_CreateNumber(msg_id));
+    cJSON_AddItemToObjectCS(root, "method", cJSON_CreateString(method));
+
+    cJSON_AddItemToObjectCS(root, "payload", payload);
+    cJSON_AddItemToObjectCS(payload, "productKey", cJSON_CreateString(pk));
+    cJSON_AddItemToObjectCS(payload, "deviceName", cJSON_CreateString(dn));
+
+    /* 设备属性或事件数据 */
+    params = struct_data_to_json_data(data, data_cnt);
+    if (!params)
+    {
+        cJSON_Delete(root);
+        *ret = LE_ERROR_INVAILD_PARAM;
+        return NULL;
+    }
+
+    if (event_name)
+    {
+        cJSON_AddItemToObjectCS(payload, "identifier", cJSON_CreateString(event_name));
+        cJSON_AddItemToObjectCS(payload, "outputData", params);
+    }
+    else
+    {
+        cJSON_AddItemToObjectCS(payload, "properties", params);
+    }
+
+    return root;
+}
+
+static int _leda_asyn_send_method(const char *pk,
+                                  const char *dn,
+                                  const char *method,
+                                  const char *event_name,
+                                  const leda_device_data_t *data,
+                                  int data_cnt,
+                                  unsigned int *msg_id)
+{
+    cJSON           *root       = NULL;
+
+    unsigned int    tmp_msg_id  = 0;
+    char            *msg        = NULL;
+
+    int             ret         = 0;
+
+    if (NULL == pk || NULL == dn || NULL == method)
+    {
+        log_w(LOG_TAG, "pk: %s dn: %s method: %s has invlid value\n", pk, dn, method);
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    tmp_msg_id = _ws_get_msg_id();
+
+    /* 离线缓存和在途表保存JSON文本, 重发时按连接协商的编码转换.
+     * 文本按模板直接生成, 只有CBOR编码发送时需要消息树 */
+    if (LEDA_ENCODING_CBOR == g_conn_encoding)
+    {
+        root = _leda_build_report(tmp_msg_id, pk, dn, method, event_name, data, data_cnt, &ret);
+        if (NULL == root)
+        {
+            return ret;
+        }
+
+        msg = cJSON_PrintUnformatted(root);
+        if (NULL == msg)
         {
             log_w(LOG_TAG, "no memory can allocate\n");
-            free(parsed_msg);
             cJSON_Delete(root);
-            return;
+            return LE_ERROR_ALLOCATING_MEM;
+        }
+    }
+    else
+    {
+        ret = leda_envelope_build(tmp_msg_id, method, pk, dn, event_name, data, data_cnt, &msg);
+        if (LE_SUCCESS != ret)
+        {
+            if (LE_ERROR_ALLOCATING_MEM == ret)
+            {
+                log_w(LOG_TAG, "no memory can allocate\n");
+            }
+            return ret;
+        }
+    }
+
+    /* 可靠模式下登记在途消息, 超时或重连后重传 */
+    if (leda_reliable_enabled())
+    {
+        ret = leda_reliable_track(tmp_msg_id, msg, strlen(msg));
+        if (ret != LE_SUCCESS)
+        {
+            cJSON_free(msg);
+            cJSON_Delete(root);
+            return ret;
         }
     }
+
+    /* 断线期间的上报进入离线缓存, 重连后按序重放 */
+    ret = leda_spool_offer(msg, strlen(msg));
+    if (LEDA_SPOOL_BYPASS == ret)
+    {
+        LOG_PAYLOAD("send request", msg);
+        trace_set_current(tmp_msg_id);
+        ret = _leda_send_report(tmp_msg_id, root, msg);
+        trace_set_current(0);
+    }
+    else if ((LE_SUCCESS == ret) && leda_reliable_enabled())
+    {
+        leda_reliable_set_spooled(tmp_msg_id);
+    }
+    else if ((LEDA_ERROR_CONNECTION == ret) && leda_reliable_enabled())
+    {
+        /* 在途表中保留, 重连后发送 */
+        ret = LE_SUCCESS;
+    }
+    else if (LEDA_ERROR_CONNECTION == ret)
+    {
+        log_w(LOG_TAG, "the connection is disconnected\n");
+    }
+    cJSON_free(msg);
     cJSON_Delete(root);
+    if (ret != LE_SUCCESS)
+    {
+        if (leda_reliable_enabled())
+        {
+            leda_reliable_untrack(tmp_msg_id);
+        }
+        return ret;
+    }
 
-    threadpool_add(g_threadpool, threadpool_recv_proc, (void *)parsed_msg, 0);
+    if (NULL != msg_id)
+    {
+        *msg_id = tmp_msg_id;
+    }
 
-    return;
+    return ret;
+}
+
+int leda_asyn_send_method(const char *pk, 
+                          const char *dn, 
+                          const char *method, 
+                          const char *event_name,
+                          const leda_device_data_t *data, 
+                          int data_cnt,
+                          unsigned int *msg_id)
+{
+    mem_arena_mark  mark    = {0};
+    int             ret     = LE_SUCCESS;
+
+    /* 消息树和文本发送前即释放, 在途表、离线缓存和发送队列都保存副本 */
+    mem_arena_begin(&mark);
+    ret = _leda_asyn_send_method(pk, dn, method, event_name, data, data_cnt, msg_id);
+    mem_arena_end(&mark);
+
+    return ret;
+}
+
+int leda_online(const char *pk, const char *dn)
+{
+    int ret = LE_SUCCESS;
+
+    ret = leda_send_method(pk, dn, METHOD_ONLINE, NULL, NULL, 0);
+    if (LE_SUCCESS == ret)
+    {
+        leda_device_set_online(pk, dn, 1);
+        leda_filter_remove_device(pk, dn);
+    }
+
+    return ret;
+}
+
+int leda_offline(const char *pk, const char *dn)
+{
+    int ret = LE_SUCCESS;
+
+    ret = leda_send_method(pk, dn, METHOD_OFFLINE, NULL, NULL, 0);
+    if (LE_SUCCESS == ret)
+    {
+        leda_device_set_online(pk, dn, 0);
+    }
+
+    return ret;
+}
+
+/* 只上报有变化或到了重发间隔的属性, 都没有变化时不发送 */
+static int _leda_report_changed(const char *pk, const char *dn, const leda_device_data_t properties[], int properties_count,
+                                unsigned int *msg_id)
+{
+    int                 ret         = LE_SUCCESS;
+    int                 *changed    = NULL;
+    int                 cnt         = 0;
+    int                 i           = 0;
+    leda_device_data_t  *sub        = NULL;
+
+    changed = mem_malloc(MEM_CORE, sizeof(int) * properties_count);
+    if (NULL == changed)
+    {
+        log_w(LOG_TAG, "no memory can allocate\n");
+        return LE_ERROR_ALLOCATING_MEM;
+    }
+
+    cnt = leda_filter_select(pk, dn, properties, properties_count, changed);
+    if (0 == cnt)
+    {
+        mem_free(changed);
+        if (NULL != msg_id)
+        {
+            *msg_id = 0;
+        }
+        return LE_SUCCESS;
+    }
+
+    if (cnt < properties_count)
+    {
+        sub = mem_malloc(MEM_CORE, sizeof(leda_device_data_t) * cnt);
+        if (NULL == sub)
+        {
+            mem_free(changed);
+            log_w(LOG_TAG, "no memory can allocate\n");
+            return LE_ERROR_ALLOCATING_MEM;
+        }
+
+        for (i = 0; i < cnt; i++)
+        {
+            sub[i] = properties[changed[i]];
+        }
+        properties = sub;
+    }
+    mem_free(changed);
+
+    ret = leda_asyn_send_method(pk, dn, EMTHOD_REPORT_PROPERTY, NULL, properties, cnt, msg_id);
+    if (LE_SUCCESS == ret)
+    {
+        leda_filter_commit(pk, dn, properties, cnt);
+    }
+
+    if (NULL != sub)
+    {
+        mem_free(sub);
+    }
+
+    return ret;
+}
+
+int leda_report_properties(const char *pk, const char *dn, const leda_device_data_t properties[], int properties_count, unsigned int *msg_id)
+{
+    /* 上报的是设备的最新值, 发送失败也可以应答getProperty */
+    leda_cache_update(pk, dn, properties, properties_count);
+
+    if (leda_filter_enabled() && (NULL != pk) && (NULL != dn) && (properties_count > 0))
+    {
+        return _leda_report_changed(pk, dn, properties, properties_count, msg_id);
+    }
+
+    return leda_asyn_send_method(pk, dn, EMTHOD_REPORT_PROPERTY, NULL, properties, properties_count, msg_id);
+}
+
+int leda_report_event(const char *pk, const char *dn, const char *event_name, const leda_device_data_t data[], int data_count, unsigned int *msg_id)
+{
+    return leda_asyn_send_method(pk, dn, METHOD_REPORT_EVENT, event_name, data, data_count, msg_id);
+}
+
+int leda_register_device(const char *pk, const char *dn, void *usr_data, int *dev_handle)
+{
+    return leda_device_register(pk, dn, usr_data, dev_handle);
+}
+
+int leda_unregister_device(int dev_handle)
+{
+    char        pk[PRODUCT_KEY_MAXLEN];
+    char        dn[DEVICE_NAME_MAXLEN];
+
+    if (LE_SUCCESS == leda_device_get_name(dev_handle, pk, dn))
+    {
+        leda_cache_remove_device(pk, dn);
+        leda_filter_remove_device(pk, dn);
+    }
+
+    return leda_device_unregister(dev_handle);
+}
+
+int leda_get_device_handle(const char *pk, const char *dn, int *dev_handle, void **usr_data)
+{
+    return leda_device_lookup(pk, dn, dev_handle, usr_data);
+}
+
+int leda_get_device_online(int dev_handle, int *online)
+{
+    if (NULL == online)
+    {
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    return leda_device_get_online(dev_handle, online);
+}
+
+int leda_online_by_handle(int dev_handle)
+{
+    char        pk[PRODUCT_KEY_MAXLEN];
+    char        dn[DEVICE_NAME_MAXLEN];
+    int         ret = LE_SUCCESS;
+
+    ret = leda_device_get_name(dev_handle, pk, dn);
+    if (LE_SUCCESS != ret)
+    {
+        return ret;
+    }
+
+    return leda_online(pk, dn);
 }
 
-static void cb_ws_close(void *user)
+int leda_offline_by_handle(int dev_handle)
 {
-    g_conn_state = LEDA_WS_DISCONNECTED;
-    log_i(LOG_TAG, "connection failed.\n");
+    char        pk[PRODUCT_KEY_MAXLEN];
+    char        dn[DEVICE_NAME_MAXLEN];
+    int         ret = LE_SUCCESS;
 
-    if (g_conn_cb.conn_state_change_cb)
+    ret = leda_device_get_name(dev_handle, pk, dn);
+    if (LE_SUCCESS != ret)
     {
-        g_conn_cb.conn_state_change_cb(LEDA_WS_DISCONNECTED, g_conn_cb.usr_data);
+        return ret;
     }
 
-    return;
+    return leda_offline(pk, dn);
 }
 
-static void cb_ws_estab(void *user)
+int leda_report_properties_by_handle(int dev_handle, const leda_device_data_t properties[], int properties_count, unsigned int *msg_id)
 {
-    g_conn_state = LEDA_WS_CONNECTED;
-    log_i(LOG_TAG, "connection success.\n");
+    char        pk[PRODUCT_KEY_MAXLEN];
+    char        dn[DEVICE_NAME_MAXLEN];
+    int         ret = LE_SUCCESS;
 
-    if (g_conn_cb.conn_state_change_cb)
+    ret = leda_device_get_name(dev_handle, pk, dn);
+    if (LE_SUCCESS != ret)
     {
-        g_conn_cb.conn_state_change_cb(LEDA_WS_CONNECTED, g_conn_cb.usr_data);
+        return ret;
     }
 
-    return;
+    return leda_report_properties(pk, dn, properties, properties_count, msg_id);
 }
 
-int leda_send_method(const char *pk, 
-                     const char *dn, 
-                     const char *method, 
-                     const char *event_name,
-                     const leda_device_data_t *data, 
-                     int data_cnt)
+int leda_report_event_by_handle(int dev_handle, const char *event_name, const leda_device_data_t data[], int data_count, unsigned int *msg_id)
 {
-    cJSON           *root       = NULL;
-    cJSON           *payload    = NULL;
-    cJSON           *params     = NULL;
+    char        pk[PRODUCT_KEY_MAXLEN];
+    char        dn[DEVICE_NAME_MAXLEN];
+    int         ret = LE_SUCCESS;
 
-    unsigned int    msg_id      = 0;
-    char            *msg        = NULL;
+    ret = leda_device_get_name(dev_handle, pk, dn);
+    if (LE_SUCCESS != ret)
+    {
+        return ret;
+    }
 
-    int             ret         = 0;
-    int             code        = 0;
+    return leda_report_event(pk, dn, event_name, data, data_count, msg_id);
+}
 
-    if (LEDA_WS_CONNECTED != g_conn_state)
+int leda_set_payload_encoding(int encoding)
+{
+    if (1 == g_has_init)
     {
-        log_w(LOG_TAG, "the connection is disconnected\n");
-        return LEDA_ERROR_CONNECTION;
+        log_w(LOG_TAG, "payload encoding should be set before leda init\n");
+        return LE_ERROR_INVAILD_PARAM;
     }
 
-    if (NULL == pk || NULL == dn || NULL == method)
+    if ((LEDA_ENCODING_JSON != encoding) && (LEDA_ENCODING_CBOR != encoding) && (LEDA_ENCODING_JSON_ZDICT != encoding))
     {
-        log_w(LOG_TAG, "pk: %s dn: %s method: %s has invlid value\n", pk, dn, method);
+        log_w(LOG_TAG, "payload encoding: %d is not supported\n", encoding);
         return LE_ERROR_INVAILD_PARAM;
     }
 
-    root = cJSON_CreateObject();
-    if (NULL == root)
+    g_encoding = encoding;
+
+    return LE_SUCCESS;
+}
+
+int leda_set_compression(const leda_compression_config_t *config)
+{
+    if (1 == g_has_init)
     {
-        log_w(LOG_TAG, "no memory can allocate\n");
-        return LE_ERROR_ALLOCATING_MEM;
+        log_w(LOG_TAG, "compression should be set before leda init\n");
+        return LE_ERROR_INVAILD_PARAM;
     }
 
-    payload = cJSON_CreateObject();
-    if (NULL == payload)
+    if (NULL == config)
     {
-        log_w(LOG_TAG, "no memory can allocate\n");
-        cJSON_Delete(root);
-        return LE_ERROR_ALLOCATING_MEM;
+        return LE_ERROR_INVAILD_PARAM;
     }
 
-    msg_id = _ws_get_msg_id();
-
-    cJSON_AddStringToObject(root, "version", PROTOCOL_VERSION);
-    cJSON_AddNumberToObject(root, "messageId", msg_id);
-    cJSON_AddStringToObject(root, "method", method);
-
-    cJSON_AddItemToObject(root, "payload", payload);
-    cJSON_AddStringToObject(payload, "productKey", pk);
-    cJSON_AddStringToObject(payload, "deviceName", dn);
-
-    /* 设备上下线 */
-    if (0 == strcmp(method, METHOD_ONLINE) || 0 == strcmp(method, METHOD_OFFLINE))
+    if (((0 != config->window_bits) && ((config->window_bits < 9) || (config->window_bits > 15)))
+        || (config->level < 0) || (config->level > 9))
     {
-        goto next_step;
+        log_w(LOG_TAG, "window bits: %d should be 0 or in [9, 15], level: %d should be 0 or in [1, 9], 0 keeps the default\n",
+              config->window_bits, config->level);
+        return LE_ERROR_INVAILD_PARAM;
     }
 
-next_step:
+    g_deflate_cfg.enable            = config->enable;
+    g_deflate_cfg.context_takeover  = config->context_takeover;
+    g_deflate_cfg.window_bits       = config->window_bits;
+    g_deflate_cfg.level             = config->level;
+    g_deflate_cfg.min_size          = config->min_size;
+    g_has_deflate                   = 1;
 
-    msg = cJSON_PrintUnformatted(root);
-    cJSON_Delete(root);
-    if (NULL == msg)
+    return LE_SUCCESS;
+}
+
+int leda_set_tls_config(const leda_tls_config_t *config)
+{
+    const char  *src[4] = {NULL};
+    char        *dst[4] = {NULL};
+    int         i       = 0;
+
+    if (1 == g_has_init)
     {
-        log_w(LOG_TAG, "no memory can allocate\n");
-        return LE_ERROR_ALLOCATING_MEM;
+        log_w(LOG_TAG, "tls config should be set before leda init\n");
+        return LE_ERROR_INVAILD_PARAM;
     }
 
-    ret = _ws_insert_reply(msg_id);
-    if (ret != LE_SUCCESS)
+    if (NULL == config)
     {
-        log_w(LOG_TAG, "no memory can allocate\n");
-        cJSON_free(msg);
-        return ret;
+        return LE_ERROR_INVAILD_PARAM;
     }
 
-    log_i(LOG_TAG, "send request msg: %s", msg);
-    ret = wsc_add_msg(msg, strlen(msg), 0);
-    cJSON_free(msg);
-    if (ret != LE_SUCCESS)
+    src[0] = config->cipher_list;
+    src[1] = config->ciphersuites;
+    src[2] = config->curves;
+    src[3] = config->session_file;
+    for (i = 0; i < 4; i++)
     {
-        log_w(LOG_TAG, "no memory can allocate\n");
-        _ws_remove_reply(msg_id);
-        return ret;
+        if ((NULL != src[i]) && (NULL == (dst[i] = mem_strdup(MEM_CORE, src[i]))))
+        {
+            while (i-- > 0)
+            {
+                mem_free(dst[i]);
+            }
+            log_w(LOG_TAG, "no memory can allocate\n");
+            return LE_ERROR_ALLOCATING_MEM;
+        }
     }
 
-    ret = _ws_get_reply_result(msg_id, 10000, &code, NULL);
-    log_i(LOG_TAG, "receive reply code: %d\n", code);
-    if (ret != LE_SUCCESS)
+    for (i = 0; i < 4; i++)
     {
-        return ret;
+        mem_free(g_tls_str[i]);
+        g_tls_str[i] = dst[i];
     }
 
-    return code;
+    g_tls_cfg.cipher_list           = g_tls_str[0];
+    g_tls_cfg.ciphersuites          = g_tls_str[1];
+    g_tls_cfg.curves                = g_tls_str[2];
+    g_tls_cfg.session_file          = g_tls_str[3];
+    g_tls_cfg.session_resumption    = config->session_resumption;
+    g_has_tls                       = 1;
+
+    return LE_SUCCESS;
 }
 
-int leda_asyn_send_method(const char *pk, 
-                          const char *dn, 
-                          const char *method, 
-                          const char *event_name,
-                          const leda_device_data_t *data, 
-                          int data_cnt,
-                          unsigned int *msg_id)
+int leda_register_method_handler(const char *method, method_handler_callback handler, void *usr_data)
 {
-    cJSON           *root       = NULL;
-    cJSON           *payload    = NULL;
-    cJSON           *params     = NULL;
+    size_t  len     = 0;
+    int     i       = 0;
 
-    unsigned int    tmp_msg_id  = 0;
-    char            *msg        = NULL;
+    if (1 == g_has_init)
+    {
+        log_w(LOG_TAG, "method handler should be registered before leda init\n");
+        return LE_ERROR_INVAILD_PARAM;
+    }
 
-    int             ret         = 0;
+    if ((NULL == method) || (0 == (len = strlen(method))) || (len >= MAX_METHOD_NAME_LENGTH))
+    {
+        return LE_ERROR_INVAILD_PARAM;
+    }
 
-    if (LEDA_WS_CONNECTED != g_conn_state)
+    for (i = 0; i < RECV_METHOD_CUSTOM; i++)
     {
-        log_w(LOG_TAG, "the connection is disconnected\n");
-        return LEDA_ERROR_CONNECTION;
+        if (0 == strcmp(g_method_names[i], method))
+        {
+            log_w(LOG_TAG, "built-in method: %s can not be replaced\n", method);
+            return LE_ERROR_INVAILD_PARAM;
+        }
     }
 
-    if (NULL == pk || NULL == dn || NULL == method)
+    for (i = 0; i < g_method_handler_cnt; i++)
     {
-        log_w(LOG_TAG, "pk: %s dn: %s method: %s has invlid value\n", pk, dn, method);
-        return LE_ERROR_INVAILD_PARAM;
+        if (0 == strcmp(g_method_handlers[i].method, method))
+        {
+            break;
+        }
     }
 
-    root = cJSON_CreateObject();
-    if (NULL == root)
+    if (NULL == handler)
     {
-        log_w(LOG_TAG, "no memory can allocate\n");
-        return LE_ERROR_ALLOCATING_MEM;
+        /* 注销时用最后一项填补空位 */
+        if (i < g_method_handler_cnt)
+        {
+            g_method_handlers[i] = g_method_handlers[--g_method_handler_cnt];
+            memset(&g_method_handlers[g_method_handler_cnt], 0, sizeof(method_handler_t));
+        }
+        return LE_SUCCESS;
     }
 
-    payload = cJSON_CreateObject();
-    if (NULL == payload)
+    if (i == g_method_handler_cnt)
     {
-        log_w(LOG_TAG, "no memory can allocate\n");
-        cJSON_Delete(root);
-        return LE_ERROR_ALLOCATING_MEM;
+        if (g_method_handler_cnt >= MAX_METHOD_HANDLER_COUNT)
+        {
+            log_w(LOG_TAG, "method handler count go beyond %d\n", MAX_METHOD_HANDLER_COUNT);
+            return LE_ERROR_PARAM_RANGE_OVERFLOW;
+        }
+        memcpy(g_method_handlers[i].method, method, len + 1);
+        g_method_handlers[i].len = len;
+        g_method_handler_cnt++;
     }
 
-    tmp_msg_id = _ws_get_msg_id();
+    g_method_handlers[i].handler  = handler;
+    g_method_handlers[i].usr_data = usr_data;
 
-    cJSON_AddStringToObject(root, "version", PROTOCOL_VERSION);
-    cJSON_AddNumberToObject(root, "messageId", tmp_msg_id);
-    cJSON_AddStringToObject(root, "method", method);
+    return LE_SUCCESS;
+}
 
-    cJSON_AddItemToObject(root, "payload", payload);
-    cJSON_AddStringToObject(payload, "productKey", pk);
-    cJSON_AddStringToObject(payload, "deviceName", dn);
+int leda_set_send_queue_file(const char *file_path, unsigned int max_msg_len)
+{
+    char *path = NULL;
 
-    /* 设备属性或事件数据 */
-    params = struct_data_to_json_data(data, data_cnt);
-    if (!params)
+    if (1 == g_has_init)
     {
-        cJSON_Delete(root);
+        log_w(LOG_TAG, "send queue file should be set before leda init\n");
         return LE_ERROR_INVAILD_PARAM;
     }
 
-    if (event_name)
+    if (max_msg_len > 1024 * 1024)
     {
-        cJSON_AddStringToObject(payload, "identifier", event_name);
-        cJSON_AddItemToObject(payload, "outputData", params);
+        log_w(LOG_TAG, "max msg len: %u go beyond %d\n", max_msg_len, 1024 * 1024);
+        return LE_ERROR_PARAM_RANGE_OVERFLOW;
     }
-    else
+
+    if (NULL != file_path)
     {
-        cJSON_AddItemToObject(payload, "properties", params);
+        path = mem_strdup(MEM_CORE, file_path);
+        if (NULL == path)
+        {
+            log_w(LOG_TAG, "no memory can allocate\n");
+            return LE_ERROR_ALLOCATING_MEM;
+        }
     }
 
-next_step:
-
-    msg = cJSON_PrintUnformatted(root);
-    cJSON_Delete(root);
-    if (NULL == msg)
+    if (NULL != g_queue_path)
     {
-        log_w(LOG_TAG, "no memory can allocate\n");
-        return LE_ERROR_ALLOCATING_MEM;
+        mem_free(g_queue_path);
     }
+    g_queue_path    = path;
+    g_queue_msg_len = (0 == max_msg_len) ? SEND_QUEUE_MSG_LEN : (int)max_msg_len;
 
-    log_i(LOG_TAG, "send request msg: %s", msg);
-    ret = wsc_add_msg(msg, strlen(msg), 0);
-    cJSON_free(msg);
-    if (ret != LE_SUCCESS)
+    return LE_SUCCESS;
+}
+
+int leda_set_allocator(const leda_allocator_t *allocator)
+{
+    mem_allocator   alloc   = {0};
+    int             ret     = LE_SUCCESS;
+
+    if (NULL == allocator)
     {
-        log_w(LOG_TAG, "no memory can allocate\n");
-        _ws_remove_reply(tmp_msg_id);
-        return ret;
+        return LE_ERROR_INVAILD_PARAM;
     }
 
-    if (NULL != msg_id)
+    alloc.malloc_fn     = allocator->malloc_fn;
+    alloc.realloc_fn    = allocator->realloc_fn;
+    alloc.free_fn       = allocator->free_fn;
+    alloc.max_bytes     = allocator->max_bytes;
+
+    ret = mem_set_allocator(&alloc);
+    if (LE_SUCCESS != ret)
     {
-        *msg_id = tmp_msg_id;
+        log_w(LOG_TAG, "allocator should be set before other sdk calls, and malloc and free should be set together\n");
     }
 
     return ret;
 }
 
-int leda_online(const char *pk, const char *dn)
+int leda_set_log_config(const leda_log_config_t *config)
 {
-    return leda_send_method(pk, dn, METHOD_ONLINE, NULL, NULL, 0);
-}
+    log_async_config    cfg = {0};
+    int                 ret = LE_SUCCESS;
 
-int leda_offline(const char *pk, const char *dn)
-{
-    return leda_send_method(pk, dn, METHOD_OFFLINE, NULL, NULL, 0);
-}
+    if (NULL == config)
+    {
+        return LE_ERROR_INVAILD_PARAM;
+    }
 
-int leda_report_properties(const char *pk, const char *dn, const leda_device_data_t properties[], int properties_count, unsigned int *msg_id)
-{
-    return leda_asyn_send_method(pk, dn, EMTHOD_REPORT_PROPERTY, NULL, properties, properties_count, msg_id);
-}
+    if ((config->level < LOG_LEVEL_DEBUG) || (config->level >= LOG_LEVEL_NONE))
+    {
+        log_w(LOG_TAG, "log level: %d should be in [%d, %d]\n", config->level, LOG_LEVEL_DEBUG, LOG_LEVEL_ERR);
+        return LE_ERROR_INVAILD_PARAM;
+    }
 
-int leda_report_event(const char *pk, const char *dn, const char *event_name, const leda_device_data_t data[], int data_count, unsigned int *msg_id)
-{
-    return leda_asyn_send_method(pk, dn, METHOD_REPORT_EVENT, event_name, data, data_count, msg_id);
+    if (config->async)
+    {
+        cfg.file_path   = config->file_path;
+        cfg.use_syslog  = config->use_syslog;
+        cfg.ring_size   = config->ring_size;
+        cfg.max_len     = config->max_len;
+        cfg.rate_limit  = config->rate_limit;
+
+        ret = log_async_start(&cfg);
+        if (LE_SUCCESS != ret)
+        {
+            log_w(LOG_TAG, "start async log to %s failed\n", config->use_syslog ? "syslog" : (config->file_path ? config->file_path : "stdout"));
+            return ret;
+        }
+    }
+    else
+    {
+        log_async_stop();
+    }
+
+    set_log_level(config->level);
+    g_payload_len       = (config->payload_len > INT_MAX) ? INT_MAX : (int)config->payload_len;
+    g_payload_sample    = config->payload_sample;
+
+    return LE_SUCCESS;
 }
 
 int leda_init(const leda_conn_info_t *info)
 {
     int             ret         = LE_SUCCESS;
 
+    int             i           = 0;
     int             len         = 0;
     char            url[64]     = {0};
 
@@ -1109,12 +2330,10 @@ int leda_init(const leda_conn_info_t *info)
 
     log_i(LOG_TAG, "leda init...\n");
 
-    /* 线程池资源 */
-    g_threadpool = threadpool_create(5, 5 * 1024, 0);
-    if (NULL == g_threadpool)
+    if (NULL == info)
     {
-        log_w(LOG_TAG, "no memory can allocate\n");
-        return LE_ERROR_ALLOCATING_MEM;
+        log_w(LOG_TAG, "conn info is NULL\n");
+        return LE_ERROR_INVAILD_PARAM;
     }
 
     /* ws连接配置 */
@@ -1161,9 +2380,10 @@ int leda_init(const leda_conn_info_t *info)
                     info->key_path, 
                     info->timeout);
 
+    ret = LE_ERROR_ALLOCATING_MEM;
     {
         len = strlen(CONN_PROTOCOL) + 1;
-        g_wsc_conn.protocol = malloc(len);
+        g_wsc_conn.protocol = mem_malloc(MEM_CORE, len);
         if (NULL == g_wsc_conn.protocol)
         {
             goto END;
@@ -1173,7 +2393,7 @@ int leda_init(const leda_conn_info_t *info)
         strcpy(g_wsc_conn.protocol, CONN_PROTOCOL);
 
         len = strlen(url) + 1;
-        g_wsc_conn.url = malloc(len);
+        g_wsc_conn.url = mem_malloc(MEM_CORE, len);
         if (NULL == g_wsc_conn.url)
         {
             goto END;
@@ -1187,7 +2407,7 @@ int leda_init(const leda_conn_info_t *info)
             if (NULL != info->ca_path)
             {
                 len = strlen(info->ca_path) + 1;
-                g_wsc_conn.ca_path = malloc(len);
+                g_wsc_conn.ca_path = mem_malloc(MEM_CORE, len);
                 if (NULL == g_wsc_conn.ca_path)
                 {
                     goto END;
@@ -1201,7 +2421,7 @@ int leda_init(const leda_conn_info_t *info)
             if (NULL != info->cert_path)
             {
                 len = strlen(info->cert_path) + 1;
-                g_wsc_conn.cert_path = malloc(len);
+                g_wsc_conn.cert_path = mem_malloc(MEM_CORE, len);
                 if (NULL == g_wsc_conn.cert_path)
                 {
                     goto END;
@@ -1214,7 +2434,7 @@ int leda_init(const leda_conn_info_t *info)
             if (NULL != info->key_path)
             {
                 len = strlen(info->key_path) + 1;
-                g_wsc_conn.key_path = malloc(len);
+                g_wsc_conn.key_path = mem_malloc(MEM_CORE, len);
                 if (NULL == g_wsc_conn.key_path)
                 {
                     goto END;
@@ -1239,6 +2459,10 @@ int leda_init(const leda_conn_info_t *info)
     }
 
     g_param_conn.protocol     = g_wsc_conn.protocol;
+    g_param_conn.alt_protocol = (LEDA_ENCODING_CBOR == g_encoding) ? CONN_PROTOCOL_CBOR
+                                : ((LEDA_ENCODING_JSON_ZDICT == g_encoding) ? CONN_PROTOCOL_ZDICT : NULL);
+    g_param_conn.deflate      = g_has_deflate ? &g_deflate_cfg : NULL;
+    g_param_conn.tls          = g_has_tls ? &g_tls_cfg : NULL;
     g_param_conn.url          = g_wsc_conn.url;
     g_param_conn.ca_path      = g_wsc_conn.ca_path;
 #if SUPPORT_DUAL_CERTIFICATION
@@ -1249,6 +2473,14 @@ int leda_init(const leda_conn_info_t *info)
     g_param_conn.key_path     = NULL;
 #endif
     g_param_conn.timeout      = g_wsc_conn.timeout;
+    g_param_conn.queue_path   = g_queue_path;
+    g_param_conn.queue_msg_len = g_queue_msg_len;
+
+    /* 队列文件中可能有上次进程的消息, 消息id不从0开始, 避免其应答与本次的请求混淆 */
+    if (NULL != g_queue_path)
+    {
+        g_msg_id = (unsigned int)time(NULL);
+    }
 
     /* ws连接回调 */
     param_cbs.p_cb_establish    = cb_ws_estab;
@@ -1273,11 +2505,75 @@ int leda_init(const leda_conn_info_t *info)
     g_devs_cb.report_reply_cb           = info->conn_devices_cb.report_reply_cb;
     g_devs_cb.usr_data_report_reply     = info->conn_devices_cb.usr_data_report_reply;
 
+    /* 线程池资源, 每个通道一个线程 */
+    for (i = 0; i < RECV_LANE_COUNT; i++)
+    {
+        g_threadpool[i] = threadpool_create(1, RECV_LANE_QUEUE_SIZE, 0);
+        if (NULL == g_threadpool[i])
+        {
+            log_w(LOG_TAG, "no memory can allocate\n");
+            goto POOL;
+        }
+    }
+
+    /* 后台任务线程, 用于设备上线恢复等 */
+    g_task_pool = threadpool_create(1, 64, 0);
+    if (NULL == g_task_pool)
+    {
+        log_w(LOG_TAG, "no memory can allocate\n");
+        goto POOL;
+    }
+
+    ret = leda_spool_init();
+    if (ret != LE_SUCCESS)
+    {
+        goto POOL;
+    }
+
+    ret = leda_reliable_init();
+    if (ret != LE_SUCCESS)
+    {
+        leda_spool_exit();
+        goto POOL;
+    }
+
+    ret = leda_batch_init((NULL != g_queue_path) ? (unsigned int)g_queue_msg_len : 0);
+    if (ret != LE_SUCCESS)
+    {
+        leda_reliable_exit();
+        leda_spool_exit();
+        goto POOL;
+    }
+
+    ret = leda_cache_init();
+    if (ret != LE_SUCCESS)
+    {
+        leda_batch_exit();
+        leda_reliable_exit();
+        leda_spool_exit();
+        goto POOL;
+    }
+
+    ret = leda_filter_init();
+    if (ret != LE_SUCCESS)
+    {
+        leda_cache_exit();
+        leda_batch_exit();
+        leda_reliable_exit();
+        leda_spool_exit();
+        goto POOL;
+    }
+
     ret = wsc_init(&g_param_conn, &param_cbs);
     if (ret != 0)
     {
         log_w(LOG_TAG, "no memory can allocate\n");
-        return ret;
+        leda_filter_exit();
+        leda_cache_exit();
+        leda_batch_exit();
+        leda_reliable_exit();
+        leda_spool_exit();
+        goto POOL;
     }
 
     pthread_mutex_init(&g_ws_msg_reply_lock, NULL);
@@ -1285,48 +2581,83 @@ int leda_init(const leda_conn_info_t *info)
 
     return LE_SUCCESS;
 
+POOL:
+    for (i = 0; i < RECV_LANE_COUNT; i++)
+    {
+        if (NULL != g_threadpool[i])
+        {
+            threadpool_destroy(g_threadpool[i], 0);
+            g_threadpool[i] = NULL;
+        }
+    }
+
+    if (NULL != g_task_pool)
+    {
+        threadpool_destroy(g_task_pool, 0);
+        g_task_pool = NULL;
+    }
+
 END:
     if (NULL != g_wsc_conn.protocol)
     {
-        free(g_wsc_conn.protocol);
+        mem_free(g_wsc_conn.protocol);
         g_wsc_conn.protocol = NULL;
     }
 
     if (NULL != g_wsc_conn.key_path)
     {
-        free(g_wsc_conn.key_path);
+        mem_free(g_wsc_conn.key_path);
         g_wsc_conn.key_path = NULL;
     }
 
     if (NULL != g_wsc_conn.cert_path)
     {
-        free(g_wsc_conn.cert_path);
+        mem_free(g_wsc_conn.cert_path);
         g_wsc_conn.cert_path = NULL;
     }
 
     if (NULL != g_wsc_conn.ca_path)
     {
-        free(g_wsc_conn.ca_path);
+        mem_free(g_wsc_conn.ca_path);
         g_wsc_conn.ca_path = NULL;
     }
 
     if (NULL != g_wsc_conn.url)
     {
-        free(g_wsc_conn.url);
+        mem_free(g_wsc_conn.url);
         g_wsc_conn.url = NULL;
     }
 
-    return LE_ERROR_ALLOCATING_MEM;
+    return ret;
 }
 
 void leda_exit(void)
 {
-    if (NULL != g_threadpool)
+    int i = 0;
+
+    leda_restore_stop();
+    if (NULL != g_task_pool)
+    {
+        threadpool_destroy(g_task_pool, 0);
+        g_task_pool = NULL;
+    }
+
+    for (i = 0; i < RECV_LANE_COUNT; i++)
     {
-        threadpool_destroy(g_threadpool, threadpool_graceful);
+        if (NULL != g_threadpool[i])
+        {
+            threadpool_destroy(g_threadpool[i], threadpool_graceful);
+            g_threadpool[i] = NULL;
+        }
     }
 
+    leda_batch_exit();
     ws_client_destroy();
+    leda_reliable_exit();
+    leda_spool_exit();
+    leda_device_clear();
+    leda_cache_exit();
+    leda_filter_exit();
 
     g_has_init      = 0;
     g_conn_state    = -1;
@@ -1334,35 +2665,35 @@ void leda_exit(void)
 
     if (NULL != g_wsc_conn.protocol)
     {
-        free(g_wsc_conn.protocol);
+        mem_free(g_wsc_conn.protocol);
         g_wsc_conn.protocol = NULL;
         g_param_conn.protocol = NULL;
     }
 
     if (NULL != g_wsc_conn.key_path)
     {
-        free(g_wsc_conn.key_path);
+        mem_free(g_wsc_conn.key_path);
         g_wsc_conn.key_path = NULL;
         g_param_conn.key_path = NULL;
     }
 
     if (NULL != g_wsc_conn.cert_path)
     {
-        free(g_wsc_conn.cert_path);
+        mem_free(g_wsc_conn.cert_path);
         g_wsc_conn.cert_path = NULL;
         g_param_conn.cert_path = NULL;
     }
 
     if (NULL != g_wsc_conn.ca_path)
     {
-        free(g_wsc_conn.ca_path);
+        mem_free(g_wsc_conn.ca_path);
         g_wsc_conn.ca_path = NULL;
         g_param_conn.ca_path = NULL;
     }
 
     if (NULL != g_wsc_conn.url)
     {
-        free(g_wsc_conn.url);
+        mem_free(g_wsc_conn.url);
         g_wsc_conn.url = NULL;
         g_param_conn.url = NULL;
     }
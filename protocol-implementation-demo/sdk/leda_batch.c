@@ -0,0 +1,476 @@
+/*
+ * Copyright (c) 2014-2019 Alibaba Group. All rights reserved.
+ * License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "ws_client.h"
+#include "cJSON.h"
+#include "cbor.h"
+#include "metrics.h"
+#include "mem.h"
+
+#include "log.h"
+#include "le_error.h"
+#include "leda.h"
+#include "leda_internal.h"
+
+#ifdef __cplusplus /* If this is a C++ compiler, use C linkage */
+extern "C"
+{
+#endif
+
+#define LOG_TAG                 "LINKEDGE_DEVICE_BATCH"
+
+#define BATCH_HEAD_ROOM         9           /* CBOR数组头最长9字节, JSON只用最后1字节放'[' */
+#define BATCH_DEF_COUNT         32
+#define BATCH_MAX_COUNT         1024
+#define BATCH_DEF_BYTES         (16 * 1024)
+#define BATCH_MAX_BYTES         (1024 * 1024)
+#define BATCH_MIN_BYTES         256
+#define BATCH_DEF_LINGER_MS     5
+#define BATCH_MAX_LINGER_MS     1000
+
+/* 缓冲区中的一条上报 */
+typedef struct batch_elem
+{
+    size_t          off;                /* 相对BATCH_HEAD_ROOM的偏移 */
+    size_t          len;
+} batch_elem_t;
+
+static leda_batch_config_t      g_batch_cfg     = {0};
+static pthread_mutex_t          g_batch_lock    = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t           g_batch_cond    = PTHREAD_COND_INITIALIZER;
+
+/* 打包缓冲区, 元素从BATCH_HEAD_ROOM处开始依次存放, 发送时在前面补数组头 */
+static char                     *g_batch_buf    = NULL;
+static size_t                   g_batch_len     = 0;
+static unsigned int             g_batch_cnt     = 0;
+static int                      g_batch_binary  = 0;
+static uint64_t                 g_batch_first_us = 0;
+static batch_elem_t             *g_batch_elems  = NULL;
+static unsigned int             *g_batch_ids    = NULL;    /* 与g_batch_elems一一对应 */
+
+static pthread_t                g_batch_timer;
+static int                      g_batch_running = 0;
+
+static uint64_t _batch_now_us(void)
+{
+    struct timespec ts = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* 在head末尾写入CBOR定长数组头, 返回头长度 */
+static size_t _batch_cbor_head(unsigned int count, char *head)
+{
+    if (count < 24)
+    {
+        head[BATCH_HEAD_ROOM - 1] = (char)(0x80 | count);
+        return 1;
+    }
+
+    if (count < 256)
+    {
+        head[BATCH_HEAD_ROOM - 2] = (char)0x98;
+        head[BATCH_HEAD_ROOM - 1] = (char)count;
+        return 2;
+    }
+
+    head[BATCH_HEAD_ROOM - 3] = (char)0x99;
+    head[BATCH_HEAD_ROOM - 2] = (char)(count >> 8);
+    head[BATCH_HEAD_ROOM - 1] = (char)(count & 0xff);
+    return 3;
+}
+
+/* 调用方持有g_batch_lock */
+static int _batch_flush(void)
+{
+    char    *frame  = g_batch_buf + BATCH_HEAD_ROOM;
+    size_t  len     = g_batch_len;
+    size_t  head    = 0;
+    int     id_cnt  = 0;
+    int     ret     = LE_SUCCESS;
+
+    if (0 == g_batch_cnt)
+    {
+        return LE_SUCCESS;
+    }
+
+    /* 只有一条时按原消息发送, 不加数组外层 */
+    if ((1 < g_batch_cnt) && g_batch_binary)
+    {
+        head    = _batch_cbor_head(g_batch_cnt, g_batch_buf);
+        frame   -= head;
+        len     += head;
+    }
+    else if (1 < g_batch_cnt)
+    {
+        frame--;
+        frame[0]        = '[';
+        frame[len + 1]  = ']';
+        len             += 2;
+    }
+
+    /* 发送失败时保留缓冲区, 等下一个linger周期重试, 数组头和外层括号都在元素之外, 不影响重试 */
+    /* 可靠模式下发送队列文件保留消息, 直到其中的上报都收到应答 */
+    id_cnt = leda_reliable_enabled() ? (int)g_batch_cnt : 0;
+    ret = g_batch_binary ? wsc_add_tracked_msg(frame, len, 1, g_batch_ids, id_cnt)
+                         : leda_send_json_tracked(frame, len, g_batch_ids, id_cnt);
+    if (LE_SUCCESS != ret)
+    {
+        log_w(LOG_TAG, "send batch of %u msgs failed: %d, retry later\n", g_batch_cnt, ret);
+        g_batch_first_us = _batch_now_us();
+        return ret;
+    }
+
+    if (1 < g_batch_cnt)
+    {
+        metrics_inc(METRIC_BATCHES_SENT);
+        metrics_add(METRIC_BATCHED_MSGS, g_batch_cnt);
+    }
+
+    g_batch_len = 0;
+    g_batch_cnt = 0;
+
+    return ret;
+}
+
+/* 将一条JSON文本或CBOR编码的上报交给离线缓存, 离线缓存保存JSON文本 */
+static int _batch_spool(const batch_elem_t *elem)
+{
+    const char  *msg    = g_batch_buf + BATCH_HEAD_ROOM + elem->off;
+    cJSON       *root   = NULL;
+    char        *text   = NULL;
+    int         ret     = LE_SUCCESS;
+
+    if (!g_batch_binary)
+    {
+        return leda_spool_offer(msg, elem->len);
+    }
+
+    root = cbor_decode(msg, elem->len);
+    text = (NULL != root) ? cJSON_PrintUnformatted(root) : NULL;
+    cJSON_Delete(root);
+    if (NULL == text)
+    {
+        return LE_ERROR_ALLOCATING_MEM;
+    }
+
+    ret = leda_spool_offer(text, strlen(text));
+    cJSON_free(text);
+
+    return ret;
+}
+
+/* 调用方持有g_batch_lock. 清空缓冲区: 断线时先交给离线缓存, 可靠模式下未进入离线缓存的上报
+ * 留在在途表中等待重传, 其余上报的msg_id写入failed, 由调用方在锁外以错误码回调, 返回failed中的个数 */
+static unsigned int _batch_discard(unsigned int *failed)
+{
+    unsigned int    i   = 0;
+    unsigned int    n   = 0;
+    int             ret = LE_SUCCESS;
+
+    for (i = 0; i < g_batch_cnt; i++)
+    {
+        ret = leda_is_connected() ? LEDA_ERROR_CONNECTION : _batch_spool(&g_batch_elems[i]);
+        if (LE_SUCCESS == ret)
+        {
+            if (leda_reliable_enabled())
+            {
+                leda_reliable_set_spooled(g_batch_ids[i]);
+            }
+            continue;
+        }
+
+        if (leda_reliable_enabled())
+        {
+            continue;
+        }
+
+        metrics_inc(METRIC_BATCH_DROPPED);
+        if (NULL != failed)
+        {
+            failed[n++] = g_batch_ids[i];
+        }
+    }
+
+    g_batch_len = 0;
+    g_batch_cnt = 0;
+
+    return n;
+}
+
+static void _batch_reply_failed(unsigned int *failed, unsigned int count, int code)
+{
+    unsigned int i = 0;
+
+    for (i = 0; i < count; i++)
+    {
+        leda_report_reply(failed[i], code);
+    }
+    mem_free(failed);
+}
+
+static void *_batch_timer_proc(void *arg)
+{
+    struct timespec ts          = {0};
+    uint64_t        deadline    = 0;
+    uint64_t        now         = 0;
+
+    pthread_mutex_lock(&g_batch_lock);
+    while (g_batch_running)
+    {
+        if (0 == g_batch_cnt)
+        {
+            pthread_cond_wait(&g_batch_cond, &g_batch_lock);
+            continue;
+        }
+
+        deadline    = g_batch_first_us + (uint64_t)g_batch_cfg.linger_ms * 1000;
+        now         = _batch_now_us();
+        if (now >= deadline)
+        {
+            /* 失败时_batch_flush重置等待起点, 下一个linger周期重试 */
+            _batch_flush();
+            continue;
+        }
+
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += (long)(deadline - now) * 1000;
+        ts.tv_sec += ts.tv_nsec / 1000000000;
+        ts.tv_nsec %= 1000000000;
+        pthread_cond_timedwait(&g_batch_cond, &g_batch_lock, &ts);
+    }
+    pthread_mutex_unlock(&g_batch_lock);
+
+    return NULL;
+}
+
+int leda_set_batching(const leda_batch_config_t *config)
+{
+    if (NULL != g_batch_buf)
+    {
+        log_w(LOG_TAG, "batching should be set before leda init\n");
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    if (NULL == config)
+    {
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    if ((config->max_count > BATCH_MAX_COUNT)
+        || ((0 != config->max_bytes) && ((config->max_bytes < BATCH_MIN_BYTES) || (config->max_bytes > BATCH_MAX_BYTES)))
+        || (config->linger_ms > BATCH_MAX_LINGER_MS))
+    {
+        log_w(LOG_TAG, "max count: %u should be in [1, %d], max bytes: %u in [%d, %d] and linger: %u in [1, %d]\n",
+              config->max_count, BATCH_MAX_COUNT, config->max_bytes, BATCH_MIN_BYTES, BATCH_MAX_BYTES,
+              config->linger_ms, BATCH_MAX_LINGER_MS);
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    g_batch_cfg.enable      = config->enable;
+    g_batch_cfg.max_count   = (0 == config->max_count) ? BATCH_DEF_COUNT : config->max_count;
+    g_batch_cfg.max_bytes   = (0 == config->max_bytes) ? BATCH_DEF_BYTES : config->max_bytes;
+    g_batch_cfg.linger_ms   = (0 == config->linger_ms) ? BATCH_DEF_LINGER_MS : config->linger_ms;
+
+    return LE_SUCCESS;
+}
+
+int leda_batch_init(unsigned int max_frame)
+{
+    if (!g_batch_cfg.enable)
+    {
+        return LE_SUCCESS;
+    }
+
+    /* 文件队列的单条消息有长度上限 */
+    if ((0 != max_frame) && (g_batch_cfg.max_bytes > max_frame))
+    {
+        log_i(LOG_TAG, "batch max bytes is limited to send queue msg len: %u\n", max_frame);
+        g_batch_cfg.max_bytes = max_frame;
+    }
+
+    pthread_mutex_lock(&g_batch_lock);
+    g_batch_buf = mem_malloc(MEM_CORE, BATCH_HEAD_ROOM + g_batch_cfg.max_bytes + 1);
+    g_batch_elems = mem_malloc(MEM_CORE, sizeof(batch_elem_t) * g_batch_cfg.max_count);
+    g_batch_ids = mem_malloc(MEM_CORE, sizeof(unsigned int) * g_batch_cfg.max_count);
+    if ((NULL == g_batch_buf) || (NULL == g_batch_elems) || (NULL == g_batch_ids))
+    {
+        mem_free(g_batch_buf);
+        mem_free(g_batch_elems);
+        mem_free(g_batch_ids);
+        g_batch_buf = NULL;
+        g_batch_elems = NULL;
+        g_batch_ids = NULL;
+        pthread_mutex_unlock(&g_batch_lock);
+        log_w(LOG_TAG, "no memory can allocate\n");
+        return LE_ERROR_ALLOCATING_MEM;
+    }
+    g_batch_len     = 0;
+    g_batch_cnt     = 0;
+    g_batch_running = 1;
+    pthread_mutex_unlock(&g_batch_lock);
+
+    if (0 != pthread_create(&g_batch_timer, NULL, _batch_timer_proc, NULL))
+    {
+        log_w(LOG_TAG, "create batch timer thread failed\n");
+        g_batch_running = 0;
+        leda_batch_exit();
+        return LE_ERROR_UNKNOWN;
+    }
+
+    return LE_SUCCESS;
+}
+
+void leda_batch_exit(void)
+{
+    unsigned int    *failed = NULL;
+    unsigned int    count   = 0;
+    int             ret     = LE_SUCCESS;
+
+    pthread_mutex_lock(&g_batch_lock);
+    if (g_batch_running)
+    {
+        g_batch_running = 0;
+        pthread_cond_signal(&g_batch_cond);
+        pthread_mutex_unlock(&g_batch_lock);
+        pthread_join(g_batch_timer, NULL);
+        pthread_mutex_lock(&g_batch_lock);
+    }
+
+    if (NULL != g_batch_buf)
+    {
+        ret = _batch_flush();
+        if (LE_SUCCESS != ret)
+        {
+            failed = mem_malloc(MEM_CORE, sizeof(unsigned int) * g_batch_cnt);
+            count = _batch_discard(failed);
+        }
+        mem_free(g_batch_buf);
+        mem_free(g_batch_elems);
+        mem_free(g_batch_ids);
+        g_batch_buf = NULL;
+        g_batch_elems = NULL;
+        g_batch_ids = NULL;
+    }
+    pthread_mutex_unlock(&g_batch_lock);
+
+    _batch_reply_failed(failed, count, ret);
+}
+
+int leda_batch_enabled(void)
+{
+    return (NULL != g_batch_buf);
+}
+
+int leda_batch_add(unsigned int msg_id, const char *msg, size_t len, int binary)
+{
+    size_t  need    = 0;
+    int     ret     = LE_SUCCESS;
+
+    pthread_mutex_lock(&g_batch_lock);
+    if (NULL == g_batch_buf)
+    {
+        pthread_mutex_unlock(&g_batch_lock);
+        return LEDA_BATCH_BYPASS;
+    }
+
+    /* 以下任一处发出缓冲区失败时, 已缓存的上报保留待重试, 本条上报返回错误, 以保持顺序 */
+
+    /* 连接编码变化后, 之前的元素不能与新元素放在同一数组中 */
+    if ((0 != g_batch_cnt) && (binary != g_batch_binary))
+    {
+        ret = _batch_flush();
+    }
+
+    need = len + (binary ? BATCH_HEAD_ROOM : 3);
+    if ((LE_SUCCESS == ret) && (need > g_batch_cfg.max_bytes))
+    {
+        /* 超长的消息单独发送, 先发出缓冲区中的消息以保持顺序 */
+        ret = _batch_flush();
+        pthread_mutex_unlock(&g_batch_lock);
+        return (LE_SUCCESS == ret) ? LEDA_BATCH_BYPASS : ret;
+    }
+
+    if ((LE_SUCCESS == ret)
+        && ((g_batch_len + need > g_batch_cfg.max_bytes) || (g_batch_cnt >= g_batch_cfg.max_count)))
+    {
+        ret = _batch_flush();
+    }
+
+    if (LE_SUCCESS != ret)
+    {
+        pthread_mutex_unlock(&g_batch_lock);
+        return ret;
+    }
+
+    if ((0 != g_batch_cnt) && !binary)
+    {
+        g_batch_buf[BATCH_HEAD_ROOM + g_batch_len++] = ',';
+    }
+    memcpy(g_batch_buf + BATCH_HEAD_ROOM + g_batch_len, msg, len);
+    g_batch_elems[g_batch_cnt].off      = g_batch_len;
+    g_batch_elems[g_batch_cnt].len      = len;
+    g_batch_ids[g_batch_cnt]            = msg_id;
+    g_batch_len     += len;
+    g_batch_binary  = binary;
+
+    if (1 == ++g_batch_cnt)
+    {
+        g_batch_first_us = _batch_now_us();
+        pthread_cond_signal(&g_batch_cond);
+    }
+
+    /* 本条已进入缓冲区, 发送失败时由定时线程重试 */
+    if (g_batch_cnt >= g_batch_cfg.max_count)
+    {
+        _batch_flush();
+    }
+    pthread_mutex_unlock(&g_batch_lock);
+
+    return LE_SUCCESS;
+}
+
+void leda_batch_drop(void)
+{
+    unsigned int    *failed = NULL;
+    unsigned int    count   = 0;
+
+    pthread_mutex_lock(&g_batch_lock);
+    if (0 != g_batch_cnt)
+    {
+        log_w(LOG_TAG, "connection closed, hand %u batched msgs to spool or reliable delivery\n", g_batch_cnt);
+        failed = mem_malloc(MEM_CORE, sizeof(unsigned int) * g_batch_cnt);
+        count = _batch_discard(failed);
+    }
+    pthread_mutex_unlock(&g_batch_lock);
+
+    _batch_reply_failed(failed, count, LEDA_ERROR_CONNECTION);
+}
+
+#ifdef __cplusplus  /* If this is a C++ compiler, use C linkage */
+}
+#endif
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2014-2019 Alibaba Group. All rights reserved.
+ * License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "base-utils.h"
+#include "metrics.h"
+#include "mem.h"
+
+#include "log.h"
+#include "le_error.h"
+#include "leda.h"
+#include "leda_internal.h"
+#include "leda_value.h"
+
+#ifdef __cplusplus /* If this is a C++ compiler, use C linkage */
+extern "C"
+{
+#endif
+
+#define LOG_TAG                 "LINKEDGE_DEVICE_CACHE"
+
+#define CACHE_DEF_ENTRIES       4096
+#define CACHE_MAX_ENTRIES       (1024 * 1024)
+
+static leda_property_cache_config_t g_cache_cfg     = {0};
+static pthread_mutex_t              g_cache_lock    = PTHREAD_MUTEX_INITIALIZER;
+static leda_value_table_t           g_cache_table   = {0};
+
+/* 有效期配置, rule->param为有效期(ms) */
+static leda_value_rules_t           g_cache_ttls    = {0};
+
+/* 调用方持有g_cache_lock */
+static unsigned int _cache_ttl_ms(const char *pk, const char *key)
+{
+    leda_value_rule_t *ttl = leda_value_rule_find(&g_cache_ttls, pk, key);
+
+    return (NULL != ttl) ? (unsigned int)ttl->param : g_cache_cfg.default_ttl_ms;
+}
+
+int leda_set_property_cache(const leda_property_cache_config_t *config)
+{
+    if (NULL != g_cache_table.buckets)
+    {
+        log_w(LOG_TAG, "property cache should be set before leda init\n");
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    if (NULL == config)
+    {
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    if (config->max_entries > CACHE_MAX_ENTRIES)
+    {
+        log_w(LOG_TAG, "max entries: %u should be in [1, %d]\n", config->max_entries, CACHE_MAX_ENTRIES);
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    g_cache_cfg.enable          = config->enable;
+    g_cache_cfg.default_ttl_ms  = config->default_ttl_ms;
+    g_cache_cfg.max_entries     = (0 == config->max_entries) ? CACHE_DEF_ENTRIES : config->max_entries;
+
+    return LE_SUCCESS;
+}
+
+int leda_set_property_ttl(const char *product_key, const char *identifier, unsigned int ttl_ms)
+{
+    int ret = LE_SUCCESS;
+
+    if ((NULL == product_key) || (NULL == identifier) || ('\0' == identifier[0])
+        || (strlen(identifier) >= MAX_PARAM_NAME_LENGTH))
+    {
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    pthread_mutex_lock(&g_cache_lock);
+    ret = leda_value_rule_set(&g_cache_ttls, product_key, identifier, 0, ttl_ms);
+    pthread_mutex_unlock(&g_cache_lock);
+
+    return ret;
+}
+
+int leda_cache_init(void)
+{
+    int ret = LE_SUCCESS;
+
+    if (!g_cache_cfg.enable)
+    {
+        return LE_SUCCESS;
+    }
+
+    pthread_mutex_lock(&g_cache_lock);
+    ret = leda_value_table_init(&g_cache_table, g_cache_cfg.max_entries);
+    pthread_mutex_unlock(&g_cache_lock);
+
+    return ret;
+}
+
+void leda_cache_exit(void)
+{
+    pthread_mutex_lock(&g_cache_lock);
+    leda_value_table_exit(&g_cache_table);
+    pthread_mutex_unlock(&g_cache_lock);
+}
+
+int leda_cache_enabled(void)
+{
+    return (NULL != g_cache_table.buckets);
+}
+
+void leda_cache_update(const char *pk, const char *dn, const leda_device_data_t *data, int data_cnt)
+{
+    uint64_t    now = 0;
+    int         i   = 0;
+
+    if ((NULL == g_cache_table.buckets) || (NULL == pk) || (NULL == dn))
+    {
+        return;
+    }
+
+    now = metrics_now_us();
+
+    pthread_mutex_lock(&g_cache_lock);
+    if (NULL == g_cache_table.buckets)
+    {
+        pthread_mutex_unlock(&g_cache_lock);
+        return;
+    }
+
+    for (i = 0; i < data_cnt; i++)
+    {
+        /* 不从缓存应答的属性不保存 */
+        if (('\0' == data[i].key[0]) || (0 == _cache_ttl_ms(pk, data[i].key)))
+        {
+            continue;
+        }
+
+        if (LE_ERROR_ALLOCATING_MEM == leda_value_store(&g_cache_table, pk, dn, &data[i], now))
+        {
+            log_w(LOG_TAG, "no memory can allocate\n");
+        }
+    }
+    pthread_mutex_unlock(&g_cache_lock);
+}
+
+int leda_cache_lookup(const char *pk, const char *dn, leda_device_data_t *data, int data_cnt, int *stale)
+{
+    leda_value_entry_t  *entry  = NULL;
+    unsigned int        ttl_ms  = 0;
+    uint64_t            now     = 0;
+    int                 hits    = 0;
+    int                 cnt     = 0;
+    int                 i       = 0;
+
+    now = metrics_now_us();
+
+    pthread_mutex_lock(&g_cache_lock);
+    for (i = 0; i < data_cnt; i++)
+    {
+        entry = NULL;
+        ttl_ms = (NULL != g_cache_table.buckets) ? _cache_ttl_ms(pk, data[i].key) : 0;
+        if (0 != ttl_ms)
+        {
+            entry = leda_value_find(&g_cache_table, pk, dn, data[i].key);
+        }
+
+        if ((NULL != entry) && (now - entry->updated_us < (uint64_t)ttl_ms * 1000))
+        {
+            data[i].type = (leda_data_type_e)entry->type;
+            memcpy(data[i].value, entry->value, entry->value_size);
+            ++hits;
+        }
+        else
+        {
+            stale[cnt++] = i;
+        }
+    }
+    pthread_mutex_unlock(&g_cache_lock);
+
+    metrics_add(METRIC_CACHE_HITS, hits);
+    metrics_add(METRIC_CACHE_MISSES, cnt);
+
+    return cnt;
+}
+
+void leda_cache_remove_device(const char *pk, const char *dn)
+{
+    pthread_mutex_lock(&g_cache_lock);
+    leda_value_remove_device(&g_cache_table, pk, dn);
+    pthread_mutex_unlock(&g_cache_lock);
+}
+
+#ifdef __cplusplus  /* If this is a C++ compiler, use C linkage */
+}
+#endif
@@ -0,0 +1,457 @@
+/*
+ * Copyright (c) 2014-2019 Alibaba Group. All rights reserved.
+ * License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "base-utils.h"
+#include "mem.h"
+
+#include "log.h"
+#include "le_error.h"
+#include "leda.h"
+#include "leda_device.h"
+
+#ifdef __cplusplus /* If this is a C++ compiler, use C linkage */
+extern "C"
+{
+#endif
+
+#define LOG_TAG                 "LINKEDGE_DEVICE_REGISTRY"
+
+#define DEVICE_HASH_BUCKETS     1024
+#define DEVICE_TABLE_MIN_SIZE   16
+
+/* 句柄为 下标 | 代数 << DEVICE_INDEX_BITS, 槽位被复用后旧句柄不再有效 */
+#define DEVICE_INDEX_BITS       20
+#define DEVICE_INDEX_MASK       ((1 << DEVICE_INDEX_BITS) - 1)
+#define DEVICE_GEN_MASK         (INT_MAX >> DEVICE_INDEX_BITS)
+#define DEVICE_TABLE_MAX_SIZE   (1 << DEVICE_INDEX_BITS)
+
+typedef struct leda_device
+{
+    struct list_head    hash_node;
+    unsigned int        hash;
+    int                 handle;
+    char                *pk;
+    char                *dn;            /* 与pk在同一块内存中, pk\0dn\0 */
+    int                 online;
+    int                 restore;        /* 重连后需要恢复上线 */
+    void                *usr_data;
+} leda_device_t;
+
+typedef struct device_slot
+{
+    leda_device_t       *dev;
+    int                 gen;
+    int                 next_free;      /* 空闲槽位链表, -1结束 */
+} device_slot_t;
+
+static struct list_head g_device_buckets[DEVICE_HASH_BUCKETS];
+static device_slot_t    *g_device_table     = NULL;
+static int              g_device_table_size = 0;
+static int              g_device_free       = -1;
+static int              g_device_count      = 0;
+static int              g_device_init       = 0;
+static pthread_mutex_t  g_device_lock       = PTHREAD_MUTEX_INITIALIZER;
+
+unsigned int leda_device_hash(const char *pk, const char *dn)
+{
+    unsigned int hash = 2166136261u;
+
+    /* FNV-1a, pk与dn之间以'\0'分隔 */
+    while (*pk)
+    {
+        hash = (hash ^ (unsigned char)*pk++) * 16777619u;
+    }
+    hash = (hash ^ 0) * 16777619u;
+    while (*dn)
+    {
+        hash = (hash ^ (unsigned char)*dn++) * 16777619u;
+    }
+
+    return hash;
+}
+
+static void _device_buckets_init(void)
+{
+    int i = 0;
+
+    if (g_device_init)
+    {
+        return;
+    }
+
+    for (i = 0; i < DEVICE_HASH_BUCKETS; i++)
+    {
+        INIT_LIST_HEAD(&g_device_buckets[i]);
+    }
+    g_device_init = 1;
+}
+
+static leda_device_t *_device_find(const char *pk, const char *dn, unsigned int hash)
+{
+    leda_device_t *pos = NULL;
+
+    if (!g_device_init)
+    {
+        return NULL;
+    }
+
+    list_for_each_entry(pos, &g_device_buckets[hash % DEVICE_HASH_BUCKETS], hash_node)
+    {
+        if ((pos->hash == hash) && (0 == strcmp(pos->pk, pk)) && (0 == strcmp(pos->dn, dn)))
+        {
+            return pos;
+        }
+    }
+
+    return NULL;
+}
+
+static int _device_handle(int index)
+{
+    return index | (g_device_table[index].gen << DEVICE_INDEX_BITS);
+}
+
+static leda_device_t *_device_get(int handle)
+{
+    int index = handle & DEVICE_INDEX_MASK;
+
+    if ((handle < 0) || (index >= g_device_table_size)
+        || (g_device_table[index].gen != (handle >> DEVICE_INDEX_BITS)))
+    {
+        return NULL;
+    }
+
+    return g_device_table[index].dev;
+}
+
+/* 从空闲链表取槽位, 没有空闲槽位时表扩大一倍 */
+static int _device_alloc_index(void)
+{
+    int             i       = 0;
+    int             size    = 0;
+    device_slot_t   *table  = NULL;
+
+    if (-1 == g_device_free)
+    {
+        if (g_device_table_size >= DEVICE_TABLE_MAX_SIZE)
+        {
+            return LEDA_DEVICE_INVALID_HANDLE;
+        }
+
+        size = (0 == g_device_table_size) ? DEVICE_TABLE_MIN_SIZE : g_device_table_size * 2;
+        table = mem_realloc(MEM_CORE, g_device_table, sizeof(device_slot_t) * size);
+        if (NULL == table)
+        {
+            return LEDA_DEVICE_INVALID_HANDLE;
+        }
+
+        for (i = size - 1; i >= g_device_table_size; i--)
+        {
+            table[i].dev        = NULL;
+            table[i].gen        = 0;
+            table[i].next_free  = g_device_free;
+            g_device_free       = i;
+        }
+        g_device_table = table;
+        g_device_table_size = size;
+    }
+
+    i = g_device_free;
+    g_device_free = g_device_table[i].next_free;
+
+    return i;
+}
+
+static void _device_free_index(int index)
+{
+    g_device_table[index].dev       = NULL;
+    g_device_table[index].gen       = (g_device_table[index].gen + 1) & DEVICE_GEN_MASK;
+    g_device_table[index].next_free = g_device_free;
+    g_device_free                   = index;
+}
+
+int leda_device_register(const char *pk, const char *dn, void *usr_data, int *handle)
+{
+    leda_device_t   *dev    = NULL;
+    unsigned int    hash    = 0;
+    size_t          pk_len  = 0;
+    size_t          dn_len  = 0;
+    int             index   = 0;
+
+    if (NULL == pk || NULL == dn || NULL == handle)
+    {
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    pk_len = strlen(pk);
+    dn_len = strlen(dn);
+    if ((0 == pk_len) || (pk_len >= PRODUCT_KEY_MAXLEN) || (0 == dn_len) || (dn_len >= DEVICE_NAME_MAXLEN))
+    {
+        log_w(LOG_TAG, "product key or device name length is invalid\n");
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    hash = leda_device_hash(pk, dn);
+
+    pthread_mutex_lock(&g_device_lock);
+    _device_buckets_init();
+
+    dev = _device_find(pk, dn, hash);
+    if (NULL != dev)
+    {
+        *handle = dev->handle;
+        pthread_mutex_unlock(&g_device_lock);
+        log_w(LOG_TAG, "device %s:%s has registered, handle: %d\n", pk, dn, dev->handle);
+        return LEDA_ERROR_NAME_EXISTED;
+    }
+
+    index = _device_alloc_index();
+    if (LEDA_DEVICE_INVALID_HANDLE == index)
+    {
+        pthread_mutex_unlock(&g_device_lock);
+        log_w(LOG_TAG, "no memory can allocate\n");
+        return LE_ERROR_ALLOCATING_MEM;
+    }
+
+    dev = mem_malloc(MEM_CORE, sizeof(leda_device_t) + pk_len + dn_len + 2);
+    if (NULL == dev)
+    {
+        g_device_table[index].next_free = g_device_free;
+        g_device_free = index;
+        pthread_mutex_unlock(&g_device_lock);
+        log_w(LOG_TAG, "no memory can allocate\n");
+        return LE_ERROR_ALLOCATING_MEM;
+    }
+
+    memset(dev, 0, sizeof(leda_device_t));
+    dev->pk = (char *)(dev + 1);
+    dev->dn = dev->pk + pk_len + 1;
+    memcpy(dev->pk, pk, pk_len + 1);
+    memcpy(dev->dn, dn, dn_len + 1);
+    dev->hash       = hash;
+    dev->handle     = _device_handle(index);
+    dev->usr_data   = usr_data;
+
+    list_add_tail(&dev->hash_node, &g_device_buckets[hash % DEVICE_HASH_BUCKETS]);
+    g_device_table[index].dev = dev;
+    ++g_device_count;
+    *handle = dev->handle;
+    pthread_mutex_unlock(&g_device_lock);
+
+    return LE_SUCCESS;
+}
+
+int leda_device_unregister(int handle)
+{
+    leda_device_t *dev = NULL;
+
+    pthread_mutex_lock(&g_device_lock);
+    dev = _device_get(handle);
+    if (NULL == dev)
+    {
+        pthread_mutex_unlock(&g_device_lock);
+        return LEDA_ERROR_DEVICE_UNREGISTER;
+    }
+
+    list_del(&dev->hash_node);
+    _device_free_index(handle & DEVICE_INDEX_MASK);
+    --g_device_count;
+    pthread_mutex_unlock(&g_device_lock);
+
+    mem_free(dev);
+
+    return LE_SUCCESS;
+}
+
+int leda_device_lookup(const char *pk, const char *dn, int *handle, void **usr_data)
+{
+    leda_device_t *dev = NULL;
+
+    if (NULL == pk || NULL == dn)
+    {
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    pthread_mutex_lock(&g_device_lock);
+    dev = _device_find(pk, dn, leda_device_hash(pk, dn));
+    if (NULL == dev)
+    {
+        pthread_mutex_unlock(&g_device_lock);
+        return LEDA_ERROR_DEVICE_UNREGISTER;
+    }
+
+    if (NULL != handle)
+    {
+        *handle = dev->handle;
+    }
+
+    if (NULL != usr_data)
+    {
+        *usr_data = dev->usr_data;
+    }
+    pthread_mutex_unlock(&g_device_lock);
+
+    return LE_SUCCESS;
+}
+
+int leda_device_get_name(int handle, char pk[PRODUCT_KEY_MAXLEN], char dn[DEVICE_NAME_MAXLEN])
+{
+    leda_device_t *dev = NULL;
+
+    pthread_mutex_lock(&g_device_lock);
+    dev = _device_get(handle);
+    if (NULL == dev)
+    {
+        pthread_mutex_unlock(&g_device_lock);
+        return LEDA_ERROR_DEVICE_UNREGISTER;
+    }
+
+    /* 注册时已校验长度 */
+    strcpy(pk, dev->pk);
+    strcpy(dn, dev->dn);
+    pthread_mutex_unlock(&g_device_lock);
+
+    return LE_SUCCESS;
+}
+
+int leda_device_get_online(int handle, int *online)
+{
+    leda_device_t *dev = NULL;
+
+    pthread_mutex_lock(&g_device_lock);
+    dev = _device_get(handle);
+    if (NULL == dev)
+    {
+        pthread_mutex_unlock(&g_device_lock);
+        return LEDA_ERROR_DEVICE_UNREGISTER;
+    }
+
+    *online = dev->online;
+    pthread_mutex_unlock(&g_device_lock);
+
+    return LE_SUCCESS;
+}
+
+void leda_device_set_online(const char *pk, const char *dn, int online)
+{
+    leda_device_t *dev = NULL;
+
+    pthread_mutex_lock(&g_device_lock);
+    dev = _device_find(pk, dn, leda_device_hash(pk, dn));
+    if (NULL != dev)
+    {
+        dev->online = online;
+        dev->restore = online;
+    }
+    pthread_mutex_unlock(&g_device_lock);
+}
+
+int leda_device_get_restore_list(int **handles, int *count)
+{
+    int i   = 0;
+    int n   = 0;
+    int *list = NULL;
+
+    *handles = NULL;
+    *count = 0;
+
+    pthread_mutex_lock(&g_device_lock);
+    if (0 == g_device_count)
+    {
+        pthread_mutex_unlock(&g_device_lock);
+        return LE_SUCCESS;
+    }
+
+    list = mem_malloc(MEM_CORE, sizeof(int) * g_device_count);
+    if (NULL == list)
+    {
+        pthread_mutex_unlock(&g_device_lock);
+        log_w(LOG_TAG, "no memory can allocate\n");
+        return LE_ERROR_ALLOCATING_MEM;
+    }
+
+    for (i = 0; i < g_device_table_size; i++)
+    {
+        if ((NULL != g_device_table[i].dev) && g_device_table[i].dev->restore)
+        {
+            list[n++] = g_device_table[i].dev->handle;
+        }
+    }
+    pthread_mutex_unlock(&g_device_lock);
+
+    if (0 == n)
+    {
+        mem_free(list);
+        return LE_SUCCESS;
+    }
+
+    *handles = list;
+    *count = n;
+
+    return LE_SUCCESS;
+}
+
+void leda_device_reset_online(void)
+{
+    int i = 0;
+
+    pthread_mutex_lock(&g_device_lock);
+    for (i = 0; i < g_device_table_size; i++)
+    {
+        if (NULL != g_device_table[i].dev)
+        {
+            g_device_table[i].dev->online = 0;
+        }
+    }
+    pthread_mutex_unlock(&g_device_lock);
+}
+
+void leda_device_clear(void)
+{
+    int i = 0;
+
+    pthread_mutex_lock(&g_device_lock);
+    for (i = 0; i < g_device_table_size; i++)
+    {
+        if (NULL != g_device_table[i].dev)
+        {
+            list_del(&g_device_table[i].dev->hash_node);
+            mem_free(g_device_table[i].dev);
+        }
+    }
+
+    if (NULL != g_device_table)
+    {
+        mem_free(g_device_table);
+        g_device_table = NULL;
+    }
+    g_device_table_size = 0;
+    g_device_free = -1;
+    g_device_count = 0;
+    pthread_mutex_unlock(&g_device_lock);
+}
+
+#ifdef __cplusplus  /* If this is a C++ compiler, use C linkage */
+}
+#endif
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2014-2019 Alibaba Group. All rights reserved.
+ * License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __LINKEDGE_DEVICE_REGISTRY__
+#define __LINKEDGE_DEVICE_REGISTRY__
+
+#ifdef __cplusplus /* If this is a C++ compiler, use C linkage */
+extern "C"
+{
+#endif
+
+#define LEDA_DEVICE_INVALID_HANDLE      (-1)
+
+/*
+ * 设备注册表, SDK内部使用.
+ *
+ * 设备的ProductKey和DeviceName在注册时只保存一份, 之后通过句柄访问.
+ * 句柄由注册表下标和槽位代数组成, 注销后槽位代数加一, 持有旧句柄的调用返回LEDA_ERROR_DEVICE_UNREGISTER.
+ * 下行消息通过哈希表将ProductKey和DeviceName映射为句柄.
+ */
+
+unsigned int leda_device_hash(const char *pk, const char *dn);
+
+int leda_device_register(const char *pk, const char *dn, void *usr_data, int *handle);
+
+int leda_device_unregister(int handle);
+
+int leda_device_lookup(const char *pk, const char *dn, int *handle, void **usr_data);
+
+/* 在锁内将pk和dn拷贝到调用方提供的缓冲区, 调用方使用期间设备被注销也不受影响 */
+int leda_device_get_name(int handle, char pk[PRODUCT_KEY_MAXLEN], char dn[DEVICE_NAME_MAXLEN]);
+
+int leda_device_get_online(int handle, int *online);
+
+/* 未注册的设备忽略. 上线成功的设备会被记录, 重连后自动恢复上线, 主动下线后不再恢复 */
+void leda_device_set_online(const char *pk, const char *dn, int online);
+
+/* 返回重连后需要恢复上线的设备句柄数组, 调用方free */
+int leda_device_get_restore_list(int **handles, int *count);
+
+void leda_device_reset_online(void);
+
+void leda_device_clear(void);
+
+#ifdef __cplusplus  /* If this is a C++ compiler, use C linkage */
+}
+#endif
+#endif
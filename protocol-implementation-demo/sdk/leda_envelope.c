@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2014-2019 Alibaba Group. All rights reserved.
+ * License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#include "cJSON.h"
+#include "mem.h"
+
+#include "log.h"
+#include "le_error.h"
+#include "leda.h"
+#include "leda_internal.h"
+
+#ifdef __cplusplus /* If this is a C++ compiler, use C linkage */
+extern "C"
+{
+#endif
+
+#define LOG_TAG                 "LINKEDGE_DEVICE_ENVELOPE"
+
+/*
+ * 上报消息的模板. 固定部分在编译期拼接好, 按片段整段复制, 只有消息ID, pk/dn
+ * 和属性值需要转义或格式化. 生成的文本与按相同顺序组装cJSON树后
+ * cJSON_PrintUnformatted的结果逐字节相同.
+ */
+#define ENV_HEAD                "{\"version\":\"" PROTOCOL_VERSION "\",\"messageId\":"
+#define ENV_METHOD              ",\"method\":"
+#define ENV_PRODUCT_KEY         ",\"payload\":{\"productKey\":"
+#define ENV_DEVICE_NAME         ",\"deviceName\":"
+#define ENV_IDENTIFIER          ",\"identifier\":"
+#define ENV_OUTPUT_DATA         ",\"outputData\":["
+#define ENV_PROPERTIES          ",\"properties\":["
+#define ENV_ITEM_HEAD           "{\"identifier\":"
+#define ENV_ITEM_TAIL           "}"
+#define ENV_ITEM_SEPARATOR      ","
+#define ENV_TAIL                "]}}"
+
+#define ENV_SPAN(text)          text, (sizeof(text) - 1)
+
+#define ENV_NUMBER_MAX          32      /* cJSON打印数字最多25字节 */
+#define ENV_ITEM_ESTIMATE       96      /* 每个属性预留的长度, 不足时扩容 */
+
+typedef struct env_span
+{
+    const char  *text;
+    size_t      len;
+} env_span_t;
+
+typedef struct env_buf
+{
+    char        *buff;
+    size_t      len;
+    size_t      size;
+} env_buf_t;
+
+/* ,"type":"int","value": 按leda_data_type_e索引, 最后一项为无效类型 */
+#define ENV_TYPE_SPAN(name)     {ENV_SPAN(",\"type\":\"" name "\",\"value\":")},
+
+static const env_span_t g_type_spans[LEDA_TYPE_BUTT + 1] =
+{
+    LEDA_TYPE_NAMES(ENV_TYPE_SPAN)
+};
+
+static int _env_reserve(env_buf_t *buf, size_t need)
+{
+    char    *tmp    = NULL;
+    size_t  size    = 0;
+
+    /* 结尾始终保留'\0'的位置 */
+    if (buf->len + need < buf->size)
+    {
+        return LE_SUCCESS;
+    }
+
+    size = buf->size * 2;
+    if (size < buf->len + need + 1)
+    {
+        size = buf->len + need + 1;
+    }
+
+    tmp = mem_realloc(MEM_JSON, buf->buff, size);
+    if (NULL == tmp)
+    {
+        return LE_ERROR_ALLOCATING_MEM;
+    }
+    buf->buff = tmp;
+    buf->size = size;
+
+    return LE_SUCCESS;
+}
+
+static int _env_append(env_buf_t *buf, const char *text, size_t len)
+{
+    if (LE_SUCCESS != _env_reserve(buf, len))
+    {
+        return LE_ERROR_ALLOCATING_MEM;
+    }
+
+    memcpy(buf->buff + buf->len, text, len);
+    buf->len += len;
+    buf->buff[buf->len] = '\0';
+
+    return LE_SUCCESS;
+}
+
+/* 单个值由cJSON直接打印到缓冲区, 转义和数字格式与打印整棵树时相同 */
+static int _env_append_value(env_buf_t *buf, cJSON *value, size_t max_len)
+{
+    if ((max_len >= INT_MAX) || (LE_SUCCESS != _env_reserve(buf, max_len)))
+    {
+        return LE_ERROR_ALLOCATING_MEM;
+    }
+
+    if (!cJSON_PrintPreallocated(value, buf->buff + buf->len, (int)(buf->size - buf->len), 0))
+    {
+        return LE_ERROR_ALLOCATING_MEM;
+    }
+    buf->len += strlen(buf->buff + buf->len);
+
+    return LE_SUCCESS;
+}
+
+static int _env_append_string(env_buf_t *buf, const char *str)
+{
+    cJSON   value   = {0};
+
+    value.type          = cJSON_String;
+    value.valuestring   = (char *)str;
+
+    /* 最坏情况下每个字符转义为\uXXXX */
+    return _env_append_value(buf, &value, strlen(str) * 6 + sizeof("\"\""));
+}
+
+static int _env_append_number(env_buf_t *buf, double number)
+{
+    cJSON   value   = {0};
+
+    value.type          = cJSON_Number;
+    value.valuedouble   = number;
+
+    return _env_append_value(buf, &value, ENV_NUMBER_MAX);
+}
+
+static int _env_append_data(env_buf_t *buf, const leda_device_data_t *data)
+{
+    cJSON   *sub_item   = NULL;
+    char    *text       = NULL;
+    int     type        = data->type;
+    int     ret         = LE_SUCCESS;
+
+    if (type < LEDA_TYPE_INT || type >= LEDA_TYPE_BUTT)
+    {
+        log_w(LOG_TAG, "unknown data type: %d\n", type);
+        type = LEDA_TYPE_BUTT;
+    }
+
+    ret = _env_append(buf, ENV_SPAN(ENV_ITEM_HEAD));
+    ret = (LE_SUCCESS == ret) ? _env_append_string(buf, data->key) : ret;
+    ret = (LE_SUCCESS == ret) ? _env_append(buf, g_type_spans[type].text, g_type_spans[type].len) : ret;
+    if (LE_SUCCESS != ret)
+    {
+        return ret;
+    }
+
+    switch (type)
+    {
+    case LEDA_TYPE_INT:
+    case LEDA_TYPE_BOOL:
+    case LEDA_TYPE_ENUM:
+        ret = _env_append_number(buf, atoi(data->value));
+        break;
+    case LEDA_TYPE_DOUBLE:
+    case LEDA_TYPE_FLOAT:
+        ret = _env_append_number(buf, atof(data->value));
+        break;
+    case LEDA_TYPE_DATE:
+    case LEDA_TYPE_TEXT:
+        ret = _env_append_string(buf, data->value);
+        break;
+    case LEDA_TYPE_ARRAY:
+    case LEDA_TYPE_STRUCT:
+        /* 重新打印以规范化格式, 并校验是否为合法的JSON */
+        sub_item = cJSON_Parse(data->value);
+        if (NULL == sub_item)
+        {
+            log_w(LOG_TAG, "identifier: %s value: %s is invalid json format\n", data->key, data->value);
+            return LE_ERROR_INVAILD_PARAM;
+        }
+        text = cJSON_PrintUnformatted(sub_item);
+        cJSON_Delete(sub_item);
+        if (NULL == text)
+        {
+            return LE_ERROR_ALLOCATING_MEM;
+        }
+        ret = _env_append(buf, text, strlen(text));
+        cJSON_free(text);
+        break;
+    default:
+        log_w(LOG_TAG, "identifier: %s type: %d is invalid type\n", data->key, data->type);
+        ret = _env_append_string(buf, "invalid");
+        break;
+    }
+
+    return (LE_SUCCESS == ret) ? _env_append(buf, ENV_SPAN(ENV_ITEM_TAIL)) : ret;
+}
+
+int leda_envelope_build(unsigned int msg_id,
+                        const char *method,
+                        const char *pk,
+                        const char *dn,
+                        const char *event_name,
+                        const leda_device_data_t *data,
+                        int data_cnt,
+                        char **msg)
+{
+    env_buf_t   buf     = {0};
+    int         ret     = LE_SUCCESS;
+    int         i       = 0;
+
+    ret = _env_reserve(&buf, sizeof(ENV_HEAD ENV_METHOD ENV_PRODUCT_KEY ENV_DEVICE_NAME ENV_IDENTIFIER ENV_TAIL)
+                             + strlen(method) + strlen(pk) + strlen(dn) + ENV_NUMBER_MAX
+                             + ((data_cnt > 0) ? (size_t)data_cnt * ENV_ITEM_ESTIMATE : 0));
+
+    ret = (LE_SUCCESS == ret) ? _env_append(&buf, ENV_SPAN(ENV_HEAD)) : ret;
+    ret = (LE_SUCCESS == ret) ? _env_append_number(&buf, msg_id) : ret;
+    ret = (LE_SUCCESS == ret) ? _env_append(&buf, ENV_SPAN(ENV_METHOD)) : ret;
+    ret = (LE_SUCCESS == ret) ? _env_append_string(&buf, method) : ret;
+    ret = (LE_SUCCESS == ret) ? _env_append(&buf, ENV_SPAN(ENV_PRODUCT_KEY)) : ret;
+    ret = (LE_SUCCESS == ret) ? _env_append_string(&buf, pk) : ret;
+    ret = (LE_SUCCESS == ret) ? _env_append(&buf, ENV_SPAN(ENV_DEVICE_NAME)) : ret;
+    ret = (LE_SUCCESS == ret) ? _env_append_string(&buf, dn) : ret;
+    if ((LE_SUCCESS == ret) && (NULL != event_name))
+    {
+        ret = _env_append(&buf, ENV_SPAN(ENV_IDENTIFIER));
+        ret = (LE_SUCCESS == ret) ? _env_append_string(&buf, event_name) : ret;
+        ret = (LE_SUCCESS == ret) ? _env_append(&buf, ENV_SPAN(ENV_OUTPUT_DATA)) : ret;
+    }
+    else if (LE_SUCCESS == ret)
+    {
+        ret = _env_append(&buf, ENV_SPAN(ENV_PROPERTIES));
+    }
+
+    for (i = 0; (LE_SUCCESS == ret) && (i < data_cnt); i++)
+    {
+        if (0 != i)
+        {
+            ret = _env_append(&buf, ENV_SPAN(ENV_ITEM_SEPARATOR));
+        }
+        ret = (LE_SUCCESS == ret) ? _env_append_data(&buf, &data[i]) : ret;
+    }
+
+    ret = (LE_SUCCESS == ret) ? _env_append(&buf, ENV_SPAN(ENV_TAIL)) : ret;
+    if (LE_SUCCESS != ret)
+    {
+        mem_free(buf.buff);
+        return ret;
+    }
+
+    *msg = buf.buff;
+
+    return LE_SUCCESS;
+}
+
+#ifdef __cplusplus  /* If this is a C++ compiler, use C linkage */
+}
+#endif
@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2014-2019 Alibaba Group. All rights reserved.
+ * License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "base-utils.h"
+#include "metrics.h"
+#include "mem.h"
+
+#include "log.h"
+#include "le_error.h"
+#include "leda.h"
+#include "leda_internal.h"
+#include "leda_value.h"
+
+#ifdef __cplusplus /* If this is a C++ compiler, use C linkage */
+extern "C"
+{
+#endif
+
+#define LOG_TAG                 "LINKEDGE_DEVICE_FILTER"
+
+#define FILTER_DEF_ENTRIES      4096
+#define FILTER_MAX_ENTRIES      (1024 * 1024)
+#define FILTER_DEF_HEARTBEAT_MS 60000
+
+static leda_report_filter_config_t  g_filter_cfg        = {0};
+static pthread_mutex_t              g_filter_lock       = PTHREAD_MUTEX_INITIALIZER;
+
+/* 每个属性最近一次发出的值, entry->updated_us为发出时间 */
+static leda_value_table_t           g_filter_table      = {0};
+
+/* 死区配置, rule->type为leda_deadband_type_e, rule->param为死区 */
+static leda_value_rules_t           g_filter_rules      = {0};
+
+static int _filter_parse_number(const char *text, double *number)
+{
+    char *end = NULL;
+
+    *number = strtod(text, &end);
+
+    return (end != text) && ('\0' == *end) && isfinite(*number);
+}
+
+/* 与最近一次发出的值相比是否有变化, 数值型属性的变化超过死区才算变化 */
+static int _filter_changed(const char *pk, const leda_value_entry_t *entry, const leda_device_data_t *data)
+{
+    leda_value_rule_t   *rule       = NULL;
+    double              last        = 0;
+    double              current     = 0;
+    double              deadband    = 0;
+
+    if (entry->type != (int)data->type)
+    {
+        return 1;
+    }
+
+    if (((LEDA_TYPE_INT == data->type) || (LEDA_TYPE_FLOAT == data->type) || (LEDA_TYPE_DOUBLE == data->type))
+        && _filter_parse_number(entry->value, &last) && _filter_parse_number(data->value, &current))
+    {
+        rule = leda_value_rule_find(&g_filter_rules, pk, data->key);
+        if (NULL != rule)
+        {
+            deadband = (LEDA_DEADBAND_PERCENT == rule->type) ? fabs(last) * rule->param / 100 : rule->param;
+        }
+
+        return fabs(current - last) > deadband;
+    }
+
+    return 0 != strncmp(entry->value, data->value, MAX_PARAM_VALUE_LENGTH);
+}
+
+int leda_set_report_filter(const leda_report_filter_config_t *config)
+{
+    if (NULL != g_filter_table.buckets)
+    {
+        log_w(LOG_TAG, "report filter should be set before leda init\n");
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    if (NULL == config)
+    {
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    if (config->max_entries > FILTER_MAX_ENTRIES)
+    {
+        log_w(LOG_TAG, "max entries: %u should be in [1, %d]\n", config->max_entries, FILTER_MAX_ENTRIES);
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    g_filter_cfg.enable         = config->enable;
+    g_filter_cfg.heartbeat_ms   = (0 == config->heartbeat_ms) ? FILTER_DEF_HEARTBEAT_MS : config->heartbeat_ms;
+    g_filter_cfg.max_entries    = (0 == config->max_entries) ? FILTER_DEF_ENTRIES : config->max_entries;
+
+    return LE_SUCCESS;
+}
+
+int leda_set_property_deadband(const char *product_key, const char *identifier, leda_deadband_type_e type, double deadband)
+{
+    int ret = LE_SUCCESS;
+
+    if ((NULL == product_key) || (NULL == identifier) || ('\0' == identifier[0])
+        || (strlen(identifier) >= MAX_PARAM_NAME_LENGTH))
+    {
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    if (((LEDA_DEADBAND_ABSOLUTE != type) && (LEDA_DEADBAND_PERCENT != type)) || !(deadband >= 0) || isinf(deadband))
+    {
+        log_w(LOG_TAG, "deadband type: %d or deadband: %f is invalid\n", type, deadband);
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    pthread_mutex_lock(&g_filter_lock);
+    ret = leda_value_rule_set(&g_filter_rules, product_key, identifier, type, deadband);
+    pthread_mutex_unlock(&g_filter_lock);
+
+    return ret;
+}
+
+int leda_filter_init(void)
+{
+    int ret = LE_SUCCESS;
+
+    if (!g_filter_cfg.enable)
+    {
+        return LE_SUCCESS;
+    }
+
+    pthread_mutex_lock(&g_filter_lock);
+    ret = leda_value_table_init(&g_filter_table, g_filter_cfg.max_entries);
+    pthread_mutex_unlock(&g_filter_lock);
+
+    return ret;
+}
+
+void leda_filter_exit(void)
+{
+    pthread_mutex_lock(&g_filter_lock);
+    leda_value_table_exit(&g_filter_table);
+    pthread_mutex_unlock(&g_filter_lock);
+}
+
+int leda_filter_enabled(void)
+{
+    return (NULL != g_filter_table.buckets);
+}
+
+int leda_filter_select(const char *pk, const char *dn, const leda_device_data_t *data, int data_cnt, int *changed)
+{
+    leda_value_entry_t  *entry      = NULL;
+    uint64_t            now         = 0;
+    uint64_t            heartbeat   = 0;
+    int                 cnt         = 0;
+    int                 i           = 0;
+
+    now = metrics_now_us();
+    heartbeat = (uint64_t)g_filter_cfg.heartbeat_ms * 1000;
+
+    pthread_mutex_lock(&g_filter_lock);
+    for (i = 0; i < data_cnt; i++)
+    {
+        entry = leda_value_find(&g_filter_table, pk, dn, data[i].key);
+        if ((NULL == entry) || (now - entry->updated_us >= heartbeat) || _filter_changed(pk, entry, &data[i]))
+        {
+            changed[cnt++] = i;
+        }
+    }
+    pthread_mutex_unlock(&g_filter_lock);
+
+    metrics_add(METRIC_REPORT_SUPPRESSED, data_cnt - cnt);
+
+    return cnt;
+}
+
+void leda_filter_commit(const char *pk, const char *dn, const leda_device_data_t *data, int data_cnt)
+{
+    uint64_t    now = 0;
+    int         i   = 0;
+
+    now = metrics_now_us();
+
+    pthread_mutex_lock(&g_filter_lock);
+    if (NULL == g_filter_table.buckets)
+    {
+        pthread_mutex_unlock(&g_filter_lock);
+        return;
+    }
+
+    /* 达到上限时表中最久未发出的属性被淘汰, 其下一次上报不会被过滤 */
+    for (i = 0; i < data_cnt; i++)
+    {
+        if (('\0' != data[i].key[0])
+            && (LE_ERROR_ALLOCATING_MEM == leda_value_store(&g_filter_table, pk, dn, &data[i], now)))
+        {
+            log_w(LOG_TAG, "no memory can allocate\n");
+        }
+    }
+    pthread_mutex_unlock(&g_filter_lock);
+}
+
+void leda_filter_remove_device(const char *pk, const char *dn)
+{
+    pthread_mutex_lock(&g_filter_lock);
+    leda_value_remove_device(&g_filter_table, pk, dn);
+    pthread_mutex_unlock(&g_filter_lock);
+}
+
+#ifdef __cplusplus  /* If this is a C++ compiler, use C linkage */
+}
+#endif
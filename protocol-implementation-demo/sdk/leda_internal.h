@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2014-2019 Alibaba Group. All rights reserved.
+ * License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __LINKEDGE_DEVICE_ACCESS_INTERNAL__
+#define __LINKEDGE_DEVICE_ACCESS_INTERNAL__
+
+#include <stddef.h>
+
+#ifdef __cplusplus /* If this is a C++ compiler, use C linkage */
+extern "C"
+{
+#endif
+
+#define METHOD_ONLINE           "onlineDevice"
+#define METHOD_OFFLINE          "offlineDevice"
+
+#define PROTOCOL_VERSION        "1.0"
+
+/* 数据类型在协议中的名称, 按leda_data_type_e的顺序, 最后一项用于无效类型 */
+#define LEDA_TYPE_NAMES(X)      X("int") X("bool") X("float") X("text") X("date") \
+                                X("enum") X("struct") X("array") X("double") X("invalid")
+
+#define LEDA_REPLY_TIMEOUT_MS   10000
+
+/*
+ * leda.c 提供给SDK其他模块的内部接口.
+ */
+
+typedef enum ws_msg_type
+{
+    MSG_INVALID = -1,
+    MSG_RSP = 0,
+    MSG_METHOD
+} ws_msg_type_e;
+
+struct cJSON;
+struct leda_device_data;
+
+/* 属性或参数数组与协议JSON数组之间的转换, 也供bench/linux/microbench单独测试 */
+struct cJSON *struct_data_to_json_data(const struct leda_device_data *struct_data, int data_cnt);
+
+/* 成功时*struct_data由调用方mem_free */
+int json_data_to_struct_data(struct cJSON *json_data, struct leda_device_data **struct_data, int *data_cnt);
+
+/* 返回ws_msg_type_e, method和payload指向root内部 */
+int leda_parse_receive_msg(struct cJSON *root, int *msg_id, int *code, char **method, struct cJSON **payload);
+
+/* 发送不带数据的请求(如上下线)并登记应答, 不等待应答 */
+int leda_send_request(const char *pk, const char *dn, const char *method, unsigned int *msg_id);
+
+/* 等待@leda_send_request发出请求的应答, code为对端返回码 */
+int leda_wait_reply(unsigned int msg_id, int timeout_ms, int *code);
+
+int leda_is_connected(void);
+
+/* 等待应答的请求数, 接收通道和后台任务队列中积压的任务数 */
+void leda_get_backlog(unsigned int *pending_replies, unsigned int *recv_backlog, unsigned int *task_backlog);
+
+/* 在SDK后台任务线程中执行, 任务之间串行 */
+int leda_add_task(void (*routine)(void *), void *arg);
+
+/* 发送JSON文本消息, 当前连接协商为CBOR编码时转换后发送 */
+int leda_send_json(const char *msg, size_t len);
+
+/* 同leda_send_json, 设置了发送队列文件时消息发出后仍保留在文件中, 直到msg_ids都收到应答或被放弃 */
+int leda_send_json_tracked(const char *msg, size_t len, const unsigned int *msg_ids, int id_cnt);
+
+/* 将异步上报的结果交给用户的应答回调 */
+void leda_report_reply(unsigned int msg_id, int code);
+
+/* leda_envelope.c */
+
+/* 按模板直接生成属性或事件上报的JSON文本, 与组装cJSON树后打印的结果相同.
+ * event_name为NULL时为属性上报. 成功时*msg由调用方cJSON_free */
+int leda_envelope_build(unsigned int msg_id,
+                        const char *method,
+                        const char *pk,
+                        const char *dn,
+                        const char *event_name,
+                        const struct leda_device_data *data,
+                        int data_cnt,
+                        char **msg);
+
+/* leda_restore.c */
+void leda_restore_start(void);
+
+void leda_restore_stop(void);
+
+/* leda_spool.c */
+#define LEDA_SPOOL_BYPASS       1       /* 消息未进入缓存, 由调用方直接发送 */
+
+int leda_spool_init(void);
+
+void leda_spool_exit(void);
+
+/* 断线或重放未完成时将消息放入缓存, 返回LE_SUCCESS; 可直接发送时返回LEDA_SPOOL_BYPASS */
+int leda_spool_offer(const char *msg, size_t len);
+
+void leda_spool_replay_start(void);
+
+void leda_spool_replay_stop(void);
+
+int leda_spool_is_holding(void);
+
+/* leda_reliable.c */
+int leda_reliable_init(void);
+
+void leda_reliable_exit(void);
+
+int leda_reliable_enabled(void);
+
+/* 登记在途的异步上报, 在途数达到窗口上限时返回LEDA_ERROR_BUSY */
+int leda_reliable_track(unsigned int msg_id, const char *msg, size_t len);
+
+void leda_reliable_untrack(unsigned int msg_id);
+
+/* 消息已进入离线缓存, 重连后由缓存重放发送 */
+void leda_reliable_set_spooled(unsigned int msg_id);
+
+/* 收到应答时调用, 重复的应答返回错误 */
+int leda_reliable_ack(unsigned int msg_id);
+
+void leda_reliable_resend_start(void);
+
+void leda_reliable_resend_stop(void);
+
+/* leda_batch.c */
+#define LEDA_BATCH_BYPASS       1       /* 消息未进入批量缓冲区, 由调用方直接发送 */
+
+/* max_frame为发送队列单条消息的长度上限, 0表示不限制 */
+int leda_batch_init(unsigned int max_frame);
+
+/* 发出缓冲区中的消息后退出 */
+void leda_batch_exit(void);
+
+int leda_batch_enabled(void);
+
+/* 放入批量缓冲区, 返回LE_SUCCESS; 消息超过批量上限时返回LEDA_BATCH_BYPASS;
+ * 缓冲区已满且发送队列满时返回错误, 本条消息未进入缓冲区.
+ * binary为0时msg为JSON文本, 为1时为CBOR编码的消息 */
+int leda_batch_add(unsigned int msg_id, const char *msg, size_t len, int binary);
+
+/* 断线时清空缓冲区: 交给离线缓存或留在可靠上报的在途表中, 都不能时以LEDA_ERROR_CONNECTION回调report_reply_cb */
+void leda_batch_drop(void);
+
+/* leda_cache.c */
+int leda_cache_init(void);
+
+void leda_cache_exit(void);
+
+int leda_cache_enabled(void);
+
+/* 以上报, 设置成功或回调获取到的属性值更新缓存 */
+void leda_cache_update(const char *pk, const char *dn, const struct leda_device_data *data, int data_cnt);
+
+/* 有效期内的属性值直接填写到data中, 其余的下标按序写入stale, 返回其个数 */
+int leda_cache_lookup(const char *pk, const char *dn, struct leda_device_data *data, int data_cnt, int *stale);
+
+/* 设备注销时丢弃其缓存 */
+void leda_cache_remove_device(const char *pk, const char *dn);
+
+/* leda_filter.c */
+int leda_filter_init(void);
+
+void leda_filter_exit(void);
+
+int leda_filter_enabled(void);
+
+/* 有变化或到了重发间隔的属性下标按序写入changed, 返回其个数 */
+int leda_filter_select(const char *pk, const char *dn, const struct leda_device_data *data, int data_cnt, int *changed);
+
+/* 记录发出成功的属性值, 作为之后比较的基准 */
+void leda_filter_commit(const char *pk, const char *dn, const struct leda_device_data *data, int data_cnt);
+
+/* 设备上线或注销时丢弃其记录, 之后的第一次上报不被过滤 */
+void leda_filter_remove_device(const char *pk, const char *dn);
+
+#ifdef __cplusplus  /* If this is a C++ compiler, use C linkage */
+}
+#endif
+#endif
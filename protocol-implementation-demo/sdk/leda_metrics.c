@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2014-2019 Alibaba Group. All rights reserved.
+ * License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "ws_client.h"
+#include "metrics.h"
+#include "trace.h"
+#include "mem.h"
+
+#include "log.h"
+#include "le_error.h"
+#include "leda.h"
+#include "leda_internal.h"
+
+#ifdef __cplusplus /* If this is a C++ compiler, use C linkage */
+extern "C"
+{
+#endif
+
+#define LOG_TAG                 "LINKEDGE_DEVICE_METRICS"
+
+/* leda_mem_module_e与mem_module一一对应 */
+typedef char _leda_mem_module_check[((int)LEDA_MEM_MODULE_BUTT == (int)MEM_MODULE_MAX) ? 1 : -1];
+
+static const char *g_mem_module_name[LEDA_MEM_MODULE_BUTT] =
+{
+    "core", "json", "ws", "threadpool", "log", "spool", "trace", "compress"
+};
+
+static void _metrics_latency(metric_hist id, leda_latency_stats_t *latency)
+{
+    metric_hist_summary summary = {0};
+
+    metrics_hist_summary(id, &summary);
+
+    latency->count  = summary.count;
+    latency->sum_us = summary.sum;
+    latency->p50_us = (unsigned int)summary.p50;
+    latency->p90_us = (unsigned int)summary.p90;
+    latency->p99_us = (unsigned int)summary.p99;
+    latency->max_us = (summary.max > 0xffffffff) ? 0xffffffff : (unsigned int)summary.max;
+}
+
+int leda_get_stats(leda_stats_t *stats)
+{
+    int         depth   = 0;
+    log_stats   logs    = {0};
+
+    if (NULL == stats)
+    {
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    memset(stats, 0, sizeof(leda_stats_t));
+
+    stats->msgs_sent        = metrics_counter(METRIC_MSGS_SENT);
+    stats->bytes_sent       = metrics_counter(METRIC_BYTES_SENT);
+    stats->msgs_recv        = metrics_counter(METRIC_MSGS_RECV);
+    stats->bytes_recv       = metrics_counter(METRIC_BYTES_RECV);
+    stats->send_queue_full  = metrics_counter(METRIC_SEND_QUEUE_FULL);
+    stats->recv_dropped     = metrics_counter(METRIC_RECV_DROPPED);
+    stats->parse_failures   = metrics_counter(METRIC_PARSE_FAILURES);
+    stats->connects         = metrics_counter(METRIC_CONNECTS);
+    stats->disconnects      = metrics_counter(METRIC_DISCONNECTS);
+    stats->reply_timeouts   = metrics_counter(METRIC_REPLY_TIMEOUTS);
+
+    depth = wsc_queue_depth();
+    stats->send_queue_depth = (depth > 0) ? depth : 0;
+    leda_get_backlog(&stats->pending_replies, &stats->recv_backlog, &stats->task_backlog);
+
+    _metrics_latency(METRIC_HIST_ENQUEUE_TO_WRITE, &stats->enqueue_to_write);
+    _metrics_latency(METRIC_HIST_REQUEST_RTT, &stats->request_rtt);
+    _metrics_latency(METRIC_HIST_CALLBACK, &stats->callback);
+    _metrics_latency(METRIC_HIST_TLS_HANDSHAKE, &stats->tls_handshake);
+    _metrics_latency(METRIC_HIST_CONNECT, &stats->connect);
+
+    stats->batches_sent     = metrics_counter(METRIC_BATCHES_SENT);
+    stats->batched_msgs     = metrics_counter(METRIC_BATCHED_MSGS);
+    stats->batch_dropped    = metrics_counter(METRIC_BATCH_DROPPED);
+    stats->tls_handshakes   = metrics_counter(METRIC_TLS_HANDSHAKES);
+    stats->tls_resumed      = metrics_counter(METRIC_TLS_RESUMED);
+    stats->cache_hits       = metrics_counter(METRIC_CACHE_HITS);
+    stats->cache_misses     = metrics_counter(METRIC_CACHE_MISSES);
+    stats->report_suppressed = metrics_counter(METRIC_REPORT_SUPPRESSED);
+
+    log_get_stats(&logs);
+    stats->log_written      = logs.written;
+    stats->log_dropped      = logs.dropped_full + logs.dropped_rate;
+    stats->log_truncated    = logs.truncated;
+
+    return LE_SUCCESS;
+}
+
+int leda_get_mem_stats(leda_mem_stats_t stats[LEDA_MEM_MODULE_BUTT])
+{
+    mem_stats   st  = {0};
+    int         i   = 0;
+
+    if (NULL == stats)
+    {
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    for (i = 0; i < LEDA_MEM_MODULE_BUTT; i++)
+    {
+        mem_get_stats((mem_module)i, &st);
+        stats[i].allocs     = st.allocs;
+        stats[i].frees      = st.frees;
+        stats[i].failures   = st.failures;
+        stats[i].in_use     = st.in_use;
+        stats[i].peak       = st.peak;
+    }
+
+    return LE_SUCCESS;
+}
+
+typedef struct metrics_text
+{
+    char            *buf;
+    unsigned int    size;
+    unsigned int    len;
+    int             overflow;
+} metrics_text_t;
+
+static void _metrics_printf(metrics_text_t *text, const char *fmt, ...)
+{
+    va_list args;
+    int     n = 0;
+
+    if (text->overflow)
+    {
+        return;
+    }
+
+    va_start(args, fmt);
+    n = vsnprintf(text->buf + text->len, text->size - text->len, fmt, args);
+    va_end(args);
+
+    if ((n < 0) || ((unsigned int)n >= text->size - text->len))
+    {
+        text->overflow = 1;
+        return;
+    }
+    text->len += n;
+}
+
+static void _metrics_counter(metrics_text_t *text, const char *name, const char *help, unsigned long long value)
+{
+    _metrics_printf(text, "# HELP leda_%s %s\n# TYPE leda_%s counter\nleda_%s %llu\n", name, help, name, name, value);
+}
+
+static void _metrics_gauge(metrics_text_t *text, const char *name, const char *help, unsigned int value)
+{
+    _metrics_printf(text, "# HELP leda_%s %s\n# TYPE leda_%s gauge\nleda_%s %u\n", name, help, name, name, value);
+}
+
+static void _metrics_summary(metrics_text_t *text, const char *name, const char *help, const leda_latency_stats_t *latency)
+{
+    _metrics_printf(text, "# HELP leda_%s %s\n# TYPE leda_%s summary\n", name, help, name);
+    _metrics_printf(text, "leda_%s{quantile=\"0.5\"} %.6f\n", name, latency->p50_us / 1e6);
+    _metrics_printf(text, "leda_%s{quantile=\"0.9\"} %.6f\n", name, latency->p90_us / 1e6);
+    _metrics_printf(text, "leda_%s{quantile=\"0.99\"} %.6f\n", name, latency->p99_us / 1e6);
+    _metrics_printf(text, "leda_%s_sum %.6f\nleda_%s_count %llu\n", name, latency->sum_us / 1e6, name, latency->count);
+}
+
+/* 按模块输出一组带module标签的指标 */
+static void _metrics_mem(metrics_text_t *text, const char *name, const char *type, const char *help,
+                         const leda_mem_stats_t *mem, size_t offset)
+{
+    int i = 0;
+
+    _metrics_printf(text, "# HELP leda_%s %s\n# TYPE leda_%s %s\n", name, help, name, type);
+    for (i = 0; i < LEDA_MEM_MODULE_BUTT; i++)
+    {
+        _metrics_printf(text, "leda_%s{module=\"%s\"} %llu\n", name, g_mem_module_name[i],
+                        *(const unsigned long long *)((const char *)&mem[i] + offset));
+    }
+}
+
+int leda_dump_stats(char *buf, unsigned int size)
+{
+    leda_stats_t        stats   = {0};
+    leda_mem_stats_t    mem[LEDA_MEM_MODULE_BUTT];
+    metrics_text_t      text    = {0};
+
+    if ((NULL == buf) || (0 == size))
+    {
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    leda_get_stats(&stats);
+    leda_get_mem_stats(mem);
+
+    text.buf    = buf;
+    text.size   = size;
+    buf[0]      = '\0';
+
+    _metrics_counter(&text, "msgs_sent_total", "Messages written to the websocket.", stats.msgs_sent);
+    _metrics_counter(&text, "bytes_sent_total", "Bytes written to the websocket.", stats.bytes_sent);
+    _metrics_counter(&text, "msgs_received_total", "Messages received from the websocket.", stats.msgs_recv);
+    _metrics_counter(&text, "bytes_received_total", "Bytes received from the websocket.", stats.bytes_recv);
+    _metrics_counter(&text, "send_queue_full_total", "Messages rejected because the send queue was full.", stats.send_queue_full);
+    _metrics_counter(&text, "recv_dropped_total", "Received messages dropped because a receive lane was full.", stats.recv_dropped);
+    _metrics_counter(&text, "parse_failures_total", "Received messages that were not valid JSON.", stats.parse_failures);
+    _metrics_counter(&text, "connects_total", "Websocket connections established.", stats.connects);
+    _metrics_counter(&text, "disconnects_total", "Websocket connections closed or failed.", stats.disconnects);
+    _metrics_counter(&text, "reply_timeouts_total", "Requests that got no reply in time.", stats.reply_timeouts);
+    _metrics_counter(&text, "log_written_total", "Log records written by the async logger.", stats.log_written);
+    _metrics_counter(&text, "log_dropped_total", "Log records dropped by the async logger.", stats.log_dropped);
+    _metrics_counter(&text, "log_truncated_total", "Log records truncated by the async logger.", stats.log_truncated);
+    _metrics_counter(&text, "batches_sent_total", "Frames carrying more than one report.", stats.batches_sent);
+    _metrics_counter(&text, "batched_msgs_total", "Reports sent inside batch frames.", stats.batched_msgs);
+    _metrics_counter(&text, "batch_dropped_total", "Batched reports dropped on disconnect or a full send queue.", stats.batch_dropped);
+    _metrics_counter(&text, "tls_handshakes_total", "TLS handshakes completed.", stats.tls_handshakes);
+    _metrics_counter(&text, "tls_resumed_total", "TLS handshakes that resumed a previous session.", stats.tls_resumed);
+    _metrics_counter(&text, "cache_hits_total", "Properties of getProperty answered from the property cache.", stats.cache_hits);
+    _metrics_counter(&text, "cache_misses_total", "Properties of getProperty passed to the callback.", stats.cache_misses);
+    _metrics_counter(&text, "report_suppressed_total", "Reported properties dropped by the change filter.", stats.report_suppressed);
+
+    _metrics_gauge(&text, "send_queue_depth", "Messages waiting in the send queue.", stats.send_queue_depth);
+    _metrics_gauge(&text, "pending_replies", "Requests waiting for a reply.", stats.pending_replies);
+    _metrics_gauge(&text, "recv_backlog", "Received messages waiting in the receive lanes.", stats.recv_backlog);
+    _metrics_gauge(&text, "task_backlog", "Tasks waiting in the background task queue.", stats.task_backlog);
+
+    _metrics_summary(&text, "enqueue_to_write_seconds", "Time from queueing a message to writing it.", &stats.enqueue_to_write);
+    _metrics_summary(&text, "request_rtt_seconds", "Time from sending a request to receiving its reply.", &stats.request_rtt);
+    _metrics_summary(&text, "callback_seconds", "Time spent in user callbacks of downstream methods.", &stats.callback);
+    _metrics_summary(&text, "tls_handshake_seconds", "Time spent in TLS handshakes.", &stats.tls_handshake);
+    _metrics_summary(&text, "connect_seconds", "Time from starting a connection to the websocket being established.", &stats.connect);
+
+    _metrics_mem(&text, "mem_allocs_total", "counter", "Heap allocations made by the SDK.", mem, offsetof(leda_mem_stats_t, allocs));
+    _metrics_mem(&text, "mem_failures_total", "counter", "Heap allocations refused by the limit or the allocator.", mem, offsetof(leda_mem_stats_t, failures));
+    _metrics_mem(&text, "mem_in_use_bytes", "gauge", "Heap bytes in use by the SDK.", mem, offsetof(leda_mem_stats_t, in_use));
+    _metrics_mem(&text, "mem_peak_bytes", "gauge", "Peak heap bytes in use by the SDK.", mem, offsetof(leda_mem_stats_t, peak));
+
+    if (text.overflow)
+    {
+        log_w(LOG_TAG, "buffer size: %u is too small for stats\n", size);
+        return LE_ERROR_PARAM_RANGE_OVERFLOW;
+    }
+
+    return LE_SUCCESS;
+}
+
+int leda_get_compression_stats(leda_compression_stats_t *stats)
+{
+    wsc_deflate_stats st = {0};
+
+    if (NULL == stats)
+    {
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    wsc_get_deflate_stats(&st);
+
+    stats->active           = st.active;
+    stats->raw_out          = st.raw_out;
+    stats->compressed_out   = st.compressed_out;
+    stats->skipped_out      = st.skipped_out;
+    stats->compressed_in    = st.compressed_in;
+    stats->raw_in           = st.raw_in;
+    stats->deflate_us       = st.deflate_us;
+    stats->inflate_us       = st.inflate_us;
+
+    return LE_SUCCESS;
+}
+
+int leda_trace_start(unsigned int events_per_thread)
+{
+    int ret = trace_start(events_per_thread);
+
+    if (LE_SUCCESS != ret)
+    {
+        log_w(LOG_TAG, "events per thread: %u should be in [1, %u]\n", events_per_thread, 1u << 24);
+    }
+
+    return ret;
+}
+
+void leda_trace_stop(void)
+{
+    trace_stop();
+}
+
+int leda_trace_export(const char *file_path)
+{
+    return trace_export(file_path);
+}
+
+#ifdef __cplusplus  /* If this is a C++ compiler, use C linkage */
+}
+#endif
@@ -0,0 +1,642 @@
+/*
+ * Copyright (c) 2014-2019 Alibaba Group. All rights reserved.
+ * License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ws_client.h"
+#include "mem.h"
+
+#include "log.h"
+#include "le_error.h"
+#include "leda.h"
+#include "leda_internal.h"
+
+#ifdef __cplusplus /* If this is a C++ compiler, use C linkage */
+extern "C"
+{
+#endif
+
+#define LOG_TAG                 "LINKEDGE_DEVICE_RELIABLE"
+
+#define RELIABLE_MAX_WINDOW     4096
+#define RELIABLE_MIN_TIMEOUT    100
+#define RELIABLE_MAX_TICK_MS    100
+#define RELIABLE_LATENCY_COUNT  1024        /* 统计最近多少次应答的时延分位 */
+#define RELIABLE_RETRY_US       (10 * 1000)
+#define RELIABLE_SCAN_BATCH     64          /* 每次扫描最多处理的超时消息数 */
+
+/* 扫描时在锁内复制待重传的消息, 解锁后发送 */
+typedef struct reliable_resend
+{
+    unsigned int    msg_id;
+    char            *msg;
+    size_t          len;
+} reliable_resend_t;
+
+typedef struct reliable_entry
+{
+    unsigned int    msg_id;
+    int             retries;
+    int             spooled;                /* 在离线缓存中, 重连时不由本模块发送 */
+    uint64_t        first_us;               /* 首次上报时间, 用于统计应答时延 */
+    uint64_t        sent_us;                /* 最近一次发送时间, 用于判断重传 */
+    char            *msg;                   /* NULL表示空闲 */
+    size_t          len;
+} reliable_entry_t;
+
+static leda_reliable_config_t   g_rel_cfg       = {0};
+static pthread_mutex_t          g_rel_lock      = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t           g_rel_cond      = PTHREAD_COND_INITIALIZER;
+
+/*
+ * 按msg_id线性探测的在途表, 容量为窗口的2倍向上取2的幂, 在途数小于窗口时总有空位.
+ * 删除时把后续同一探测链上的表项前移, 不需要删除标记.
+ */
+static reliable_entry_t         *g_rel_table    = NULL;
+static unsigned int             g_rel_mask      = 0;
+static unsigned int             g_rel_inflight  = 0;
+
+static pthread_t                g_rel_timer;
+static int                      g_rel_running   = 0;
+static int                      g_rel_paused    = 1;
+static volatile unsigned int    g_rel_gen       = 0;
+static volatile int             g_rel_resending = 0;
+
+static leda_reliable_stats_t    g_rel_stats     = {0};
+static uint32_t                 g_rel_latency[RELIABLE_LATENCY_COUNT];
+static unsigned int             g_rel_latency_cnt = 0;
+
+static uint64_t _reliable_now_us(void)
+{
+    struct timespec ts = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static reliable_entry_t *_reliable_find(unsigned int msg_id)
+{
+    unsigned int i = msg_id & g_rel_mask;
+
+    while (NULL != g_rel_table[i].msg)
+    {
+        if (g_rel_table[i].msg_id == msg_id)
+        {
+            return &g_rel_table[i];
+        }
+        i = (i + 1) & g_rel_mask;
+    }
+
+    return NULL;
+}
+
+static void _reliable_free_entry(reliable_entry_t *entry)
+{
+    unsigned int hole   = (unsigned int)(entry - g_rel_table);
+    unsigned int i      = hole;
+    unsigned int home   = 0;
+
+    mem_free(entry->msg);
+    entry->msg = NULL;
+    --g_rel_inflight;
+
+    /* 探测链上起始位置不在(hole, i]内的表项可以前移到空位 */
+    for (i = (i + 1) & g_rel_mask; NULL != g_rel_table[i].msg; i = (i + 1) & g_rel_mask)
+    {
+        home = g_rel_table[i].msg_id & g_rel_mask;
+        if (((i - home) & g_rel_mask) < ((i - hole) & g_rel_mask))
+        {
+            continue;
+        }
+
+        g_rel_table[hole] = g_rel_table[i];
+        g_rel_table[i].msg = NULL;
+        hole = i;
+    }
+}
+
+int leda_set_reliable_delivery(const leda_reliable_config_t *config)
+{
+    if (NULL == config)
+    {
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    if (config->enable && ((config->window <= 0) || (config->window > RELIABLE_MAX_WINDOW)
+        || (config->timeout_ms < RELIABLE_MIN_TIMEOUT) || (config->max_retries < 0)))
+    {
+        log_w(LOG_TAG, "window: %d should be in [1, %d], timeout: %d should not be less than %d, max retries: %d should not be negative\n",
+              config->window, RELIABLE_MAX_WINDOW, config->timeout_ms, RELIABLE_MIN_TIMEOUT, config->max_retries);
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    pthread_mutex_lock(&g_rel_lock);
+    if (NULL != g_rel_table)
+    {
+        pthread_mutex_unlock(&g_rel_lock);
+        log_w(LOG_TAG, "reliable delivery should be set before leda init\n");
+        return LE_ERROR_INVAILD_PARAM;
+    }
+    g_rel_cfg = *config;
+    pthread_mutex_unlock(&g_rel_lock);
+
+    return LE_SUCCESS;
+}
+
+int leda_reliable_enabled(void)
+{
+    return (NULL != g_rel_table);
+}
+
+/* 断线, 重传或离线缓存重放期间暂停计时, 恢复后所有在途消息重新计时 */
+static int _reliable_should_pause(void)
+{
+    return !leda_is_connected() || g_rel_resending || leda_spool_is_holding();
+}
+
+static void _reliable_scan(void)
+{
+    reliable_entry_t    *entry      = NULL;
+    reliable_resend_t   resend[RELIABLE_SCAN_BATCH];
+    uint64_t            now         = _reliable_now_us();
+    uint64_t            timeout     = (uint64_t)g_rel_cfg.timeout_ms * 1000;
+    unsigned int        expired[RELIABLE_SCAN_BATCH];
+    int                 expired_cnt = 0;
+    int                 resend_cnt  = 0;
+    int                 sent        = 0;
+    unsigned int        i           = 0;
+    int                 pause       = _reliable_should_pause();
+
+    pthread_mutex_lock(&g_rel_lock);
+    if (pause || g_rel_paused)
+    {
+        if (!pause)
+        {
+            for (i = 0; i <= g_rel_mask; i++)
+            {
+                g_rel_table[i].sent_us = now;
+            }
+        }
+        g_rel_paused = pause;
+        pthread_mutex_unlock(&g_rel_lock);
+        return;
+    }
+
+    for (i = 0; (i <= g_rel_mask) && (expired_cnt < RELIABLE_SCAN_BATCH) && (resend_cnt < RELIABLE_SCAN_BATCH); i++)
+    {
+        entry = &g_rel_table[i];
+        if ((NULL == entry->msg) || (now - entry->sent_us < timeout))
+        {
+            continue;
+        }
+
+        if ((g_rel_cfg.max_retries > 0) && (entry->retries >= g_rel_cfg.max_retries))
+        {
+            /* 释放会前移表项, 遍历结束后再释放 */
+            expired[expired_cnt++] = entry->msg_id;
+            continue;
+        }
+
+        resend[resend_cnt].msg = mem_malloc(MEM_CORE, entry->len);
+        if (NULL == resend[resend_cnt].msg)
+        {
+            break;
+        }
+        memcpy(resend[resend_cnt].msg, entry->msg, entry->len);
+        resend[resend_cnt].len      = entry->len;
+        resend[resend_cnt].msg_id   = entry->msg_id;
+        ++resend_cnt;
+    }
+
+    for (i = 0; i < (unsigned int)expired_cnt; i++)
+    {
+        _reliable_free_entry(_reliable_find(expired[i]));
+        ++g_rel_stats.expired;
+    }
+    pthread_mutex_unlock(&g_rel_lock);
+
+    /* 发送不持有在途表的锁, 以免阻塞上报和应答 */
+    for (sent = 0; sent < resend_cnt; sent++)
+    {
+        if (LE_SUCCESS != leda_send_json_tracked(resend[sent].msg, resend[sent].len, &resend[sent].msg_id, 1))
+        {
+            /* 发送队列已满, 下次再试 */
+            break;
+        }
+
+        pthread_mutex_lock(&g_rel_lock);
+        entry = _reliable_find(resend[sent].msg_id);
+        if (NULL != entry)
+        {
+            ++entry->retries;
+            entry->sent_us = now;
+        }
+        ++g_rel_stats.retransmitted;
+        pthread_mutex_unlock(&g_rel_lock);
+    }
+
+    for (i = 0; i < (unsigned int)resend_cnt; i++)
+    {
+        mem_free(resend[i].msg);
+    }
+
+    for (i = 0; i < (unsigned int)expired_cnt; i++)
+    {
+        log_w(LOG_TAG, "msg id: %u is not acknowledged after %d retries\n", expired[i], g_rel_cfg.max_retries);
+        wsc_ack_msg(expired[i]);
+        leda_report_reply(expired[i], LE_ERROR_TIMEOUT);
+    }
+}
+
+static void *_reliable_timer_proc(void *arg)
+{
+    struct timespec ts      = {0};
+    int             tick_ms = g_rel_cfg.timeout_ms / 4;
+
+    if (tick_ms > RELIABLE_MAX_TICK_MS)
+    {
+        tick_ms = RELIABLE_MAX_TICK_MS;
+    }
+
+    pthread_mutex_lock(&g_rel_lock);
+    while (g_rel_running)
+    {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += (long)tick_ms * 1000000;
+        ts.tv_sec += ts.tv_nsec / 1000000000;
+        ts.tv_nsec %= 1000000000;
+        pthread_cond_timedwait(&g_rel_cond, &g_rel_lock, &ts);
+        if (!g_rel_running)
+        {
+            break;
+        }
+
+        pthread_mutex_unlock(&g_rel_lock);
+        _reliable_scan();
+        pthread_mutex_lock(&g_rel_lock);
+    }
+    pthread_mutex_unlock(&g_rel_lock);
+
+    return NULL;
+}
+
+int leda_reliable_init(void)
+{
+    unsigned int size = 1;
+
+    if (!g_rel_cfg.enable)
+    {
+        return LE_SUCCESS;
+    }
+
+    while (size < (unsigned int)g_rel_cfg.window * 2)
+    {
+        size <<= 1;
+    }
+
+    pthread_mutex_lock(&g_rel_lock);
+    g_rel_table = mem_malloc(MEM_CORE, size * sizeof(reliable_entry_t));
+    if (NULL == g_rel_table)
+    {
+        pthread_mutex_unlock(&g_rel_lock);
+        log_w(LOG_TAG, "no memory can allocate\n");
+        return LE_ERROR_ALLOCATING_MEM;
+    }
+    memset(g_rel_table, 0, size * sizeof(reliable_entry_t));
+    g_rel_mask      = size - 1;
+    g_rel_inflight  = 0;
+    g_rel_paused    = 1;
+    g_rel_running   = 1;
+    pthread_mutex_unlock(&g_rel_lock);
+
+    if (0 != pthread_create(&g_rel_timer, NULL, _reliable_timer_proc, NULL))
+    {
+        log_w(LOG_TAG, "create reliable timer thread failed\n");
+        g_rel_running = 0;
+        leda_reliable_exit();
+        return LE_ERROR_UNKNOWN;
+    }
+
+    return LE_SUCCESS;
+}
+
+void leda_reliable_exit(void)
+{
+    unsigned int i = 0;
+
+    pthread_mutex_lock(&g_rel_lock);
+    ++g_rel_gen;
+    if (g_rel_running)
+    {
+        g_rel_running = 0;
+        pthread_cond_signal(&g_rel_cond);
+        pthread_mutex_unlock(&g_rel_lock);
+        pthread_join(g_rel_timer, NULL);
+        pthread_mutex_lock(&g_rel_lock);
+    }
+
+    if (NULL != g_rel_table)
+    {
+        /* 整表释放, 不需要前移表项 */
+        for (i = 0; i <= g_rel_mask; i++)
+        {
+            mem_free(g_rel_table[i].msg);
+        }
+        g_rel_inflight = 0;
+        mem_free(g_rel_table);
+        g_rel_table = NULL;
+    }
+    g_rel_mask = 0;
+    pthread_mutex_unlock(&g_rel_lock);
+}
+
+int leda_reliable_track(unsigned int msg_id, const char *msg, size_t len)
+{
+    reliable_entry_t    *entry  = NULL;
+    char                *copy   = NULL;
+    uint64_t            now     = 0;
+
+    copy = mem_malloc(MEM_CORE, len);
+    if (NULL == copy)
+    {
+        log_w(LOG_TAG, "no memory can allocate\n");
+        return LE_ERROR_ALLOCATING_MEM;
+    }
+    memcpy(copy, msg, len);
+    now = _reliable_now_us();
+
+    pthread_mutex_lock(&g_rel_lock);
+    if (g_rel_inflight >= (unsigned int)g_rel_cfg.window)
+    {
+        ++g_rel_stats.window_full;
+        pthread_mutex_unlock(&g_rel_lock);
+        mem_free(copy);
+        log_w(LOG_TAG, "inflight msgs reach the window: %d\n", g_rel_cfg.window);
+        return LEDA_ERROR_BUSY;
+    }
+
+    entry = &g_rel_table[msg_id & g_rel_mask];
+    while (NULL != entry->msg)
+    {
+        entry = &g_rel_table[(entry - g_rel_table + 1) & g_rel_mask];
+    }
+
+    entry->msg_id   = msg_id;
+    entry->retries  = 0;
+    entry->spooled  = 0;
+    entry->first_us = now;
+    entry->sent_us  = now;
+    entry->msg      = copy;
+    entry->len      = len;
+    ++g_rel_inflight;
+    ++g_rel_stats.tracked;
+    pthread_mutex_unlock(&g_rel_lock);
+
+    return LE_SUCCESS;
+}
+
+void leda_reliable_untrack(unsigned int msg_id)
+{
+    reliable_entry_t *entry = NULL;
+
+    pthread_mutex_lock(&g_rel_lock);
+    entry = _reliable_find(msg_id);
+    if (NULL != entry)
+    {
+        _reliable_free_entry(entry);
+        --g_rel_stats.tracked;
+    }
+    pthread_mutex_unlock(&g_rel_lock);
+}
+
+void leda_reliable_set_spooled(unsigned int msg_id)
+{
+    reliable_entry_t *entry = NULL;
+
+    pthread_mutex_lock(&g_rel_lock);
+    entry = _reliable_find(msg_id);
+    if (NULL != entry)
+    {
+        entry->spooled = 1;
+    }
+    pthread_mutex_unlock(&g_rel_lock);
+}
+
+int leda_reliable_ack(unsigned int msg_id)
+{
+    reliable_entry_t    *entry  = NULL;
+    uint64_t            cost    = 0;
+
+    pthread_mutex_lock(&g_rel_lock);
+    entry = _reliable_find(msg_id);
+    if (NULL == entry)
+    {
+        /* 重传导致的重复应答, 或已超过重传次数放弃的消息 */
+        ++g_rel_stats.duplicates;
+        pthread_mutex_unlock(&g_rel_lock);
+        return LE_ERROR_UNKNOWN;
+    }
+
+    cost = _reliable_now_us() - entry->first_us;
+    g_rel_latency[g_rel_latency_cnt++ % RELIABLE_LATENCY_COUNT] = (cost > UINT32_MAX) ? UINT32_MAX : (uint32_t)cost;
+    ++g_rel_stats.acked;
+    _reliable_free_entry(entry);
+    pthread_mutex_unlock(&g_rel_lock);
+
+    return LE_SUCCESS;
+}
+
+static int _reliable_cmp_id(const void *a, const void *b)
+{
+    return (int)(*(const unsigned int *)a - *(const unsigned int *)b);
+}
+
+static void _reliable_resend_proc(void *arg)
+{
+    unsigned int        gen     = (unsigned int)(uintptr_t)arg;
+    unsigned int        *ids    = NULL;
+    unsigned int        count   = 0;
+    unsigned int        i       = 0;
+    unsigned int        sent    = 0;
+    reliable_entry_t    *entry  = NULL;
+    char                *msg    = NULL;
+    size_t              len     = 0;
+    int                 ret     = LE_SUCCESS;
+
+    pthread_mutex_lock(&g_rel_lock);
+    ids = mem_malloc(MEM_CORE, (g_rel_inflight + 1) * sizeof(unsigned int));
+    if (NULL != ids)
+    {
+        for (i = 0; i <= g_rel_mask; i++)
+        {
+            if (NULL != g_rel_table[i].msg)
+            {
+                ids[count++] = g_rel_table[i].msg_id;
+            }
+        }
+    }
+    pthread_mutex_unlock(&g_rel_lock);
+
+    /* 按上报顺序重传 */
+    qsort(ids, count, sizeof(unsigned int), _reliable_cmp_id);
+
+    for (i = 0; (i < count) && (gen == g_rel_gen) && leda_is_connected(); )
+    {
+        pthread_mutex_lock(&g_rel_lock);
+        entry = _reliable_find(ids[i]);
+        if ((NULL == entry) || entry->spooled)
+        {
+            /* 缓存中的消息随后由重放发出, 之后按超时重传 */
+            if (NULL != entry)
+            {
+                entry->spooled = 0;
+            }
+            pthread_mutex_unlock(&g_rel_lock);
+            ++i;
+            continue;
+        }
+
+        msg = mem_malloc(MEM_CORE, entry->len);
+        if (NULL != msg)
+        {
+            memcpy(msg, entry->msg, entry->len);
+            len = entry->len;
+        }
+        pthread_mutex_unlock(&g_rel_lock);
+
+        /* 发送不持有在途表的锁, 复制的消息不受期间应答的影响 */
+        ret = (NULL != msg) ? leda_send_json_tracked(msg, len, &ids[i], 1) : LE_ERROR_ALLOCATING_MEM;
+        mem_free(msg);
+        msg = NULL;
+        if (LE_SUCCESS != ret)
+        {
+            /* 发送队列已满, 稍后重试 */
+            usleep(RELIABLE_RETRY_US);
+            continue;
+        }
+
+        pthread_mutex_lock(&g_rel_lock);
+        entry = _reliable_find(ids[i]);
+        if (NULL != entry)
+        {
+            ++entry->retries;
+        }
+        ++g_rel_stats.retransmitted;
+        pthread_mutex_unlock(&g_rel_lock);
+
+        ++sent;
+        ++i;
+    }
+
+    mem_free(ids);
+    if (gen == g_rel_gen)
+    {
+        g_rel_resending = 0;
+    }
+
+    if (sent > 0)
+    {
+        log_i(LOG_TAG, "resend %u unacknowledged msgs after reconnect\n", sent);
+    }
+}
+
+void leda_reliable_resend_start(void)
+{
+    unsigned int gen = 0;
+
+    if (NULL == g_rel_table)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&g_rel_lock);
+    gen = ++g_rel_gen;
+    g_rel_resending = 1;
+    pthread_mutex_unlock(&g_rel_lock);
+
+    /* 任务线程串行执行, 在设备上线恢复之后, 离线缓存重放之前 */
+    if (LE_SUCCESS != leda_add_task(_reliable_resend_proc, (void *)(uintptr_t)gen))
+    {
+        log_w(LOG_TAG, "start reliable resend task failed\n");
+        g_rel_resending = 0;
+    }
+}
+
+void leda_reliable_resend_stop(void)
+{
+    pthread_mutex_lock(&g_rel_lock);
+    ++g_rel_gen;
+    g_rel_resending = 0;
+    pthread_mutex_unlock(&g_rel_lock);
+}
+
+static int _reliable_cmp_latency(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+int leda_get_reliable_stats(leda_reliable_stats_t *stats)
+{
+    uint32_t        *sorted = NULL;
+    unsigned int    count   = 0;
+
+    if (NULL == stats)
+    {
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    sorted = mem_malloc(MEM_CORE, RELIABLE_LATENCY_COUNT * sizeof(uint32_t));
+    if (NULL == sorted)
+    {
+        log_w(LOG_TAG, "no memory can allocate\n");
+        return LE_ERROR_ALLOCATING_MEM;
+    }
+
+    pthread_mutex_lock(&g_rel_lock);
+    *stats = g_rel_stats;
+    stats->inflight = g_rel_inflight;
+    count = (g_rel_latency_cnt < RELIABLE_LATENCY_COUNT) ? g_rel_latency_cnt : RELIABLE_LATENCY_COUNT;
+    memcpy(sorted, g_rel_latency, count * sizeof(uint32_t));
+    pthread_mutex_unlock(&g_rel_lock);
+
+    if (count > 0)
+    {
+        qsort(sorted, count, sizeof(uint32_t), _reliable_cmp_latency);
+        stats->ack_p50_us = sorted[(count - 1) * 50 / 100];
+        stats->ack_p90_us = sorted[(count - 1) * 90 / 100];
+        stats->ack_p99_us = sorted[(count - 1) * 99 / 100];
+        stats->ack_max_us = sorted[count - 1];
+    }
+    mem_free(sorted);
+
+    return LE_SUCCESS;
+}
+
+#ifdef __cplusplus  /* If this is a C++ compiler, use C linkage */
+}
+#endif
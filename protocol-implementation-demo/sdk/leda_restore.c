@@ -0,0 +1,298 @@
+/*
+ * Copyright (c) 2014-2019 Alibaba Group. All rights reserved.
+ * License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mem.h"
+
+#include "log.h"
+#include "le_error.h"
+#include "leda.h"
+#include "leda_device.h"
+#include "leda_internal.h"
+
+#ifdef __cplusplus /* If this is a C++ compiler, use C linkage */
+extern "C"
+{
+#endif
+
+#define LOG_TAG                 "LINKEDGE_DEVICE_RESTORE"
+
+#define RESTORE_MAX_WINDOW      64
+#define RESTORE_DEFAULT_WINDOW  8
+#define RESTORE_DEFAULT_RATE    100
+
+typedef struct restore_inflight
+{
+    unsigned int    msg_id;
+    char            pk[PRODUCT_KEY_MAXLEN];     /* 等待应答期间设备可能被注销, 保存名字副本 */
+    char            dn[DEVICE_NAME_MAXLEN];
+} restore_inflight_t;
+
+static leda_restore_policy_t    g_restore_policy = {1, RESTORE_DEFAULT_WINDOW, RESTORE_DEFAULT_RATE, NULL, NULL};
+static leda_restore_stats_t     g_restore_stats  = {0};
+static pthread_mutex_t          g_restore_lock   = PTHREAD_MUTEX_INITIALIZER;
+
+static volatile unsigned int    g_restore_gen    = 0;
+static uint64_t                 g_restore_begin  = 0;
+
+static uint64_t _restore_now_us(void)
+{
+    struct timespec ts = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int _restore_aborted(unsigned int gen)
+{
+    return (gen != g_restore_gen) || !leda_is_connected();
+}
+
+/* policy为_restore_proc开始时的副本, 恢复期间可能被leda_set_restore_policy修改 */
+static void _restore_done(const leda_restore_policy_t *policy, const char *pk, const char *dn, int code)
+{
+    pthread_mutex_lock(&g_restore_lock);
+    if (LE_SUCCESS == code)
+    {
+        ++g_restore_stats.devices_restored;
+    }
+    else
+    {
+        ++g_restore_stats.devices_failed;
+    }
+    pthread_mutex_unlock(&g_restore_lock);
+
+    if (LE_SUCCESS == code)
+    {
+        /* 与leda_online一致, 云端重新上线后属性需全量上报 */
+        leda_device_set_online(pk, dn, 1);
+        leda_filter_remove_device(pk, dn);
+    }
+    else
+    {
+        log_w(LOG_TAG, "restore device %s:%s failed, code: %d\n", pk, dn, code);
+    }
+
+    if (policy->restore_cb)
+    {
+        policy->restore_cb(pk, dn, code, policy->usr_data);
+    }
+}
+
+static void _restore_wait(const leda_restore_policy_t *policy, restore_inflight_t *inflight, unsigned int gen)
+{
+    int ret     = LE_SUCCESS;
+    int code    = LE_ERROR_UNKNOWN;
+
+    /* 恢复被中断时不再等待, 仅清理应答登记 */
+    ret = leda_wait_reply(inflight->msg_id, _restore_aborted(gen) ? 0 : LEDA_REPLY_TIMEOUT_MS, &code);
+    _restore_done(policy, inflight->pk, inflight->dn, (LE_SUCCESS == ret) ? code : ret);
+}
+
+static void _restore_proc(void *arg)
+{
+    unsigned int            gen         = (unsigned int)(uintptr_t)arg;
+    int                     *handles    = NULL;
+    int                     count       = 0;
+    int                     window      = 0;
+    int                     rate        = 0;
+    int                     head        = 0;
+    int                     pending     = 0;
+    int                     sent        = 0;
+    int                     i           = 0;
+    uint64_t                begin       = 0;
+    uint64_t                now         = 0;
+    uint64_t                next        = 0;
+    unsigned int            msg_id      = 0;
+    unsigned int            elapsed_ms  = 0;
+    restore_inflight_t      *slot       = NULL;
+    restore_inflight_t      inflight[RESTORE_MAX_WINDOW];
+    leda_restore_policy_t   policy;
+
+    if (_restore_aborted(gen))
+    {
+        return;
+    }
+
+    if (LE_SUCCESS != leda_device_get_restore_list(&handles, &count))
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&g_restore_lock);
+    policy = g_restore_policy;
+    pthread_mutex_unlock(&g_restore_lock);
+
+    window  = policy.window;
+    rate    = policy.rate;
+    begin   = _restore_now_us();
+
+    log_i(LOG_TAG, "restore %d devices, window: %d rate: %d\n", count, window, rate);
+
+    for (i = 0; i < count; i++)
+    {
+        if (_restore_aborted(gen))
+        {
+            break;
+        }
+
+        if (pending == window)
+        {
+            _restore_wait(&policy, &inflight[head], gen);
+            head = (head + 1) % window;
+            --pending;
+        }
+
+        if (rate > 0)
+        {
+            next = begin + (uint64_t)sent * 1000000 / rate;
+            now = _restore_now_us();
+            if (next > now)
+            {
+                usleep((useconds_t)(next - now));
+            }
+        }
+
+        slot = &inflight[(head + pending) % window];
+        if (LE_SUCCESS != leda_device_get_name(handles[i], slot->pk, slot->dn))
+        {
+            continue;
+        }
+
+        ++sent;
+        if (LE_SUCCESS != leda_send_request(slot->pk, slot->dn, METHOD_ONLINE, &msg_id))
+        {
+            _restore_done(&policy, slot->pk, slot->dn, LEDA_ERROR_CONNECTION);
+            continue;
+        }
+
+        slot->msg_id = msg_id;
+        ++pending;
+    }
+
+    while (pending > 0)
+    {
+        _restore_wait(&policy, &inflight[head], gen);
+        head = (head + 1) % window;
+        --pending;
+    }
+
+    mem_free(handles);
+
+    pthread_mutex_lock(&g_restore_lock);
+    elapsed_ms = g_restore_stats.last_restore_ms;
+    if (gen == g_restore_gen)
+    {
+        g_restore_stats.in_progress = 0;
+        if (!_restore_aborted(gen))
+        {
+            /* 从连接建立到所有设备恢复完成的耗时 */
+            g_restore_stats.last_restore_ms = (unsigned int)((_restore_now_us() - g_restore_begin) / 1000);
+            if (g_restore_stats.last_restore_ms > g_restore_stats.max_restore_ms)
+            {
+                g_restore_stats.max_restore_ms = g_restore_stats.last_restore_ms;
+            }
+            g_restore_stats.last_device_count = count;
+            ++g_restore_stats.restore_count;
+            elapsed_ms = g_restore_stats.last_restore_ms;
+        }
+    }
+    pthread_mutex_unlock(&g_restore_lock);
+
+    log_i(LOG_TAG, "restore finished, %d devices in %u ms\n", count, elapsed_ms);
+}
+
+void leda_restore_start(void)
+{
+    unsigned int gen = 0;
+
+    pthread_mutex_lock(&g_restore_lock);
+    if (!g_restore_policy.enable)
+    {
+        pthread_mutex_unlock(&g_restore_lock);
+        return;
+    }
+
+    gen = ++g_restore_gen;
+    g_restore_begin = _restore_now_us();
+    g_restore_stats.in_progress = 1;
+    pthread_mutex_unlock(&g_restore_lock);
+
+    if (LE_SUCCESS != leda_add_task(_restore_proc, (void *)(uintptr_t)gen))
+    {
+        log_w(LOG_TAG, "start restore task failed\n");
+        pthread_mutex_lock(&g_restore_lock);
+        g_restore_stats.in_progress = 0;
+        pthread_mutex_unlock(&g_restore_lock);
+    }
+}
+
+void leda_restore_stop(void)
+{
+    pthread_mutex_lock(&g_restore_lock);
+    ++g_restore_gen;
+    g_restore_stats.in_progress = 0;
+    pthread_mutex_unlock(&g_restore_lock);
+}
+
+int leda_set_restore_policy(const leda_restore_policy_t *policy)
+{
+    if (NULL == policy)
+    {
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    if ((policy->window <= 0) || (policy->window > RESTORE_MAX_WINDOW) || (policy->rate < 0))
+    {
+        log_w(LOG_TAG, "restore window: %d should be in [1, %d], rate: %d should not be negative\n",
+              policy->window, RESTORE_MAX_WINDOW, policy->rate);
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    pthread_mutex_lock(&g_restore_lock);
+    g_restore_policy = *policy;
+    pthread_mutex_unlock(&g_restore_lock);
+
+    return LE_SUCCESS;
+}
+
+int leda_get_restore_stats(leda_restore_stats_t *stats)
+{
+    if (NULL == stats)
+    {
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    pthread_mutex_lock(&g_restore_lock);
+    *stats = g_restore_stats;
+    pthread_mutex_unlock(&g_restore_lock);
+
+    return LE_SUCCESS;
+}
+
+#ifdef __cplusplus  /* If this is a C++ compiler, use C linkage */
+}
+#endif
@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2014-2019 Alibaba Group. All rights reserved.
+ * License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ws_client.h"
+#include "spool.h"
+#include "mem.h"
+
+#include "log.h"
+#include "le_error.h"
+#include "leda.h"
+#include "leda_internal.h"
+
+#ifdef __cplusplus /* If this is a C++ compiler, use C linkage */
+extern "C"
+{
+#endif
+
+#define LOG_TAG                 "LINKEDGE_DEVICE_SPOOL"
+
+#define SPOOL_MIN_CAPACITY      (4 * 1024)
+#define SPOOL_RETRY_US          (10 * 1000)
+
+static leda_spool_config_t  g_spool_cfg     = {0};
+static char                 *g_spool_path   = NULL;
+static spool_t              *g_spool        = NULL;
+static pthread_mutex_t      g_spool_lock    = PTHREAD_MUTEX_INITIALIZER;
+
+/* 断线后置1, 重放清空缓存后清0, 期间的上报都进入缓存以保证顺序 */
+static int                  g_spool_holding = 0;
+static volatile unsigned int g_spool_gen    = 0;
+
+static unsigned long long   g_spool_replayed        = 0;
+static unsigned int         g_spool_last_count      = 0;
+static unsigned int         g_spool_last_ms         = 0;
+static unsigned int         g_spool_last_rate       = 0;
+
+static uint64_t _spool_now_us(void)
+{
+    struct timespec ts = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int leda_set_offline_spool(const leda_spool_config_t *config)
+{
+    char *path = NULL;
+
+    if (NULL == config)
+    {
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    if (config->enable && ((config->capacity < SPOOL_MIN_CAPACITY) || (config->max_age < 0) || (config->replay_rate < 0)))
+    {
+        log_w(LOG_TAG, "spool capacity: %u should not be less than %d, max age: %d and replay rate: %d should not be negative\n",
+              config->capacity, SPOOL_MIN_CAPACITY, config->max_age, config->replay_rate);
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    if (NULL != config->file_path)
+    {
+        path = mem_strdup(MEM_CORE, config->file_path);
+        if (NULL == path)
+        {
+            log_w(LOG_TAG, "no memory can allocate\n");
+            return LE_ERROR_ALLOCATING_MEM;
+        }
+    }
+
+    pthread_mutex_lock(&g_spool_lock);
+    if (NULL != g_spool_path)
+    {
+        mem_free(g_spool_path);
+    }
+    g_spool_path = path;
+    g_spool_cfg = *config;
+    g_spool_cfg.file_path = g_spool_path;
+    pthread_mutex_unlock(&g_spool_lock);
+
+    return LE_SUCCESS;
+}
+
+int leda_spool_init(void)
+{
+    int ret = LE_SUCCESS;
+
+    pthread_mutex_lock(&g_spool_lock);
+    if (g_spool_cfg.enable && (NULL == g_spool))
+    {
+        g_spool = spool_create(g_spool_cfg.file_path, g_spool_cfg.capacity, g_spool_cfg.max_age);
+        if (NULL == g_spool)
+        {
+            log_w(LOG_TAG, "create spool %s failed\n", g_spool_cfg.file_path ? g_spool_cfg.file_path : "in memory");
+            ret = LE_ERROR_ALLOCATING_MEM;
+        }
+        else
+        {
+            /* 文件中遗留的消息在首次连接后重放 */
+            g_spool_holding = 1;
+        }
+    }
+    pthread_mutex_unlock(&g_spool_lock);
+
+    return ret;
+}
+
+void leda_spool_exit(void)
+{
+    pthread_mutex_lock(&g_spool_lock);
+    ++g_spool_gen;
+    if (NULL != g_spool)
+    {
+        spool_destroy(g_spool);
+        g_spool = NULL;
+    }
+    g_spool_holding = 0;
+    pthread_mutex_unlock(&g_spool_lock);
+}
+
+int leda_spool_offer(const char *msg, size_t len)
+{
+    int ret = LEDA_ERROR_CONNECTION;
+
+    pthread_mutex_lock(&g_spool_lock);
+    if (NULL == g_spool)
+    {
+        pthread_mutex_unlock(&g_spool_lock);
+        return leda_is_connected() ? LEDA_SPOOL_BYPASS : LEDA_ERROR_CONNECTION;
+    }
+
+    if (leda_is_connected() && !g_spool_holding)
+    {
+        pthread_mutex_unlock(&g_spool_lock);
+        return LEDA_SPOOL_BYPASS;
+    }
+
+    ret = spool_push(g_spool, msg, len);
+    pthread_mutex_unlock(&g_spool_lock);
+
+    return ret;
+}
+
+static int _spool_replay_msg(const char *data, size_t len, void *usr)
+{
+    return leda_send_json(data, len);
+}
+
+static void _spool_replay_proc(void *arg)
+{
+    unsigned int    gen     = (unsigned int)(uintptr_t)arg;
+    unsigned int    count   = 0;
+    int             rate    = g_spool_cfg.replay_rate;
+    int             ret     = LE_SUCCESS;
+    uint64_t        begin   = _spool_now_us();
+    uint64_t        next    = 0;
+    uint64_t        now     = 0;
+    uint64_t        cost    = 0;
+
+    while ((gen == g_spool_gen) && leda_is_connected())
+    {
+        if (rate > 0)
+        {
+            next = begin + (uint64_t)count * 1000000 / rate;
+            now = _spool_now_us();
+            if (next > now)
+            {
+                usleep((useconds_t)(next - now));
+            }
+        }
+
+        pthread_mutex_lock(&g_spool_lock);
+        if ((gen != g_spool_gen) || (NULL == g_spool))
+        {
+            pthread_mutex_unlock(&g_spool_lock);
+            break;
+        }
+
+        ret = spool_pop(g_spool, _spool_replay_msg, NULL);
+        if (SPOOL_EMPTY == ret)
+        {
+            g_spool_holding = 0;
+            pthread_mutex_unlock(&g_spool_lock);
+            break;
+        }
+        pthread_mutex_unlock(&g_spool_lock);
+
+        if (LE_SUCCESS != ret)
+        {
+            /* 发送队列已满, 稍后重试 */
+            usleep(SPOOL_RETRY_US);
+            continue;
+        }
+        ++count;
+    }
+
+    cost = _spool_now_us() - begin;
+
+    pthread_mutex_lock(&g_spool_lock);
+    g_spool_replayed += count;
+    if (count > 0)
+    {
+        g_spool_last_count = count;
+        g_spool_last_ms = (unsigned int)(cost / 1000);
+        g_spool_last_rate = (cost > 0) ? (unsigned int)((uint64_t)count * 1000000 / cost) : count;
+    }
+    pthread_mutex_unlock(&g_spool_lock);
+
+    if (count > 0)
+    {
+        log_i(LOG_TAG, "replay %u spooled msgs in %u ms\n", count, (unsigned int)(cost / 1000));
+    }
+}
+
+void leda_spool_replay_start(void)
+{
+    unsigned int gen = 0;
+
+    pthread_mutex_lock(&g_spool_lock);
+    if (NULL == g_spool)
+    {
+        pthread_mutex_unlock(&g_spool_lock);
+        return;
+    }
+    gen = ++g_spool_gen;
+    pthread_mutex_unlock(&g_spool_lock);
+
+    /* 任务线程串行执行, 重放在设备上线恢复之后进行 */
+    if (LE_SUCCESS != leda_add_task(_spool_replay_proc, (void *)(uintptr_t)gen))
+    {
+        log_w(LOG_TAG, "start spool replay task failed\n");
+    }
+}
+
+int leda_spool_is_holding(void)
+{
+    return g_spool_holding;
+}
+
+void leda_spool_replay_stop(void)
+{
+    pthread_mutex_lock(&g_spool_lock);
+    ++g_spool_gen;
+    if (NULL != g_spool)
+    {
+        g_spool_holding = 1;
+    }
+    pthread_mutex_unlock(&g_spool_lock);
+}
+
+int leda_get_spool_stats(leda_spool_stats_t *stats)
+{
+    spool_stats st = {0};
+
+    if (NULL == stats)
+    {
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    memset(stats, 0, sizeof(leda_spool_stats_t));
+
+    pthread_mutex_lock(&g_spool_lock);
+    if (NULL != g_spool)
+    {
+        spool_get_stats(g_spool, &st);
+    }
+
+    stats->depth                = st.count;
+    stats->bytes                = st.used;
+    stats->capacity             = st.capacity;
+    stats->spooled              = st.pushed;
+    stats->dropped_full         = st.dropped_full;
+    stats->dropped_aged         = st.dropped_aged;
+    stats->replayed             = g_spool_replayed;
+    stats->last_replay_count    = g_spool_last_count;
+    stats->last_replay_ms       = g_spool_last_ms;
+    stats->last_replay_rate     = g_spool_last_rate;
+    stats->holding              = g_spool_holding;
+    pthread_mutex_unlock(&g_spool_lock);
+
+    return LE_SUCCESS;
+}
+
+#ifdef __cplusplus  /* If this is a C++ compiler, use C linkage */
+}
+#endif
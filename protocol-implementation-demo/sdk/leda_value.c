@@ -0,0 +1,382 @@
+/*
+ * Copyright (c) 2014-2019 Alibaba Group. All rights reserved.
+ * License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "base-utils.h"
+#include "mem.h"
+
+#include "log.h"
+#include "le_error.h"
+#include "leda.h"
+#include "leda_device.h"
+#include "leda_value.h"
+
+#ifdef __cplusplus /* If this is a C++ compiler, use C linkage */
+extern "C"
+{
+#endif
+
+#define LOG_TAG                 "LINKEDGE_DEVICE_VALUE"
+
+#define VALUE_MIN_BUCKETS       64
+#define VALUE_DEV_BUCKETS       1024
+
+/* 表中有属性的设备 */
+typedef struct leda_value_device
+{
+    struct list_head    hash_node;
+    struct list_head    entries;
+    unsigned int        hash;
+    char                *pk;
+    char                *dn;            /* 与pk在同一块内存中, pk\0dn\0 */
+} leda_value_device_t;
+
+static unsigned int _value_entry_hash(const leda_value_device_t *dev, const char *key)
+{
+    return (dev->hash * 16777619u) ^ leda_device_hash(key, "");
+}
+
+static leda_value_device_t *_value_dev_find(leda_value_table_t *table, const char *pk, const char *dn, unsigned int hash)
+{
+    leda_value_device_t *pos = NULL;
+
+    list_for_each_entry(pos, &table->dev_buckets[hash % VALUE_DEV_BUCKETS], hash_node)
+    {
+        if ((pos->hash == hash) && (0 == strcmp(pos->pk, pk)) && (0 == strcmp(pos->dn, dn)))
+        {
+            return pos;
+        }
+    }
+
+    return NULL;
+}
+
+static leda_value_device_t *_value_dev_add(leda_value_table_t *table, const char *pk, const char *dn, unsigned int hash)
+{
+    leda_value_device_t *dev    = NULL;
+    size_t              pk_len  = strlen(pk);
+    size_t              dn_len  = strlen(dn);
+
+    dev = mem_malloc(MEM_CORE, sizeof(leda_value_device_t) + pk_len + dn_len + 2);
+    if (NULL == dev)
+    {
+        return NULL;
+    }
+
+    dev->pk = (char *)(dev + 1);
+    dev->dn = dev->pk + pk_len + 1;
+    memcpy(dev->pk, pk, pk_len + 1);
+    memcpy(dev->dn, dn, dn_len + 1);
+    dev->hash = hash;
+    INIT_LIST_HEAD(&dev->entries);
+    list_add_tail(&dev->hash_node, &table->dev_buckets[hash % VALUE_DEV_BUCKETS]);
+
+    return dev;
+}
+
+static leda_value_entry_t *_value_find(leda_value_table_t *table, leda_value_device_t *dev, const char *key, unsigned int hash)
+{
+    leda_value_entry_t *pos = NULL;
+
+    list_for_each_entry(pos, &table->buckets[hash & table->mask], hash_node)
+    {
+        if ((pos->hash == hash) && (pos->dev == dev) && (0 == strcmp(pos->key, key)))
+        {
+            return pos;
+        }
+    }
+
+    return NULL;
+}
+
+/* 设备的最后一个属性被删除时一并删除设备 */
+static void _value_remove(leda_value_table_t *table, leda_value_entry_t *entry)
+{
+    leda_value_device_t *dev = entry->dev;
+
+    list_del(&entry->hash_node);
+    list_del(&entry->lru_node);
+    list_del(&entry->dev_node);
+    --table->count;
+
+    mem_free(entry->value);
+    mem_free(entry);
+
+    if (list_empty(&dev->entries))
+    {
+        list_del(&dev->hash_node);
+        mem_free(dev);
+    }
+}
+
+static leda_value_entry_t *_value_add(leda_value_table_t *table, leda_value_device_t *dev, const char *key, unsigned int hash)
+{
+    leda_value_entry_t  *entry  = NULL;
+    size_t              key_len = strlen(key);
+
+    entry = mem_malloc(MEM_CORE, sizeof(leda_value_entry_t) + key_len + 1);
+    if (NULL == entry)
+    {
+        return NULL;
+    }
+
+    memset(entry, 0, sizeof(leda_value_entry_t));
+    entry->key = (char *)(entry + 1);
+    memcpy(entry->key, key, key_len + 1);
+    entry->dev  = dev;
+    entry->hash = hash;
+
+    list_add_tail(&entry->hash_node, &table->buckets[hash & table->mask]);
+    list_add_tail(&entry->lru_node, &table->lru);
+    list_add_tail(&entry->dev_node, &dev->entries);
+    ++table->count;
+
+    return entry;
+}
+
+int leda_value_table_init(leda_value_table_t *table, unsigned int max_entries)
+{
+    unsigned int    buckets = VALUE_MIN_BUCKETS;
+    unsigned int    i       = 0;
+
+    while (buckets < max_entries)
+    {
+        buckets <<= 1;
+    }
+
+    memset(table, 0, sizeof(leda_value_table_t));
+    table->buckets = mem_malloc(MEM_CORE, sizeof(struct list_head) * (buckets + VALUE_DEV_BUCKETS));
+    if (NULL == table->buckets)
+    {
+        log_w(LOG_TAG, "no memory can allocate\n");
+        return LE_ERROR_ALLOCATING_MEM;
+    }
+
+    for (i = 0; i < buckets + VALUE_DEV_BUCKETS; i++)
+    {
+        INIT_LIST_HEAD(&table->buckets[i]);
+    }
+    table->dev_buckets  = table->buckets + buckets;
+    table->mask         = buckets - 1;
+    table->max_entries  = max_entries;
+    INIT_LIST_HEAD(&table->lru);
+
+    return LE_SUCCESS;
+}
+
+void leda_value_table_exit(leda_value_table_t *table)
+{
+    leda_value_entry_t *pos = NULL;
+    leda_value_entry_t *tmp = NULL;
+
+    if (NULL == table->buckets)
+    {
+        return;
+    }
+
+    list_for_each_entry_safe(pos, tmp, &table->lru, lru_node)
+    {
+        _value_remove(table, pos);
+    }
+    mem_free(table->buckets);
+    table->buckets      = NULL;
+    table->dev_buckets  = NULL;
+}
+
+leda_value_entry_t *leda_value_find(leda_value_table_t *table, const char *pk, const char *dn, const char *key)
+{
+    leda_value_device_t *dev = NULL;
+
+    if ((NULL == table->buckets) || (NULL == pk) || (NULL == dn) || ('\0' == key[0]))
+    {
+        return NULL;
+    }
+
+    dev = _value_dev_find(table, pk, dn, leda_device_hash(pk, dn));
+    if (NULL == dev)
+    {
+        return NULL;
+    }
+
+    return _value_find(table, dev, key, _value_entry_hash(dev, key));
+}
+
+int leda_value_store(leda_value_table_t *table, const char *pk, const char *dn, const leda_device_data_t *data, uint64_t now)
+{
+    leda_value_device_t *dev    = NULL;
+    leda_value_entry_t  *entry  = NULL;
+    char                *value  = NULL;
+    unsigned int        hash    = 0;
+    size_t              len     = 0;
+
+    if ((NULL == table->buckets) || (NULL == pk) || (NULL == dn) || ('\0' == data->key[0]))
+    {
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    hash = leda_device_hash(pk, dn);
+    dev = _value_dev_find(table, pk, dn, hash);
+    entry = (NULL != dev) ? _value_find(table, dev, data->key, _value_entry_hash(dev, data->key)) : NULL;
+    if (NULL == entry)
+    {
+        /* 达到上限时淘汰最久未写入的属性, 被淘汰的是当前设备的唯一属性时dev随之释放 */
+        if ((table->count >= table->max_entries) && !list_empty(&table->lru))
+        {
+            entry = list_first_entry(&table->lru, leda_value_entry_t, lru_node);
+            if ((entry->dev == dev) && list_is_singular(&dev->entries))
+            {
+                dev = NULL;
+            }
+            _value_remove(table, entry);
+        }
+
+        if ((NULL == dev) && (NULL == (dev = _value_dev_add(table, pk, dn, hash))))
+        {
+            return LE_ERROR_ALLOCATING_MEM;
+        }
+
+        entry = _value_add(table, dev, data->key, _value_entry_hash(dev, data->key));
+        if (NULL == entry)
+        {
+            if (list_empty(&dev->entries))
+            {
+                list_del(&dev->hash_node);
+                mem_free(dev);
+            }
+            return LE_ERROR_ALLOCATING_MEM;
+        }
+    }
+
+    len = strnlen(data->value, MAX_PARAM_VALUE_LENGTH - 1);
+    if (len + 1 > entry->value_size)
+    {
+        value = mem_realloc(MEM_CORE, entry->value, len + 1);
+        if (NULL == value)
+        {
+            _value_remove(table, entry);
+            return LE_ERROR_ALLOCATING_MEM;
+        }
+        entry->value        = value;
+        entry->value_size   = len + 1;
+    }
+
+    memcpy(entry->value, data->value, len);
+    entry->value[len]   = '\0';
+    entry->type         = data->type;
+    entry->updated_us   = now;
+    list_move_tail(&entry->lru_node, &table->lru);
+
+    return LE_SUCCESS;
+}
+
+void leda_value_remove_device(leda_value_table_t *table, const char *pk, const char *dn)
+{
+    leda_value_device_t *dev    = NULL;
+    leda_value_entry_t  *entry  = NULL;
+    int                 last    = 0;
+
+    if ((NULL == table->buckets) || (NULL == pk) || (NULL == dn))
+    {
+        return;
+    }
+
+    dev = _value_dev_find(table, pk, dn, leda_device_hash(pk, dn));
+    if (NULL == dev)
+    {
+        return;
+    }
+
+    /* 只遍历该设备的属性, 删除最后一个属性时dev随之释放, 之后不再访问 */
+    do
+    {
+        entry   = list_first_entry(&dev->entries, leda_value_entry_t, dev_node);
+        last    = list_is_singular(&dev->entries);
+        _value_remove(table, entry);
+    } while (!last);
+}
+
+leda_value_rule_t *leda_value_rule_find(leda_value_rules_t *rules, const char *pk, const char *key)
+{
+    leda_value_rule_t   *pos    = NULL;
+    unsigned int        hash    = 0;
+
+    if (!rules->init)
+    {
+        return NULL;
+    }
+
+    hash = leda_device_hash(pk, key);
+    list_for_each_entry(pos, &rules->buckets[hash % LEDA_VALUE_RULE_BUCKETS], hash_node)
+    {
+        if ((pos->hash == hash) && (0 == strcmp(pos->key, key)) && (0 == strcmp(pos->pk, pk)))
+        {
+            return pos;
+        }
+    }
+
+    return NULL;
+}
+
+int leda_value_rule_set(leda_value_rules_t *rules, const char *pk, const char *key, int type, double param)
+{
+    leda_value_rule_t   *rule   = NULL;
+    size_t              pk_len  = 0;
+    size_t              key_len = 0;
+    int                 i       = 0;
+
+    if (!rules->init)
+    {
+        for (i = 0; i < LEDA_VALUE_RULE_BUCKETS; i++)
+        {
+            INIT_LIST_HEAD(&rules->buckets[i]);
+        }
+        rules->init = 1;
+    }
+
+    rule = leda_value_rule_find(rules, pk, key);
+    if (NULL == rule)
+    {
+        pk_len  = strlen(pk);
+        key_len = strlen(key);
+        rule = mem_malloc(MEM_CORE, sizeof(leda_value_rule_t) + pk_len + key_len + 2);
+        if (NULL == rule)
+        {
+            log_w(LOG_TAG, "no memory can allocate\n");
+            return LE_ERROR_ALLOCATING_MEM;
+        }
+
+        rule->pk    = (char *)(rule + 1);
+        rule->key   = rule->pk + pk_len + 1;
+        memcpy(rule->pk, pk, pk_len + 1);
+        memcpy(rule->key, key, key_len + 1);
+        rule->hash  = leda_device_hash(pk, key);
+        list_add_tail(&rule->hash_node, &rules->buckets[rule->hash % LEDA_VALUE_RULE_BUCKETS]);
+    }
+    rule->type  = type;
+    rule->param = param;
+
+    return LE_SUCCESS;
+}
+
+#ifdef __cplusplus  /* If this is a C++ compiler, use C linkage */
+}
+#endif
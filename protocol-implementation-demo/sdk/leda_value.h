@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2014-2019 Alibaba Group. All rights reserved.
+ * License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __LINKEDGE_DEVICE_VALUE__
+#define __LINKEDGE_DEVICE_VALUE__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "base-utils.h"
+
+#ifdef __cplusplus /* If this is a C++ compiler, use C linkage */
+extern "C"
+{
+#endif
+
+#define LEDA_VALUE_RULE_BUCKETS     256
+
+/*
+ * 按设备和属性名索引的属性最新值表, 属性缓存和上报过滤共用, SDK内部使用.
+ *
+ * 设备的ProductKey和DeviceName只保存一份, 属性挂在所属设备下, 丢弃设备的属性不需要遍历整个表.
+ * 表本身不加锁, 调用方持有各自的锁.
+ */
+
+struct leda_value_device;
+
+/* 一个设备的一个属性的最新值 */
+typedef struct leda_value_entry
+{
+    struct list_head            hash_node;
+    struct list_head            lru_node;       /* 按写入时间排列, 表头最旧 */
+    struct list_head            dev_node;       /* 同一设备的属性 */
+    struct leda_value_device    *dev;
+    unsigned int                hash;
+    int                         type;
+    uint64_t                    updated_us;     /* 最近一次写入的时间 */
+    char                        *value;
+    size_t                      value_size;     /* value缓冲区的长度 */
+    char                        *key;           /* 紧随结构体 */
+} leda_value_entry_t;
+
+typedef struct leda_value_table
+{
+    struct list_head            *buckets;       /* 属性, 按设备和属性名散列 */
+    struct list_head            *dev_buckets;   /* 设备, 按leda_device_hash散列 */
+    unsigned int                mask;
+    unsigned int                count;
+    unsigned int                max_entries;
+    struct list_head            lru;
+} leda_value_table_t;
+
+/* 产品物模型中一个属性的配置, 如缓存有效期和上报死区 */
+typedef struct leda_value_rule
+{
+    struct list_head            hash_node;
+    unsigned int                hash;
+    int                         type;
+    double                      param;
+    char                        *pk;            /* pk\0key\0, 紧随结构体 */
+    char                        *key;
+} leda_value_rule_t;
+
+/* 规则在leda_init前后都可以设置, leda_exit后保留 */
+typedef struct leda_value_rules
+{
+    struct list_head            buckets[LEDA_VALUE_RULE_BUCKETS];
+    int                         init;
+} leda_value_rules_t;
+
+int leda_value_table_init(leda_value_table_t *table, unsigned int max_entries);
+
+void leda_value_table_exit(leda_value_table_t *table);
+
+leda_value_entry_t *leda_value_find(leda_value_table_t *table, const char *pk, const char *dn, const char *key);
+
+/* 写入属性的类型, 值和写入时间并移到LRU表尾, 达到上限时淘汰最久未写入的属性 */
+int leda_value_store(leda_value_table_t *table, const char *pk, const char *dn, const struct leda_device_data *data, uint64_t now);
+
+void leda_value_remove_device(leda_value_table_t *table, const char *pk, const char *dn);
+
+leda_value_rule_t *leda_value_rule_find(leda_value_rules_t *rules, const char *pk, const char *key);
+
+int leda_value_rule_set(leda_value_rules_t *rules, const char *pk, const char *key, int type, double param);
+
+#ifdef __cplusplus  /* If this is a C++ compiler, use C linkage */
+}
+#endif
+#endif
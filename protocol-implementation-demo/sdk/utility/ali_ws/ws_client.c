@@ -7,6 +7,7 @@
 #include "libwebsockets.h"
 #include "ws_client.h"
 #include "wsc_buffer_mgmt.h"
+#include "mem.h"
 #include "le_error.h"
 
 extern void *thread_wsc_network(void *arg);
@@ -28,7 +29,7 @@ int wsc_init(p_wsc_param_conn pc, p_wsc_param_cb cb)
         printf("ca path must not be NULL when use ssl\n");
     }
 
-    g_cbs = malloc(sizeof(wsc_param_cb));
+    g_cbs = mem_malloc(MEM_WS, sizeof(wsc_param_cb));
     if (!g_cbs) {
         printf("malloc error.\n");
         return LE_ERROR_ALLOCATING_MEM;
@@ -39,9 +40,13 @@ int wsc_init(p_wsc_param_conn pc, p_wsc_param_cb cb)
     
     force_exit = 0;
 
-    ret = client_buf_mgmt_init(1024 * 2, 1024);
+    if (pc->queue_path) {
+        ret = client_buf_mgmt_init_file(pc->queue_path, pc->queue_msg_len, 1024);
+    } else {
+        ret = client_buf_mgmt_init(1024 * 2, 1024);
+    }
     if (ret != LE_SUCCESS) {
-        free(g_cbs);
+        mem_free(g_cbs);
         g_cbs = NULL;
         return ret;
     }
@@ -51,7 +56,7 @@ int wsc_init(p_wsc_param_conn pc, p_wsc_param_cb cb)
     if (ret == 0) {
         printf("wsc init ok\n");
     } else {
-        free(g_cbs);
+        mem_free(g_cbs);
         g_cbs = NULL;
 #ifndef _WIN32
         printf("wsc init faild, %s.\n", strerror(errno));
@@ -78,6 +83,26 @@ int wsc_add_msg(const char *msg, size_t len, int type)
     return client_buf_mgmt_push(msg, len, type);
 }
 
+int wsc_add_tracked_msg(const char *msg, size_t len, int type,
+                        const unsigned int *msg_ids, int id_cnt)
+{
+    if (!msg || len <= 0 || type > 1 || type < 0 || id_cnt < 0 || (id_cnt && !msg_ids)) {
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    return client_buf_mgmt_push_tracked(msg, len, type, msg_ids, id_cnt);
+}
+
+void wsc_ack_msg(unsigned int msg_id)
+{
+    client_buf_mgmt_ack(msg_id);
+}
+
+int wsc_queue_depth(void)
+{
+    return client_buf_mgmt_depth();
+}
+
 int ws_client_destroy()
 {
     force_exit = 1;
@@ -87,7 +112,7 @@ int ws_client_destroy()
     Sleep(1000);
 #endif
     if (g_cbs) {
-        free(g_cbs);
+        mem_free(g_cbs);
         g_cbs = NULL;
     }
 
@@ -1,6 +1,36 @@
 #ifndef __WS_CLIENT_H__
 #define __WS_CLIENT_H__
 
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct{
+    int                 enable;             //0 offers no compression at all.
+    int                 context_takeover;   //keep the deflate context between messages.
+    int                 window_bits;        //9 - 15, 0 for 15.
+    int                 level;              //0 or 1 - 9, 0 leaves compression_level unset so lws uses its default.
+    unsigned int        min_size;           //messages shorter than this are sent uncompressed.
+}wsc_deflate_config;
+
+typedef struct{
+    int                 active;             //server accepted permessage-deflate.
+    uint64_t            raw_out;            //bytes handed to deflate.
+    uint64_t            compressed_out;     //bytes deflate produced.
+    uint64_t            skipped_out;        //messages sent uncompressed for being below min_size.
+    uint64_t            compressed_in;      //bytes handed to inflate.
+    uint64_t            raw_in;             //bytes inflate produced.
+    uint64_t            deflate_us;         //time spent compressing.
+    uint64_t            inflate_us;         //time spent decompressing.
+}wsc_deflate_stats;
+
+typedef struct{
+    const char          *cipher_list;       //TLS 1.2 and below, OpenSSL format. NULL keeps the library default.
+    const char          *ciphersuites;      //TLS 1.3 suites, NULL keeps the library default.
+    const char          *curves;            //key exchange groups in preference order, e.g. "X25519:P-256".
+    int                 session_resumption; //offer the last session on reconnect.
+    const char          *session_file;      //keeps the last session across restarts, NULL keeps it in memory.
+}wsc_tls_config;
+
 typedef struct{
     const char                *url;           //wss://127.0.0.1:5432/
     int                 timeout;        //timeout seconds to close current connection.
@@ -8,11 +38,17 @@ typedef struct{
     const char                *cert_path;     //path of the cert. 
     const char                *key_path;       //path of the private key.
     const char                *protocol;      //"sec-websocket-protocol" filed in websocket handshark protocol, NULL will  be the default "alibaba-iot-linkedge-protocol"
+    const char                *alt_protocol;  //offered before @protocol, the server picks one of them. NULL offers @protocol only.
+    const char                *queue_path;    //file to keep the send queue across restarts, NULL keeps it in memory.
+    int                 queue_msg_len;  //max length of a msg in the queue file.
+    const wsc_deflate_config  *deflate;   //NULL keeps the default offer of permessage-deflate and deflate-frame.
+    const wsc_tls_config      *tls;       //NULL keeps the library ciphers and resumes sessions in memory.
 }wsc_param_conn, *p_wsc_param_conn;
 
 typedef struct {
     char *appendBuffer;
     size_t totalLen;
+    uint64_t beginUs;   //arrival time of the first fragment, only kept when tracing.
 }wsc_recv_tmpInfo;
 
 
@@ -59,6 +95,48 @@ int wsc_init(p_wsc_param_conn pc, p_wsc_param_cb cb);
  * */
 int wsc_add_msg(const char *msg, size_t len, int type);
 
+/*add a message that answers are expected for.
+ *
+ *  msg_ids:    ids of the requests carried by the message.
+ *  id_cnt:     number of ids.
+ *
+ *  with a send queue file the message is kept in the file after it has
+ *  been written until wsc_ack_msg is called for every id, so it is sent
+ *  again after a process restart. same as wsc_add_msg otherwise.
+ *
+ *  return value: 0 on success , error code on failed.
+ * */
+int wsc_add_tracked_msg(const char *msg, size_t len, int type,
+                        const unsigned int *msg_ids, int id_cnt);
+
+/*the answer to @msg_id arrived or the request was given up.
+ * */
+void wsc_ack_msg(unsigned int msg_id);
+
+/*arrival time of the first fragment of the message being delivered to
+ * p_cb_recv, 0 when tracing is off. only valid inside p_cb_recv.
+ * */
+uint64_t wsc_recv_begin_us(void);
+
+/*subprotocol the server picked for the current connection, NULL when
+ * not connected.
+ * */
+const char *wsc_get_protocol(void);
+
+/*1 when the message being delivered to p_cb_recv came in binary frames.
+ * only valid inside p_cb_recv.
+ * */
+int wsc_recv_is_binary(void);
+
+/*compression counters of the current connection, reset when a new
+ * connection negotiates permessage-deflate.
+ * */
+void wsc_get_deflate_stats(wsc_deflate_stats *stats);
+
+/*number of messages waiting to be sent.
+ * */
+int wsc_queue_depth(void);
+
 /*module destroy. 
  *
  *  return value: 0 on success , error code on failed.
@@ -1,9 +1,34 @@
 #include "libwebsockets.h"
 #include "ws_client.h"
 #include "wsc_buffer_mgmt.h"
+#include "trace.h"
+#include "metrics.h"
+#include "mem.h"
 
 extern p_wsc_param_cb g_cbs;
 extern struct lws *g_wsi;
+extern void wsc_deflate_established(struct lws *wsi);
+extern void wsc_tls_setup_ctx(void *ssl_ctx);
+extern uint64_t g_connect_us;
+
+static uint64_t g_recv_begin_us = 0;
+static int g_recv_binary = 0;
+static const char *volatile g_protocol = NULL;
+
+uint64_t wsc_recv_begin_us(void)
+{
+    return g_recv_begin_us;
+}
+
+int wsc_recv_is_binary(void)
+{
+    return g_recv_binary;
+}
+
+const char *wsc_get_protocol(void)
+{
+    return g_protocol;
+}
 
 int cb_pop_msg(char *buf, size_t buf_len, int type, void *usr)
 {
@@ -20,9 +45,9 @@ static int recvframeAppend(struct lws *wsi, void **appendBuffer, void *in, size_
     char *tmp = NULL;
     
     if (*appendBuffer == NULL){
-        tmp = malloc(preLen + len + 1);
+        tmp = mem_malloc(MEM_WS, preLen + len + 1);
     } else {
-        tmp = realloc((void *)*appendBuffer,preLen + len + 1);
+        tmp = mem_realloc(MEM_WS, (void *)*appendBuffer,preLen + len + 1);
     } 
 
     if(!tmp)
@@ -44,7 +69,15 @@ int callback_dumb_increment(struct lws *wsi, enum lws_callback_reasons reason,
     wsc_recv_tmpInfo* tmp = (wsc_recv_tmpInfo*)user;
     
     switch (reason) {
+        case LWS_CALLBACK_OPENSSL_LOAD_EXTRA_CLIENT_VERIFY_CERTS:
+            /* user is the client SSL_CTX, created once per context */
+            wsc_tls_setup_ctx(user);
+            break;
         case LWS_CALLBACK_CLIENT_ESTABLISHED:
+            if (g_connect_us)
+                metrics_observe(METRIC_HIST_CONNECT, metrics_now_us() - g_connect_us);
+            g_protocol = lws_get_protocol(wsi) ? lws_get_protocol(wsi)->name : NULL;
+            wsc_deflate_established(wsi);
             if(g_cbs && g_cbs->p_cb_establish)
                 g_cbs->p_cb_establish(g_cbs->usr_cb_establish);
             break;
@@ -52,16 +85,23 @@ int callback_dumb_increment(struct lws *wsi, enum lws_callback_reasons reason,
             client_buf_mgmt_pop(cb_pop_msg, (void *)wsi);
             break;
         case LWS_CALLBACK_CLIENT_RECEIVE:
+           if (tmp->totalLen == 0)
+            {
+                tmp->beginUs = trace_enabled() ? trace_now_us() : 0;
+            }
            if (lws_is_final_fragment(wsi))
             {
                 tmp->totalLen += recvframeAppend(wsi,(void **)&tmp->appendBuffer,in,tmp->totalLen,len);
                         
                 if(g_cbs && g_cbs->p_cb_recv)
                 {
+                    g_recv_begin_us = tmp->beginUs;
+                    g_recv_binary = lws_frame_is_binary(wsi);
                     g_cbs->p_cb_recv(tmp->appendBuffer, tmp->totalLen, g_cbs->usr_cb_recv);
+                    g_recv_begin_us = 0;
                 }
                 if(tmp->appendBuffer != NULL){
-                    free(tmp->appendBuffer);
+                    mem_free(tmp->appendBuffer);
                     tmp->appendBuffer = NULL;
                 } 
                 tmp->totalLen = 0;
@@ -72,12 +112,14 @@ int callback_dumb_increment(struct lws *wsi, enum lws_callback_reasons reason,
             }
             break;
         case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+            g_protocol = NULL;
             if(g_cbs && g_cbs->p_cb_close)
                 g_cbs->p_cb_close(g_cbs->usr_cb_close);
             g_wsi = NULL;
             break;
         case LWS_CALLBACK_CLOSED:
         case LWS_CALLBACK_CLIENT_CLOSED:
+            g_protocol = NULL;
             if(g_cbs && g_cbs->p_cb_close)
                 g_cbs->p_cb_close(g_cbs->usr_cb_close);
             g_wsi = NULL; 
@@ -1,7 +1,11 @@
 #include <signal.h>
+#include <time.h>
 #include "libwebsockets.h"
 #include "ws_client.h"
 #include "os.h"
+#include "mem.h"
+#include "log.h"
+#include "metrics.h"
 #ifndef _WIN32
 #include <syslog.h>
 #endif
@@ -28,9 +32,19 @@ struct lws *g_wsi = NULL;
 
 extern int callback_dumb_increment(struct lws *wsi, enum lws_callback_reasons reason,
                                    void *user, void *in, size_t len);
+extern void wsc_tls_init(const wsc_tls_config *cfg);
+extern void wsc_tls_cleanup(void);
+
+uint64_t g_connect_us = 0;
 
 static wsc_recv_tmpInfo gwc_recv_tmpInfo;
 
+/* lws frees with a 0 size */
+static void *wsc_lws_realloc(void *ptr, size_t size, const char *reason)
+{
+    return mem_realloc(MEM_WS, ptr, size);
+}
+
 
 static struct lws_protocols protocols[] = {
     {
@@ -41,6 +55,14 @@ static struct lws_protocols protocols[] = {
         0,
         &gwc_recv_tmpInfo,
     },
+    {
+        NULL,                     /* alt_protocol, also ends the list when unset */
+        callback_dumb_increment,
+        128,
+        4096,
+        0,
+        &gwc_recv_tmpInfo,
+    },
     { NULL, NULL, 0, 0 }
 };
 
@@ -53,9 +75,162 @@ static const struct lws_extension exts[] = {
     { NULL, NULL, NULL }
 };
 
+/* libwebsockets levels enabled for each of our log levels */
+static int lws_log_mask(int lvl)
+{
+    switch (lvl) {
+    case LOG_LEVEL_DEBUG:
+        return 0xffff;
+    case LOG_LEVEL_INFO:
+        return LLL_ERR | LLL_WARN | LLL_NOTICE;
+    case LOG_LEVEL_WARN:
+        return LLL_ERR | LLL_WARN;
+    case LOG_LEVEL_ERR:
+        return LLL_ERR;
+    default:
+        return 0;
+    }
+}
+
+#define PMD_NAME    "permessage-deflate"
+
+static const wsc_deflate_config *g_deflate = NULL;
+static wsc_deflate_stats g_deflate_stats;
+static int g_deflate_skip = 0;      /* message being sent bypasses deflate */
+static char g_deflate_offer[128];
+
+static uint64_t deflate_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * wraps the lws permessage-deflate callback to apply min_size and count
+ * bytes and time. lws runs extension callbacks on the service thread only.
+ */
+static int callback_deflate_policy(struct lws_context *context, const struct lws_extension *ext,
+                                   struct lws *wsi, enum lws_extension_callback_reasons reason,
+                                   void *user, void *in, size_t len)
+{
+    struct lws_tokens *ebuf = in;
+    uint64_t begin = 0;
+    int before = 0;
+    int n = 0;
+
+    switch (reason) {
+    case LWS_EXT_CB_CLIENT_CONSTRUCT:
+        memset(&g_deflate_stats, 0, sizeof(g_deflate_stats));
+        g_deflate_stats.active = 1;
+        g_deflate_skip = 0;
+        break;
+    case LWS_EXT_CB_DESTROY:
+        g_deflate_stats.active = 0;
+        break;
+    case LWS_EXT_CB_PAYLOAD_TX:
+        /* a zero length call drains output of a message already compressed */
+        if (ebuf->len > 0) {
+            g_deflate_skip = (unsigned int)ebuf->len < g_deflate->min_size;
+            if (g_deflate_skip) {
+                g_deflate_stats.skipped_out++;
+                return 0;
+            }
+            g_deflate_stats.raw_out += ebuf->len;
+        }
+        begin = deflate_now_us();
+        n = lws_extension_callback_pm_deflate(context, ext, wsi, reason, user, in, len);
+        g_deflate_stats.deflate_us += deflate_now_us() - begin;
+        if (ebuf->len > 0)
+            g_deflate_stats.compressed_out += ebuf->len;
+        return n;
+    case LWS_EXT_CB_PACKET_TX_PRESEND:
+        /* leave RSV1 clear on frames that were not compressed */
+        if (g_deflate_skip)
+            return 0;
+        break;
+    case LWS_EXT_CB_PAYLOAD_RX:
+        before = ebuf->len;
+        begin = deflate_now_us();
+        n = lws_extension_callback_pm_deflate(context, ext, wsi, reason, user, in, len);
+        g_deflate_stats.inflate_us += deflate_now_us() - begin;
+        g_deflate_stats.compressed_in += before;
+        if (ebuf->len > 0)
+            g_deflate_stats.raw_in += ebuf->len;
+        return n;
+    default:
+        break;
+    }
+
+    return lws_extension_callback_pm_deflate(context, ext, wsi, reason, user, in, len);
+}
+
+static const struct lws_extension policy_exts[] = {
+    { PMD_NAME, callback_deflate_policy, g_deflate_offer },
+    { NULL, NULL, NULL }
+};
+
+static const struct lws_extension *deflate_exts(const wsc_deflate_config *cfg)
+{
+    int n = 0;
+
+    g_deflate = cfg;
+    if (!cfg)
+        return exts;
+    if (!cfg->enable)
+        return NULL;
+
+    n = snprintf(g_deflate_offer, sizeof(g_deflate_offer), "%s", PMD_NAME);
+    if (!cfg->context_takeover)
+        n += snprintf(g_deflate_offer + n, sizeof(g_deflate_offer) - n, "; client_no_context_takeover");
+    if (cfg->window_bits >= 9 && cfg->window_bits < 15)
+        n += snprintf(g_deflate_offer + n, sizeof(g_deflate_offer) - n, "; client_max_window_bits=%d", cfg->window_bits);
+    else
+        n += snprintf(g_deflate_offer + n, sizeof(g_deflate_offer) - n, "; client_max_window_bits");
+
+    return policy_exts;
+}
+
+/* local settings, applied before the first message creates the deflate stream */
+void wsc_deflate_established(struct lws *wsi)
+{
+    char val[16];
+
+    if (!g_deflate || !g_deflate->enable || !g_deflate_stats.active)
+        return;
+
+    if (g_deflate->level > 0) {
+        snprintf(val, sizeof(val), "%d", g_deflate->level);
+        lws_set_extension_option(wsi, PMD_NAME, "compression_level", val);
+    }
+    if (g_deflate->window_bits >= 9 && g_deflate->window_bits < 15) {
+        snprintf(val, sizeof(val), "%d", g_deflate->window_bits);
+        lws_set_extension_option(wsi, PMD_NAME, "client_max_window_bits", val);
+    }
+}
+
+void wsc_get_deflate_stats(wsc_deflate_stats *stats)
+{
+    if (stats)
+        memcpy(stats, &g_deflate_stats, sizeof(wsc_deflate_stats));
+}
+
 void alog_print(int lvl, const char *content)
 {
-    printf("<LIBWEBSOCKETS>  %s", content);
+    int level = LOG_LEVEL_DEBUG;
+
+    if (lvl & LLL_ERR)
+        level = LOG_LEVEL_ERR;
+    else if (lvl & LLL_WARN)
+        level = LOG_LEVEL_WARN;
+    else if (lvl & LLL_NOTICE)
+        level = LOG_LEVEL_INFO;
+
+    if (level < LEDA_LOG_MIN_LEVEL || level < get_log_level())
+        return;
+
+    log_print(level, NULL, "LIBWEBSOCKETS", NULL, NULL, 0, "%s", content);
 }
 
 void notify_network()
@@ -74,8 +249,9 @@ void *thread_wsc_network(void *arg)
     int use_ssl = 0;
     int opts = 0;
     int n = 0;
-    int debug_level = 0xffff;
+    int debug_level = lws_log_mask(get_log_level() > LEDA_LOG_MIN_LEVEL ? get_log_level() : LEDA_LOG_MIN_LEVEL);
     const char *prot, *p;
+    char *offer = NULL;
     wsc_recv_tmpInfo * pTmp = (wsc_recv_tmpInfo *)(protocols[0].user);
 
     if (!param) {
@@ -86,7 +262,7 @@ void *thread_wsc_network(void *arg)
     lws_set_log_level(debug_level, alog_print);
 
     memset(&i, 0, sizeof(i));
-    char *url = os_strdup(param->url);
+    char *url = mem_strdup(MEM_WS, param->url);
     if (lws_parse_uri(url, &prot, &i.address, &i.port, &p)) {
         lwsl_notice("url is not correct\n"); 
         exit(0);
@@ -106,22 +282,28 @@ void *thread_wsc_network(void *arg)
         if (param->ca_path[0]) {
             info.client_ssl_ca_filepath = param->ca_path;
         }
+        if (param->tls)
+            info.client_ssl_cipher_list = param->tls->cipher_list;
+        wsc_tls_init(param->tls);
     }
     info.gid = gid;
     info.uid = uid;
-    info.extensions = exts;
+    info.extensions = deflate_exts(param->deflate);
     info.timeout_secs = (param->timeout > 1) ? (param->timeout - 1) : 1;
     info.ws_ping_pong_interval = (param->timeout >= 1) ? param->timeout : 1;
 
 #if defined(LWS_OPENSSL_SUPPORT)
     info.options |= LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
 #endif
+    /* the lws allocator is process wide, only take it over when the application asked for its own allocator */
+    if (mem_custom_allocator())
+        lws_set_allocator(wsc_lws_realloc);
     context = lws_create_context(&info);
     if (context == NULL) {
         lwsl_err("libwebsocket init failed\n");
-        free(url);
+        mem_free(url);
         if(pTmp->appendBuffer != NULL){
-                free(pTmp->appendBuffer);
+                mem_free(pTmp->appendBuffer);
                 pTmp->appendBuffer = NULL;
         } 
         exit(0);
@@ -133,12 +315,22 @@ void *thread_wsc_network(void *arg)
     i.origin = i.address;
     i.path = "//";
     i.protocol = !param->protocol ? DEFAULT_LWS_PROTOCOL : param->protocol;
+    if (param->alt_protocol) {
+        /* lws only accepts a picked protocol that is in our table */
+        protocols[1].name = param->alt_protocol;
+        offer = mem_malloc(MEM_WS, strlen(param->alt_protocol) + strlen(i.protocol) + 3);
+        if (offer) {
+            sprintf(offer, "%s, %s", param->alt_protocol, i.protocol);
+            i.protocol = offer;
+        }
+    }
     i.ietf_version_or_minus_one = -1;
     n = 0;
     while (n >= 0 && !force_exit) {
         if (!g_wsi) {
             lwsl_notice("connecting to server....\n");
             i.pwsi = &g_wsi;
+            g_connect_us = metrics_now_us();
             lws_client_connect_via_info(&i);
             lwsl_notice("connecting to server done, %p.\n", g_wsi);
 			os_sleep(1);
@@ -151,14 +343,16 @@ void *thread_wsc_network(void *arg)
     lws_context_destroy(context);
     context = NULL;
     g_wsi = NULL;
+    wsc_tls_cleanup();
     lwsl_notice("libwebsockets-test-client exited cleanly\n");
 
     if(pTmp->appendBuffer != NULL){
-            free(pTmp->appendBuffer);
+            mem_free(pTmp->appendBuffer);
             pTmp->appendBuffer = NULL;
     } 
 
-    free(url);
+    mem_free(url);
+    mem_free(offer);
 #ifndef _WIN32
     closelog();
 #endif
@@ -1,11 +1,472 @@
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "libwebsockets.h"
 #include "wsc_buffer_mgmt.h"
+#include "ws_client.h"
+#include "metrics.h"
+#include "trace.h"
+#include "mem.h"
 #include "le_error.h"
 
+#define FILE_BUF_MAGIC      0x51435357      /* "WSCQ" */
+#define FILE_BUF_VERSION    2
+#define FILE_BUF_HEADER     4096
+#define FILE_BUF_SYNC_CNT   32              /* msync once every this many pushes */
+#define FILE_BUF_ALIGN(x)   (((x) + 7) & ~(size_t)7)
+#define FILE_BUF_ACK_SLOTS  8192            /* msg ids waited for, kept at most 3/4 full */
+
+/*
+ * head and tail only grow, slot of a sequence is seq % slot_cnt. slots from
+ * head up to the in memory send cursor are written but still wait for acks,
+ * after a restart they are sent again.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_size;
+    uint32_t slot_cnt;
+    uint64_t head;
+    uint64_t tail;
+} file_buf_header;
+
+typedef struct {
+    uint32_t crc;           /* over seq, type, len, proto and data */
+    uint32_t seq;           /* low 32 bits of the sequence, rejects slots of older laps */
+    uint32_t type;
+    uint32_t len;           /* bytes sent, text msgs include their trailing '\0' */
+    uint32_t proto;         /* crc of the subprotocol a binary msg was encoded for */
+} file_buf_slot;
+
+typedef struct {
+    uint32_t msg_id;
+    uint32_t used;
+    uint64_t seq;           /* the latest slot carrying msg_id */
+} file_buf_ack;
+
+typedef struct {
+    int              fd;
+    size_t           map_len;
+    size_t           max_len;   /* payload room of a slot */
+    file_buf_header *hdr;
+    char            *slots;
+    char            *stage;     /* LWS_PRE + payload, lws_write never touches the map */
+    uint64_t        *enq_us;    /* push time of each slot, 0 for msgs of a previous run */
+    uint32_t        *trace_id;
+    unsigned int     unsynced;
+    uint64_t         send;      /* next slot to write */
+    uint16_t        *pending;   /* acks each slot still waits for, 0 for msgs of a previous run */
+    file_buf_ack    *acks;      /* open addressing, linear probing */
+    unsigned int     ack_cnt;
+} file_buf;
+
 static msg_buf_status g_ws_buf_state;
 static msg_buf_item   *g_ws_buf = NULL;
+static file_buf       *g_ws_file = NULL;
+
+static uint32_t g_crc_table[256];
+
+extern void notify_network();
+
+static void crc32_init(void)
+{
+    uint32_t c = 0;
+    int i = 0, j = 0;
+
+    for (i = 0; i < 256; i++) {
+        c = (uint32_t)i;
+        for (j = 0; j < 8; j++)
+            c = (c & 1) ? (0xedb88320u ^ (c >> 1)) : (c >> 1);
+        g_crc_table[i] = c;
+    }
+}
+
+static uint32_t crc32_update(uint32_t crc, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+
+    crc = ~crc;
+    while (len--)
+        crc = g_crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+static uint32_t file_slot_crc(const file_buf_slot *slot)
+{
+    uint32_t crc = crc32_update(0, &slot->seq, sizeof(uint32_t) * 4);
+
+    return crc32_update(crc, slot + 1, slot->len);
+}
+
+/* binary msgs are only understood by a server speaking the subprotocol they were encoded for */
+static uint32_t file_proto_tag(void)
+{
+    const char *protocol = wsc_get_protocol();
+
+    return protocol ? crc32_update(0, protocol, strlen(protocol)) : 0;
+}
+
+static file_buf_slot *file_slot(uint64_t seq)
+{
+    return (file_buf_slot *)(g_ws_file->slots +
+            (size_t)(seq % g_ws_file->hdr->slot_cnt) * g_ws_file->hdr->slot_size);
+}
+
+static file_buf_ack *file_ack_find(uint32_t msg_id)
+{
+    uint32_t i = (msg_id * 2654435761u) & (FILE_BUF_ACK_SLOTS - 1);
+
+    while (g_ws_file->acks[i].used) {
+        if (g_ws_file->acks[i].msg_id == msg_id)
+            return &g_ws_file->acks[i];
+        i = (i + 1) & (FILE_BUF_ACK_SLOTS - 1);
+    }
+
+    return NULL;
+}
+
+/* backward shift keeps every probe chain free of holes */
+static void file_ack_del(file_buf_ack *ack)
+{
+    uint32_t i = (uint32_t)(ack - g_ws_file->acks);
+    uint32_t j = i, home = 0;
+
+    for (;;) {
+        j = (j + 1) & (FILE_BUF_ACK_SLOTS - 1);
+        if (!g_ws_file->acks[j].used)
+            break;
+        home = (g_ws_file->acks[j].msg_id * 2654435761u) & (FILE_BUF_ACK_SLOTS - 1);
+        if (((j - home) & (FILE_BUF_ACK_SLOTS - 1)) >= ((j - i) & (FILE_BUF_ACK_SLOTS - 1))) {
+            g_ws_file->acks[i] = g_ws_file->acks[j];
+            i = j;
+        }
+    }
+    g_ws_file->acks[i].used = 0;
+    g_ws_file->ack_cnt--;
+}
+
+/* the slot of @seq no longer waits for one of its acks */
+static void file_slot_acked(uint64_t seq)
+{
+    uint32_t idx = seq % g_ws_file->hdr->slot_cnt;
+
+    if (seq >= g_ws_file->hdr->head && seq < g_ws_file->hdr->tail && g_ws_file->pending[idx])
+        g_ws_file->pending[idx]--;
+}
+
+/* wait for @msg_id on slot @seq, a resent msg supersedes its earlier copy */
+static int file_ack_add(uint32_t msg_id, uint64_t seq)
+{
+    file_buf_ack *ack = file_ack_find(msg_id);
+    uint32_t i = 0;
+
+    if (ack) {
+        file_slot_acked(ack->seq);
+        ack->seq = seq;
+        return 1;
+    }
+    if (g_ws_file->ack_cnt >= FILE_BUF_ACK_SLOTS / 4 * 3)
+        return 0;
+
+    i = (msg_id * 2654435761u) & (FILE_BUF_ACK_SLOTS - 1);
+    while (g_ws_file->acks[i].used)
+        i = (i + 1) & (FILE_BUF_ACK_SLOTS - 1);
+    g_ws_file->acks[i].msg_id = msg_id;
+    g_ws_file->acks[i].seq = seq;
+    g_ws_file->acks[i].used = 1;
+    g_ws_file->ack_cnt++;
+    return 1;
+}
+
+/* forget the acks a slot waits for, it is dropped or given up */
+static void file_slot_forget(uint64_t seq)
+{
+    uint32_t idx = seq % g_ws_file->hdr->slot_cnt;
+    uint32_t i = 0;
+
+    for (i = 0; g_ws_file->pending[idx] && i < FILE_BUF_ACK_SLOTS; ) {
+        if (g_ws_file->acks[i].used && g_ws_file->acks[i].seq == seq) {
+            file_ack_del(&g_ws_file->acks[i]);
+            g_ws_file->pending[idx]--;
+            continue;   /* the shift may have moved another entry here */
+        }
+        i++;
+    }
+    g_ws_file->pending[idx] = 0;
+}
+
+/* release the written slots at the head that wait for no more acks */
+static void file_buf_release(void)
+{
+    file_buf_header *hdr = g_ws_file->hdr;
+
+    while (hdr->head < g_ws_file->send && !g_ws_file->pending[hdr->head % hdr->slot_cnt])
+        hdr->head++;
+}
+
+/* drop whatever a crash left half written at the end of the queue */
+static void file_buf_recover(void)
+{
+    file_buf_header *hdr = g_ws_file->hdr;
+    file_buf_slot   *slot = NULL;
+    uint64_t         seq = 0;
+
+    for (seq = hdr->head; seq != hdr->tail; seq++) {
+        slot = file_slot(seq);
+        if (slot->seq != (uint32_t)seq || slot->len == 0 ||
+            slot->len > g_ws_file->max_len || slot->crc != file_slot_crc(slot))
+            break;
+    }
+
+    if (seq != hdr->tail) {
+        printf("drop %llu broken msgs in send queue file.\n",
+               (unsigned long long)(hdr->tail - seq));
+        hdr->tail = seq;
+    }
+    if (hdr->tail != hdr->head)
+        printf("%llu msgs restored from send queue file.\n",
+               (unsigned long long)(hdr->tail - hdr->head));
+}
+
+int client_buf_mgmt_init_file(const char *path, int max_msg_len, int max_buf_cnt)
+{
+    struct stat st;
+    file_buf_header *hdr = NULL;
+    size_t slot_size = 0;
+    void *addr = NULL;
+    int ret = 0;
+
+    if (!path || max_msg_len <= 0 || max_buf_cnt <= 0)
+        return LE_ERROR_INVAILD_PARAM;
+
+    memset(&g_ws_buf_state, 0, sizeof(msg_buf_status));
+    ret = pthread_mutex_init(&g_ws_buf_state.locker, NULL);
+    if(ret != 0){
+        printf("failed to init buffer locker.\n");
+        return LE_ERROR_CREATING_MUTEX;
+    }
+    g_ws_buf_state.max_buf_cnt = max_buf_cnt;
+
+    g_ws_file = mem_malloc(MEM_WS, sizeof(file_buf));
+    if (!g_ws_file)
+        goto _failed;
+    memset(g_ws_file, 0, sizeof(file_buf));
+    g_ws_file->fd = -1;
+    g_ws_file->max_len = max_msg_len + 1;
+    slot_size = FILE_BUF_ALIGN(sizeof(file_buf_slot) + g_ws_file->max_len);
+    g_ws_file->map_len = FILE_BUF_HEADER + slot_size * max_buf_cnt;
+    g_ws_buf_state.single_buf_size = slot_size;
+
+    g_ws_file->stage = mem_malloc(MEM_WS, LWS_PRE + g_ws_file->max_len);
+    g_ws_file->enq_us = mem_calloc(MEM_WS, max_buf_cnt, sizeof(uint64_t));
+    g_ws_file->trace_id = mem_calloc(MEM_WS, max_buf_cnt, sizeof(uint32_t));
+    g_ws_file->pending = mem_calloc(MEM_WS, max_buf_cnt, sizeof(uint16_t));
+    g_ws_file->acks = mem_calloc(MEM_WS, FILE_BUF_ACK_SLOTS, sizeof(file_buf_ack));
+    if (!g_ws_file->stage || !g_ws_file->enq_us || !g_ws_file->trace_id ||
+        !g_ws_file->pending || !g_ws_file->acks)
+        goto _failed;
+
+    g_ws_file->fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (g_ws_file->fd < 0) {
+        printf("failed to open send queue file %s.\n", path);
+        ret = LE_ERROR_WRITING_FILE;
+        goto _failed;
+    }
+    if (fstat(g_ws_file->fd, &st) != 0 || ((size_t)st.st_size != g_ws_file->map_len &&
+        ftruncate(g_ws_file->fd, g_ws_file->map_len) != 0)) {
+        printf("failed to resize send queue file %s.\n", path);
+        ret = LE_ERROR_WRITING_FILE;
+        goto _failed;
+    }
+    addr = mmap(NULL, g_ws_file->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, g_ws_file->fd, 0);
+    if (addr == MAP_FAILED) {
+        printf("failed to map send queue file %s.\n", path);
+        ret = LE_ERROR_WRITING_FILE;
+        goto _failed;
+    }
+
+    hdr = addr;
+    g_ws_file->hdr = hdr;
+    g_ws_file->slots = (char *)addr + FILE_BUF_HEADER;
+    crc32_init();
+
+    if (hdr->magic != FILE_BUF_MAGIC || hdr->version != FILE_BUF_VERSION ||
+        hdr->slot_size != slot_size || hdr->slot_cnt != (uint32_t)max_buf_cnt ||
+        hdr->tail < hdr->head || hdr->tail - hdr->head > (uint64_t)max_buf_cnt) {
+        memset(hdr, 0, sizeof(file_buf_header));
+        hdr->magic = FILE_BUF_MAGIC;
+        hdr->version = FILE_BUF_VERSION;
+        hdr->slot_size = slot_size;
+        hdr->slot_cnt = max_buf_cnt;
+    } else {
+        file_buf_recover();
+    }
+    g_ws_file->send = hdr->head;
+    msync(hdr, FILE_BUF_HEADER, MS_SYNC);
+
+    return LE_SUCCESS;
+_failed:
+    if (g_ws_file) {
+        if (g_ws_file->fd >= 0)
+            close(g_ws_file->fd);
+        if (g_ws_file->stage)
+            mem_free(g_ws_file->stage);
+        if (g_ws_file->enq_us)
+            mem_free(g_ws_file->enq_us);
+        if (g_ws_file->trace_id)
+            mem_free(g_ws_file->trace_id);
+        if (g_ws_file->pending)
+            mem_free(g_ws_file->pending);
+        if (g_ws_file->acks)
+            mem_free(g_ws_file->acks);
+        mem_free(g_ws_file);
+        g_ws_file = NULL;
+    }
+    pthread_mutex_destroy(&g_ws_buf_state.locker);
+
+    return ret ? ret : LE_ERROR_ALLOCATING_MEM;
+}
+
+static int file_buf_push(const char *buf, size_t len, int msg_type,
+                         const unsigned int *msg_ids, int id_cnt)
+{
+    file_buf_header *hdr = g_ws_file->hdr;
+    file_buf_slot   *slot = NULL;
+    size_t           size = len + (msg_type == 0);
+    uint32_t         idx = 0;
+    int              i = 0;
+
+    if (size > g_ws_file->max_len) {
+        printf("msg of %zu bytes exceeds send queue slot.\n", len);
+        return LE_ERROR_PARAM_RANGE_OVERFLOW;
+    }
+
+    pthread_mutex_lock(&g_ws_buf_state.locker);
+    /* written msgs waiting for acks never block new ones, the oldest gives up its place */
+    if (hdr->tail - hdr->head >= hdr->slot_cnt && hdr->head < g_ws_file->send) {
+        file_slot_forget(hdr->head);
+        file_buf_release();
+    }
+    if (hdr->tail - hdr->head >= hdr->slot_cnt) {
+        pthread_mutex_unlock(&g_ws_buf_state.locker);
+        metrics_inc(METRIC_SEND_QUEUE_FULL);
+        return LE_ERROR_ALLOCATING_MEM;
+    }
+
+    slot = file_slot(hdr->tail);
+    slot->seq = (uint32_t)hdr->tail;
+    slot->type = msg_type;
+    slot->len = size;
+    slot->proto = msg_type ? file_proto_tag() : 0;
+    memcpy(slot + 1, buf, len);
+    if (size > len)
+        ((char *)(slot + 1))[len] = '\0';
+    slot->crc = file_slot_crc(slot);
+    idx = hdr->tail % hdr->slot_cnt;
+    g_ws_file->enq_us[idx] = metrics_now_us();
+    g_ws_file->trace_id[idx] = trace_current();
+    g_ws_file->pending[idx] = 0;
+    for (i = 0; i < id_cnt; i++)
+        g_ws_file->pending[idx] += file_ack_add(msg_ids[i], hdr->tail);
+
+    /* publish the slot only after its content is in place */
+    __sync_synchronize();
+    hdr->tail++;
+    file_buf_release();
+
+    if (++g_ws_file->unsynced >= FILE_BUF_SYNC_CNT) {
+        g_ws_file->unsynced = 0;
+        msync(hdr, g_ws_file->map_len, MS_ASYNC);
+    }
+    pthread_mutex_unlock(&g_ws_buf_state.locker);
+
+    notify_network();
+    return LE_SUCCESS;
+}
+
+static int file_buf_pop(cb_del cb, void *usr)
+{
+    file_buf_header *hdr = g_ws_file->hdr;
+    file_buf_slot   *slot = NULL;
+    uint32_t         idx = 0;
+    uint64_t         begin = 0;
+    int ret = 0;
+
+    pthread_mutex_lock(&g_ws_buf_state.locker);
+    /*
+     * binary msgs queued by an earlier connection or process may use another
+     * encoding than the one negotiated now, drop them instead of sending frames
+     * the server cannot decode. Text msgs are understood by every subprotocol.
+     */
+    while (g_ws_file->send != hdr->tail) {
+        slot = file_slot(g_ws_file->send);
+        if (slot->type == 0 || slot->proto == file_proto_tag())
+            break;
+        printf("drop msg of %u bytes encoded for another subprotocol.\n", slot->len);
+        g_ws_file->enq_us[g_ws_file->send % hdr->slot_cnt] = 0;
+        file_slot_forget(g_ws_file->send);
+        g_ws_file->send++;
+    }
+    file_buf_release();
+
+    if (g_ws_file->send == hdr->tail) {
+        pthread_mutex_unlock(&g_ws_buf_state.locker);
+        return LE_SUCCESS;
+    }
+
+    slot = file_slot(g_ws_file->send);
+    idx = g_ws_file->send % hdr->slot_cnt;
+    memcpy(g_ws_file->stage + LWS_PRE, slot + 1, slot->len);
+    begin = metrics_now_us();
+    ret = cb(g_ws_file->stage + LWS_PRE, slot->len, slot->type, usr);
+    if (ret < (int)slot->len) {
+        pthread_mutex_unlock(&g_ws_buf_state.locker);
+        printf("failed to post msg to server.\n");
+        return LE_ERROR_UNKNOWN;
+    }
+    metrics_inc(METRIC_MSGS_SENT);
+    metrics_add(METRIC_BYTES_SENT, slot->len);
+    if (g_ws_file->enq_us[idx]) {
+        metrics_observe(METRIC_HIST_ENQUEUE_TO_WRITE, begin - g_ws_file->enq_us[idx]);
+        if (trace_enabled() && g_ws_file->trace_id[idx]) {
+            trace_span("send_wait", g_ws_file->trace_id[idx], g_ws_file->enq_us[idx], begin);
+            trace_span("write", g_ws_file->trace_id[idx], begin, metrics_now_us());
+        }
+        g_ws_file->enq_us[idx] = 0;
+    }
+    g_ws_file->send++;
+    file_buf_release();
+    pthread_mutex_unlock(&g_ws_buf_state.locker);
+
+    notify_network();
+    return LE_SUCCESS;
+}
+
+static int file_buf_destroy(void)
+{
+    pthread_mutex_lock(&g_ws_buf_state.locker);
+    msync(g_ws_file->hdr, g_ws_file->map_len, MS_SYNC);
+    munmap(g_ws_file->hdr, g_ws_file->map_len);
+    close(g_ws_file->fd);
+    mem_free(g_ws_file->stage);
+    mem_free(g_ws_file->enq_us);
+    mem_free(g_ws_file->trace_id);
+    mem_free(g_ws_file->pending);
+    mem_free(g_ws_file->acks);
+    mem_free(g_ws_file);
+    g_ws_file = NULL;
+    pthread_mutex_unlock(&g_ws_buf_state.locker);
+
+    pthread_mutex_destroy(&g_ws_buf_state.locker);
+    memset(&g_ws_buf_state, 0, sizeof(msg_buf_status));
+
+    return LE_SUCCESS;
+}
 
 int client_buf_mgmt_init(int single_buf_size, int max_buf_cnt)
 {
@@ -23,7 +484,7 @@ int client_buf_mgmt_init(int single_buf_size, int max_buf_cnt)
     g_ws_buf_state.single_buf_size = single_buf_size;
     g_ws_buf_state.max_buf_cnt = max_buf_cnt;
 
-    g_ws_buf = malloc(max_buf_cnt * sizeof(msg_buf_item));
+    g_ws_buf = mem_malloc(MEM_WS, max_buf_cnt * sizeof(msg_buf_item));
     if(!g_ws_buf){
         printf("failed to malloc memory for client buffer mgmt\n");
         pthread_mutex_destroy(&g_ws_buf_state.locker);
@@ -31,7 +492,7 @@ int client_buf_mgmt_init(int single_buf_size, int max_buf_cnt)
     }
     memset(g_ws_buf, 0, sizeof(msg_buf_item) * max_buf_cnt);
 	for (i = 0; i < max_buf_cnt; i++) {
-        g_ws_buf[i].buf = malloc(single_buf_size);
+        g_ws_buf[i].buf = mem_malloc(MEM_WS, single_buf_size);
         if(!g_ws_buf[i].buf)
             goto _failed;
 		memset(g_ws_buf[i].buf, 0, single_buf_size);
@@ -41,27 +502,53 @@ int client_buf_mgmt_init(int single_buf_size, int max_buf_cnt)
 _failed:
     for(i = 0; i < max_buf_cnt; i++){
         if(g_ws_buf[i].buf){
-            free(g_ws_buf[i].buf);
+            mem_free(g_ws_buf[i].buf);
             g_ws_buf[i].buf = NULL;
         }else
             break;
     }
     
-    free(g_ws_buf);
+    mem_free(g_ws_buf);
     g_ws_buf = NULL;
     pthread_mutex_destroy(&g_ws_buf_state.locker);
 
 	return LE_ERROR_ALLOCATING_MEM;
 }
 
-extern void notify_network();
 int client_buf_mgmt_push(const char *buf, size_t len, int msg_type)
+{
+    return client_buf_mgmt_push_tracked(buf, len, msg_type, NULL, 0);
+}
+
+void client_buf_mgmt_ack(unsigned int msg_id)
+{
+    file_buf_ack *ack = NULL;
+
+    if (!g_ws_file)
+        return;
+
+    pthread_mutex_lock(&g_ws_buf_state.locker);
+    ack = file_ack_find(msg_id);
+    if (ack) {
+        file_slot_acked(ack->seq);
+        file_ack_del(ack);
+        file_buf_release();
+    }
+    pthread_mutex_unlock(&g_ws_buf_state.locker);
+}
+
+int client_buf_mgmt_push_tracked(const char *buf, size_t len, int msg_type,
+                                 const unsigned int *msg_ids, int id_cnt)
 {
 	msg_buf_item *p_new_msg = NULL;
     char         *tmp = NULL;
     int           windex = 0;
 
-    if(!buf || !g_ws_buf)
+    if(!buf)
+        return LE_ERROR_INVAILD_PARAM;
+    if(g_ws_file)
+        return file_buf_push(buf, len, msg_type, msg_ids, id_cnt);
+    if(!g_ws_buf)
         return LE_ERROR_INVAILD_PARAM;
 
 	pthread_mutex_lock(&g_ws_buf_state.locker);
@@ -71,9 +558,17 @@ int client_buf_mgmt_push(const char *buf, size_t len, int msg_type)
 		g_ws_buf_state.wr_index = 0;
         windex = 0;
     }
-    ++len;
+    if (g_ws_buf[windex].buf_len != 0) {
+        /* ring is full, never overwrite a msg that has not been sent */
+        pthread_mutex_unlock(&g_ws_buf_state.locker);
+        metrics_inc(METRIC_SEND_QUEUE_FULL);
+        return LE_ERROR_ALLOCATING_MEM;
+    }
+    /* text msgs go out with a trailing '\0', binary frames exactly as given */
+    if(msg_type == 0)
+        ++len;
     if(len > g_ws_buf_state.single_buf_size - LWS_PRE){
-        tmp = realloc(g_ws_buf[windex].buf, len + LWS_PRE);    
+        tmp = mem_realloc(MEM_WS, g_ws_buf[windex].buf, len + LWS_PRE);    
         if(!tmp){
             printf("failed to alloc more memory to store msg\n");
             pthread_mutex_unlock(&g_ws_buf_state.locker);
@@ -84,10 +579,15 @@ int client_buf_mgmt_push(const char *buf, size_t len, int msg_type)
     }
 
 	memset(g_ws_buf[windex].buf, 0, g_ws_buf[windex].buf_len);
-	memcpy(g_ws_buf[windex].buf + LWS_PRE, buf, len - 1);
-	g_ws_buf[windex].buf[LWS_PRE + len - 1] = '\0';
+	if(msg_type == 0){
+		memcpy(g_ws_buf[windex].buf + LWS_PRE, buf, len - 1);
+		g_ws_buf[windex].buf[LWS_PRE + len - 1] = '\0';
+	} else
+		memcpy(g_ws_buf[windex].buf + LWS_PRE, buf, len);
 	g_ws_buf[windex].buf_len = len;
 	g_ws_buf[windex].type = msg_type;
+	g_ws_buf[windex].enq_us = metrics_now_us();
+	g_ws_buf[windex].trace_id = trace_current();
 
 	g_ws_buf_state.wr_index++;
 
@@ -101,6 +601,13 @@ int client_buf_mgmt_pop(cb_del cb, void *usr)
 {
 	int ret = 0;
     int rindex = 0;
+    uint64_t begin = 0;
+
+    if(g_ws_file){
+        return file_buf_pop(cb, usr);
+    } else if(!g_ws_buf){
+        return LE_SUCCESS;
+    }
 
 	pthread_mutex_lock(&g_ws_buf_state.locker);
     
@@ -115,6 +622,7 @@ int client_buf_mgmt_pop(cb_del cb, void *usr)
 		return LE_SUCCESS;
 	}
     
+    begin = metrics_now_us();
     ret = cb(g_ws_buf[rindex].buf + LWS_PRE, 
                         g_ws_buf[rindex].buf_len, g_ws_buf[rindex].type, usr);
     
@@ -123,6 +631,13 @@ int client_buf_mgmt_pop(cb_del cb, void *usr)
         printf("failed to post msg to server.\n"); 
         return LE_ERROR_UNKNOWN;
     }
+    metrics_inc(METRIC_MSGS_SENT);
+    metrics_add(METRIC_BYTES_SENT, g_ws_buf[rindex].buf_len);
+    metrics_observe(METRIC_HIST_ENQUEUE_TO_WRITE, begin - g_ws_buf[rindex].enq_us);
+    if (trace_enabled() && g_ws_buf[rindex].trace_id) {
+        trace_span("send_wait", g_ws_buf[rindex].trace_id, g_ws_buf[rindex].enq_us, begin);
+        trace_span("write", g_ws_buf[rindex].trace_id, begin, metrics_now_us());
+    }
     g_ws_buf[rindex].buf_len = 0;
 	g_ws_buf_state.rd_index++;
 	pthread_mutex_unlock(&g_ws_buf_state.locker);
@@ -131,15 +646,41 @@ int client_buf_mgmt_pop(cb_del cb, void *usr)
 	return LE_SUCCESS;
 }
 
+int client_buf_mgmt_depth(void)
+{
+    int i = 0;
+    int depth = 0;
+
+    if (g_ws_file)
+        return (int)(g_ws_file->hdr->tail - g_ws_file->send);
+    if (!g_ws_buf)
+        return 0;
+
+    /* slots are taken and released in order, count the busy ones */
+    pthread_mutex_lock(&g_ws_buf_state.locker);
+    for (i = 0; i < g_ws_buf_state.max_buf_cnt; i++) {
+        if (g_ws_buf[i].buf_len != 0)
+            depth++;
+    }
+    pthread_mutex_unlock(&g_ws_buf_state.locker);
+
+    return depth;
+}
+
 void buf_mgmt_client_clear_msg()
 {
 	int i = 0;
+
+	/* msgs in the queue file are kept for the next connection */
+	if (g_ws_file || !g_ws_buf)
+		return;
+
 	pthread_mutex_lock(&g_ws_buf_state.locker);
 
 	g_ws_buf_state.wr_index = 0;
 	g_ws_buf_state.rd_index = 0;
 
-	for (i = 0; i < MAX_MSG_BUF_COUNT; i++) {
+	for (i = 0; i < g_ws_buf_state.max_buf_cnt; i++) {
 		g_ws_buf[i].buf_len = 0;
 	}
 	pthread_mutex_unlock(&g_ws_buf_state.locker);
@@ -149,15 +690,17 @@ int client_buf_mgmt_destroy(void)
 {
 	int i = 0;
     
+    if(g_ws_file)
+        return file_buf_destroy();
     if(!g_ws_buf)
         return 0;
 
 	pthread_mutex_lock(&g_ws_buf_state.locker);
 	for (i = 0; i < g_ws_buf_state.max_buf_cnt; i++) {
 		if (NULL != g_ws_buf[i].buf)
-			free(g_ws_buf[i].buf);
+			mem_free(g_ws_buf[i].buf);
 	}
-    free(g_ws_buf);
+    mem_free(g_ws_buf);
     g_ws_buf = NULL;
 	pthread_mutex_unlock(&g_ws_buf_state.locker);
 
@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
 #include <pthread.h>
 
 #define MAX_MSG_LEN_EACH    640
@@ -21,16 +22,36 @@ typedef struct {
 	char *buf;
 	size_t buf_len;
 	int type;
+	uint64_t enq_us;
+	uint32_t trace_id;
 } msg_buf_item;
 
 typedef int (*cb_del)(char *buf, size_t buf_len, int type, void *usr);
 
 int client_buf_mgmt_init(int single_buf_size, int max_buf_cnt);
 
+/* keep the ring in @path so msgs not yet sent survive a process restart.
+ * each slot holds one msg of at most @max_msg_len bytes, msgs left in the
+ * file by the previous process are sent first once connected.
+ */
+int client_buf_mgmt_init_file(const char *path, int max_msg_len, int max_buf_cnt);
+
 int client_buf_mgmt_push(const char *buf, size_t len, int msg_type);
 
+/* like client_buf_mgmt_push, with a queue file the msg stays in the file
+ * after it is sent until client_buf_mgmt_ack has been called for each of
+ * @msg_ids, the memory ring ignores them.
+ */
+int client_buf_mgmt_push_tracked(const char *buf, size_t len, int msg_type,
+                                 const unsigned int *msg_ids, int id_cnt);
+
+void client_buf_mgmt_ack(unsigned int msg_id);
+
 int client_buf_mgmt_pop(cb_del cb, void *usr);
 
+/* number of msgs waiting to be sent */
+int client_buf_mgmt_depth(void);
+
 void buf_mgmt_client_clear_msg();
 
 int client_buf_mgmt_destroy(void);
@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "libwebsockets.h"
+#include "ws_client.h"
+#include "metrics.h"
+#include "log.h"
+
+/*
+ * TLS session reuse and handshake timing for the client connection.
+ *
+ * lws 3.1 keeps no client sessions, so the last session is captured with the
+ * new session callback and handed to the next SSL object when its handshake
+ * starts, before the ClientHello is built. Everything here runs on the lws
+ * service thread.
+ */
+
+#if defined(LWS_OPENSSL_SUPPORT) && !defined(LWS_WITH_MBEDTLS)
+#include <openssl/ssl.h>
+#endif
+
+#define LOG_TAG "WSC_TLS"
+
+#define TLS_SESSION_FILE_MAX    8192
+
+static const wsc_tls_config *g_tls = NULL;
+
+#if defined(LWS_OPENSSL_SUPPORT) && !defined(LWS_WITH_MBEDTLS) && (OPENSSL_VERSION_NUMBER >= 0x10100000L)
+
+static SSL_SESSION *g_session = NULL;
+static uint64_t g_handshake_begin = 0;
+
+static int tls_resumption(void)
+{
+    return !g_tls || g_tls->session_resumption;
+}
+
+static void tls_save_session(SSL_SESSION *sess)
+{
+    unsigned char buf[TLS_SESSION_FILE_MAX];
+    unsigned char *p = buf;
+    char tmp[256];
+    int len = 0;
+    int fd = -1;
+
+    if (!g_tls || !g_tls->session_file)
+        return;
+
+    len = i2d_SSL_SESSION(sess, NULL);
+    if (len <= 0 || len > (int)sizeof(buf))
+        return;
+    i2d_SSL_SESSION(sess, &p);
+
+    /* the file holds the session secret, keep it private and replace it atomically */
+    snprintf(tmp, sizeof(tmp), "%s.tmp", g_tls->session_file);
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        log_w(LOG_TAG, "open %s failed\n", tmp);
+        return;
+    }
+    if (write(fd, buf, len) != len) {
+        close(fd);
+        unlink(tmp);
+        return;
+    }
+    close(fd);
+    rename(tmp, g_tls->session_file);
+}
+
+static void tls_load_session(void)
+{
+    unsigned char buf[TLS_SESSION_FILE_MAX];
+    const unsigned char *p = buf;
+    ssize_t len = 0;
+    int fd = -1;
+
+    if (!g_tls || !g_tls->session_file)
+        return;
+
+    fd = open(g_tls->session_file, O_RDONLY);
+    if (fd < 0)
+        return;
+    len = read(fd, buf, sizeof(buf));
+    close(fd);
+    if (len <= 0)
+        return;
+
+    g_session = d2i_SSL_SESSION(NULL, &p, len);
+    if (!g_session)
+        log_w(LOG_TAG, "session file %s is invalid\n", g_tls->session_file);
+}
+
+static int tls_new_session(SSL *ssl, SSL_SESSION *sess)
+{
+    if (g_session)
+        SSL_SESSION_free(g_session);
+    g_session = sess;
+    tls_save_session(sess);
+
+    /* we keep the reference */
+    return 1;
+}
+
+static void tls_info(const SSL *ssl, int where, int ret)
+{
+    uint64_t cost = 0;
+
+    /* TLS 1.3 also reports post-handshake messages, only the first handshake counts */
+    if ((where & SSL_CB_HANDSHAKE_START) && SSL_in_before(ssl)) {
+        g_handshake_begin = metrics_now_us();
+        if (g_session && tls_resumption())
+            SSL_set_session((SSL *)ssl, g_session);
+        return;
+    }
+
+    if ((where & SSL_CB_HANDSHAKE_DONE) && g_handshake_begin) {
+        cost = metrics_now_us() - g_handshake_begin;
+        g_handshake_begin = 0;
+        metrics_inc(METRIC_TLS_HANDSHAKES);
+        metrics_observe(METRIC_HIST_TLS_HANDSHAKE, cost);
+        if (SSL_session_reused((SSL *)ssl))
+            metrics_inc(METRIC_TLS_RESUMED);
+        log_d(LOG_TAG, "%s handshake done in %llu us, %s\n", SSL_get_version(ssl),
+              (unsigned long long)cost, SSL_session_reused((SSL *)ssl) ? "resumed" : "full");
+    }
+}
+
+void wsc_tls_setup_ctx(void *ssl_ctx)
+{
+    SSL_CTX *ctx = ssl_ctx;
+
+    if (!ctx)
+        return;
+
+#if defined(TLS1_3_VERSION)
+    if (g_tls && g_tls->ciphersuites && !SSL_CTX_set_ciphersuites(ctx, g_tls->ciphersuites))
+        log_w(LOG_TAG, "ciphersuites %s are not supported\n", g_tls->ciphersuites);
+#endif
+    if (g_tls && g_tls->curves && !SSL_CTX_set1_curves_list(ctx, g_tls->curves))
+        log_w(LOG_TAG, "curves %s are not supported\n", g_tls->curves);
+
+    SSL_CTX_set_info_callback(ctx, tls_info);
+    if (tls_resumption()) {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx, tls_new_session);
+    }
+}
+
+void wsc_tls_init(const wsc_tls_config *cfg)
+{
+    g_tls = cfg;
+    g_handshake_begin = 0;
+    if (!g_session && tls_resumption())
+        tls_load_session();
+}
+
+void wsc_tls_cleanup(void)
+{
+    if (g_session) {
+        SSL_SESSION_free(g_session);
+        g_session = NULL;
+    }
+}
+
+#else
+
+/* mbedtls and OpenSSL before 1.1.0 always do full handshakes */
+void wsc_tls_setup_ctx(void *ssl_ctx)
+{
+}
+
+void wsc_tls_init(const wsc_tls_config *cfg)
+{
+    g_tls = cfg;
+}
+
+void wsc_tls_cleanup(void)
+{
+}
+
+#endif
@@ -0,0 +1,478 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cbor.h"
+
+#define CBOR_UINT       0
+#define CBOR_NEGINT     1
+#define CBOR_BYTES      2
+#define CBOR_TEXT       3
+#define CBOR_ARRAY      4
+#define CBOR_MAP        5
+#define CBOR_TAG        6
+#define CBOR_SIMPLE     7
+
+#define CBOR_FALSE      0xf4
+#define CBOR_TRUE       0xf5
+#define CBOR_NULL       0xf6
+#define CBOR_FLOAT32    0xfa
+#define CBOR_FLOAT64    0xfb
+#define CBOR_BREAK      0xff
+
+#define CBOR_INDEFINITE 31
+
+typedef struct {
+    unsigned char *buf;
+    size_t len;
+    size_t cap;
+    int fail;
+} cbor_out;
+
+typedef struct {
+    const unsigned char *p;
+    const unsigned char *end;
+    int depth;
+} cbor_in;
+
+static unsigned char *out_reserve(cbor_out *out, size_t n)
+{
+    unsigned char *tmp = NULL;
+    size_t cap = out->cap;
+
+    if (out->fail)
+        return NULL;
+
+    if (out->len + n > cap) {
+        while (out->len + n > cap)
+            cap = cap ? cap * 2 : 256;
+        tmp = cJSON_malloc(cap);
+        if (!tmp) {
+            out->fail = 1;
+            return NULL;
+        }
+        if (out->buf) {
+            memcpy(tmp, out->buf, out->len);
+            cJSON_free(out->buf);
+        }
+        out->buf = tmp;
+        out->cap = cap;
+    }
+
+    tmp = out->buf + out->len;
+    out->len += n;
+    return tmp;
+}
+
+static void put_be(unsigned char *p, uint64_t v, int n)
+{
+    while (n-- > 0) {
+        p[n] = (unsigned char)v;
+        v >>= 8;
+    }
+}
+
+static void put_head(cbor_out *out, int major, uint64_t arg)
+{
+    unsigned char *p = NULL;
+    int n = 0, ai = 0;
+
+    if (arg < 24) {
+        ai = (int)arg;
+    } else if (arg <= 0xff) {
+        ai = 24, n = 1;
+    } else if (arg <= 0xffff) {
+        ai = 25, n = 2;
+    } else if (arg <= 0xffffffffULL) {
+        ai = 26, n = 4;
+    } else {
+        ai = 27, n = 8;
+    }
+
+    p = out_reserve(out, 1 + n);
+    if (!p)
+        return;
+    p[0] = (unsigned char)((major << 5) | ai);
+    put_be(p + 1, arg, n);
+}
+
+static void put_text(cbor_out *out, const char *str)
+{
+    size_t n = strlen(str);
+    unsigned char *p = NULL;
+
+    put_head(out, CBOR_TEXT, n);
+    p = out_reserve(out, n);
+    if (p)
+        memcpy(p, str, n);
+}
+
+static void put_number(cbor_out *out, double d)
+{
+    unsigned char *p = NULL;
+    union { float f; uint32_t u; } f32;
+    union { double d; uint64_t u; } f64;
+
+    if (d != d || d - d != 0) {
+        /* NaN or infinity, cJSON_Print writes null */
+        p = out_reserve(out, 1);
+        if (p)
+            p[0] = CBOR_NULL;
+        return;
+    }
+
+    if (d >= -9223372036854775808.0 && d < 9223372036854775808.0 && (double)(int64_t)d == d) {
+        if (d >= 0)
+            put_head(out, CBOR_UINT, (uint64_t)(int64_t)d);
+        else
+            put_head(out, CBOR_NEGINT, (uint64_t)(-1 - (int64_t)d));
+        return;
+    }
+
+    f32.f = (float)d;
+    if ((double)f32.f == d) {
+        p = out_reserve(out, 5);
+        if (p) {
+            p[0] = CBOR_FLOAT32;
+            put_be(p + 1, f32.u, 4);
+        }
+        return;
+    }
+
+    f64.d = d;
+    p = out_reserve(out, 9);
+    if (p) {
+        p[0] = CBOR_FLOAT64;
+        put_be(p + 1, f64.u, 8);
+    }
+}
+
+static void put_item(cbor_out *out, const cJSON *item)
+{
+    const cJSON *child = NULL;
+    cJSON *raw = NULL;
+    unsigned char *p = NULL;
+    size_t n = 0;
+
+    switch (item->type & 0xff) {
+    case cJSON_False:
+    case cJSON_True:
+    case cJSON_NULL:
+        p = out_reserve(out, 1);
+        if (p)
+            p[0] = (item->type & cJSON_NULL) ? CBOR_NULL : ((item->type & cJSON_True) ? CBOR_TRUE : CBOR_FALSE);
+        break;
+    case cJSON_Number:
+        put_number(out, item->valuedouble);
+        break;
+    case cJSON_String:
+        put_text(out, item->valuestring ? item->valuestring : "");
+        break;
+    case cJSON_Array:
+    case cJSON_Object:
+        for (child = item->child; child; child = child->next)
+            n++;
+        put_head(out, (item->type & cJSON_Array) ? CBOR_ARRAY : CBOR_MAP, n);
+        for (child = item->child; child && !out->fail; child = child->next) {
+            if (item->type & cJSON_Object)
+                put_text(out, child->string ? child->string : "");
+            put_item(out, child);
+        }
+        break;
+    case cJSON_Raw:
+        raw = item->valuestring ? cJSON_Parse(item->valuestring) : NULL;
+        if (!raw) {
+            out->fail = 1;
+            break;
+        }
+        put_item(out, raw);
+        cJSON_Delete(raw);
+        break;
+    default:
+        out->fail = 1;
+        break;
+    }
+}
+
+char *cbor_encode(const cJSON *item, size_t *len)
+{
+    cbor_out out = {0};
+
+    if (!item || !len)
+        return NULL;
+
+    put_item(&out, item);
+    if (out.fail) {
+        if (out.buf)
+            cJSON_free(out.buf);
+        return NULL;
+    }
+
+    *len = out.len;
+    return (char *)out.buf;
+}
+
+static uint64_t get_be(const unsigned char *p, int n)
+{
+    uint64_t v = 0;
+
+    while (n-- > 0)
+        v = (v << 8) | *p++;
+    return v;
+}
+
+/* return the additional info, or -1 when the input is truncated or invalid */
+static int get_head(cbor_in *in, int *major, uint64_t *arg)
+{
+    int ai = 0, n = 0;
+
+    if (in->p >= in->end)
+        return -1;
+
+    *major = *in->p >> 5;
+    ai = *in->p & 31;
+    in->p++;
+
+    if (ai < 24) {
+        *arg = ai;
+        return ai;
+    }
+    if (ai == CBOR_INDEFINITE) {
+        *arg = 0;
+        return ai;
+    }
+    if (ai > 27)
+        return -1;
+
+    n = 1 << (ai - 24);
+    if (in->end - in->p < n)
+        return -1;
+    *arg = get_be(in->p, n);
+    in->p += n;
+    return ai;
+}
+
+static double half_to_double(unsigned int h)
+{
+    union { double d; uint64_t u; } v;
+    unsigned int exp = (h >> 10) & 0x1f;
+    unsigned int mant = h & 0x3ff;
+    double d = 0;
+
+    if (exp == 0) {
+        d = mant / 16777216.0;  /* mant * 2^-24 */
+    } else if (exp != 31) {
+        v.u = (uint64_t)(exp - 15 + 1023) << 52 | (uint64_t)mant << 42;
+        d = v.d;
+    } else {
+        v.u = 0x7ffULL << 52 | (uint64_t)mant << 42;
+        d = v.d;
+    }
+    return (h & 0x8000) ? -d : d;
+}
+
+/* append @len bytes to a text string allocated with cJSON_malloc */
+static char *text_append(char *str, size_t *used, const unsigned char *data, size_t len)
+{
+    char *tmp = cJSON_malloc(*used + len + 1);
+
+    if (!tmp) {
+        if (str)
+            cJSON_free(str);
+        return NULL;
+    }
+    if (str) {
+        memcpy(tmp, str, *used);
+        cJSON_free(str);
+    }
+    memcpy(tmp + *used, data, len);
+    *used += len;
+    tmp[*used] = '\0';
+    return tmp;
+}
+
+static char *get_text(cbor_in *in, int ai, uint64_t arg)
+{
+    char *str = NULL;
+    size_t used = 0;
+    int major = 0;
+
+    if (ai != CBOR_INDEFINITE) {
+        if (arg > (uint64_t)(in->end - in->p))
+            return NULL;
+        str = text_append(NULL, &used, in->p, (size_t)arg);
+        in->p += arg;
+        return str;
+    }
+
+    str = text_append(NULL, &used, in->p, 0);
+    while (str) {
+        if (in->p < in->end && *in->p == CBOR_BREAK) {
+            in->p++;
+            return str;
+        }
+        /* chunks must be definite text strings */
+        ai = get_head(in, &major, &arg);
+        if (ai < 0 || ai == CBOR_INDEFINITE || major != CBOR_TEXT || arg > (uint64_t)(in->end - in->p))
+            break;
+        str = text_append(str, &used, in->p, (size_t)arg);
+        in->p += arg;
+    }
+
+    if (str)
+        cJSON_free(str);
+    return NULL;
+}
+
+static cJSON *get_item(cbor_in *in);
+
+/* children are linked by hand, cJSON_AddItemToArray walks the list */
+static int get_children(cbor_in *in, cJSON *parent, int ai, uint64_t count)
+{
+    cJSON *child = NULL, *tail = NULL;
+    char *key = NULL;
+    uint64_t i = 0;
+    uint64_t karg = 0;
+    int kmajor = 0, kai = 0;
+    int is_map = parent->type & cJSON_Object;
+
+    /* every item takes at least one byte */
+    if (ai != CBOR_INDEFINITE && count > (uint64_t)(in->end - in->p))
+        return -1;
+
+    for (i = 0; ai == CBOR_INDEFINITE || i < count; i++) {
+        if (ai == CBOR_INDEFINITE) {
+            if (in->p >= in->end)
+                return -1;
+            if (*in->p == CBOR_BREAK) {
+                in->p++;
+                break;
+            }
+        }
+
+        if (is_map) {
+            kai = get_head(in, &kmajor, &karg);
+            if (kai < 0 || kmajor != CBOR_TEXT)
+                return -1;
+            key = get_text(in, kai, karg);
+            if (!key)
+                return -1;
+        }
+
+        child = get_item(in);
+        if (!child) {
+            if (key)
+                cJSON_free(key);
+            return -1;
+        }
+        child->string = key;
+        key = NULL;
+
+        if (tail) {
+            tail->next = child;
+            child->prev = tail;
+        } else {
+            parent->child = child;
+        }
+        tail = child;
+    }
+
+    return 0;
+}
+
+static cJSON *get_simple(cbor_in *in, int ai, uint64_t arg)
+{
+    union { float f; uint32_t u; } f32;
+    union { double d; uint64_t u; } f64;
+
+    switch (ai) {
+    case 20:
+        return cJSON_CreateFalse();
+    case 21:
+        return cJSON_CreateTrue();
+    case 22:
+    case 23:
+        return cJSON_CreateNull();
+    case 25:
+        return cJSON_CreateNumber(half_to_double((unsigned int)arg));
+    case 26:
+        f32.u = (uint32_t)arg;
+        return cJSON_CreateNumber(f32.f);
+    case 27:
+        f64.u = arg;
+        return cJSON_CreateNumber(f64.d);
+    default:
+        return NULL;
+    }
+}
+
+static cJSON *get_item(cbor_in *in)
+{
+    cJSON *item = NULL;
+    uint64_t arg = 0;
+    int major = 0;
+    int ai = get_head(in, &major, &arg);
+
+    if (ai < 0)
+        return NULL;
+    if (ai == CBOR_INDEFINITE && (major < CBOR_BYTES || major > CBOR_MAP))
+        return NULL;
+
+    switch (major) {
+    case CBOR_UINT:
+        return cJSON_CreateNumber((double)arg);
+    case CBOR_NEGINT:
+        return cJSON_CreateNumber(-1.0 - (double)arg);
+    case CBOR_TEXT:
+        item = cJSON_CreateNull();
+        if (!item)
+            return NULL;
+        item->valuestring = get_text(in, ai, arg);
+        if (!item->valuestring) {
+            cJSON_Delete(item);
+            return NULL;
+        }
+        item->type = cJSON_String;
+        return item;
+    case CBOR_ARRAY:
+    case CBOR_MAP:
+        if (++in->depth > CJSON_NESTING_LIMIT)
+            return NULL;
+        item = (major == CBOR_ARRAY) ? cJSON_CreateArray() : cJSON_CreateObject();
+        if (item && get_children(in, item, ai, arg) != 0) {
+            cJSON_Delete(item);
+            item = NULL;
+        }
+        in->depth--;
+        return item;
+    case CBOR_TAG:
+        if (++in->depth > CJSON_NESTING_LIMIT)
+            return NULL;
+        item = get_item(in);
+        in->depth--;
+        return item;
+    case CBOR_SIMPLE:
+        return get_simple(in, ai, arg);
+    default:
+        return NULL;
+    }
+}
+
+cJSON *cbor_decode(const char *data, size_t len)
+{
+    cbor_in in;
+    cJSON *item = NULL;
+
+    if (!data || !len)
+        return NULL;
+
+    in.p = (const unsigned char *)data;
+    in.end = in.p + len;
+    in.depth = 0;
+
+    item = get_item(&in);
+    if (item && in.p != in.end) {
+        cJSON_Delete(item);
+        item = NULL;
+    }
+    return item;
+}
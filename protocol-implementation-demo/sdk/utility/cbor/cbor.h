@@ -0,0 +1,30 @@
+#ifndef _CBOR_H_
+#define _CBOR_H_
+
+#include <stddef.h>
+#include "cJSON.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * CBOR (RFC 7049) encoding of the cJSON data model.
+ *
+ * Integral numbers are encoded as CBOR integers, other numbers as single
+ * precision floats when that is exact and double precision otherwise.
+ * NaN and infinity become null, as cJSON_Print does. Byte strings are not
+ * part of the JSON model and are rejected by the decoder, tags are skipped.
+ */
+
+/* return a buffer allocated with cJSON_malloc, free it with cJSON_free. */
+char *cbor_encode(const cJSON *item, size_t *len);
+
+/* return NULL when @data is not exactly one well-formed data item. */
+cJSON *cbor_decode(const char *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
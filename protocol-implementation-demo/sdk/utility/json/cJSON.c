@@ -43,6 +43,18 @@
 #include <stdlib.h>
 #include <limits.h>
 #include <ctype.h>
+#include <float.h>
+#include <stdint.h>
+
+/* SSE2 is part of x86_64, NEON of aarch64, so no runtime detection is needed; CJSON_NO_SIMD forces the scalar scans */
+#if defined(CJSON_NO_SIMD)
+#elif defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#define CJSON_SCAN_SSE2
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CJSON_SCAN_NEON
+#endif
 
 #ifdef ENABLE_LOCALES
 #include <locale.h>
@@ -56,6 +68,7 @@
 #endif
 
 #include "cJSON.h"
+#include "mem.h"
 
 /* define our own boolean type */
 #define true ((cJSON_bool)1)
@@ -117,6 +130,145 @@ static int case_insensitive_strcmp(const unsigned char *string1, const unsigned
     return tolower(*string1) - tolower(*string2);
 }
 
+#ifdef CJSON_SCAN_NEON
+/* four bits per byte of a comparison result, zero when nothing matched */
+static unsigned long long neon_mask(uint8x16_t matches)
+{
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)), 0);
+}
+#endif
+
+/* offset of the first quote or backslash in the @length bytes at @input, @length if there is none */
+static size_t scan_string_special(const unsigned char * const input, const size_t length)
+{
+    size_t i = 0;
+#if defined(CJSON_SCAN_SSE2)
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+
+    for (; (i + 16) <= length; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(const void*)(input + i));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)));
+        if (mask != 0)
+        {
+            return i + (size_t)__builtin_ctz((unsigned int)mask);
+        }
+    }
+#elif defined(CJSON_SCAN_NEON)
+    const uint8x16_t quote = vdupq_n_u8('\"');
+    const uint8x16_t backslash = vdupq_n_u8('\\');
+
+    for (; (i + 16) <= length; i += 16)
+    {
+        uint8x16_t chunk = vld1q_u8(input + i);
+        unsigned long long mask = neon_mask(vorrq_u8(vceqq_u8(chunk, quote), vceqq_u8(chunk, backslash)));
+        if (mask != 0)
+        {
+            return i + (size_t)(__builtin_ctzll(mask) >> 2);
+        }
+    }
+#endif
+
+    for (; i < length; i++)
+    {
+        if ((input[i] == '\"') || (input[i] == '\\'))
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+/* offset of the first byte above ' ' in the @length bytes at @input, @length if there is none */
+static size_t scan_whitespace(const unsigned char * const input, const size_t length)
+{
+    size_t i = 0;
+#if defined(CJSON_SCAN_SSE2)
+    const __m128i space = _mm_set1_epi8(' ');
+
+    for (; (i + 16) <= length; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(const void*)(input + i));
+        /* max(c, ' ') == ' ' for every byte up to ' ', there is no unsigned compare in SSE2 */
+        int mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(chunk, space), space)) & 0xFFFF;
+        if (mask != 0)
+        {
+            return i + (size_t)__builtin_ctz((unsigned int)mask);
+        }
+    }
+#elif defined(CJSON_SCAN_NEON)
+    const uint8x16_t space = vdupq_n_u8(' ');
+
+    for (; (i + 16) <= length; i += 16)
+    {
+        unsigned long long mask = neon_mask(vcgtq_u8(vld1q_u8(input + i), space));
+        if (mask != 0)
+        {
+            return i + (size_t)(__builtin_ctzll(mask) >> 2);
+        }
+    }
+#endif
+
+    for (; i < length; i++)
+    {
+        if (input[i] > 32)
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+/* offset of the first byte print_string_ptr has to escape in the @length bytes at @input, @length if there is none */
+static size_t scan_print_special(const unsigned char * const input, const size_t length)
+{
+    size_t i = 0;
+#if defined(CJSON_SCAN_SSE2)
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(31);
+
+    for (; (i + 16) <= length; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(const void*)(input + i));
+        __m128i special = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash));
+        int mask = _mm_movemask_epi8(_mm_or_si128(special, _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control)));
+        if (mask != 0)
+        {
+            return i + (size_t)__builtin_ctz((unsigned int)mask);
+        }
+    }
+#elif defined(CJSON_SCAN_NEON)
+    const uint8x16_t quote = vdupq_n_u8('\"');
+    const uint8x16_t backslash = vdupq_n_u8('\\');
+    const uint8x16_t space = vdupq_n_u8(' ');
+
+    for (; (i + 16) <= length; i += 16)
+    {
+        uint8x16_t chunk = vld1q_u8(input + i);
+        uint8x16_t special = vorrq_u8(vceqq_u8(chunk, quote), vceqq_u8(chunk, backslash));
+        unsigned long long mask = neon_mask(vorrq_u8(special, vcltq_u8(chunk, space)));
+        if (mask != 0)
+        {
+            return i + (size_t)(__builtin_ctzll(mask) >> 2);
+        }
+    }
+#endif
+
+    for (; i < length; i++)
+    {
+        if ((input[i] < 32) || (input[i] == '\"') || (input[i] == '\\'))
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
 typedef struct internal_hooks
 {
     void *(*allocate)(size_t size);
@@ -124,25 +276,19 @@ typedef struct internal_hooks
     void *(*reallocate)(void *pointer, size_t size);
 } internal_hooks;
 
-#if defined(_MSC_VER)
-/* work around MSVC error C2322: '...' address of dillimport '...' is not static */
+/* allocations go through the SDK allocator and are counted as MEM_JSON */
 static void *internal_malloc(size_t size)
 {
-    return malloc(size);
+    return mem_malloc(MEM_JSON, size);
 }
 static void internal_free(void *pointer)
 {
-    free(pointer);
+    mem_free(pointer);
 }
 static void *internal_realloc(void *pointer, size_t size)
 {
-    return realloc(pointer, size);
+    return mem_realloc(MEM_JSON, pointer, size);
 }
-#else
-#define internal_malloc malloc
-#define internal_free free
-#define internal_realloc realloc
-#endif
 
 static internal_hooks global_hooks = { internal_malloc, internal_free, internal_realloc };
 
@@ -172,19 +318,19 @@ CJSON_PUBLIC(void) cJSON_InitHooks(cJSON_Hooks* hooks)
     if (hooks == NULL)
     {
         /* Reset hooks */
-        global_hooks.allocate = malloc;
-        global_hooks.deallocate = free;
-        global_hooks.reallocate = realloc;
+        global_hooks.allocate = internal_malloc;
+        global_hooks.deallocate = internal_free;
+        global_hooks.reallocate = internal_realloc;
         return;
     }
 
-    global_hooks.allocate = malloc;
+    global_hooks.allocate = internal_malloc;
     if (hooks->malloc_fn != NULL)
     {
         global_hooks.allocate = hooks->malloc_fn;
     }
 
-    global_hooks.deallocate = free;
+    global_hooks.deallocate = internal_free;
     if (hooks->free_fn != NULL)
     {
         global_hooks.deallocate = hooks->free_fn;
@@ -192,9 +338,9 @@ CJSON_PUBLIC(void) cJSON_InitHooks(cJSON_Hooks* hooks)
 
     /* use realloc only if both free and malloc are used */
     global_hooks.reallocate = NULL;
-    if ((global_hooks.allocate == malloc) && (global_hooks.deallocate == free))
+    if ((global_hooks.allocate == internal_malloc) && (global_hooks.deallocate == internal_free))
     {
-        global_hooks.reallocate = realloc;
+        global_hooks.reallocate = internal_realloc;
     }
 }
 
@@ -262,6 +408,123 @@ typedef struct
 /* get a pointer to the buffer at the position */
 #define buffer_at_offset(buffer) ((buffer)->content + (buffer)->offset)
 
+#if defined(FLT_EVAL_METHOD) && (FLT_EVAL_METHOD == 0)
+/* powers of ten that are exact doubles */
+static const double exact_powers_of_ten[] =
+{
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*
+ * Numbers whose digits fit in 53 bits and whose decimal exponent is within
+ * [-22, 22] are one exact double multiplied or divided by another, so a
+ * single rounding gives the same result as strtod (Clinger's fast path).
+ * Returns the number of bytes read, 0 when strtod has to be used.
+ */
+static size_t parse_number_fast(const unsigned char * const input, const size_t length, double * const number)
+{
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    int exponent_value = 0;
+    cJSON_bool negative = false;
+    cJSON_bool exponent_negative = false;
+    cJSON_bool seen_digit = false;
+    size_t i = 0;
+    size_t exponent_start = 0;
+    double value = 0;
+
+    if ((i < length) && (input[i] == '-'))
+    {
+        negative = true;
+        i++;
+    }
+
+    for (; (i < length) && (input[i] >= '0') && (input[i] <= '9'); i++)
+    {
+        seen_digit = true;
+        if ((mantissa != 0) || (input[i] != '0'))
+        {
+            mantissa = mantissa * 10 + (uint64_t)(input[i] - '0');
+            digits++;
+        }
+        if (digits > 19)
+        {
+            return 0;
+        }
+    }
+
+    if ((i < length) && (input[i] == '.'))
+    {
+        for (i++; (i < length) && (input[i] >= '0') && (input[i] <= '9'); i++)
+        {
+            seen_digit = true;
+            if ((mantissa != 0) || (input[i] != '0'))
+            {
+                mantissa = mantissa * 10 + (uint64_t)(input[i] - '0');
+                digits++;
+            }
+            exponent--;
+            if (digits > 19)
+            {
+                return 0;
+            }
+        }
+    }
+
+    if (!seen_digit)
+    {
+        return 0;
+    }
+
+    /* like strtod an exponent without digits is not part of the number */
+    if ((i < length) && ((input[i] == 'e') || (input[i] == 'E')))
+    {
+        exponent_start = i++;
+        if ((i < length) && ((input[i] == '+') || (input[i] == '-')))
+        {
+            exponent_negative = (input[i] == '-');
+            i++;
+        }
+        if ((i < length) && (input[i] >= '0') && (input[i] <= '9'))
+        {
+            for (; (i < length) && (input[i] >= '0') && (input[i] <= '9'); i++)
+            {
+                if (exponent_value > 1000)
+                {
+                    return 0;
+                }
+                exponent_value = exponent_value * 10 + (input[i] - '0');
+            }
+            exponent += exponent_negative ? -exponent_value : exponent_value;
+        }
+        else
+        {
+            i = exponent_start;
+        }
+    }
+
+    if (mantissa == 0)
+    {
+        value = 0;
+    }
+    else if ((mantissa <= (1ULL << 53)) && (exponent >= -22) && (exponent <= 22))
+    {
+        value = (double)mantissa;
+        value = (exponent < 0) ? (value / exact_powers_of_ten[-exponent]) : (value * exact_powers_of_ten[exponent]);
+    }
+    else
+    {
+        return 0;
+    }
+
+    *number = negative ? -value : value;
+
+    return i;
+}
+#endif
+
 /* Parse the input text to generate a number, and populate the result into item. */
 static cJSON_bool parse_number(cJSON * const item, parse_buffer * const input_buffer)
 {
@@ -276,6 +539,17 @@ static cJSON_bool parse_number(cJSON * const item, parse_buffer * const input_bu
         return false;
     }
 
+#if defined(FLT_EVAL_METHOD) && (FLT_EVAL_METHOD == 0)
+    /* common numbers need neither strtod nor the locale, the window is the one strtod sees below */
+    i = input_buffer->length - input_buffer->offset;
+    i = parse_number_fast(buffer_at_offset(input_buffer), (i < (sizeof(number_c_string) - 1)) ? i : (sizeof(number_c_string) - 1), &number);
+    if (i != 0)
+    {
+        after_end = number_c_string + i;
+        goto number_end;
+    }
+#endif
+
     /* copy the number into a temporary buffer and replace '.' with the decimal point
      * of the current locale (for strtod)
      * This also takes care of '\0' not necessarily being available for marking the end of the input */
@@ -317,6 +591,9 @@ loop_end:
         return false; /* parse_error */
     }
 
+#if defined(FLT_EVAL_METHOD) && (FLT_EVAL_METHOD == 0)
+number_end:
+#endif
     item->valuedouble = number;
 
     /* use saturation in case of overflow */
@@ -470,16 +747,427 @@ static void update_offset(printbuffer * const buffer)
     buffer->offset += strlen((const char*)buffer_pointer);
 }
 
+/*
+ * Grisu2 (Florian Loitsch, "Printing Floating-Point Numbers Quickly and Accurately with Integers"):
+ * produces digits that read back as the same double, the shortest ones in all but rare cases.
+ */
+typedef struct
+{
+    uint64_t f;
+    int e;
+} diy_fp;
+
+#define DIY_FP_HIDDEN_BIT 0x0010000000000000ULL
+#define DIY_FP_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFULL
+
+/* normalized 10^k for k = -348, -340, ..., 340 */
+static const uint64_t cached_powers_f[] =
+{
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL, 0xcf42894a5dce35eaULL,
+    0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL, 0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL,
+    0xbe5691ef416bd60cULL, 0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL, 0xc21094364dfb5637ULL,
+    0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL, 0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL,
+    0xb23867fb2a35b28eULL, 0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL, 0xb5b5ada8aaff80b8ULL,
+    0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL, 0x964e858c91ba2655ULL, 0xdff9772470297ebdULL,
+    0xa6dfbd9fb8e5b88fULL, 0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL, 0xaa242499697392d3ULL,
+    0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL, 0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL,
+    0x9c40000000000000ULL, 0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL, 0x9f4f2726179a2245ULL,
+    0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL, 0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL,
+    0x924d692ca61be758ULL, 0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL, 0x952ab45cfa97a0b3ULL,
+    0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL, 0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL,
+    0x88fcf317f22241e2ULL, 0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL, 0x8bab8eefb6409c1aULL,
+    0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL, 0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL,
+    0x80444b5e7aa7cf85ULL, 0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+
+static const short cached_powers_e[] =
+{
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+    -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+    -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+    -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+    56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+    694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+    1013, 1039, 1066,
+};
+
+static const uint64_t powers_of_ten[] =
+{
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+    1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+    1000000000000000000ULL, 10000000000000000000ULL
+};
+
+static diy_fp diy_fp_from_double(double d)
+{
+    diy_fp fp;
+    uint64_t bits = 0;
+    int biased_e = 0;
+
+    memcpy(&bits, &d, sizeof(bits));
+    biased_e = (int)((bits >> 52) & 0x7FF);
+    fp.f = bits & DIY_FP_SIGNIFICAND_MASK;
+    if (biased_e != 0)
+    {
+        fp.f += DIY_FP_HIDDEN_BIT;
+        fp.e = biased_e - 1075;
+    }
+    else
+    {
+        fp.e = -1074;
+    }
+
+    return fp;
+}
+
+/* upper 64 bits of the 128 bit product, rounded */
+static diy_fp diy_fp_multiply(const diy_fp x, const diy_fp y)
+{
+    const uint64_t mask = 0xFFFFFFFFULL;
+    uint64_t a = x.f >> 32, b = x.f & mask, c = y.f >> 32, d = y.f & mask;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & mask) + (bc & mask) + (1ULL << 31);
+    diy_fp product;
+
+    product.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+    product.e = x.e + y.e + 64;
+
+    return product;
+}
+
+static diy_fp diy_fp_normalize(diy_fp fp)
+{
+    while (!(fp.f & 0x8000000000000000ULL))
+    {
+        fp.f <<= 1;
+        fp.e--;
+    }
+
+    return fp;
+}
+
+/* the halfway points to the neighbouring doubles, both with the exponent of the upper one */
+static void diy_fp_boundaries(const diy_fp v, diy_fp * const minus, diy_fp * const plus)
+{
+    diy_fp pl, mi;
+
+    pl.f = (v.f << 1) + 1;
+    pl.e = v.e - 1;
+    while (!(pl.f & (DIY_FP_HIDDEN_BIT << 1)))
+    {
+        pl.f <<= 1;
+        pl.e--;
+    }
+    pl.f <<= 64 - 52 - 2;
+    pl.e -= 64 - 52 - 2;
+
+    /* the lower neighbour is closer when v is a power of two */
+    if (v.f == DIY_FP_HIDDEN_BIT)
+    {
+        mi.f = (v.f << 2) - 1;
+        mi.e = v.e - 2;
+    }
+    else
+    {
+        mi.f = (v.f << 1) - 1;
+        mi.e = v.e - 1;
+    }
+    mi.f <<= mi.e - pl.e;
+    mi.e = pl.e;
+
+    *minus = mi;
+    *plus = pl;
+}
+
+/* cached power bringing a product with @e into [-60, -32], *k is its negated decimal exponent */
+static diy_fp cached_power(const int e, int * const k)
+{
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int ik = (int)dk;
+    unsigned int index = 0;
+    diy_fp power;
+
+    if (dk - ik > 0.0)
+    {
+        ik++;
+    }
+    index = (unsigned int)((ik >> 3) + 1);
+    *k = -(-348 + (int)(index << 3));
+
+    power.f = cached_powers_f[index];
+    power.e = cached_powers_e[index];
+
+    return power;
+}
+
+static void grisu_round(unsigned char * const buffer, const int length, const uint64_t delta, uint64_t rest, const uint64_t ten_kappa, const uint64_t wp_w)
+{
+    while ((rest < wp_w) && ((delta - rest) >= ten_kappa) &&
+           (((rest + ten_kappa) < wp_w) || ((wp_w - rest) > (rest + ten_kappa - wp_w))))
+    {
+        buffer[length - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+static int count_decimal_digits(const uint32_t n)
+{
+    int digits = 1;
+
+    while ((digits < 10) && (n >= powers_of_ten[digits]))
+    {
+        digits++;
+    }
+
+    return digits;
+}
+
+static int grisu_digits(const diy_fp w, const diy_fp mp, uint64_t delta, unsigned char * const buffer, int * const k)
+{
+    const int shift = -mp.e;
+    const uint64_t one = 1ULL << shift;
+    const uint64_t wp_w = mp.f - w.f;
+    uint32_t p1 = (uint32_t)(mp.f >> shift);
+    uint64_t p2 = mp.f & (one - 1);
+    int kappa = count_decimal_digits(p1);
+    int length = 0;
+    uint32_t digit = 0;
+
+    while (kappa > 0)
+    {
+        digit = p1 / (uint32_t)powers_of_ten[kappa - 1];
+        p1 %= (uint32_t)powers_of_ten[kappa - 1];
+        if ((digit != 0) || (length != 0))
+        {
+            buffer[length++] = (unsigned char)('0' + digit);
+        }
+        kappa--;
+        if ((((uint64_t)p1 << shift) + p2) <= delta)
+        {
+            *k += kappa;
+            grisu_round(buffer, length, delta, ((uint64_t)p1 << shift) + p2, powers_of_ten[kappa] << shift, wp_w);
+            return length;
+        }
+    }
+
+    for (;;)
+    {
+        p2 *= 10;
+        delta *= 10;
+        digit = (uint32_t)(p2 >> shift);
+        if ((digit != 0) || (length != 0))
+        {
+            buffer[length++] = (unsigned char)('0' + digit);
+        }
+        p2 &= one - 1;
+        kappa--;
+        if (p2 < delta)
+        {
+            *k += kappa;
+            grisu_round(buffer, length, delta, p2, one, (-kappa < 20) ? (wp_w * powers_of_ten[-kappa]) : 0);
+            return length;
+        }
+    }
+}
+
+/* digits of a positive finite @d into @buffer (17 bytes), @d is digits * 10^*k */
+static int grisu2(const double d, unsigned char * const buffer, int * const k)
+{
+    diy_fp v = diy_fp_from_double(d);
+    diy_fp minus, plus, power, w, wp, wm;
+    int mk = 0;
+
+    diy_fp_boundaries(v, &minus, &plus);
+    power = cached_power(plus.e, &mk);
+    w = diy_fp_multiply(diy_fp_normalize(v), power);
+    wp = diy_fp_multiply(plus, power);
+    wm = diy_fp_multiply(minus, power);
+    wm.f++;
+    wp.f--;
+
+    *k = mk;
+    return grisu_digits(w, wp, wp.f - wm.f, buffer, k);
+}
+
+/* decimal digits of @value at @output, returns their count */
+static int print_uint64(uint64_t value, unsigned char * const output)
+{
+    unsigned char digits[20];
+    int length = 0;
+    int i = 0;
+
+    do
+    {
+        digits[length++] = (unsigned char)('0' + (value % 10));
+        value /= 10;
+    } while (value != 0);
+
+    for (i = 0; i < length; i++)
+    {
+        output[i] = digits[length - 1 - i];
+    }
+
+    return length;
+}
+
+#if defined(FLT_EVAL_METHOD) && (FLT_EVAL_METHOD == 0)
+/*
+ * Grisu2 now and then returns 16 or 17 digits where 15 would do. Rounds
+ * them to 15 and keeps those when they read back as @d, checked exactly
+ * like parse_number_fast does. Returns the new length.
+ */
+static int grisu_shorten(const double d, unsigned char * const digits, const int length, int * const k)
+{
+    const uint64_t scale = powers_of_ten[length - 15];
+    const int exponent = *k + length - 15;
+    uint64_t mantissa = 0;
+    double value = 0;
+    int i = 0;
+
+    if ((exponent < -22) || (exponent > 22))
+    {
+        return length;
+    }
+
+    for (i = 0; i < length; i++)
+    {
+        mantissa = mantissa * 10 + (uint64_t)(digits[i] - '0');
+    }
+    mantissa = (mantissa + scale / 2) / scale;
+
+    value = (double)mantissa;
+    value = (exponent < 0) ? (value / exact_powers_of_ten[-exponent]) : (value * exact_powers_of_ten[exponent]);
+    if (value != d)
+    {
+        return length;
+    }
+
+    *k = exponent;
+    return print_uint64(mantissa, digits);
+}
+#endif
+
+/*
+ * Same layout as printf("%1.15g") when 15 significant digits are enough and
+ * "%1.17g" otherwise, which is what cJSON used to print, with the shortest digits.
+ */
+static int print_double(double d, unsigned char * const output)
+{
+    unsigned char digits[18];
+    unsigned char *p = output;
+    int length = 0;
+    int k = 0;
+    int exponent = 0;
+    int precision = 0;
+    int i = 0;
+
+    /* -0 keeps its sign, like printf */
+    if (signbit(d))
+    {
+        *p++ = '-';
+        d = -d;
+    }
+
+    if (d == 0)
+    {
+        *p++ = '0';
+        return (int)(p - output);
+    }
+
+    /* integers below 10^15 print the same in both precisions */
+    if ((d < 1e15) && (d == (double)(uint64_t)d))
+    {
+        return (int)(p - output) + print_uint64((uint64_t)d, p);
+    }
+
+    length = grisu2(d, digits, &k);
+#if defined(FLT_EVAL_METHOD) && (FLT_EVAL_METHOD == 0)
+    if (length > 15)
+    {
+        length = grisu_shorten(d, digits, length, &k);
+    }
+#endif
+    while ((length > 1) && (digits[length - 1] == '0'))
+    {
+        length--;
+        k++;
+    }
+
+    precision = (length <= 15) ? 15 : 17;
+    exponent = length + k - 1;
+    if ((exponent < -4) || (exponent >= precision))
+    {
+        /* d.ddde+XX */
+        *p++ = digits[0];
+        if (length > 1)
+        {
+            *p++ = '.';
+            memcpy(p, digits + 1, (size_t)(length - 1));
+            p += length - 1;
+        }
+        *p++ = 'e';
+        *p++ = (exponent < 0) ? '-' : '+';
+        if (exponent < 0)
+        {
+            exponent = -exponent;
+        }
+        if (exponent < 10)
+        {
+            *p++ = '0';
+        }
+        p += print_uint64((uint64_t)exponent, p);
+    }
+    else if (exponent < 0)
+    {
+        /* 0.000ddd */
+        *p++ = '0';
+        *p++ = '.';
+        for (i = -1; i > exponent; i--)
+        {
+            *p++ = '0';
+        }
+        memcpy(p, digits, (size_t)length);
+        p += length;
+    }
+    else if (length <= (exponent + 1))
+    {
+        /* ddd000 */
+        memcpy(p, digits, (size_t)length);
+        p += length;
+        for (i = length; i <= exponent; i++)
+        {
+            *p++ = '0';
+        }
+    }
+    else
+    {
+        /* ddd.ddd */
+        memcpy(p, digits, (size_t)(exponent + 1));
+        p += exponent + 1;
+        *p++ = '.';
+        memcpy(p, digits + exponent + 1, (size_t)(length - exponent - 1));
+        p += length - exponent - 1;
+    }
+
+    return (int)(p - output);
+}
+
 /* Render the number nicely from the given item into a string. */
 static cJSON_bool print_number(const cJSON * const item, printbuffer * const output_buffer)
 {
     unsigned char *output_pointer = NULL;
     double d = item->valuedouble;
     int length = 0;
-    size_t i = 0;
     unsigned char number_buffer[26]; /* temporary buffer to print the number into */
-    unsigned char decimal_point = get_decimal_point();
-    double test;
 
     if (output_buffer == NULL)
     {
@@ -493,15 +1181,8 @@ static cJSON_bool print_number(const cJSON * const item, printbuffer * const out
     }
     else
     {
-        /* Try 15 decimal places of precision to avoid nonsignificant nonzero digits */
-        length = sprintf((char*)number_buffer, "%1.15g", d);
-
-        /* Check whether the original double can be recovered */
-        if ((sscanf((char*)number_buffer, "%lg", &test) != 1) || ((double)test != d))
-        {
-            /* If not, print with 17 decimal places of precision */
-            length = sprintf((char*)number_buffer, "%1.17g", d);
-        }
+        /* shortest digits that read back as d, laid out like "%1.15g" or "%1.17g" */
+        length = print_double(d, number_buffer);
     }
 
     /* sprintf failed or buffer overrun occured */
@@ -517,19 +1198,9 @@ static cJSON_bool print_number(const cJSON * const item, printbuffer * const out
         return false;
     }
 
-    /* copy the printed number to the output and replace locale
-     * dependent decimal point with '.' */
-    for (i = 0; i < ((size_t)length); i++)
-    {
-        if (number_buffer[i] == decimal_point)
-        {
-            output_pointer[i] = '.';
-            continue;
-        }
-
-        output_pointer[i] = number_buffer[i];
-    }
-    output_pointer[i] = '\0';
+    /* print_double does not depend on the locale */
+    memcpy(output_pointer, number_buffer, (size_t)length);
+    output_pointer[length] = '\0';
 
     output_buffer->offset += (size_t)length;
 
@@ -712,20 +1383,23 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
         /* calculate approximate size of the output (overestimate) */
         size_t allocation_length = 0;
         size_t skipped_bytes = 0;
-        while (((size_t)(input_end - input_buffer->content) < input_buffer->length) && (*input_end != '\"'))
+        while ((size_t)(input_end - input_buffer->content) < input_buffer->length)
         {
+            /* jump to the closing quote or the next escape sequence */
+            input_end += scan_string_special(input_end, input_buffer->length - (size_t)(input_end - input_buffer->content));
+            if (((size_t)(input_end - input_buffer->content) >= input_buffer->length) || (*input_end == '\"'))
+            {
+                break;
+            }
+
             /* is escape sequence */
-            if (input_end[0] == '\\')
+            if ((size_t)(input_end + 1 - input_buffer->content) >= input_buffer->length)
             {
-                if ((size_t)(input_end + 1 - input_buffer->content) >= input_buffer->length)
-                {
-                    /* prevent buffer overflow when last input character is a backslash */
-                    goto fail;
-                }
-                skipped_bytes++;
-                input_end++;
+                /* prevent buffer overflow when last input character is a backslash */
+                goto fail;
             }
-            input_end++;
+            skipped_bytes++;
+            input_end += 2;
         }
         if (((size_t)(input_end - input_buffer->content) >= input_buffer->length) || (*input_end != '\"'))
         {
@@ -747,7 +1421,15 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
     {
         if (*input_pointer != '\\')
         {
-            *output_pointer++ = *input_pointer++;
+            /* copy everything up to the next escape sequence at once */
+            const unsigned char *run_end = (const unsigned char*)memchr(input_pointer, '\\', (size_t)(input_end - input_pointer));
+            if (run_end == NULL)
+            {
+                run_end = input_end;
+            }
+            memcpy(output_pointer, input_pointer, (size_t)(run_end - input_pointer));
+            output_pointer += run_end - input_pointer;
+            input_pointer = run_end;
         }
         /* escape sequence */
         else
@@ -827,9 +1509,11 @@ fail:
 static cJSON_bool print_string_ptr(const unsigned char * const input, printbuffer * const output_buffer)
 {
     const unsigned char *input_pointer = NULL;
+    const unsigned char *input_end = NULL;
     unsigned char *output = NULL;
     unsigned char *output_pointer = NULL;
     size_t output_length = 0;
+    size_t run_length = 0;
     /* numbers of additional characters needed for escaping */
     size_t escape_characters = 0;
 
@@ -852,8 +1536,15 @@ static cJSON_bool print_string_ptr(const unsigned char * const input, printbuffe
     }
 
     /* set "flag" to 1 if something needs to be escaped */
-    for (input_pointer = input; *input_pointer; input_pointer++)
+    input_end = input + strlen((const char*)input);
+    for (input_pointer = input; input_pointer < input_end; input_pointer++)
     {
+        input_pointer += scan_print_special(input_pointer, (size_t)(input_end - input_pointer));
+        if (input_pointer == input_end)
+        {
+            break;
+        }
+
         switch (*input_pointer)
         {
             case '\"':
@@ -875,7 +1566,7 @@ static cJSON_bool print_string_ptr(const unsigned char * const input, printbuffe
                 break;
         }
     }
-    output_length = (size_t)(input_pointer - input) + escape_characters;
+    output_length = (size_t)(input_end - input) + escape_characters;
 
     output = ensure(output_buffer, output_length + sizeof("\"\""));
     if (output == NULL)
@@ -897,46 +1588,48 @@ static cJSON_bool print_string_ptr(const unsigned char * const input, printbuffe
     output[0] = '\"';
     output_pointer = output + 1;
     /* copy the string */
-    for (input_pointer = input; *input_pointer != '\0'; (void)input_pointer++, output_pointer++)
+    for (input_pointer = input; input_pointer < input_end; (void)input_pointer++, output_pointer++)
     {
-        if ((*input_pointer > 31) && (*input_pointer != '\"') && (*input_pointer != '\\'))
+        /* normal characters, copy up to the next one to escape */
+        run_length = scan_print_special(input_pointer, (size_t)(input_end - input_pointer));
+        memcpy(output_pointer, input_pointer, run_length);
+        input_pointer += run_length;
+        output_pointer += run_length;
+        if (input_pointer == input_end)
         {
-            /* normal character, copy */
-            *output_pointer = *input_pointer;
+            break;
         }
-        else
+
+        /* character needs to be escaped */
+        *output_pointer++ = '\\';
+        switch (*input_pointer)
         {
-            /* character needs to be escaped */
-            *output_pointer++ = '\\';
-            switch (*input_pointer)
-            {
-                case '\\':
-                    *output_pointer = '\\';
-                    break;
-                case '\"':
-                    *output_pointer = '\"';
-                    break;
-                case '\b':
-                    *output_pointer = 'b';
-                    break;
-                case '\f':
-                    *output_pointer = 'f';
-                    break;
-                case '\n':
-                    *output_pointer = 'n';
-                    break;
-                case '\r':
-                    *output_pointer = 'r';
-                    break;
-                case '\t':
-                    *output_pointer = 't';
-                    break;
-                default:
-                    /* escape and print as unicode codepoint */
-                    sprintf((char*)output_pointer, "u%04x", *input_pointer);
-                    output_pointer += 4;
-                    break;
-            }
+            case '\\':
+                *output_pointer = '\\';
+                break;
+            case '\"':
+                *output_pointer = '\"';
+                break;
+            case '\b':
+                *output_pointer = 'b';
+                break;
+            case '\f':
+                *output_pointer = 'f';
+                break;
+            case '\n':
+                *output_pointer = 'n';
+                break;
+            case '\r':
+                *output_pointer = 'r';
+                break;
+            case '\t':
+                *output_pointer = 't';
+                break;
+            default:
+                /* escape and print as unicode codepoint */
+                sprintf((char*)output_pointer, "u%04x", *input_pointer);
+                output_pointer += 4;
+                break;
         }
     }
     output[output_length + 1] = '\"';
@@ -967,9 +1660,9 @@ static parse_buffer *buffer_skip_whitespace(parse_buffer * const buffer)
         return NULL;
     }
 
-    while (can_access_at_index(buffer, 0) && (buffer_at_offset(buffer)[0] <= 32))
+    if (can_access_at_index(buffer, 0) && (buffer_at_offset(buffer)[0] <= 32))
     {
-       buffer->offset++;
+        buffer->offset += scan_whitespace(buffer_at_offset(buffer), buffer->length - buffer->offset);
     }
 
     if (buffer->offset == buffer->length)
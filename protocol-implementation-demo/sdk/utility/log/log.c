@@ -1,31 +1,89 @@
+
 #include <stdarg.h>
 #include <time.h>
+#include <pthread.h>
+#ifndef _WIN32
+#include <syslog.h>
+#endif
 #include "log.h"
+#include "mem.h"
+#include "le_error.h"
 
 //date [module] level <tag> file-func:line content
 #define LOG_FMT     "%s %s <%s> %s-%s:%d \r\n"
+#define LOG_ASYNC_FMT   "%s %s <%s> %s-%s:%d "
+
+#define LOG_RING_DEFAULT    256
+#define LOG_LEN_DEFAULT     256
+#define LOG_FLUSH_MS        20
+#define LOG_TRUNC_MARK      "...\n"
 
 static const char       *g_log_desc[] = {"DBG", "INF",
                                          "WRN", "ERR",
                                          "FTL"
                                         };
 
-static int g_log_lvl = LOG_LEVEL_INFO;
-static char *get_timestamp(char *buf, int len, time_t cur_time)
+typedef struct {
+    uint32_t len;
+    uint32_t lvl;
+    char     text[];
+} log_record;
+
+/* one producer (the owner thread) and one consumer (the flusher).
+ * rings outlive log_async_stop, a later start keeps using them with
+ * their original size.
+ */
+typedef struct log_ring {
+    struct log_ring *next;
+    unsigned int     size;
+    size_t           rec_size;
+    int              dead;          /* owner thread has exited */
+    uint64_t         head;
+    uint64_t         tail;
+    time_t           rate_sec;
+    unsigned int     rate_cnt;
+    uint64_t         rate_dropped;  /* not yet reported */
+    char            *records;
+} log_ring;
+
+int g_log_lvl = LOG_LEVEL_INFO;
+
+static volatile int     g_log_async = 0;
+static log_async_config g_log_cfg;
+static size_t           g_log_rec_size = 0;
+static FILE            *g_log_fp = NULL;
+static pthread_t        g_log_flusher;
+static pthread_mutex_t  g_log_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   g_log_cond = PTHREAD_COND_INITIALIZER;
+static log_ring        *g_log_rings = NULL;
+static log_stats        g_log_stats;
+static pthread_key_t    g_log_key;
+static pthread_once_t   g_log_once = PTHREAD_ONCE_INIT;
+
+static __thread log_ring *t_log_ring = NULL;
+static __thread time_t    t_log_sec = 0;
+static __thread char      t_log_date[32];
+
+/* localtime only when the second changes */
+static const char *get_timestamp(time_t cur_time)
 {
     struct tm tm_time;
 
+    if (cur_time == t_log_sec && t_log_date[0])
+        return t_log_date;
+
 #ifndef _WIN32
     localtime_r(&cur_time, &tm_time);
 #else
     localtime_s(&tm_time, &cur_time);
 #endif
 
-    snprintf(buf, len, "%d-%d-%d %d:%d:%d",
+    snprintf(t_log_date, sizeof(t_log_date), "%d-%d-%d %d:%d:%d",
              1900 + tm_time.tm_year, 1 + tm_time.tm_mon,
              tm_time.tm_mday, tm_time.tm_hour,
              tm_time.tm_min, tm_time.tm_sec);
-    return buf;
+    t_log_sec = cur_time;
+    return t_log_date;
 }
 
 void set_log_level(int lvl)
@@ -38,6 +96,274 @@ void set_log_level(int lvl)
     printf("set log level :  %d\n", lvl);
 }
 
+int get_log_level(void)
+{
+    return g_log_lvl;
+}
+
+static log_record *log_ring_slot(log_ring *ring, uint64_t seq)
+{
+    return (log_record *)(ring->records + (seq & (ring->size - 1)) * ring->rec_size);
+}
+
+/* the flusher frees the ring once it is drained */
+static void log_thread_exit(void *arg)
+{
+    log_ring *ring = arg;
+
+    __atomic_store_n(&ring->dead, 1, __ATOMIC_RELEASE);
+}
+
+static void log_once_init(void)
+{
+    pthread_key_create(&g_log_key, log_thread_exit);
+    atexit(log_async_stop);
+}
+
+static log_ring *log_get_ring(void)
+{
+    log_ring *ring = NULL;
+
+    if (t_log_ring)
+        return t_log_ring;
+
+    ring = mem_malloc(MEM_LOG, sizeof(log_ring));
+    if (!ring)
+        return NULL;
+    memset(ring, 0, sizeof(log_ring));
+    ring->size = g_log_cfg.ring_size;
+    ring->rec_size = g_log_rec_size;
+    ring->records = mem_malloc(MEM_LOG, ring->size * ring->rec_size);
+    if (!ring->records) {
+        mem_free(ring);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&g_log_lock);
+    ring->next = g_log_rings;
+    g_log_rings = ring;
+    pthread_mutex_unlock(&g_log_lock);
+
+    pthread_setspecific(g_log_key, ring);
+    t_log_ring = ring;
+    return ring;
+}
+
+/* caller owns @ring, returns 0 when the record may be queued */
+static int log_rate_check(log_ring *ring, time_t now)
+{
+    if (g_log_cfg.rate_limit == 0)
+        return 0;
+
+    if (now != ring->rate_sec) {
+        ring->rate_sec = now;
+        ring->rate_cnt = 0;
+    }
+    if (ring->rate_cnt >= g_log_cfg.rate_limit) {
+        ring->rate_dropped++;
+        __atomic_fetch_add(&g_log_stats.dropped_rate, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    ring->rate_cnt++;
+
+    return 0;
+}
+
+static void log_enqueue(LOG_LEVEL lvl, time_t now, cchar *t, cchar *f, cchar *func, int l, cchar *fmt, va_list ap)
+{
+    log_ring *ring = log_get_ring();
+    log_record *rec = NULL;
+    size_t room = 0;
+    uint64_t head = 0;
+    int n = 0, m = 0;
+
+    if (!ring) {
+        __atomic_fetch_add(&g_log_stats.dropped_full, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    room = ring->rec_size - sizeof(log_record);
+    if (log_rate_check(ring, now) != 0)
+        return;
+
+    head = ring->head;
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= ring->size) {
+        __atomic_fetch_add(&g_log_stats.dropped_full, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    rec = log_ring_slot(ring, head);
+    n = snprintf(rec->text, room, LOG_ASYNC_FMT, get_timestamp(now), g_log_desc[lvl], t, f, func, l);
+    if (n < 0 || (size_t)n >= room)
+        n = room - 1;
+    if (ring->rate_dropped) {
+        /* report what the rate limit swallowed since the last record */
+        m = snprintf(rec->text + n, room - n, "(%llu records dropped) ",
+                     (unsigned long long)ring->rate_dropped);
+        n += (m > 0 && (size_t)m < room - n) ? m : 0;
+        ring->rate_dropped = 0;
+    }
+    m = vsnprintf(rec->text + n, room - n, fmt, ap);
+    if (m < 0)
+        m = 0;
+    if ((size_t)m >= room - n) {
+        n = room - 1;
+        memcpy(rec->text + n - strlen(LOG_TRUNC_MARK), LOG_TRUNC_MARK, strlen(LOG_TRUNC_MARK));
+        __atomic_fetch_add(&g_log_stats.truncated, 1, __ATOMIC_RELAXED);
+    } else {
+        n += m;
+    }
+    if (n > 0 && rec->text[n - 1] != '\n' && (size_t)n < room - 1)
+        rec->text[n++] = '\n';
+    rec->len = n;
+    rec->lvl = lvl;
+
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void log_write_record(const log_record *rec)
+{
+#ifndef _WIN32
+    static const int prio[] = {LOG_DEBUG, LOG_INFO, LOG_WARNING, LOG_ERR, LOG_CRIT};
+
+    if (g_log_cfg.use_syslog) {
+        syslog(prio[rec->lvl < 4 ? rec->lvl : 4], "%.*s", (int)rec->len, rec->text);
+        return;
+    }
+#endif
+    fwrite(rec->text, 1, rec->len, g_log_fp ? g_log_fp : stdout);
+}
+
+/* called by the flusher with g_log_lock held */
+static int log_drain(void)
+{
+    log_ring **link = &g_log_rings;
+    log_ring *ring = NULL;
+    uint64_t head = 0, tail = 0;
+    int written = 0, dead = 0;
+
+    while ((ring = *link) != NULL) {
+        dead = __atomic_load_n(&ring->dead, __ATOMIC_ACQUIRE);
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        for (tail = ring->tail; tail != head; tail++) {
+            log_write_record(log_ring_slot(ring, tail));
+            written++;
+        }
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+        if (dead) {
+            *link = ring->next;
+            mem_free(ring->records);
+            mem_free(ring);
+            continue;
+        }
+        link = &ring->next;
+    }
+
+    if (written) {
+        __atomic_fetch_add(&g_log_stats.written, written, __ATOMIC_RELAXED);
+        if (!g_log_cfg.use_syslog)
+            fflush(g_log_fp ? g_log_fp : stdout);
+    }
+    return written;
+}
+
+static void *log_flush_proc(void *arg)
+{
+    struct timespec ts;
+
+    pthread_mutex_lock(&g_log_lock);
+    while (g_log_async) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += LOG_FLUSH_MS * 1000000L;
+        ts.tv_sec += ts.tv_nsec / 1000000000L;
+        ts.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&g_log_cond, &g_log_lock, &ts);
+        log_drain();
+    }
+    log_drain();
+    pthread_mutex_unlock(&g_log_lock);
+
+    return NULL;
+}
+
+int log_async_start(const log_async_config *cfg)
+{
+    unsigned int size = 1;
+
+    if (!cfg)
+        return LE_ERROR_INVAILD_PARAM;
+    pthread_once(&g_log_once, log_once_init);
+    if (g_log_async)
+        log_async_stop();
+
+    memcpy(&g_log_cfg, cfg, sizeof(log_async_config));
+    while (size < (cfg->ring_size ? cfg->ring_size : LOG_RING_DEFAULT))
+        size <<= 1;
+    g_log_cfg.ring_size = size;
+    g_log_cfg.max_len = cfg->max_len ? cfg->max_len : LOG_LEN_DEFAULT;
+    if (g_log_cfg.max_len < 64)
+        g_log_cfg.max_len = 64;
+    g_log_rec_size = (sizeof(log_record) + g_log_cfg.max_len + 7) & ~(size_t)7;
+    g_log_cfg.file_path = NULL;
+
+#ifndef _WIN32
+    if (cfg->use_syslog) {
+        openlog("leda", LOG_PID, LOG_USER);
+    } else
+#endif
+    if (cfg->file_path) {
+        g_log_fp = fopen(cfg->file_path, "a");
+        if (!g_log_fp) {
+            printf("failed to open log file %s.\n", cfg->file_path);
+            return LE_ERROR_WRITING_FILE;
+        }
+    }
+
+    g_log_async = 1;
+    if (pthread_create(&g_log_flusher, NULL, log_flush_proc, NULL) != 0) {
+        g_log_async = 0;
+        if (g_log_fp) {
+            fclose(g_log_fp);
+            g_log_fp = NULL;
+        }
+        return LE_ERROR_UNKNOWN;
+    }
+
+    return LE_SUCCESS;
+}
+
+void log_async_stop(void)
+{
+    if (!g_log_async)
+        return;
+
+    pthread_mutex_lock(&g_log_lock);
+    g_log_async = 0;
+    pthread_cond_signal(&g_log_cond);
+    pthread_mutex_unlock(&g_log_lock);
+    pthread_join(g_log_flusher, NULL);
+
+#ifndef _WIN32
+    if (g_log_cfg.use_syslog)
+        closelog();
+#endif
+    if (g_log_fp) {
+        fclose(g_log_fp);
+        g_log_fp = NULL;
+    }
+}
+
+void log_get_stats(log_stats *stats)
+{
+    if (!stats)
+        return;
+
+    stats->written = __atomic_load_n(&g_log_stats.written, __ATOMIC_RELAXED);
+    stats->dropped_full = __atomic_load_n(&g_log_stats.dropped_full, __ATOMIC_RELAXED);
+    stats->dropped_rate = __atomic_load_n(&g_log_stats.dropped_rate, __ATOMIC_RELAXED);
+    stats->truncated = __atomic_load_n(&g_log_stats.truncated, __ATOMIC_RELAXED);
+}
+
 #define color_len_fin strlen(COL_DEF)
 #define color_len_start strlen(COL_RED)
 void log_print(LOG_LEVEL lvl, cchar *color, cchar *t, cchar *f, cchar *func, int l, cchar *fmt, ...)
@@ -50,7 +376,6 @@ void log_print(LOG_LEVEL lvl, cchar *color, cchar *t, cchar *f, cchar *func, int
     va_start(ap, fmt);
 
     char *tmp = NULL;
-    char buf_date[20] = {0};
     time_t cur_time = time(NULL);
 
     t = !t ? "\b" : t;
@@ -62,12 +387,18 @@ void log_print(LOG_LEVEL lvl, cchar *color, cchar *t, cchar *f, cchar *func, int
         f = tmp + 1;
     }
 
+    if (g_log_async) {
+        log_enqueue(lvl, cur_time, t, f, func, l, fmt, ap);
+        va_end(ap);
+        return;
+    }
+
     //add color support
     if (color) {
         puts(color);
     }
 
-    printf(LOG_FMT, get_timestamp(buf_date, 20, cur_time), g_log_desc[lvl], t, f, func, l);
+    printf(LOG_FMT, get_timestamp(cur_time), g_log_desc[lvl], t, f, func, l);
 
     vprintf(fmt, ap);
 
@@ -77,4 +408,3 @@ void log_print(LOG_LEVEL lvl, cchar *color, cchar *t, cchar *f, cchar *func, int
 
     va_end(ap);
 }
-
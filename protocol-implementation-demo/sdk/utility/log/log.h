@@ -29,32 +29,72 @@ typedef const char cchar;
 #define COL_CYN "\x1B[36m"
 #define COL_MAG "\x1B[35m"
 
+typedef struct {
+    const char   *file_path;    /* append to this file, NULL writes to stdout */
+    int           use_syslog;   /* write to syslog instead of a file */
+    unsigned int  ring_size;    /* records buffered per thread, 0 for 256 */
+    unsigned int  max_len;      /* longer records are truncated, 0 for 256 */
+    unsigned int  rate_limit;   /* records per second per thread, 0 unlimited */
+} log_async_config;
+
+typedef struct {
+    uint64_t written;
+    uint64_t dropped_full;      /* ring of the calling thread was full */
+    uint64_t dropped_rate;      /* over rate_limit */
+    uint64_t truncated;
+} log_stats;
+
 void set_log_level(int lvl);
 
+int get_log_level(void);
+
+/* hand records to a background flusher instead of printing in the caller.
+ * callers never block, records are dropped when the ring is full.
+ */
+int log_async_start(const log_async_config *cfg);
+
+/* flush what is buffered and go back to printing in the caller. */
+void log_async_stop(void);
+
+void log_get_stats(log_stats *stats);
+
 void log_print(LOG_LEVEL lvl, cchar *color, cchar *t, cchar *f, cchar *func, int l, cchar *fmt, ...);
 
+/* sites below this level compile to nothing, e.g. -DLEDA_LOG_MIN_LEVEL=2
+ * keeps only warnings and errors. must be a plain number for #if.
+ */
+#ifndef LEDA_LOG_MIN_LEVEL
+#define LEDA_LOG_MIN_LEVEL 0
+#endif
+
+extern int g_log_lvl;
+
+/* level checked before the arguments are evaluated */
+#define log_enabled(lvl) \
+    ((lvl) >= LEDA_LOG_MIN_LEVEL && (lvl) >= g_log_lvl)
+
 #ifndef _WIN32
 #define log_d(tag, fmt,args...) \
-    log_print(LOG_LEVEL_DEBUG,COL_WHE,tag,__FILE__,__FUNCTION__,__LINE__,fmt,##args)
+    do { if (log_enabled(LOG_LEVEL_DEBUG)) log_print(LOG_LEVEL_DEBUG,COL_WHE,tag,__FILE__,__FUNCTION__,__LINE__,fmt,##args); } while (0)
 #define log_i(tag, fmt,args...) \
-    log_print(LOG_LEVEL_INFO,COL_GRE,tag,__FILE__,__FUNCTION__,__LINE__,fmt,##args)
+    do { if (log_enabled(LOG_LEVEL_INFO)) log_print(LOG_LEVEL_INFO,COL_GRE,tag,__FILE__,__FUNCTION__,__LINE__,fmt,##args); } while (0)
 #define log_w(tag, fmt,args...) \
-    log_print(LOG_LEVEL_WARN,COL_CYN,tag,__FILE__,__FUNCTION__,__LINE__,fmt,##args)
+    do { if (log_enabled(LOG_LEVEL_WARN)) log_print(LOG_LEVEL_WARN,COL_CYN,tag,__FILE__,__FUNCTION__,__LINE__,fmt,##args); } while (0)
 #define log_e(tag,fmt,args...) \
-    log_print(LOG_LEVEL_ERR,COL_YEL,tag,__FILE__,__FUNCTION__,__LINE__,fmt,##args)
+    do { if (log_enabled(LOG_LEVEL_ERR)) log_print(LOG_LEVEL_ERR,COL_YEL,tag,__FILE__,__FUNCTION__,__LINE__,fmt,##args); } while (0)
 #define log_f(tag,fmt,args...) \
-    log_print(LOG_LEVEL_FATAL,COL_RED,tag,__FILE__,__FUNCTION__,__LINE__,fmt,##args)
+    do { if (log_enabled(LOG_LEVEL_FATAL)) log_print(LOG_LEVEL_FATAL,COL_RED,tag,__FILE__,__FUNCTION__,__LINE__,fmt,##args); } while (0)
 #else
 #define log_d(tag, fmt, ...) \
-    log_print(LOG_LEVEL_DEBUG,COL_WHE,tag,__FILE__,__FUNCTION__,__LINE__,fmt,__VA_ARGS__)
+    do { if (log_enabled(LOG_LEVEL_DEBUG)) log_print(LOG_LEVEL_DEBUG,COL_WHE,tag,__FILE__,__FUNCTION__,__LINE__,fmt,__VA_ARGS__); } while (0)
 #define log_i(tag, fmt, ...) \
-    log_print(LOG_LEVEL_INFO,COL_GRE,tag,__FILE__,__FUNCTION__,__LINE__,fmt,__VA_ARGS__)
+    do { if (log_enabled(LOG_LEVEL_INFO)) log_print(LOG_LEVEL_INFO,COL_GRE,tag,__FILE__,__FUNCTION__,__LINE__,fmt,__VA_ARGS__); } while (0)
 #define log_w(tag, fmt, ...) \
-    log_print(LOG_LEVEL_WARN,COL_CYN,tag,__FILE__,__FUNCTION__,__LINE__,fmt,__VA_ARGS__)
+    do { if (log_enabled(LOG_LEVEL_WARN)) log_print(LOG_LEVEL_WARN,COL_CYN,tag,__FILE__,__FUNCTION__,__LINE__,fmt,__VA_ARGS__); } while (0)
 #define log_e(tag,fmt, ...) \
-    log_print(LOG_LEVEL_ERR,COL_YEL,tag,__FILE__,__FUNCTION__,__LINE__,fmt,__VA_ARGS__)
+    do { if (log_enabled(LOG_LEVEL_ERR)) log_print(LOG_LEVEL_ERR,COL_YEL,tag,__FILE__,__FUNCTION__,__LINE__,fmt,__VA_ARGS__); } while (0)
 #define log_f(tag,fmt, ...) \
-    log_print(LOG_LEVEL_FATAL,COL_RED,tag,__FILE__,__FUNCTION__,__LINE__,fmt,__VA_ARGS__)
+    do { if (log_enabled(LOG_LEVEL_FATAL)) log_print(LOG_LEVEL_FATAL,COL_RED,tag,__FILE__,__FUNCTION__,__LINE__,fmt,__VA_ARGS__); } while (0)
 #endif
 
 #if defined(__cplusplus) /* If this is a C++ compiler, use C linkage */
@@ -0,0 +1,361 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "mem.h"
+#include "le_error.h"
+
+#define MEM_MAGIC       0x6c65646du     /* "leda" */
+#define MEM_ARENA_MAGIC 0x6172656eu     /* "aren", freeing it is a no-op */
+#define MEM_ARENA_CHUNK (16 * 1024)
+#define MEM_ALIGN(n)    (((n) + 15) & ~(size_t)15)
+
+/* keeps the malloc alignment for the block behind it */
+typedef union {
+    struct {
+        size_t size;
+        uint32_t module;
+        uint32_t magic;
+    } h;
+    char pad[16];
+} mem_head;
+
+typedef struct {
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t failures;
+    uint64_t in_use;
+    uint64_t peak;
+} __attribute__((aligned(64))) mem_counter;
+
+/* data follows the header, 16 byte aligned */
+typedef union {
+    struct {
+        void *prev;
+        size_t size;        /* usable bytes */
+        size_t used;        /* bytes in use when a newer chunk was pushed */
+    } c;
+    char pad[32];
+} mem_chunk;
+
+static mem_allocator g_alloc = { malloc, realloc, free, 0 };
+static int g_custom = 0;
+static uint64_t g_total = 0;            /* bytes in use by all modules, only kept with max_bytes */
+static int g_started = 0;               /* mem_set_allocator is refused after the first allocation */
+static mem_counter g_counters[MEM_MODULE_MAX];
+
+static __thread mem_chunk *t_chunk = NULL;     /* chunk being carved */
+static __thread size_t t_used = 0;
+static __thread mem_chunk *t_spare = NULL;     /* one free chunk kept for the next scope */
+static __thread int t_depth = 0;
+static __thread int t_paused = 0;
+static __thread int t_arena = 0;               /* t_depth && !t_paused */
+static pthread_key_t g_spare_key;
+static pthread_once_t g_spare_once = PTHREAD_ONCE_INIT;
+
+int mem_set_allocator(const mem_allocator *alloc)
+{
+    if (!alloc || (!alloc->malloc_fn != !alloc->free_fn))
+        return LE_ERROR_INVAILD_PARAM;
+
+    if (__atomic_load_n(&g_started, __ATOMIC_RELAXED))
+        return LE_ERROR_INVAILD_PARAM;
+
+    if (alloc->malloc_fn) {
+        g_alloc.malloc_fn = alloc->malloc_fn;
+        g_alloc.realloc_fn = alloc->realloc_fn;
+        g_alloc.free_fn = alloc->free_fn;
+        g_custom = 1;
+    }
+    g_alloc.max_bytes = alloc->max_bytes;
+
+    return LE_SUCCESS;
+}
+
+int mem_custom_allocator(void)
+{
+    return g_custom;
+}
+
+static int mem_charge(mem_counter *c, size_t size)
+{
+    uint64_t in_use = 0, peak = 0;
+
+    if (g_alloc.max_bytes &&
+        __atomic_add_fetch(&g_total, size, __ATOMIC_RELAXED) > g_alloc.max_bytes) {
+        __atomic_sub_fetch(&g_total, size, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&c->failures, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+
+    in_use = __atomic_add_fetch(&c->in_use, size, __ATOMIC_RELAXED);
+    peak = __atomic_load_n(&c->peak, __ATOMIC_RELAXED);
+    while (in_use > peak &&
+           !__atomic_compare_exchange_n(&c->peak, &peak, in_use, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+    return 0;
+}
+
+static void mem_uncharge(mem_counter *c, size_t size)
+{
+    if (g_alloc.max_bytes)
+        __atomic_sub_fetch(&g_total, size, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&c->in_use, size, __ATOMIC_RELAXED);
+}
+
+static void *mem_heap_alloc(mem_module mod, size_t size)
+{
+    mem_counter *c = NULL;
+    mem_head *head = NULL;
+
+    if ((unsigned int)mod >= MEM_MODULE_MAX || size > SIZE_MAX - sizeof(mem_head))
+        return NULL;
+
+    c = &g_counters[mod];
+    if (!__atomic_load_n(&g_started, __ATOMIC_RELAXED))
+        __atomic_store_n(&g_started, 1, __ATOMIC_RELAXED);
+    if (mem_charge(c, size) != 0)
+        return NULL;
+
+    head = g_alloc.malloc_fn(sizeof(mem_head) + size);
+    if (!head) {
+        mem_uncharge(c, size);
+        __atomic_fetch_add(&c->failures, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    head->h.size = size;
+    head->h.module = mod;
+    head->h.magic = MEM_MAGIC;
+    __atomic_fetch_add(&c->allocs, 1, __ATOMIC_RELAXED);
+
+    return head + 1;
+}
+
+static void *mem_arena_alloc(size_t size)
+{
+    size_t need = sizeof(mem_head) + MEM_ALIGN(size);
+    mem_chunk *chunk = NULL;
+    mem_head *head = NULL;
+
+    if (size > SIZE_MAX - sizeof(mem_head) - MEM_ARENA_CHUNK)
+        return NULL;
+
+    if (!t_chunk || t_used + need > t_chunk->c.size) {
+        if (t_spare && t_spare->c.size >= need) {
+            chunk = t_spare;
+            t_spare = NULL;
+        } else {
+            chunk = mem_heap_alloc(MEM_JSON, sizeof(mem_chunk) + (need > MEM_ARENA_CHUNK ? need : MEM_ARENA_CHUNK));
+            if (!chunk)
+                return NULL;
+            chunk->c.size = need > MEM_ARENA_CHUNK ? need : MEM_ARENA_CHUNK;
+        }
+        if (t_chunk)
+            t_chunk->c.used = t_used;
+        chunk->c.prev = t_chunk;
+        t_chunk = chunk;
+        t_used = 0;
+    }
+
+    head = (mem_head *)((char *)(t_chunk + 1) + t_used);
+    head->h.size = size;
+    head->h.module = MEM_JSON;
+    head->h.magic = MEM_ARENA_MAGIC;
+    t_used += need;
+
+    return head + 1;
+}
+
+void *mem_malloc(mem_module mod, size_t size)
+{
+    if (t_arena && mod == MEM_JSON)
+        return mem_arena_alloc(size);
+
+    return mem_heap_alloc(mod, size);
+}
+
+void *mem_calloc(mem_module mod, size_t nmemb, size_t size)
+{
+    void *p = NULL;
+
+    if (size && nmemb > SIZE_MAX / size)
+        return NULL;
+
+    p = mem_malloc(mod, nmemb * size);
+    if (p)
+        memset(p, 0, nmemb * size);
+
+    return p;
+}
+
+void *mem_realloc(mem_module mod, void *ptr, size_t size)
+{
+    mem_head *head = NULL, *tmp = NULL;
+    mem_counter *c = NULL;
+    size_t old = 0;
+
+    if (!ptr)
+        return mem_malloc(mod, size);
+
+    if (!size) {
+        mem_free(ptr);
+        return NULL;
+    }
+
+    /* the block stays with the module that allocated it */
+    head = (mem_head *)ptr - 1;
+    old = head->h.size;
+    c = &g_counters[head->h.module];
+
+    if (head->h.magic == MEM_ARENA_MAGIC) {
+        /* the last block of the chunk grows or shrinks in place, e.g. a print buffer */
+        if (t_arena && t_chunk && (char *)ptr + MEM_ALIGN(old) == (char *)(t_chunk + 1) + t_used &&
+            size <= SIZE_MAX - MEM_ARENA_CHUNK &&
+            t_used - MEM_ALIGN(old) + MEM_ALIGN(size) <= t_chunk->c.size) {
+            t_used = t_used - MEM_ALIGN(old) + MEM_ALIGN(size);
+            head->h.size = size;
+            return ptr;
+        }
+        tmp = mem_malloc((mem_module)head->h.module, size);
+        if (tmp)
+            memcpy(tmp, ptr, old < size ? old : size);
+        return tmp;
+    }
+
+    if (!g_alloc.realloc_fn) {
+        tmp = mem_malloc((mem_module)head->h.module, size);
+        if (!tmp)
+            return NULL;
+        memcpy(tmp, ptr, old < size ? old : size);
+        mem_free(ptr);
+        return tmp;
+    }
+
+    if (size > SIZE_MAX - sizeof(mem_head))
+        return NULL;
+    if (size > old && mem_charge(c, size - old) != 0)
+        return NULL;
+
+    tmp = g_alloc.realloc_fn(head, sizeof(mem_head) + size);
+    if (!tmp) {
+        if (size > old)
+            mem_uncharge(c, size - old);
+        __atomic_fetch_add(&c->failures, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    if (size < old)
+        mem_uncharge(c, old - size);
+    tmp->h.size = size;
+
+    return tmp + 1;
+}
+
+char *mem_strdup(mem_module mod, const char *s)
+{
+    size_t len = 0;
+    char *p = NULL;
+
+    if (!s)
+        return NULL;
+
+    len = strlen(s) + 1;
+    p = mem_malloc(mod, len);
+    if (p)
+        memcpy(p, s, len);
+
+    return p;
+}
+
+void mem_free(void *ptr)
+{
+    mem_head *head = NULL;
+    mem_counter *c = NULL;
+
+    if (!ptr)
+        return;
+
+    head = (mem_head *)ptr - 1;
+    if (head->h.magic == MEM_ARENA_MAGIC)
+        return;         /* released with its arena scope */
+    if (head->h.magic != MEM_MAGIC || head->h.module >= MEM_MODULE_MAX)
+        abort();        /* not from mem_malloc, or freed twice */
+
+    c = &g_counters[head->h.module];
+    mem_uncharge(c, head->h.size);
+    __atomic_fetch_add(&c->frees, 1, __ATOMIC_RELAXED);
+
+    head->h.magic = 0;
+    g_alloc.free_fn(head);
+}
+
+void mem_get_stats(mem_module mod, mem_stats *stats)
+{
+    mem_counter *c = NULL;
+
+    if ((unsigned int)mod >= MEM_MODULE_MAX || !stats)
+        return;
+
+    c = &g_counters[mod];
+    stats->allocs = __atomic_load_n(&c->allocs, __ATOMIC_RELAXED);
+    stats->frees = __atomic_load_n(&c->frees, __ATOMIC_RELAXED);
+    stats->failures = __atomic_load_n(&c->failures, __ATOMIC_RELAXED);
+    stats->in_use = __atomic_load_n(&c->in_use, __ATOMIC_RELAXED);
+    stats->peak = __atomic_load_n(&c->peak, __ATOMIC_RELAXED);
+}
+
+static void mem_spare_free(void *arg)
+{
+    mem_free(arg);
+}
+
+static void mem_spare_once(void)
+{
+    pthread_key_create(&g_spare_key, mem_spare_free);
+}
+
+void mem_arena_begin(mem_arena_mark *mark)
+{
+    mark->chunk = t_chunk;
+    mark->used = t_used;
+    t_depth++;
+    t_arena = !t_paused;
+}
+
+void mem_arena_end(const mem_arena_mark *mark)
+{
+    mem_chunk *chunk = NULL;
+
+    while (t_chunk && t_chunk != mark->chunk) {
+        chunk = t_chunk;
+        t_chunk = chunk->c.prev;
+
+        /* keep a standard chunk for the next scope, it is freed at thread exit */
+        if (!t_spare && chunk->c.size == MEM_ARENA_CHUNK) {
+            if (pthread_once(&g_spare_once, mem_spare_once) == 0 &&
+                pthread_setspecific(g_spare_key, chunk) == 0) {
+                t_spare = chunk;
+                continue;
+            }
+        }
+        mem_free(chunk);
+    }
+
+    t_used = t_chunk ? mark->used : 0;
+    if (t_depth > 0)
+        t_depth--;
+    t_arena = t_depth && !t_paused;
+}
+
+void mem_arena_pause(void)
+{
+    t_paused++;
+    t_arena = 0;
+}
+
+void mem_arena_resume(void)
+{
+    if (t_paused > 0)
+        t_paused--;
+    t_arena = t_depth && !t_paused;
+}
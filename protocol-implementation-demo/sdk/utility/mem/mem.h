@@ -0,0 +1,94 @@
+#ifndef _MEM_H_
+#define _MEM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Heap allocations of the SDK.
+ *
+ * Every block carries a small header with its size and owning module, so
+ * frees need no module and usage is tracked per module. By default blocks
+ * come from the C library; an allocator installed before the first
+ * allocation replaces it for the whole process lifetime of the SDK.
+ */
+
+typedef enum {
+    MEM_CORE = 0,       /* sdk/leda*.c */
+    MEM_JSON,           /* cJSON trees and printed text */
+    MEM_WS,             /* websocket client, send queue and libwebsockets */
+    MEM_THREADPOOL,
+    MEM_LOG,
+    MEM_SPOOL,
+    MEM_TRACE,
+    MEM_COMPRESS,       /* zdict and its zlib streams */
+    MEM_MODULE_MAX
+} mem_module;
+
+typedef struct {
+    void *(*malloc_fn)(size_t size);
+    void *(*realloc_fn)(void *ptr, size_t size);    /* optional */
+    void (*free_fn)(void *ptr);
+    size_t max_bytes;                               /* 0 for no limit */
+} mem_allocator;
+
+typedef struct {
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t failures;      /* allocations refused by the limit or the allocator */
+    uint64_t in_use;        /* bytes requested and not freed yet */
+    uint64_t peak;
+} mem_stats;
+
+/* fails once anything has been allocated, blocks must be freed by the allocator that made them */
+int mem_set_allocator(const mem_allocator *alloc);
+
+/* non zero when mem_set_allocator installed an allocator */
+int mem_custom_allocator(void);
+
+void *mem_malloc(mem_module mod, size_t size);
+
+void *mem_calloc(mem_module mod, size_t nmemb, size_t size);
+
+/* a NULL @ptr allocates, a 0 @size frees and returns NULL */
+void *mem_realloc(mem_module mod, void *ptr, size_t size);
+
+char *mem_strdup(mem_module mod, const char *s);
+
+void mem_free(void *ptr);
+
+void mem_get_stats(mem_module mod, mem_stats *stats);
+
+/*
+ * Per thread arena for short lived cJSON trees.
+ *
+ * Between mem_arena_begin and mem_arena_end the MEM_JSON allocations of
+ * the calling thread are carved from 16KB chunks: freeing them is a no-op
+ * and mem_arena_end releases everything allocated since the matching
+ * begin at once. Scopes nest. Nothing allocated in a scope may be used
+ * after it ends, trees handed to other threads are made between
+ * mem_arena_pause and mem_arena_resume.
+ */
+typedef struct {
+    void *chunk;
+    size_t used;
+} mem_arena_mark;
+
+void mem_arena_begin(mem_arena_mark *mark);
+
+void mem_arena_end(const mem_arena_mark *mark);
+
+/* allocate from the heap again until mem_arena_resume, pauses nest */
+void mem_arena_pause(void);
+
+void mem_arena_resume(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
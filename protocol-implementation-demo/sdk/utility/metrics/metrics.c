@@ -0,0 +1,171 @@
+#include <string.h>
+#include <time.h>
+#include "metrics.h"
+
+#define METRICS_SHARDS      8
+#define HIST_SUB_BITS       3                       /* 8 linear buckets per power of two */
+#define HIST_SUB_COUNT      (1 << HIST_SUB_BITS)
+#define HIST_MAX_EXP        36                      /* samples above 2^36 us are clamped */
+#define HIST_BUCKETS        ((HIST_MAX_EXP - HIST_SUB_BITS + 2) * HIST_SUB_COUNT)
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[HIST_BUCKETS];
+} hist_shard;
+
+typedef struct {
+    uint64_t   counters[METRIC_COUNTER_MAX];
+    hist_shard hists[METRIC_HIST_MAX];
+} __attribute__((aligned(64))) metrics_shard;
+
+static metrics_shard g_shards[METRICS_SHARDS];
+static unsigned int  g_next_shard = 0;
+static __thread int  t_shard = -1;
+
+static metrics_shard *metrics_get_shard(void)
+{
+    if (t_shard < 0)
+        t_shard = __atomic_fetch_add(&g_next_shard, 1, __ATOMIC_RELAXED) % METRICS_SHARDS;
+
+    return &g_shards[t_shard];
+}
+
+static int hist_bucket(uint64_t v)
+{
+    int exp = 0;
+
+    if (v < HIST_SUB_COUNT)
+        return (int)v;
+
+    exp = 63 - __builtin_clzll(v);
+    if (exp > HIST_MAX_EXP)
+        return HIST_BUCKETS - 1;
+
+    return (exp - HIST_SUB_BITS + 1) * HIST_SUB_COUNT +
+           (int)((v >> (exp - HIST_SUB_BITS)) & (HIST_SUB_COUNT - 1));
+}
+
+/* largest value that falls in @bucket */
+static uint64_t hist_bucket_upper(int bucket)
+{
+    int exp = 0;
+    uint64_t sub = 0;
+
+    if (bucket < HIST_SUB_COUNT)
+        return (uint64_t)bucket;
+
+    exp = bucket / HIST_SUB_COUNT + HIST_SUB_BITS - 1;
+    sub = (uint64_t)(bucket % HIST_SUB_COUNT);
+
+    return ((HIST_SUB_COUNT + sub + 1) << (exp - HIST_SUB_BITS)) - 1;
+}
+
+uint64_t metrics_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void metrics_add(metric_counter id, uint64_t value)
+{
+    if ((unsigned int)id >= METRIC_COUNTER_MAX)
+        return;
+
+    __atomic_fetch_add(&metrics_get_shard()->counters[id], value, __ATOMIC_RELAXED);
+}
+
+void metrics_observe(metric_hist id, uint64_t us)
+{
+    hist_shard *h = NULL;
+    uint64_t max = 0;
+
+    if ((unsigned int)id >= METRIC_HIST_MAX)
+        return;
+
+    h = &metrics_get_shard()->hists[id];
+    __atomic_fetch_add(&h->buckets[hist_bucket(us)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum, us, __ATOMIC_RELAXED);
+
+    max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+    while (us > max &&
+           !__atomic_compare_exchange_n(&h->max, &max, us, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+uint64_t metrics_counter(metric_counter id)
+{
+    uint64_t total = 0;
+    int i = 0;
+
+    if ((unsigned int)id >= METRIC_COUNTER_MAX)
+        return 0;
+
+    for (i = 0; i < METRICS_SHARDS; i++)
+        total += __atomic_load_n(&g_shards[i].counters[id], __ATOMIC_RELAXED);
+
+    return total;
+}
+
+static uint64_t hist_percentile(const uint64_t *buckets, uint64_t count, int pct)
+{
+    uint64_t rank = (count * pct + 99) / 100;
+    uint64_t seen = 0;
+    int i = 0;
+
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= rank)
+            return hist_bucket_upper(i);
+    }
+
+    return hist_bucket_upper(HIST_BUCKETS - 1);
+}
+
+void metrics_hist_summary(metric_hist id, metric_hist_summary *summary)
+{
+    static __thread uint64_t buckets[HIST_BUCKETS];
+    hist_shard *h = NULL;
+    uint64_t count = 0;
+    uint64_t max = 0;
+    int i = 0, j = 0;
+
+    if (!summary)
+        return;
+    memset(summary, 0, sizeof(metric_hist_summary));
+    if ((unsigned int)id >= METRIC_HIST_MAX)
+        return;
+
+    memset(buckets, 0, sizeof(buckets));
+    for (i = 0; i < METRICS_SHARDS; i++) {
+        h = &g_shards[i].hists[id];
+        for (j = 0; j < HIST_BUCKETS; j++)
+            buckets[j] += __atomic_load_n(&h->buckets[j], __ATOMIC_RELAXED);
+        summary->sum += __atomic_load_n(&h->sum, __ATOMIC_RELAXED);
+        max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+        if (max > summary->max)
+            summary->max = max;
+    }
+
+    /* count from the buckets so the percentiles agree with it */
+    for (j = 0; j < HIST_BUCKETS; j++)
+        count += buckets[j];
+    summary->count = count;
+    if (count == 0)
+        return;
+
+    summary->p50 = hist_percentile(buckets, count, 50);
+    summary->p90 = hist_percentile(buckets, count, 90);
+    summary->p99 = hist_percentile(buckets, count, 99);
+    if (summary->p99 > summary->max)
+        summary->p99 = summary->max;
+    if (summary->p90 > summary->max)
+        summary->p90 = summary->max;
+    if (summary->p50 > summary->max)
+        summary->p50 = summary->max;
+}
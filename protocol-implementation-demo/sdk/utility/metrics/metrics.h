@@ -0,0 +1,76 @@
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Process wide counters and latency histograms.
+ *
+ * Updates go to one of METRICS_SHARDS cache line aligned shards picked per
+ * thread, so concurrent writers do not bounce the same line. Reads sum the
+ * shards and are only eventually consistent.
+ */
+
+typedef enum {
+    METRIC_MSGS_SENT = 0,
+    METRIC_BYTES_SENT,
+    METRIC_MSGS_RECV,
+    METRIC_BYTES_RECV,
+    METRIC_SEND_QUEUE_FULL,     /* msgs rejected because the send ring was full */
+    METRIC_RECV_DROPPED,        /* msgs dropped because a recv lane was full */
+    METRIC_PARSE_FAILURES,
+    METRIC_CONNECTS,
+    METRIC_DISCONNECTS,
+    METRIC_REPLY_TIMEOUTS,
+    METRIC_BATCHES_SENT,        /* frames carrying more than one report */
+    METRIC_BATCHED_MSGS,        /* reports sent inside those frames */
+    METRIC_BATCH_DROPPED,       /* batched reports that could not be spooled, tracked or sent */
+    METRIC_TLS_HANDSHAKES,
+    METRIC_TLS_RESUMED,         /* handshakes that reused a previous session */
+    METRIC_CACHE_HITS,          /* properties of getProperty answered from the cache */
+    METRIC_CACHE_MISSES,        /* properties of getProperty passed to the callback */
+    METRIC_REPORT_SUPPRESSED,   /* reported properties dropped by the change filter */
+    METRIC_COUNTER_MAX
+} metric_counter;
+
+typedef enum {
+    METRIC_HIST_ENQUEUE_TO_WRITE = 0,   /* send ring push to lws_write */
+    METRIC_HIST_REQUEST_RTT,            /* request sent to reply received */
+    METRIC_HIST_CALLBACK,               /* user callback of a method */
+    METRIC_HIST_TLS_HANDSHAKE,          /* TLS handshake start to finish */
+    METRIC_HIST_CONNECT,                /* connect request to websocket established */
+    METRIC_HIST_MAX
+} metric_hist;
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+} metric_hist_summary;
+
+uint64_t metrics_now_us(void);
+
+void metrics_add(metric_counter id, uint64_t value);
+
+#define metrics_inc(id) metrics_add((id), 1)
+
+/* record a sample in microseconds. */
+void metrics_observe(metric_hist id, uint64_t us);
+
+uint64_t metrics_counter(metric_counter id);
+
+/* percentiles are the upper bound of the bucket, within 12.5% of the sample. */
+void metrics_hist_summary(metric_hist id, metric_hist_summary *summary);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,337 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "spool.h"
+#include "mem.h"
+#include "le_error.h"
+
+#define SPOOL_MAGIC         0x4c4f4f50      /* "POOL" */
+#define SPOOL_VERSION       1
+#define SPOOL_HEADER_SIZE   4096
+#define SPOOL_WRAP          0xffffffffu     /* rest of the ring is padding */
+#define SPOOL_ALIGN(x)      (((x) + 7) & ~(uint64_t)7)
+#define SPOOL_SYNC_INTERVAL 1               /* seconds between msync of a file spool */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    uint64_t head;          /* offset of the oldest record */
+    uint64_t tail;          /* offset of the next record */
+    uint64_t used;
+    uint64_t count;
+} spool_header;
+
+typedef struct {
+    uint32_t len;
+    uint32_t ts;            /* seconds since epoch when pushed */
+} spool_record;
+
+struct spool {
+    pthread_mutex_t locker;
+    spool_header   *hdr;
+    char           *data;
+    size_t          map_len;
+    int             fd;
+    int             max_age;
+    time_t          synced;         /* last msync of a file spool */
+    spool_stats     stats;
+};
+
+static int spool_map_file(spool_t *sp, const char *path, size_t capacity)
+{
+    struct stat st;
+    void *addr = NULL;
+
+    sp->fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (sp->fd < 0) {
+        printf("failed to open spool file %s.\n", path);
+        return LE_ERROR_WRITING_FILE;
+    }
+
+    if (fstat(sp->fd, &st) != 0 ||
+        ((size_t)st.st_size != sp->map_len && ftruncate(sp->fd, sp->map_len) != 0)) {
+        printf("failed to resize spool file %s.\n", path);
+        close(sp->fd);
+        sp->fd = -1;
+        return LE_ERROR_WRITING_FILE;
+    }
+
+    addr = mmap(NULL, sp->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, sp->fd, 0);
+    if (addr == MAP_FAILED) {
+        printf("failed to map spool file %s.\n", path);
+        close(sp->fd);
+        sp->fd = -1;
+        return LE_ERROR_WRITING_FILE;
+    }
+
+    sp->hdr = (spool_header *)addr;
+    return LE_SUCCESS;
+}
+
+spool_t *spool_create(const char *path, size_t capacity, int max_age)
+{
+    spool_t *sp = NULL;
+
+    capacity = (size_t)SPOOL_ALIGN(capacity);
+    if (capacity < 2 * sizeof(spool_record)) {
+        return NULL;
+    }
+
+    sp = mem_malloc(MEM_SPOOL, sizeof(spool_t));
+    if (!sp) {
+        return NULL;
+    }
+    memset(sp, 0, sizeof(spool_t));
+    sp->fd = -1;
+    sp->max_age = max_age;
+    sp->map_len = SPOOL_HEADER_SIZE + capacity;
+
+    if (path) {
+        if (spool_map_file(sp, path, capacity) != LE_SUCCESS) {
+            mem_free(sp);
+            return NULL;
+        }
+    } else {
+        sp->hdr = mem_malloc(MEM_SPOOL, sp->map_len);
+        if (!sp->hdr) {
+            mem_free(sp);
+            return NULL;
+        }
+        memset(sp->hdr, 0, SPOOL_HEADER_SIZE);
+    }
+    sp->data = (char *)sp->hdr + SPOOL_HEADER_SIZE;
+
+    /* keep what a previous process left behind if the layout matches */
+    if (sp->hdr->magic != SPOOL_MAGIC || sp->hdr->version != SPOOL_VERSION ||
+        sp->hdr->capacity != capacity || sp->hdr->head >= capacity ||
+        sp->hdr->tail >= capacity || sp->hdr->used > capacity ||
+        SPOOL_ALIGN(sp->hdr->head) != sp->hdr->head ||
+        SPOOL_ALIGN(sp->hdr->tail) != sp->hdr->tail) {
+        memset(sp->hdr, 0, sizeof(spool_header));
+        sp->hdr->magic = SPOOL_MAGIC;
+        sp->hdr->version = SPOOL_VERSION;
+        sp->hdr->capacity = capacity;
+    }
+
+    pthread_mutex_init(&sp->locker, NULL);
+    sp->stats.capacity = capacity;
+
+    return sp;
+}
+
+/* caller holds the lock, forget every record after finding the ring corrupted */
+static void spool_reset(spool_t *sp)
+{
+    spool_header *hdr = sp->hdr;
+
+    printf("spool corrupted, dropping %llu records.\n", (unsigned long long)hdr->count);
+    hdr->head = hdr->tail = hdr->used = hdr->count = 0;
+}
+
+/*
+ * caller holds the lock and the spool is not empty, returns the oldest record
+ * skipping the wrap marker, or NULL after resetting a corrupted spool. A file
+ * spool may hold whatever a crashed process or a torn write left behind, so
+ * nothing read from the ring is trusted.
+ */
+static spool_record *spool_head(spool_t *sp)
+{
+    spool_header *hdr = sp->hdr;
+    spool_record *rec = (spool_record *)(sp->data + hdr->head);
+
+    if (rec->len == SPOOL_WRAP) {
+        if (hdr->head == 0 || hdr->used < hdr->capacity - hdr->head) {
+            spool_reset(sp);
+            return NULL;
+        }
+        hdr->used -= hdr->capacity - hdr->head;
+        hdr->head = 0;
+        rec = (spool_record *)sp->data;
+    }
+
+    if (rec->len == SPOOL_WRAP ||
+        hdr->head + sizeof(spool_record) + rec->len > hdr->capacity ||
+        SPOOL_ALIGN(sizeof(spool_record) + rec->len) > hdr->used) {
+        spool_reset(sp);
+        return NULL;
+    }
+
+    return rec;
+}
+
+/* caller holds the lock and the spool is not empty */
+static void spool_drop_head(spool_t *sp)
+{
+    spool_header *hdr = sp->hdr;
+    spool_record *rec = spool_head(sp);
+    uint64_t size = 0;
+
+    if (!rec) {
+        return;
+    }
+
+    size = SPOOL_ALIGN(sizeof(spool_record) + rec->len);
+    hdr->head += size;
+    if (hdr->head >= hdr->capacity) {
+        hdr->head = 0;
+    }
+    hdr->used -= size;
+    hdr->count--;
+
+    if (hdr->count == 0) {
+        hdr->head = hdr->tail = hdr->used = 0;
+    }
+}
+
+int spool_push(spool_t *sp, const char *data, size_t len)
+{
+    spool_header *hdr = NULL;
+    spool_record *rec = NULL;
+    uint64_t need = 0;
+    uint64_t room = 0;
+    time_t now = 0;
+    int sync = 0;
+
+    if (!sp || !data || len == 0) {
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    hdr = sp->hdr;
+    need = SPOOL_ALIGN(sizeof(spool_record) + len);
+    if (need > hdr->capacity || len >= SPOOL_WRAP) {
+        return LE_ERROR_PARAM_RANGE_OVERFLOW;
+    }
+
+    pthread_mutex_lock(&sp->locker);
+    for (;;) {
+        if (hdr->count == 0) {
+            hdr->head = hdr->tail = hdr->used = 0;
+            break;
+        }
+
+        if (hdr->tail > hdr->head) {
+            room = hdr->capacity - hdr->tail;
+            if (need <= room) {
+                break;
+            }
+            if (need <= hdr->head) {
+                /* pad the end of the ring and continue from the start */
+                ((spool_record *)(sp->data + hdr->tail))->len = SPOOL_WRAP;
+                hdr->used += room;
+                hdr->tail = 0;
+                break;
+            }
+        } else if (need <= hdr->head - hdr->tail) {
+            break;
+        }
+
+        spool_drop_head(sp);
+        sp->stats.dropped_full++;
+    }
+
+    now = time(NULL);
+    rec = (spool_record *)(sp->data + hdr->tail);
+    rec->ts = (uint32_t)now;
+    memcpy(rec + 1, data, len);
+    rec->len = (uint32_t)len;
+
+    hdr->tail += need;
+    if (hdr->tail >= hdr->capacity) {
+        hdr->tail = 0;
+    }
+    hdr->used += need;
+    hdr->count++;
+    sp->stats.pushed++;
+
+    if (sp->fd >= 0 && now - sp->synced >= SPOOL_SYNC_INTERVAL) {
+        sp->synced = now;
+        sync = 1;
+    }
+    pthread_mutex_unlock(&sp->locker);
+
+    /* pushes may go on while the pages are written back */
+    if (sync) {
+        msync(sp->hdr, sp->map_len, MS_SYNC);
+    }
+
+    return LE_SUCCESS;
+}
+
+int spool_pop(spool_t *sp, spool_cb_pop cb, void *usr)
+{
+    spool_record *rec = NULL;
+    uint32_t now = 0;
+    int ret = 0;
+
+    if (!sp || !cb) {
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    now = (uint32_t)time(NULL);
+
+    pthread_mutex_lock(&sp->locker);
+    while (sp->hdr->count > 0) {
+        rec = spool_head(sp);
+        if (!rec) {
+            break;
+        }
+
+        if (sp->max_age > 0 && now - rec->ts > (uint32_t)sp->max_age) {
+            spool_drop_head(sp);
+            sp->stats.dropped_aged++;
+            continue;
+        }
+
+        ret = cb((const char *)(rec + 1), rec->len, usr);
+        if (ret == 0) {
+            spool_drop_head(sp);
+            sp->stats.popped++;
+        }
+        pthread_mutex_unlock(&sp->locker);
+        return ret;
+    }
+    pthread_mutex_unlock(&sp->locker);
+
+    return SPOOL_EMPTY;
+}
+
+void spool_get_stats(spool_t *sp, spool_stats *stats)
+{
+    if (!sp || !stats) {
+        return;
+    }
+
+    pthread_mutex_lock(&sp->locker);
+    memcpy(stats, &sp->stats, sizeof(spool_stats));
+    stats->used = sp->hdr->used;
+    stats->count = sp->hdr->count;
+    pthread_mutex_unlock(&sp->locker);
+}
+
+void spool_destroy(spool_t *sp)
+{
+    if (!sp) {
+        return;
+    }
+
+    pthread_mutex_lock(&sp->locker);
+    if (sp->fd >= 0) {
+        msync(sp->hdr, sp->map_len, MS_SYNC);
+        munmap(sp->hdr, sp->map_len);
+        close(sp->fd);
+    } else {
+        mem_free(sp->hdr);
+    }
+    sp->hdr = NULL;
+    pthread_mutex_unlock(&sp->locker);
+
+    pthread_mutex_destroy(&sp->locker);
+    mem_free(sp);
+}
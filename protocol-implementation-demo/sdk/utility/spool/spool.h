@@ -0,0 +1,63 @@
+#ifndef _SPOOL_H_
+#define _SPOOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Bounded FIFO of variable length records kept in a byte ring.
+ *
+ * The ring lives either in memory or in a memory-mapped file. When the ring
+ * is full the oldest records are dropped to make room, and records older than
+ * max_age seconds are dropped instead of being popped.
+ *
+ * A file spool survives a crash of the process as is. Against power loss it
+ * is only as good as the last msync, which runs at most once a second on
+ * push: the newest records may be lost and records popped since may be
+ * delivered again. Records that fail validation on the way out reset the
+ * spool.
+ */
+
+#define SPOOL_EMPTY     1
+
+typedef struct spool spool_t;
+
+typedef struct {
+    uint64_t capacity;      /* bytes available for records */
+    uint64_t used;          /* bytes in use, including record headers */
+    uint64_t count;         /* records currently queued */
+    uint64_t pushed;
+    uint64_t popped;
+    uint64_t dropped_full;  /* dropped to make room for newer records */
+    uint64_t dropped_aged;  /* dropped because older than max_age */
+} spool_stats;
+
+/* return 0 to remove the record from the spool, others to keep it. */
+typedef int (*spool_cb_pop)(const char *data, size_t len, void *usr);
+
+/*
+ * path:        NULL keeps the spool in memory, otherwise the file is mapped
+ *              and records already in it are kept.
+ * capacity:    size of the record area in bytes.
+ * max_age:     seconds a record may stay in the spool, 0 never ages out.
+ */
+spool_t *spool_create(const char *path, size_t capacity, int max_age);
+
+int spool_push(spool_t *sp, const char *data, size_t len);
+
+/* hand the oldest record to @cb, returns SPOOL_EMPTY when nothing is queued. */
+int spool_pop(spool_t *sp, spool_cb_pop cb, void *usr);
+
+void spool_get_stats(spool_t *sp, spool_stats *stats);
+
+void spool_destroy(spool_t *sp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -36,6 +36,7 @@
 #include <unistd.h>
 
 #include "threadpool.h"
+#include "mem.h"
 
 typedef enum {
     immediate_shutdown = 1,
@@ -103,7 +104,7 @@ threadpool_t *threadpool_create(int thread_count, int queue_size, int flags)
         return NULL;
     }
 
-    if((pool = (threadpool_t *)malloc(sizeof(threadpool_t))) == NULL) {
+    if((pool = (threadpool_t *)mem_malloc(MEM_THREADPOOL, sizeof(threadpool_t))) == NULL) {
         goto err;
     }
 
@@ -114,9 +115,8 @@ threadpool_t *threadpool_create(int thread_count, int queue_size, int flags)
     pool->shutdown = pool->started = 0;
 
     /* Allocate thread and task queue */
-    pool->threads = (pthread_t *)malloc(sizeof(pthread_t) * thread_count);
-    pool->queue = (threadpool_task_t *)malloc
-        (sizeof(threadpool_task_t) * queue_size);
+    pool->threads = (pthread_t *)mem_malloc(MEM_THREADPOOL, sizeof(pthread_t) * thread_count);
+    pool->queue = (threadpool_task_t *)mem_malloc(MEM_THREADPOOL, sizeof(threadpool_task_t) * queue_size);
 
     /* Initialize mutex and conditional variable first */
     if((pthread_mutex_init(&(pool->lock), NULL) != 0) ||
@@ -243,6 +243,23 @@ int threadpool_destroy(threadpool_t *pool, int flags)
     return err;
 }
 
+int threadpool_pending(threadpool_t *pool)
+{
+    int count;
+
+    if(pool == NULL) {
+        return threadpool_invalid;
+    }
+
+    if(pthread_mutex_lock(&(pool->lock)) != 0) {
+        return threadpool_lock_failure;
+    }
+    count = pool->count;
+    pthread_mutex_unlock(&(pool->lock));
+
+    return count;
+}
+
 int threadpool_free(threadpool_t *pool)
 {
     if(pool == NULL || pool->started > 0) {
@@ -251,8 +268,8 @@ int threadpool_free(threadpool_t *pool)
 
     /* Did we manage to allocate ? */
     if(pool->threads) {
-        free(pool->threads);
-        free(pool->queue);
+        mem_free(pool->threads);
+        mem_free(pool->queue);
 
 #if 0   /* reth code  */ 
         /* Because we allocate pool->threads after initializing the
@@ -263,7 +280,7 @@ int threadpool_free(threadpool_t *pool)
         pthread_mutex_destroy(&(pool->lock));
         pthread_cond_destroy(&(pool->notify));
     }
-    free(pool);    
+    mem_free(pool);    
     return 0;
 }
 
@@ -94,6 +94,14 @@ int threadpool_add(threadpool_t *pool, void (*routine)(void *),
  */
 int threadpool_destroy(threadpool_t *pool, int flags);
 
+/**
+ * @function threadpool_pending
+ * @brief Number of tasks waiting in the queue of a thread pool.
+ * @param pool  Thread pool to query.
+ * @return the number of queued tasks, negative values in case of error.
+ */
+int threadpool_pending(threadpool_t *pool);
+
 #ifdef __cplusplus
 }
 #endif
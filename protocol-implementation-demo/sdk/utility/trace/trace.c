@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include "trace.h"
+#include "mem.h"
+#include "le_error.h"
+
+typedef struct {
+    uint64_t    ts;
+    const char *name;
+    uint32_t    dur;
+    uint32_t    id;
+} trace_event;
+
+typedef struct trace_buf {
+    struct trace_buf *next;
+    int               tid;
+    uint64_t          head;     /* written by the owner thread only */
+    trace_event       events[];
+} trace_buf;
+
+volatile int g_trace_on = 0;
+
+static pthread_mutex_t g_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static trace_buf      *g_trace_bufs = NULL;
+static uint32_t        g_trace_cap = 0;
+static uint64_t        g_trace_since = 0;
+
+static __thread trace_buf *t_trace_buf = NULL;
+static __thread uint32_t   t_trace_id = 0;
+
+uint64_t trace_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int trace_start(unsigned int events_per_thread)
+{
+    uint32_t cap = 1;
+
+    if (events_per_thread == 0 || events_per_thread > (1u << 24))
+        return LE_ERROR_INVAILD_PARAM;
+
+    pthread_mutex_lock(&g_trace_lock);
+    if (g_trace_cap == 0) {
+        while (cap < events_per_thread)
+            cap <<= 1;
+        g_trace_cap = cap;
+    }
+    g_trace_since = trace_now_us();
+    g_trace_on = 1;
+    pthread_mutex_unlock(&g_trace_lock);
+
+    return LE_SUCCESS;
+}
+
+void trace_stop(void)
+{
+    g_trace_on = 0;
+}
+
+static trace_buf *trace_get_buf(void)
+{
+    trace_buf *buf = NULL;
+
+    if (t_trace_buf)
+        return t_trace_buf;
+
+    pthread_mutex_lock(&g_trace_lock);
+    buf = mem_malloc(MEM_TRACE, sizeof(trace_buf) + g_trace_cap * sizeof(trace_event));
+    if (buf) {
+        buf->tid = (int)syscall(SYS_gettid);
+        buf->head = 0;
+        buf->next = g_trace_bufs;
+        g_trace_bufs = buf;
+    }
+    pthread_mutex_unlock(&g_trace_lock);
+
+    t_trace_buf = buf;
+    return buf;
+}
+
+void trace_span(const char *name, uint32_t id, uint64_t begin_us, uint64_t end_us)
+{
+    trace_buf *buf = NULL;
+    trace_event *ev = NULL;
+
+    if (!g_trace_on || !name)
+        return;
+
+    buf = trace_get_buf();
+    if (!buf)
+        return;
+
+    if (begin_us == 0 || begin_us > end_us)
+        begin_us = end_us;
+
+    ev = &buf->events[buf->head & (g_trace_cap - 1)];
+    ev->ts = begin_us;
+    ev->name = name;
+    ev->dur = (end_us - begin_us > UINT32_MAX) ? UINT32_MAX : (uint32_t)(end_us - begin_us);
+    ev->id = id;
+
+    __atomic_store_n(&buf->head, buf->head + 1, __ATOMIC_RELEASE);
+}
+
+void trace_set_current(uint32_t id)
+{
+    t_trace_id = id;
+}
+
+uint32_t trace_current(void)
+{
+    return t_trace_id;
+}
+
+/* copy the events of @buf still in the ring, returns how many are valid */
+static uint64_t trace_snapshot(trace_buf *buf, trace_event *out, uint64_t *first)
+{
+    uint64_t head = __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE);
+    uint64_t start = head > g_trace_cap ? head - g_trace_cap : 0;
+    uint64_t seq = 0;
+    uint64_t now_head = 0;
+
+    for (seq = start; seq < head; seq++)
+        out[seq - start] = buf->events[seq & (g_trace_cap - 1)];
+
+    /* the owner may have overwritten the oldest events meanwhile */
+    now_head = __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE);
+    *first = 0;
+    if (now_head > g_trace_cap && now_head - g_trace_cap > start) {
+        *first = now_head - g_trace_cap - start;
+        if (*first > head - start)
+            *first = head - start;
+    }
+
+    return head - start;
+}
+
+int trace_export(const char *path)
+{
+    FILE *fp = NULL;
+    trace_buf *buf = NULL;
+    trace_event *events = NULL;
+    uint64_t count = 0, first = 0, i = 0;
+    int pid = (int)getpid();
+    int sep = 0;
+
+    if (!path)
+        return LE_ERROR_INVAILD_PARAM;
+
+    pthread_mutex_lock(&g_trace_lock);
+    if (g_trace_cap == 0) {
+        pthread_mutex_unlock(&g_trace_lock);
+        return LE_ERROR_INVAILD_PARAM;
+    }
+
+    events = mem_malloc(MEM_TRACE, g_trace_cap * sizeof(trace_event));
+    fp = fopen(path, "w");
+    if (!events || !fp) {
+        pthread_mutex_unlock(&g_trace_lock);
+        printf("failed to export trace to %s.\n", path);
+        if (fp)
+            fclose(fp);
+        mem_free(events);
+        return fp ? LE_ERROR_ALLOCATING_MEM : LE_ERROR_WRITING_FILE;
+    }
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (buf = g_trace_bufs; buf; buf = buf->next) {
+        count = trace_snapshot(buf, events, &first);
+        for (i = first; i < count; i++) {
+            if (events[i].ts < g_trace_since)
+                continue;
+            fprintf(fp, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+                    "\"ts\":%llu,\"dur\":%u,\"args\":{\"msg_id\":%u}}",
+                    sep ? "," : "", events[i].name, pid, buf->tid,
+                    (unsigned long long)events[i].ts, events[i].dur, events[i].id);
+            sep = 1;
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    pthread_mutex_unlock(&g_trace_lock);
+
+    mem_free(events);
+    if (fclose(fp) != 0) {
+        printf("failed to export trace to %s.\n", path);
+        return LE_ERROR_WRITING_FILE;
+    }
+
+    return LE_SUCCESS;
+}
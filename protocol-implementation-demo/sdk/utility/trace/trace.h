@@ -0,0 +1,48 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Per-message stage tracing.
+ *
+ * Each thread records spans into its own ring without taking locks, the
+ * oldest spans are overwritten when the ring is full. Spans carry the msg
+ * id so the stages of one message can be lined up across threads, and are
+ * exported in the Chrome trace event format.
+ */
+
+extern volatile int g_trace_on;
+
+#define trace_enabled() (g_trace_on)
+
+uint64_t trace_now_us(void);
+
+/* @events_per_thread is rounded up to a power of two, only the first
+ * start decides the size. spans recorded before a start are not exported.
+ */
+int trace_start(unsigned int events_per_thread);
+
+void trace_stop(void);
+
+/* record a span of stage @name from @begin_us to @end_us, @name must be a
+ * string literal or otherwise outlive the trace.
+ */
+void trace_span(const char *name, uint32_t id, uint64_t begin_us, uint64_t end_us);
+
+/* msg id the current thread is working on, picked up by the send queue. */
+void trace_set_current(uint32_t id);
+
+uint32_t trace_current(void);
+
+int trace_export(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
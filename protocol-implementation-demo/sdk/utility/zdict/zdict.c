@@ -0,0 +1,202 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "zdict.h"
+#include "mem.h"
+
+/*
+ * deflate looks back from the end of the dictionary, the most frequent
+ * strings go last.
+ */
+static const char g_dict[] =
+    "\"struct\"\"array\"\"date\"\"enum\"\"text\""
+    "\"inputData\":[{\"outputData\":[{\"callService\"\"setProperty\"\"getProperty\""
+    "\"offlineDevice\"\"onlineDevice\"\"reportEvent\"\"invalid\""
+    "{\"code\":0,\"message\":\"Success\",\"messageId\":"
+    "{\"code\":0,\"messageId\":,\"payload\":{}}"
+    "\"type\":\"bool\",\"value\":true},{\"identifier\":\""
+    "\"type\":\"double\",\"value\":},{\"identifier\":\""
+    "\"type\":\"float\",\"value\":},{\"identifier\":\""
+    "\"type\":\"int\",\"value\":},{\"identifier\":\""
+    "{\"version\":\"1.0\",\"messageId\":,\"method\":\"reportProperty\","
+    "\"payload\":{\"productKey\":\"\",\"deviceName\":\"\",\"properties\":[{\"identifier\":\"";
+
+#define ZDICT_LEVEL     Z_DEFAULT_COMPRESSION
+#define ZDICT_MEM_LEVEL 8
+
+typedef struct {
+    z_stream def;
+    z_stream inf;
+    int def_ok;
+    int inf_ok;
+} zdict_ctx;
+
+static pthread_key_t g_zdict_key;
+static pthread_once_t g_zdict_once = PTHREAD_ONCE_INIT;
+static uint32_t g_zdict_id = 0;
+
+static voidpf zdict_zalloc(voidpf opaque, uInt items, uInt size)
+{
+    return mem_malloc(MEM_COMPRESS, (size_t)items * size);
+}
+
+static void zdict_zfree(voidpf opaque, voidpf ptr)
+{
+    mem_free(ptr);
+}
+
+static void zdict_ctx_free(void *arg)
+{
+    zdict_ctx *ctx = arg;
+
+    if (ctx->def_ok)
+        deflateEnd(&ctx->def);
+    if (ctx->inf_ok)
+        inflateEnd(&ctx->inf);
+    mem_free(ctx);
+}
+
+static void zdict_once_init(void)
+{
+    pthread_key_create(&g_zdict_key, zdict_ctx_free);
+    g_zdict_id = adler32(adler32(0L, Z_NULL, 0), (const Bytef *)g_dict, sizeof(g_dict) - 1);
+}
+
+/* streams are kept per thread and reset between messages */
+static zdict_ctx *zdict_get_ctx(void)
+{
+    zdict_ctx *ctx = NULL;
+
+    pthread_once(&g_zdict_once, zdict_once_init);
+
+    ctx = pthread_getspecific(g_zdict_key);
+    if (ctx)
+        return ctx;
+
+    ctx = mem_calloc(MEM_COMPRESS, 1, sizeof(zdict_ctx));
+    if (!ctx)
+        return NULL;
+    ctx->def.zalloc = ctx->inf.zalloc = zdict_zalloc;
+    ctx->def.zfree = ctx->inf.zfree = zdict_zfree;
+    if (pthread_setspecific(g_zdict_key, ctx) != 0) {
+        mem_free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+uint32_t zdict_id(void)
+{
+    pthread_once(&g_zdict_once, zdict_once_init);
+    return g_zdict_id;
+}
+
+size_t zdict_bound(size_t len)
+{
+    /* compressBound plus the dictionary id in the header */
+    return compressBound((uLong)len) + 4;
+}
+
+int zdict_compress(const char *data, size_t len, char *out, size_t *out_len)
+{
+    zdict_ctx *ctx = zdict_get_ctx();
+
+    if (!ctx || !data || !out || !out_len || len > 0xffffffffUL || *out_len > 0xffffffffUL)
+        return -1;
+
+    if (!ctx->def_ok) {
+        if (deflateInit2(&ctx->def, ZDICT_LEVEL, Z_DEFLATED, 15, ZDICT_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK)
+            return -1;
+        ctx->def_ok = 1;
+    } else {
+        deflateReset(&ctx->def);
+    }
+
+    if (deflateSetDictionary(&ctx->def, (const Bytef *)g_dict, sizeof(g_dict) - 1) != Z_OK)
+        return -1;
+
+    ctx->def.next_in = (Bytef *)data;
+    ctx->def.avail_in = (uInt)len;
+    ctx->def.next_out = (Bytef *)out;
+    ctx->def.avail_out = (uInt)*out_len;
+
+    if (deflate(&ctx->def, Z_FINISH) != Z_STREAM_END)
+        return -1;
+
+    *out_len = ctx->def.total_out;
+    return 0;
+}
+
+char *zdict_decompress(const char *data, size_t len, size_t max_len, size_t *out_len)
+{
+    zdict_ctx *ctx = zdict_get_ctx();
+    char *out = NULL, *tmp = NULL;
+    size_t cap = 0;
+    int ret = Z_OK;
+
+    if (!ctx || !data || !out_len || len > 0xffffffffUL)
+        return NULL;
+
+    if (!ctx->inf_ok) {
+        if (inflateInit(&ctx->inf) != Z_OK)
+            return NULL;
+        ctx->inf_ok = 1;
+    } else {
+        inflateReset(&ctx->inf);
+    }
+
+    cap = len * 4 < 1024 ? 1024 : len * 4;
+    if (cap > max_len)
+        cap = max_len;
+
+    ctx->inf.next_in = (Bytef *)data;
+    ctx->inf.avail_in = (uInt)len;
+    ctx->inf.total_out = 0;
+
+    while (ret != Z_STREAM_END) {
+        if (!out || ctx->inf.total_out == cap) {
+            if (out) {
+                if (cap >= max_len)
+                    goto fail;
+                cap = cap * 2 > max_len ? max_len : cap * 2;
+            }
+            /* one extra byte for the terminator */
+            tmp = mem_realloc(MEM_COMPRESS, out, cap + 1);
+            if (!tmp)
+                goto fail;
+            out = tmp;
+        }
+
+        ctx->inf.next_out = (Bytef *)out + ctx->inf.total_out;
+        ctx->inf.avail_out = (uInt)(cap - ctx->inf.total_out);
+
+        ret = inflate(&ctx->inf, Z_FINISH);
+        if (ret == Z_NEED_DICT) {
+            if (ctx->inf.adler != g_zdict_id)
+                goto fail;
+            if (inflateSetDictionary(&ctx->inf, (const Bytef *)g_dict, sizeof(g_dict) - 1) != Z_OK)
+                goto fail;
+            ret = Z_OK;
+            continue;
+        }
+        if (ret == Z_BUF_ERROR && ctx->inf.avail_out == 0)
+            continue;
+        if (ret != Z_OK && ret != Z_STREAM_END)
+            goto fail;
+        if (ret == Z_OK && ctx->inf.avail_in == 0 && ctx->inf.avail_out != 0)
+            goto fail;      /* truncated */
+    }
+
+    /* a stream made without the dictionary is fine too, trailing bytes are not */
+    if (ctx->inf.avail_in != 0)
+        goto fail;
+
+    out[ctx->inf.total_out] = '\0';
+    *out_len = ctx->inf.total_out;
+    return out;
+
+fail:
+    mem_free(out);
+    return NULL;
+}
@@ -0,0 +1,43 @@
+#ifndef _ZDICT_H_
+#define _ZDICT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * zlib streams primed with a preset dictionary of the LinkEdge message
+ * vocabulary, so that even a single short message compresses well.
+ *
+ * Output is a complete zlib stream. Its header carries the Adler-32 of the
+ * dictionary, a peer holding a different dictionary fails to decompress
+ * instead of producing garbage. Bump ZDICT_VERSION whenever the dictionary
+ * text changes; it is part of the negotiated subprotocol name.
+ */
+
+#define ZDICT_VERSION   1
+
+/* Adler-32 of the dictionary, as found in the stream header. */
+uint32_t zdict_id(void);
+
+/* size of @out that zdict_compress always fits in. */
+size_t zdict_bound(size_t len);
+
+/* out_len:     size of @out on entry, length of the stream on return.
+ * return 0 on success.
+ */
+int zdict_compress(const char *data, size_t len, char *out, size_t *out_len);
+
+/* return a '\0' terminated buffer to be freed with mem_free, NULL when the stream is
+ * corrupt, uses another dictionary or inflates beyond max_len bytes.
+ */
+char *zdict_decompress(const char *data, size_t len, size_t max_len, size_t *out_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif